@@ -10,6 +10,9 @@
 #include "core/core.h"
 #include "core/loader/loader.h"
 
+#include "video_core/renderer_opengl/renderer_opengl.h"
+
+#include "citra/config.h"
 #include "citra/emu_window/emu_window_glfw.h"
 
 /// Application entry point
@@ -22,9 +25,10 @@ int __cdecl main(int argc, char **argv) {
     }
 
     std::string boot_filename = argv[1];
-    EmuWindow_GLFW* emu_window = new EmuWindow_GLFW;
+    Config::Load(Config::GetDefaultPath());
 
-    System::Init(emu_window);
+    EmuWindow_GLFW* emu_window = new EmuWindow_GLFW;
+    System::Init(emu_window, new RendererOpenGL);
 
     if (Loader::ResultStatus::Success != Loader::LoadFile(boot_filename)) {
         ERROR_LOG(BOOT, "Failed to load ROM!");
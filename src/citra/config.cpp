@@ -0,0 +1,96 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <fstream>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/string_util.h"
+
+#include "core/settings.h"
+
+#include "citra/config.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace Config {
+
+/**
+ * Applies one key of the INI file to the settings
+ * @param section Section the key is in, without the brackets
+ * @param key Name of the key
+ * @param value Value of the key, with surrounding spaces stripped
+ * @return True if the key is known and its value valid
+ */
+static bool ApplyValue(const std::string& section, const std::string& key,
+    const std::string& value) {
+
+    if (section == "Core" && key == "cpu_core") {
+        if (value == "interpreter") {
+            Settings::values.cpu_core = Settings::CpuCore::Interpreter;
+        } else if (value == "cached") {
+            Settings::values.cpu_core = Settings::CpuCore::CachedInterpreter;
+        } else if (value == "jit") {
+            Settings::values.cpu_core = Settings::CpuCore::Jit;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (section == "Memory" && key == "use_fastmem") {
+        return TryParse(value, &Settings::values.use_fastmem);
+    }
+    if (section == "Memory" && key == "emulate_mmu") {
+        return TryParse(value, &Settings::values.emulate_mmu);
+    }
+    if (section == "FileSystem" && key == "num_io_threads") {
+        return TryParse(value, &Settings::values.num_io_threads);
+    }
+    if (section == "Video" && key == "num_rasterizer_threads") {
+        return TryParse(value, &Settings::values.num_rasterizer_threads);
+    }
+    return false;
+}
+
+bool Load(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string section;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = StripSpaces(line);
+        if (line.empty() || line[0] == ';' || line[0] == '#') {
+            continue;
+        }
+
+        if (line[0] == '[') {
+            size_t end = line.find(']');
+            section = line.substr(1, end == std::string::npos ? std::string::npos : end - 1);
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = StripSpaces(line.substr(0, equals));
+        std::string value = StripSpaces(line.substr(equals + 1));
+
+        if (!ApplyValue(section, key, value)) {
+            WARN_LOG(BOOT, "%s: ignoring [%s] %s = %s", filename.c_str(), section.c_str(),
+                key.c_str(), value.c_str());
+        }
+    }
+    INFO_LOG(BOOT, "Loaded settings from %s", filename.c_str());
+    return true;
+}
+
+std::string GetDefaultPath() {
+    return File::GetUserPath(D_CONFIG_IDX) + "config.ini";
+}
+
+} // namespace
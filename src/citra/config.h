@@ -0,0 +1,24 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace Config {
+
+/**
+ * Reads the emulator settings from an INI file into Settings::values. Missing files, sections
+ * and keys keep the defaults, unknown ones are ignored.
+ * @param filename Path of the INI file
+ * @return True if the file was read, false if it could not be opened
+ */
+bool Load(const std::string& filename);
+
+/// Returns the path of config.ini in the user configuration directory
+std::string GetDefaultPath();
+
+} // namespace
@@ -0,0 +1,258 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/log_manager.h"
+#include "common/profiler.h"
+#include "common/thread_pool.h"
+#include "common/timer.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/settings.h"
+#include "core/system.h"
+#include "core/hle/hle.h"
+#include "core/hw/gpu.h"
+#include "core/loader/loader.h"
+
+#include "video_core/video_core.h"
+#include "video_core/renderer_null/renderer_null.h"
+
+/// Limits of a benchmark run, whichever is reached first ends it (0 means no limit)
+static int g_max_frames = 600;
+static u32 g_max_time_ms = 0;
+
+static u32 g_start_time_ms = 0;     ///< Host time when emulation started
+static int g_check_event_type;      ///< CoreTiming event checking the limits once per frame
+
+/// Stops the core loop once the frame or time limit is reached
+static void CheckLimits(u64 userdata, int cycles_late) {
+    const int frames = VideoCore::g_renderer->current_frame();
+    const u32 elapsed_ms = Common::Timer::GetTimeMs() - g_start_time_ms;
+
+    if ((g_max_frames != 0 && frames >= g_max_frames) ||
+        (g_max_time_ms != 0 && elapsed_ms >= g_max_time_ms)) {
+        Core::Stop();
+        return;
+    }
+    CoreTiming::ScheduleEvent(GPU::kFrameTicks - cycles_late, g_check_event_type);
+}
+
+static void PrintUsage(const char* program) {
+    printf("Usage: %s <rom> [options]\n"
+           "       %s --warm-code-cache <directory>\n"
+           "  Decompresses the code of every ROM in the directory into the code cache\n\n"
+           "  --frames N      Stop after N emulated frames (default 600, 0 for no limit)\n"
+           "  --seconds N     Stop after N seconds of host time (default no limit)\n"
+           "  --cpu CORE      CPU backend: interpreter, cached or jit (default interpreter)\n"
+           "  --fastmem       Map the guest address space into the host one for direct accesses\n"
+           "  --dump FILE     Save the final top screen framebuffer to FILE (TGA)\n"
+           "  --io-threads N  Run archive reads and writes on N worker threads (default 0)\n"
+           "  --raster-threads N\n"
+           "                  Rasterize triangles on N worker threads (default 0)\n"
+           "  --service-profile FILE\n"
+           "                  Write per-command service statistics to FILE (.json or .csv)\n"
+           "  --trace FILE    Trace SVCs and service commands to FILE (see citra-trace)\n",
+           program, program);
+}
+
+/// Adds the files of a directory tree to a list
+static void ListFiles(const File::FSTEntry& entry, std::vector<std::string>& filenames) {
+    for (const auto& child : entry.children) {
+        if (child.isDirectory) {
+            ListFiles(child, filenames);
+        } else {
+            filenames.push_back(child.physicalName);
+        }
+    }
+}
+
+/**
+ * Decompresses the code of every ROM of a directory and its subdirectories into the code cache,
+ * on as many threads as the host has cores
+ * @param directory Path of the directory
+ * @return True if the code of every ROM is cached
+ */
+static bool WarmCodeCache(const std::string& directory) {
+    File::FSTEntry root;
+    File::ScanDirectoryTree(directory, root);
+    std::vector<std::string> filenames;
+    ListFiles(root, filenames);
+
+    // The user paths are set up on first use, which isn't thread safe
+    File::GetUserPath(D_CACHE_IDX);
+
+    std::atomic<int> num_cached(0), num_failed(0);
+    {
+        Common::ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+        for (const auto& filename : filenames) {
+            pool.Push([&, filename] {
+                switch (Loader::CacheCode(filename)) {
+                case Loader::ResultStatus::Success:
+                    num_cached++;
+                    break;
+                case Loader::ResultStatus::ErrorNotUsed:
+                case Loader::ResultStatus::ErrorInvalidFormat:
+                    break; // Not a ROM, or its code isn't compressed
+                default:
+                    fprintf(stderr, "Failed to cache the code of %s\n", filename.c_str());
+                    num_failed++;
+                    break;
+                }
+            });
+        }
+        pool.WaitForIdle();
+    }
+
+    printf("Code of %d ROMs cached, %d failed\n", num_cached.load(), num_failed.load());
+    return num_failed == 0;
+}
+
+/// Prints the results of a run
+static void PrintStats(u32 elapsed_ms, u64 instructions) {
+    const double seconds = elapsed_ms / 1000.0;
+    const int frames = VideoCore::g_renderer->current_frame();
+
+    printf("\nEmulated %d frames in %.3f s\n", frames, seconds);
+    if (seconds > 0) {
+        printf("  %.2f FPS\n", frames / seconds);
+        printf("  %llu instructions, %.2f MIPS\n", (unsigned long long)instructions,
+               instructions / seconds / 1000000.0);
+    }
+    printf("  %llu of %llu CoreTiming ticks skipped in idle loops\n",
+           (unsigned long long)CoreTiming::GetIdleTicks(),
+           (unsigned long long)CoreTiming::GetTicks());
+
+    printf("\nTime per section:\n");
+    double total = 0;
+    for (int i = 0; i < Common::Profiling::NUM_SECTIONS; ++i) {
+        total += Common::Profiling::GetSectionTime((Common::Profiling::Section)i);
+    }
+    for (int i = 0; i < Common::Profiling::NUM_SECTIONS; ++i) {
+        auto section = (Common::Profiling::Section)i;
+        double time = Common::Profiling::GetSectionTime(section);
+        printf("  %-6s %9.3f s  %5.1f%%\n", Common::Profiling::GetSectionName(section), time,
+               total > 0 ? time * 100.0 / total : 0.0);
+    }
+
+    printf("\nSVC calls:\n");
+    for (u32 func_num = 0; func_num < 0x100; ++func_num) {
+        u64 count = HLE::GetSVCCallCount(func_num);
+        if (count != 0) {
+            printf("  0x%02X %-28s %10llu\n", func_num, HLE::GetSVCInfo(func_num)->name.c_str(),
+                   (unsigned long long)count);
+        }
+    }
+}
+
+/// Application entry point
+int __cdecl main(int argc, char **argv) {
+    LogManager::Init();
+
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return -1;
+    }
+
+    if (!strcmp(argv[1], "--warm-code-cache")) {
+        if (argc != 3) {
+            PrintUsage(argv[0]);
+            return -1;
+        }
+        return WarmCodeCache(argv[2]) ? 0 : -1;
+    }
+
+    std::string boot_filename = argv[1];
+    std::string dump_filename;
+
+    for (int i = 2; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        // Options without a value
+        if (!strcmp(arg, "--fastmem")) {
+            Settings::values.use_fastmem = true;
+            continue;
+        }
+
+        if (value == nullptr) {
+            PrintUsage(argv[0]);
+            return -1;
+        } else if (!strcmp(arg, "--frames")) {
+            g_max_frames = atoi(value);
+        } else if (!strcmp(arg, "--seconds")) {
+            g_max_time_ms = atoi(value) * 1000;
+        } else if (!strcmp(arg, "--cpu")) {
+            if (!strcmp(value, "interpreter")) {
+                Settings::values.cpu_core = Settings::CpuCore::Interpreter;
+            } else if (!strcmp(value, "cached")) {
+                Settings::values.cpu_core = Settings::CpuCore::CachedInterpreter;
+            } else if (!strcmp(value, "jit")) {
+                Settings::values.cpu_core = Settings::CpuCore::Jit;
+            } else {
+                PrintUsage(argv[0]);
+                return -1;
+            }
+        } else if (!strcmp(arg, "--dump")) {
+            dump_filename = value;
+        } else if (!strcmp(arg, "--io-threads")) {
+            Settings::values.num_io_threads = atoi(value);
+        } else if (!strcmp(arg, "--raster-threads")) {
+            Settings::values.num_rasterizer_threads = atoi(value);
+        } else if (!strcmp(arg, "--service-profile")) {
+            Settings::values.service_profile_path = value;
+        } else if (!strcmp(arg, "--trace")) {
+            Settings::values.hle_trace_path = value;
+        } else {
+            PrintUsage(argv[0]);
+            return -1;
+        }
+        ++i;
+    }
+
+    // No window: VideoCore uses the null renderer
+    System::Init(nullptr, nullptr);
+
+    if (Loader::ResultStatus::Success != Loader::LoadFile(boot_filename)) {
+        ERROR_LOG(BOOT, "Failed to load ROM!");
+        return -1;
+    }
+
+    g_check_event_type = CoreTiming::RegisterEvent("Bench::CheckLimits", CheckLimits);
+    CoreTiming::ScheduleEvent(GPU::kFrameTicks, g_check_event_type);
+
+    Common::Profiling::SetEnabled(true);
+    Common::Profiling::Reset();
+
+    const u64 start_instructions = Core::g_app_core->GetTicks();
+    g_start_time_ms = Common::Timer::GetTimeMs();
+
+    Core::RunLoop();
+
+    const u32 elapsed_ms = Common::Timer::GetTimeMs() - g_start_time_ms;
+    Common::Profiling::SetEnabled(false);
+
+    PrintStats(elapsed_ms, Core::g_app_core->GetTicks() - start_instructions);
+
+    if (!dump_filename.empty()) {
+        auto renderer = dynamic_cast<RendererNull*>(VideoCore::g_renderer);
+        if (renderer == nullptr || !renderer->DumpTopScreen(dump_filename)) {
+            return -1;
+        }
+        printf("\nTop screen saved to %s\n", dump_filename.c_str());
+    }
+
+    System::Shutdown();
+
+    return 0;
+}
@@ -25,8 +25,11 @@
 #include "core/system.h"
 #include "core/core.h"
 #include "core/loader/loader.h"
+#include "core/hle/trace.h"
 #include "core/arm/disassembler/load_symbol_map.h"
 
+#include "video_core/renderer_opengl/renderer_opengl.h"
+
 #include "version.h"
 
 
@@ -92,6 +95,8 @@ GMainWindow::GMainWindow()
     connect(ui.action_Start, SIGNAL(triggered()), this, SLOT(OnStartGame()));
     connect(ui.action_Pause, SIGNAL(triggered()), this, SLOT(OnPauseGame()));
     connect(ui.action_Stop, SIGNAL(triggered()), this, SLOT(OnStopGame()));
+    connect(ui.action_Trace_HLE, SIGNAL(triggered(bool)), this, SLOT(OnToggleHLETrace(bool)));
+    connect(ui.action_Dump_HLE_Trace, SIGNAL(triggered()), this, SLOT(OnMenuDumpHLETrace()));
     connect(ui.action_Popout_Window_Mode, SIGNAL(triggered(bool)), this, SLOT(ToggleWindowMode()));
     connect(ui.action_Hotkeys, SIGNAL(triggered()), this, SLOT(OnOpenHotkeysDialog()));
 
@@ -113,7 +118,7 @@ GMainWindow::GMainWindow()
     show();
 
     LogManager::Init();
-    System::Init(render_window);
+    System::Init(render_window, new RendererOpenGL);
 }
 
 GMainWindow::~GMainWindow()
@@ -188,6 +193,18 @@ void GMainWindow::OnStopGame()
     ui.action_Stop->setEnabled(false);
 }
 
+void GMainWindow::OnToggleHLETrace(bool enabled)
+{
+    HLE::Trace::SetEnabled(enabled);
+}
+
+void GMainWindow::OnMenuDumpHLETrace()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Dump HLE trace"), QString(), tr("HLE trace (*.trace)"));
+    if (filename.size())
+        HLE::Trace::Dump(filename.toLatin1().data());
+}
+
 void GMainWindow::OnOpenHotkeysDialog()
 {
     GHotkeysDialog dialog(this);
@@ -38,6 +38,8 @@ private slots:
     void OnStartGame();
     void OnPauseGame();
     void OnStopGame();
+    void OnToggleHLETrace(bool enabled);
+    void OnMenuDumpHLETrace();
     void OnMenuLoadFile();
     void OnMenuLoadSymbolMap();
     void OnOpenHotkeysDialog();
@@ -0,0 +1,147 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "common/common.h"
+
+#include "core/hle/trace.h"
+
+using namespace HLE::Trace;
+
+typedef std::tuple<u32, u32, u32> CallKey; ///< (type, object, id) of a traced call
+
+/// Contents of a trace file
+struct TraceFile {
+    FileHeader header;
+    std::vector<Record> records;
+    std::map<CallKey, std::string> names;
+};
+
+/// Returns the key identifying the call of a record
+static CallKey GetCallKey(const Record& record) {
+    return std::make_tuple(record.type, record.type == RECORD_IPC ? record.object : 0, record.id);
+}
+
+/// Returns the name of a call, or a placeholder if the trace has no name for it
+static std::string GetCallName(const TraceFile& trace, const CallKey& key) {
+    auto itr = trace.names.find(key);
+    if (itr != trace.names.end()) {
+        return itr->second;
+    }
+    char name[32];
+    if (std::get<0>(key) == RECORD_SVC) {
+        sprintf(name, "svc_0x%02X", std::get<2>(key));
+    } else {
+        sprintf(name, "0x%08X::0x%08X", std::get<1>(key), std::get<2>(key));
+    }
+    return name;
+}
+
+/**
+ * Reads a trace file written by HLE::Trace::Dump
+ * @param filename Path of the file
+ * @param trace Receives the contents of the file
+ * @return True on success
+ */
+static bool ReadTrace(const char* filename, TraceFile& trace) {
+    FILE* file = fopen(filename, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Can't open %s\n", filename);
+        return false;
+    }
+
+    bool ok = fread(&trace.header, sizeof(FileHeader), 1, file) == 1 &&
+        trace.header.magic == kFileMagic && trace.header.version == kFileVersion &&
+        trace.header.record_size == sizeof(Record);
+    if (ok) {
+        trace.records.resize(trace.header.num_records);
+        ok = fread(trace.records.data(), sizeof(Record), trace.records.size(), file) ==
+            trace.records.size();
+    }
+    for (u32 i = 0; ok && i < trace.header.num_names; ++i) {
+        NameEntry entry;
+        ok = fread(&entry, sizeof(entry), 1, file) == 1;
+        if (ok) {
+            std::string name(entry.length, '\0');
+            ok = fread(&name[0], 1, entry.length, file) == entry.length;
+            trace.names[std::make_tuple(entry.type, entry.object, entry.id)] = name;
+        }
+    }
+    fclose(file);
+
+    if (!ok) {
+        fprintf(stderr, "%s is not a valid HLE trace\n", filename);
+    }
+    return ok;
+}
+
+/// Prints every record
+static void PrintRecords(const TraceFile& trace) {
+    printf("%-14s %-10s %-40s %-10s %-10s %-10s %-10s %s\n", "tick", "thread", "call",
+           "arg0", "arg1", "arg2", "arg3", "result");
+    for (const auto& record : trace.records) {
+        printf("%-14llu 0x%08X %-40s 0x%08X 0x%08X 0x%08X 0x%08X 0x%08X\n",
+               (unsigned long long)record.tick, record.thread,
+               GetCallName(trace, GetCallKey(record)).c_str(), record.args[0], record.args[1],
+               record.args[2], record.args[3], record.result);
+    }
+}
+
+/// Prints how many times each call was made, most frequent first
+static void PrintSummary(const TraceFile& trace) {
+    std::map<CallKey, u64> counts;
+    for (const auto& record : trace.records) {
+        counts[GetCallKey(record)]++;
+    }
+
+    std::vector<std::pair<u64, CallKey>> sorted;
+    for (const auto& count : counts) {
+        sorted.push_back(std::make_pair(count.second, count.first));
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<u64, CallKey>& a,
+                                               const std::pair<u64, CallKey>& b) {
+        return a.first > b.first;
+    });
+
+    const u64 first_tick = trace.records.empty() ? 0 : trace.records.front().tick;
+    const u64 last_tick = trace.records.empty() ? 0 : trace.records.back().tick;
+    printf("%u records over %llu ticks (%u older records were dropped)\n\n",
+           trace.header.num_records, (unsigned long long)(last_tick - first_tick),
+           trace.header.num_dropped);
+
+    for (const auto& entry : sorted) {
+        printf("%10llu  %5.1f%%  %s\n", (unsigned long long)entry.first,
+               entry.first * 100.0 / trace.records.size(),
+               GetCallName(trace, entry.second).c_str());
+    }
+}
+
+/// Application entry point
+int __cdecl main(int argc, char **argv) {
+    if (argc < 2 || (argc > 2 && strcmp(argv[2], "--summary"))) {
+        printf("Usage: %s <trace> [--summary]\n"
+               "  Prints the SVCs and service commands recorded in an HLE trace, or with\n"
+               "  --summary, how many times each of them was called.\n", argv[0]);
+        return -1;
+    }
+
+    TraceFile trace;
+    if (!ReadTrace(argv[1], trace)) {
+        return -1;
+    }
+
+    if (argc > 2) {
+        PrintSummary(trace);
+    } else {
+        PrintRecords(trace);
+    }
+    return 0;
+}
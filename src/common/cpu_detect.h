@@ -40,6 +40,7 @@ struct CPUInfo
     bool bLZCNT;
     bool bSSE4A;
     bool bAVX;
+    bool bAVX2;
     bool bAES;
     bool bLAHFSAHF64;
     bool bLongMode;
@@ -76,3 +77,13 @@ private:
 };
 
 extern CPUInfo cpu_info;
+
+// Functions using instructions the compiler doesn't emit elsewhere are marked with these, so that
+// they can be called once cpu_info says the host supports them
+#ifdef __GNUC__
+#define FUNCTION_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define FUNCTION_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FUNCTION_TARGET_SSE41
+#define FUNCTION_TARGET_AVX2
+#endif
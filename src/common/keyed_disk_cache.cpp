@@ -0,0 +1,112 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <atomic>
+
+#include "common/file_util.h"
+#include "common/keyed_disk_cache.h"
+#include "common/string_util.h"
+
+namespace Common {
+
+/// Header of the file storing a value, followed by the value
+struct ValueHeader {
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 size;
+    u32 reserved;
+};
+
+static const u32 kValueMagic = 0x4843444B; ///< "KDCH"
+
+KeyedDiskCache::KeyedDiskCache(const std::string& directory, u32 version) :
+    directory(directory), version(version) {
+
+    if (!this->directory.empty() && this->directory.back() != DIR_SEP_CHR) {
+        this->directory += DIR_SEP;
+    }
+}
+
+/// Returns the path of the file storing the value of a key
+std::string KeyedDiskCache::GetFilename(u64 key) const {
+    return StringFromFormat("%s%016llX.bin", directory.c_str(), (unsigned long long)key);
+}
+
+/**
+ * Reads a value from the cache
+ * @param key Key of the value
+ * @param buffer Buffer to read the value into
+ * @param max_size Size of the buffer
+ * @param size Receives the size of the value
+ * @return True on success, false if the key isn't cached or its value doesn't fit the buffer
+ */
+bool KeyedDiskCache::Read(u64 key, u8* buffer, u32 max_size, u32& size) const {
+    File::IOFile file(GetFilename(key), "rb");
+    if (!file.IsOpen()) {
+        return false;
+    }
+
+    ValueHeader header;
+    if (!file.ReadBytes(&header, sizeof(header)) || header.magic != kValueMagic ||
+        header.version != version || header.key != key || header.size > max_size ||
+        file.GetSize() != sizeof(header) + header.size) {
+        WARN_LOG(COMMON, "Ignoring invalid cache entry %016llX in %s", (unsigned long long)key,
+            directory.c_str());
+        return false;
+    }
+    if (!file.ReadBytes(buffer, header.size)) {
+        return false;
+    }
+    size = header.size;
+    return true;
+}
+
+/**
+ * Writes a value to the cache, replacing the value already stored for the key if any
+ * @param key Key of the value
+ * @param data Value to write
+ * @param size Size of the value in bytes
+ * @return True on success
+ */
+bool KeyedDiskCache::Write(u64 key, const u8* data, u32 size) const {
+    // Written to a temporary file first, so that readers never see a partial value
+    static std::atomic<u32> next_temp_id(0);
+    const std::string filename = GetFilename(key);
+    const std::string temp_filename = StringFromFormat("%s.%u.tmp", filename.c_str(),
+        next_temp_id++);
+
+    File::CreateFullPath(directory);
+
+    ValueHeader header;
+    header.magic = kValueMagic;
+    header.version = version;
+    header.key = key;
+    header.size = size;
+    header.reserved = 0;
+
+    File::IOFile file(temp_filename, "wb");
+    bool success = file.IsOpen() && file.WriteBytes(&header, sizeof(header)) &&
+        file.WriteBytes(data, size);
+    file.Close();
+
+    if (success) {
+#ifdef _WIN32
+        // rename doesn't replace existing files on Windows
+        if (File::Exists(filename)) {
+            File::Delete(filename);
+        }
+#endif
+        success = File::Rename(temp_filename, filename);
+    }
+    if (!success) {
+        ERROR_LOG(COMMON, "Failed to write cache entry %s", filename.c_str());
+        if (File::Exists(temp_filename)) {
+            File::Delete(temp_filename);
+        }
+    }
+    return success;
+}
+
+} // namespace
@@ -0,0 +1,54 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common.h"
+
+namespace Common {
+
+/**
+ * Persistent cache of binary values keyed by 64-bit hashes, one file per value. Unlike
+ * LinearDiskCache, a value can be looked up without reading the whole cache, so it suits large
+ * values of which only one is needed at a time. Different keys may be read and written from
+ * several threads at once.
+ */
+class KeyedDiskCache {
+public:
+    /**
+     * @param directory Directory the values are stored in, created when the first one is written
+     * @param version Version of the format of the values, values of other versions are ignored
+     */
+    KeyedDiskCache(const std::string& directory, u32 version);
+
+    /**
+     * Reads a value from the cache
+     * @param key Key of the value
+     * @param buffer Buffer to read the value into
+     * @param max_size Size of the buffer
+     * @param size Receives the size of the value
+     * @return True on success, false if the key isn't cached or its value doesn't fit the buffer
+     */
+    bool Read(u64 key, u8* buffer, u32 max_size, u32& size) const;
+
+    /**
+     * Writes a value to the cache, replacing the value already stored for the key if any
+     * @param key Key of the value
+     * @param data Value to write
+     * @param size Size of the value in bytes
+     * @return True on success
+     */
+    bool Write(u64 key, const u8* data, u32 size) const;
+
+private:
+    /// Returns the path of the file storing the value of a key
+    std::string GetFilename(u64 key) const;
+
+    std::string directory;  ///< Directory of the cache, with a trailing separator
+    u32 version;            ///< Version of the values
+};
+
+} // namespace
@@ -0,0 +1,134 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "common/mapped_file.h"
+#include "common/string_util.h"
+
+namespace Common {
+
+MappedFile::MappedFile() : view(nullptr), view_size(0), data(nullptr), size(0) {
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+/**
+ * Maps a range of a file, replacing the current mapping
+ * @param filename Path of the file
+ * @param offset Offset of the range in the file
+ * @param size Size of the range, which must be entirely within the file
+ * @return True on success
+ */
+bool MappedFile::Open(const std::string& filename, u64 offset, u64 size) {
+    Close();
+
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const u64 aligned_offset = offset & ~(u64)(info.dwAllocationGranularity - 1);
+    const u64 mapping_size = size + (offset - aligned_offset);
+
+    HANDLE file = CreateFile(UTF8ToTStr(filename).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &file_size) && offset + size <= (u64)file_size.QuadPart) {
+        mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    if (mapping != nullptr) {
+        view = (u8*)MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(aligned_offset >> 32),
+            (DWORD)aligned_offset, (SIZE_T)mapping_size);
+        // The view keeps the file mapped
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+#else
+    const u64 aligned_offset = offset & ~(u64)(sysconf(_SC_PAGESIZE) - 1);
+    const u64 mapping_size = size + (offset - aligned_offset);
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat file_info;
+    if (fstat(fd, &file_info) == 0 && offset + size <= (u64)file_info.st_size) {
+        void* address = mmap(nullptr, (size_t)mapping_size, PROT_READ, MAP_PRIVATE, fd,
+            (off_t)aligned_offset);
+        view = (address != MAP_FAILED) ? (u8*)address : nullptr;
+    }
+    // The mapping keeps the file open
+    close(fd);
+#endif
+
+    if (view == nullptr) {
+        ERROR_LOG(COMMON, "Failed to map 0x%llx bytes at 0x%llx of %s", (unsigned long long)size,
+            (unsigned long long)offset, filename.c_str());
+        return false;
+    }
+    view_size = (size_t)mapping_size;
+    data = view + (offset - aligned_offset);
+    this->size = size;
+    return true;
+}
+
+/// Unmaps the file
+void MappedFile::Close() {
+    if (view != nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile(view);
+#else
+        munmap(view, view_size);
+#endif
+    }
+    view = nullptr;
+    view_size = 0;
+    data = nullptr;
+    size = 0;
+}
+
+/// Hints that the mapping will mostly be read sequentially, so the OS reads ahead more
+void MappedFile::AdviseSequential() const {
+#ifndef _WIN32
+    if (view != nullptr) {
+        madvise(view, view_size, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+/**
+ * Hints that a part of the mapping will be read soon, so the OS can start reading it in
+ * @param offset Offset of the part in the mapped range
+ * @param length Length of the part, clamped to the end of the range
+ */
+void MappedFile::AdviseWillNeed(u64 offset, u64 length) const {
+#ifndef _WIN32
+    if (view == nullptr || offset >= size) {
+        return;
+    }
+    if (length > size - offset) {
+        length = size - offset;
+    }
+    // madvise takes page aligned addresses
+    const size_t page_mask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+    const size_t start = (size_t)(data - view + offset) & ~page_mask;
+    const size_t end = (size_t)(data - view + offset + length);
+    madvise(view + start, end - start, MADV_WILLNEED);
+#endif
+}
+
+} // namespace
@@ -0,0 +1,59 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common.h"
+
+namespace Common {
+
+/**
+ * Read-only memory mapping of a range of a file. Pages are only read from the file (and only take
+ * memory) once they are accessed.
+ */
+class MappedFile : NonCopyable {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    /**
+     * Maps a range of a file, replacing the current mapping
+     * @param filename Path of the file
+     * @param offset Offset of the range in the file
+     * @param size Size of the range, which must be entirely within the file
+     * @return True on success
+     */
+    bool Open(const std::string& filename, u64 offset, u64 size);
+
+    /// Unmaps the file
+    void Close();
+
+    bool IsOpen() const { return data != nullptr; }
+
+    /// Returns the start of the mapped range, or nullptr if no file is mapped
+    const u8* GetData() const { return data; }
+
+    /// Returns the size of the mapped range
+    u64 GetSize() const { return size; }
+
+    /// Hints that the mapping will mostly be read sequentially, so the OS reads ahead more
+    void AdviseSequential() const;
+
+    /**
+     * Hints that a part of the mapping will be read soon, so the OS can start reading it in
+     * @param offset Offset of the part in the mapped range
+     * @param length Length of the part, clamped to the end of the range
+     */
+    void AdviseWillNeed(u64 offset, u64 length) const;
+
+private:
+    u8* view;           ///< Start of the mapping, aligned down from the start of the range
+    size_t view_size;   ///< Size of the mapping
+    const u8* data;     ///< Start of the mapped range in the mapping
+    u64 size;           ///< Size of the mapped range
+};
+
+} // namespace
@@ -168,6 +168,28 @@ inline u64 Log2(u64 val)
 #endif
 }
 
+// Index of the lowest set bit. 0 -> undefined
+inline u32 CountTrailingZeros64(u64 val)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(val);
+
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long result = 0;
+    _BitScanForward64(&result, val);
+    return result;
+
+#else
+    u32 result = 0;
+    while ((val & 1) == 0)
+    {
+        val >>= 1;
+        ++result;
+    }
+    return result;
+#endif
+}
+
 // Tiny matrix/vector library.
 // Used for things like Free-Look in the gfx backend.
 
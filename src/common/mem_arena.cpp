@@ -164,6 +164,13 @@ void MemArena::GrabLowMemSpace(size_t size)
 
 void MemArena::ReleaseSpace()
 {
+#if defined(_M_X64) && !defined(_WIN32)
+    if (reserved_base)
+    {
+        munmap(reserved_base, 0x100000000ULL);
+        reserved_base = nullptr;
+    }
+#endif
 #ifdef _WIN32
     CloseHandle(hMemoryMapping);
     hMemoryMapping = 0;
@@ -222,6 +229,23 @@ void MemArena::ReleaseView(void* view, size_t size)
 #endif
 }
 
+u8* MemArena::Reserve4GBSpace()
+{
+#if defined(_M_X64) && !defined(_WIN32)
+    void* base = mmap(0, 0x100000000ULL, PROT_NONE,
+        MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        ERROR_LOG(MEMMAP, "Failed to reserve 4GB of address space: %s", strerror(errno));
+        return nullptr;
+    }
+    reserved_base = static_cast<u8*>(base);
+    return reserved_base;
+#else
+    ERROR_LOG(MEMMAP, "Reserving 4GB of address space is not supported on this platform");
+    return nullptr;
+#endif
+}
+
 #ifndef __SYMBIAN32__
 u8* MemArena::Find4GBBase()
 {
@@ -399,7 +423,11 @@ u8 *MemoryMap_Setup(const MemoryView *views, int num_views, u32 flags, MemArena
 
     // Now, create views in high memory where there's plenty of space.
 #ifdef _M_X64
-    u8 *base = MemArena::Find4GBBase();
+    u8 *base = nullptr;
+    if (flags & MM_RESERVE_4GB)
+        base = arena->Reserve4GBSpace();
+    if (!base)
+        base = MemArena::Find4GBBase();
     // This really shouldn't fail - in 64-bit, there will always be enough
     // address space.
     if (!Memory_TryBase(base, views, num_views, flags, arena))
@@ -34,8 +34,14 @@
 class MemArena
 {
 public:
+    MemArena() : reserved_base(nullptr) {}
+
     void GrabLowMemSpace(size_t size);
     void ReleaseSpace();
+    // Reserves (without committing) 4GB of address space, so that views can be mapped at
+    // base + virtual_address and everything else faults. Released by ReleaseSpace.
+    u8 *Reserve4GBSpace();
+    bool HasReserved4GBSpace() const { return reserved_base != nullptr; }
     void *CreateView(s64 offset, size_t size, void *base = 0);
     void ReleaseView(void *view, size_t size);
 
@@ -46,6 +52,7 @@ public:
     static u8 *Find4GBBase();
 #endif
 private:
+    u8 *reserved_base;
 
 #ifdef _WIN32
     HANDLE hMemoryMapping;
@@ -63,6 +70,11 @@ enum {
     MV_IS_EXTRA2_RAM = 0x400,
 };
 
+// Flags for MemoryMap_Setup
+enum {
+    MM_RESERVE_4GB = 0x10000,   // Map views into a reserved 4GB region (64-bit POSIX only)
+};
+
 struct MemoryView
 {
     u8 **out_ptr_low;
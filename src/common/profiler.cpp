@@ -0,0 +1,70 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <chrono>
+
+#include "common/profiler.h"
+
+namespace Common {
+namespace Profiling {
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static bool g_enabled = false;
+static Section g_current_section = SECTION_OTHER;     ///< Section time is currently charged to
+static Clock::time_point g_section_start;             ///< When the current section was entered
+static Clock::duration g_section_time[NUM_SECTIONS];  ///< Time accumulated by each section
+
+/// Charges the time since the last switch to the current section and makes `section` current
+static void SwitchSection(Section section) {
+    Clock::time_point now = Clock::now();
+    g_section_time[g_current_section] += now - g_section_start;
+    g_current_section = section;
+    g_section_start = now;
+}
+
+void SetEnabled(bool enabled) {
+    g_enabled = enabled;
+    g_current_section = SECTION_OTHER;
+    g_section_start = Clock::now();
+}
+
+bool IsEnabled() {
+    return g_enabled;
+}
+
+void Reset() {
+    for (int i = 0; i < NUM_SECTIONS; ++i) {
+        g_section_time[i] = Clock::duration::zero();
+    }
+    g_section_start = Clock::now();
+}
+
+double GetSectionTime(Section section) {
+    Clock::duration time = g_section_time[section];
+    if (g_enabled && section == g_current_section) {
+        time += Clock::now() - g_section_start;
+    }
+    return std::chrono::duration_cast<std::chrono::duration<double>>(time).count();
+}
+
+const char* GetSectionName(Section section) {
+    static const char* names[NUM_SECTIONS] = { "Other", "CPU", "HLE", "PICA" };
+    return names[section];
+}
+
+ScopedSection::ScopedSection(Section section) : previous(g_current_section), active(g_enabled) {
+    if (active) {
+        SwitchSection(section);
+    }
+}
+
+ScopedSection::~ScopedSection() {
+    if (active) {
+        SwitchSection(previous);
+    }
+}
+
+} // namespace
+} // namespace
@@ -0,0 +1,56 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+namespace Common {
+namespace Profiling {
+
+/// Parts of the emulator whose host time is measured separately
+enum Section {
+    SECTION_OTHER = 0,  ///< Anything not covered by another section (CoreTiming, frontend, ...)
+    SECTION_CPU,        ///< Guest code execution
+    SECTION_HLE,        ///< SVCs and the services they call into
+    SECTION_PICA,       ///< GPU command lists, memory fills and display transfers
+
+    NUM_SECTIONS
+};
+
+/// Enables or disables time measurement, it is off by default
+void SetEnabled(bool enabled);
+
+/// Returns true if time measurement is enabled
+bool IsEnabled();
+
+/// Clears the time accumulated by all sections
+void Reset();
+
+/**
+ * Returns the host time spent in a section, excluding any sections entered from it
+ * @param section Section to query
+ * @return Time in seconds
+ */
+double GetSectionTime(Section section);
+
+/// Returns the display name of a section
+const char* GetSectionName(Section section);
+
+/**
+ * Charges the host time spent until it goes out of scope to a section. Scopes nest: time spent in
+ * an inner section is not charged to the outer one. Only meant to be used on the emulation thread.
+ */
+class ScopedSection {
+public:
+    explicit ScopedSection(Section section);
+    ~ScopedSection();
+
+private:
+    Section previous;   ///< Section that was active when this one was entered
+    bool active;        ///< False if profiling was disabled when the scope was entered
+};
+
+} // namespace
+} // namespace
@@ -0,0 +1,181 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common.h"
+#include "common/math_util.h"
+
+namespace Common {
+
+/// Links an object into a SchedulerQueue, embedded in the object itself
+template<class T>
+struct SchedulerQueueHook {
+    SchedulerQueueHook() : prev(nullptr), next(nullptr), priority(-1) {}
+
+    T* prev;        ///< Previous object with the same priority
+    T* next;        ///< Next object with the same priority
+    s32 priority;   ///< Priority the object is queued at, or -1 if it isn't queued
+};
+
+/**
+ * Ready queue for the thread scheduler: one FIFO per priority level (0 being the best), linked
+ * through a SchedulerQueueHook member of the queued objects, and a bitmap of the non-empty levels.
+ * All operations are O(1), an object can be in at most one queue at a time.
+ * @tparam T Type of the queued objects
+ * @tparam hook Member of T linking it into the queue
+ */
+template<class T, SchedulerQueueHook<T> T::*hook>
+class SchedulerQueue {
+public:
+    // Number of queues (number of priority levels starting at 0.)
+    static const int NUM_QUEUES = 128;
+
+    SchedulerQueue() {
+        clear();
+    }
+
+    /**
+     * Returns the priority an object is queued at
+     * @return Priority level, or -1 if the object isn't queued
+     */
+    int contains(const T* object) const {
+        return (object->*hook).priority;
+    }
+
+    /// Removes and returns the first object of the best non-empty priority, or nullptr if empty
+    T* pop_first() {
+        for (int word = 0; word < NUM_WORDS; ++word) {
+            if (occupied[word] != 0) {
+                return pop_front(word * 64 + CountTrailingZeros64(occupied[word]));
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Removes and returns the first object of the best priority strictly better than `priority`
+     * @return Object, or nullptr if there is none
+     */
+    T* pop_first_better(u32 priority) {
+        for (u32 word = 0; word * 64 < priority; ++word) {
+            u64 mask = occupied[word];
+            if (priority < (word + 1) * 64) {
+                mask &= (1ULL << (priority % 64)) - 1;
+            }
+            if (mask != 0) {
+                return pop_front(word * 64 + CountTrailingZeros64(mask));
+            }
+        }
+        return nullptr;
+    }
+
+    /// Adds an object to the front of its priority level, it will be the next one popped from it
+    void push_front(u32 priority, T* object) {
+        Hook& node = object->*hook;
+        _dbg_assert_msg_(COMMON, node.priority == -1, "SchedulerQueue: object is already queued");
+
+        Queue& queue = queues[priority];
+        node.priority = priority;
+        node.prev = nullptr;
+        node.next = queue.head;
+        if (queue.head != nullptr) {
+            (queue.head->*hook).prev = object;
+        } else {
+            queue.tail = object;
+            occupied[priority / 64] |= 1ULL << (priority % 64);
+        }
+        queue.head = object;
+    }
+
+    /// Adds an object to the back of its priority level
+    void push_back(u32 priority, T* object) {
+        Hook& node = object->*hook;
+        _dbg_assert_msg_(COMMON, node.priority == -1, "SchedulerQueue: object is already queued");
+
+        Queue& queue = queues[priority];
+        node.priority = priority;
+        node.prev = queue.tail;
+        node.next = nullptr;
+        if (queue.tail != nullptr) {
+            (queue.tail->*hook).next = object;
+        } else {
+            queue.head = object;
+            occupied[priority / 64] |= 1ULL << (priority % 64);
+        }
+        queue.tail = object;
+    }
+
+    /// Removes an object from the queue, does nothing if it isn't queued
+    void remove(T* object) {
+        Hook& node = object->*hook;
+        if (node.priority == -1) {
+            return;
+        }
+
+        Queue& queue = queues[node.priority];
+        if (node.prev != nullptr) {
+            (node.prev->*hook).next = node.next;
+        } else {
+            queue.head = node.next;
+        }
+        if (node.next != nullptr) {
+            (node.next->*hook).prev = node.prev;
+        } else {
+            queue.tail = node.prev;
+        }
+        if (queue.head == nullptr) {
+            occupied[node.priority / 64] &= ~(1ULL << (node.priority % 64));
+        }
+
+        node.prev = node.next = nullptr;
+        node.priority = -1;
+    }
+
+    /// Moves the first object of a priority level to its back
+    void rotate(u32 priority) {
+        T* first = queues[priority].head;
+        if (first != nullptr && first != queues[priority].tail) {
+            remove(first);
+            push_back(priority, first);
+        }
+    }
+
+    /// Empties the queue (the hooks of the queued objects are left as they are)
+    void clear() {
+        for (int i = 0; i < NUM_QUEUES; ++i) {
+            queues[i].head = queues[i].tail = nullptr;
+        }
+        for (int word = 0; word < NUM_WORDS; ++word) {
+            occupied[word] = 0;
+        }
+    }
+
+    /// Returns true if no object is queued at the given priority
+    bool empty(u32 priority) const {
+        return queues[priority].head == nullptr;
+    }
+
+private:
+    typedef SchedulerQueueHook<T> Hook;
+
+    static const int NUM_WORDS = NUM_QUEUES / 64;
+
+    struct Queue {
+        T* head;    ///< Next object to be popped
+        T* tail;    ///< Last pushed object
+    };
+
+    /// Removes and returns the first object of a non-empty priority level
+    T* pop_front(u32 priority) {
+        T* object = queues[priority].head;
+        remove(object);
+        return object;
+    }
+
+    u64 occupied[NUM_WORDS];    ///< Bit N is set if priority level N is not empty
+    Queue queues[NUM_QUEUES];   ///< FIFO of each priority level
+};
+
+} // namespace
@@ -0,0 +1,71 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+
+#include "common/thread_pool.h"
+
+namespace Common {
+
+ThreadPool::ThreadPool(int num_threads) : num_running(0), stopping(false) {
+    for (int i = 0; i < std::max(num_threads, 1); ++i) {
+        threads.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_available.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+/// Queues a task, it is run by the first worker thread available
+void ThreadPool::Push(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    task_available.notify_one();
+}
+
+/// Blocks until every queued task has finished running
+void ThreadPool::WaitForIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!tasks.empty() || num_running != 0) {
+        idle.wait(lock);
+    }
+}
+
+/// Main loop of the worker threads
+void ThreadPool::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        while (tasks.empty() && !stopping) {
+            task_available.wait(lock);
+        }
+        if (tasks.empty()) {
+            return;
+        }
+
+        std::function<void()> task = std::move(tasks.front());
+        tasks.pop_front();
+        num_running++;
+
+        lock.unlock();
+        task();
+        lock.lock();
+
+        num_running--;
+        if (tasks.empty() && num_running == 0) {
+            idle.notify_all();
+        }
+    }
+}
+
+} // namespace
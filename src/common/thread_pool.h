@@ -0,0 +1,56 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "common/common.h"
+#include "common/thread.h"
+
+namespace Common {
+
+/**
+ * Fixed set of worker threads running tasks in the order they are pushed. Tasks run concurrently,
+ * so they must not depend on each other.
+ */
+class ThreadPool : NonCopyable {
+public:
+    /**
+     * Starts the worker threads
+     * @param num_threads Number of worker threads, at least 1
+     */
+    explicit ThreadPool(int num_threads);
+
+    /// Runs the tasks still queued, then stops the worker threads
+    ~ThreadPool();
+
+    /// Queues a task, it is run by the first worker thread available
+    void Push(std::function<void()> task);
+
+    /// Blocks until every queued task has finished running
+    void WaitForIdle();
+
+    /// Returns the number of worker threads
+    int GetNumThreads() const {
+        return (int)threads.size();
+    }
+
+private:
+    /// Main loop of the worker threads
+    void WorkerLoop();
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;    ///< Tasks no worker thread took yet
+    int num_running;                            ///< Tasks being run by a worker thread
+    bool stopping;                              ///< Set when the pool is destroyed
+
+    std::mutex mutex;
+    std::condition_variable task_available;     ///< Signalled when a task is pushed or on stop
+    std::condition_variable idle;               ///< Signalled when the last task finishes
+};
+
+} // namespace
@@ -0,0 +1,151 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/x64_analyzer.h"
+
+namespace Common {
+
+bool DisassembleMov(const u8* code, X64MovInfo* info) {
+    const u8* start = code;
+    bool operand_size_override = false;
+
+    // Skip legacy prefixes, keeping track of the operand-size override
+    for (;;) {
+        const u8 prefix = *code;
+        if (prefix == 0x66) {
+            operand_size_override = true;
+        } else if (prefix != 0x26 && prefix != 0x2E && prefix != 0x36 && prefix != 0x3E &&
+                   prefix != 0x64 && prefix != 0x65) {
+            break;
+        }
+        code++;
+    }
+
+    u8 rex = 0;
+    if ((*code & 0xF0) == 0x40) {
+        rex = *code++;
+    }
+    const bool rex_w = (rex & 0x8) != 0;
+    const bool rex_r = (rex & 0x4) != 0;
+
+    const int default_size = rex_w ? 8 : (operand_size_override ? 2 : 4);
+    int immediate_size = 0;
+
+    info->sign_extend = false;
+    info->has_immediate = false;
+    info->immediate = 0;
+    info->high_byte = false;
+
+    const u8 opcode = *code++;
+    switch (opcode) {
+    case 0x88: // mov r/m8, r8
+    case 0x8A: // mov r8, r/m8
+        info->is_load = (opcode == 0x8A);
+        info->operand_size = info->register_size = 1;
+        break;
+
+    case 0x89: // mov r/m, r
+    case 0x8B: // mov r, r/m
+        info->is_load = (opcode == 0x8B);
+        info->operand_size = info->register_size = default_size;
+        break;
+
+    case 0xC6: // mov r/m8, imm8
+        info->is_load = false;
+        info->has_immediate = true;
+        info->operand_size = info->register_size = immediate_size = 1;
+        break;
+
+    case 0xC7: // mov r/m, imm16/imm32
+        info->is_load = false;
+        info->has_immediate = true;
+        info->operand_size = info->register_size = default_size;
+        immediate_size = (default_size == 2) ? 2 : 4;
+        break;
+
+    case 0x63: // movsxd r64, r/m32
+        if (!rex_w)
+            return false;
+        info->is_load = true;
+        info->sign_extend = true;
+        info->operand_size = 4;
+        info->register_size = 8;
+        break;
+
+    case 0x0F:
+    {
+        const u8 opcode2 = *code++;
+        switch (opcode2) {
+        case 0xB6: // movzx r, r/m8
+        case 0xB7: // movzx r, r/m16
+        case 0xBE: // movsx r, r/m8
+        case 0xBF: // movsx r, r/m16
+            info->is_load = true;
+            info->sign_extend = (opcode2 >= 0xBE);
+            info->operand_size = (opcode2 & 1) ? 2 : 1;
+            info->register_size = default_size;
+            break;
+
+        default:
+            return false;
+        }
+        break;
+    }
+
+    default:
+        return false;
+    }
+
+    // Decode ModRM, which also tells us how many addressing bytes follow
+    const u8 modrm = *code++;
+    const int mod = modrm >> 6;
+    const int reg = (modrm >> 3) & 7;
+    const int rm = modrm & 7;
+
+    // Register-to-register forms never access memory
+    if (mod == 3)
+        return false;
+
+    // mov r/m, imm is only defined for /0
+    if (info->has_immediate && reg != 0)
+        return false;
+
+    if (rm == 4) {
+        const u8 sib = *code++;
+        if ((sib & 7) == 5 && mod == 0)
+            code += 4;
+    } else if (rm == 5 && mod == 0) {
+        code += 4; // RIP-relative
+    }
+
+    if (mod == 1) {
+        code += 1;
+    } else if (mod == 2) {
+        code += 4;
+    }
+
+    if (immediate_size != 0) {
+        u64 value = 0;
+        for (int i = 0; i < immediate_size; ++i)
+            value |= (u64)code[i] << (i * 8);
+        code += immediate_size;
+
+        // Immediates are sign extended to the operand size
+        const int shift = 64 - immediate_size * 8;
+        info->immediate = (u64)((s64)(value << shift) >> shift);
+    }
+
+    info->reg = reg | (rex_r ? 8 : 0);
+
+    // Without a REX prefix, byte registers 4-7 refer to AH, CH, DH and BH
+    if (info->register_size == 1 && !info->has_immediate && rex == 0 && reg >= 4) {
+        info->reg = reg - 4;
+        info->high_byte = true;
+    }
+
+    info->instruction_size = (int)(code - start);
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,32 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/// Decoded form of an x86-64 instruction that moves data between a register and memory
+struct X64MovInfo {
+    int instruction_size;   ///< Length of the instruction in bytes
+    int operand_size;       ///< Size of the memory operand in bytes (1, 2, 4 or 8)
+    int register_size;      ///< Size of the register operand in bytes (for movzx/movsx)
+    int reg;                ///< Register operand, 0-15 (RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI...)
+    bool high_byte;         ///< Register operand is AH/CH/DH/BH (reg is the corresponding full reg)
+    bool is_load;           ///< True if memory is read into the register, false if it is written
+    bool sign_extend;       ///< Load sign extends the memory operand (movsx/movsxd)
+    bool has_immediate;     ///< Store writes an immediate value instead of a register
+    u64 immediate;          ///< Immediate value (already sign extended to operand_size)
+};
+
+/**
+ * Decodes a register/memory mov instruction (mov, movzx, movsx, movsxd, mov r/m imm)
+ * @param code Pointer to the first byte of the instruction
+ * @param info Receives the decoded instruction on success
+ * @return True if the instruction is a supported mov with a memory operand, otherwise false
+ */
+bool DisassembleMov(const u8* code, X64MovInfo* info);
+
+} // namespace
@@ -0,0 +1,335 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/common.h"
+#include "common/x64_emitter.h"
+
+namespace Gen {
+
+void XEmitter::Write16(u16 value) {
+    Write8(value & 0xFF);
+    Write8(value >> 8);
+}
+
+void XEmitter::Write32(u32 value) {
+    Write16(value & 0xFFFF);
+    Write16(value >> 16);
+}
+
+void XEmitter::Write64(u64 value) {
+    Write32((u32)value);
+    Write32((u32)(value >> 32));
+}
+
+void XEmitter::WriteOp(int bits, u32 opcode, int opcode_size, int reg_field, const OpArg& rm,
+    bool byte_regs) {
+
+    _dbg_assert_msg_(DYNA_REC, !rm.IsImm(), "immediate used as a ModRM operand");
+
+    if (bits == 16)
+        Write8(0x66);
+
+    // REX prefix
+    u8 rex = 0;
+    if (bits == 64)
+        rex |= 0x48;
+    if (reg_field & 8)
+        rex |= 0x44;
+    if (rm.kind == OpArg::KIND_MEMORY && rm.index != INVALID_REG && (rm.index & 8))
+        rex |= 0x42;
+    if (rm.reg & 8)
+        rex |= 0x41;
+    if (byte_regs && ((reg_field >= 4 && reg_field < 8) || (rm.IsSimpleReg() && rm.reg >= 4)))
+        rex |= 0x40;
+    if (rex)
+        Write8(rex);
+
+    for (int i = opcode_size - 1; i >= 0; --i)
+        Write8((opcode >> (i * 8)) & 0xFF);
+
+    const u8 reg_bits = (reg_field & 7) << 3;
+
+    if (rm.IsSimpleReg()) {
+        Write8(0xC0 | reg_bits | (rm.reg & 7));
+        return;
+    }
+
+    // Memory operand, [base + index * scale + disp]
+    const int base = rm.reg & 7;
+    int mod;
+    if (rm.disp == 0 && base != 5) {
+        mod = 0x00;
+    } else if (rm.disp >= -128 && rm.disp <= 127) {
+        mod = 0x40;
+    } else {
+        mod = 0x80;
+    }
+
+    if (rm.index != INVALID_REG || base == 4) {
+        static const u8 scale_bits[9] = { 0, 0x00, 0x40, 0, 0x80, 0, 0, 0, 0xC0 };
+        const int index = (rm.index != INVALID_REG) ? (rm.index & 7) : 4;
+        Write8(mod | reg_bits | 4);
+        Write8(scale_bits[rm.scale] | (index << 3) | base);
+    } else {
+        Write8(mod | reg_bits | base);
+    }
+
+    if (mod == 0x40) {
+        Write8((u8)rm.disp);
+    } else if (mod == 0x80) {
+        Write32((u32)rm.disp);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Control flow
+
+FixupBranch XEmitter::J() {
+    Write8(0xE9);
+    Write32(0);
+    FixupBranch branch = { code };
+    return branch;
+}
+
+FixupBranch XEmitter::J_CC(CCFlags cc) {
+    Write8(0x0F);
+    Write8(0x80 + cc);
+    Write32(0);
+    FixupBranch branch = { code };
+    return branch;
+}
+
+void XEmitter::SetJumpTarget(const FixupBranch& branch) {
+    SetJumpTarget(branch, code);
+}
+
+void XEmitter::SetJumpTarget(const FixupBranch& branch, const u8* target) {
+    const s64 distance = target - branch.ptr;
+    _assert_msg_(DYNA_REC, distance == (s32)distance, "jump target out of range");
+    const u32 rel = (u32)(s32)distance;
+    branch.ptr[-4] = rel & 0xFF;
+    branch.ptr[-3] = (rel >> 8) & 0xFF;
+    branch.ptr[-2] = (rel >> 16) & 0xFF;
+    branch.ptr[-1] = rel >> 24;
+}
+
+void XEmitter::JMP(const u8* target) {
+    SetJumpTarget(J(), target);
+}
+
+void XEmitter::JMPptr(const OpArg& target) {
+    WriteOp(32, 0xFF, 1, 4, target, false);
+}
+
+void XEmitter::J_CC(CCFlags cc, const u8* target) {
+    SetJumpTarget(J_CC(cc), target);
+}
+
+void XEmitter::CALL(const void* function) {
+    const s64 distance = (const u8*)function - (code + 5);
+    if (distance == (s32)distance) {
+        Write8(0xE8);
+        Write32((u32)(s32)distance);
+        return;
+    }
+
+    // Out of rel32 range, call through RAX (which is caller saved anyway)
+    MOV(64, R(RAX), Imm64((u64)function));
+    WriteOp(32, 0xFF, 1, 2, R(RAX), false);
+}
+
+void XEmitter::RET() {
+    Write8(0xC3);
+}
+
+void XEmitter::PUSH(X64Reg reg) {
+    if (reg & 8)
+        Write8(0x41);
+    Write8(0x50 + (reg & 7));
+}
+
+void XEmitter::POP(X64Reg reg) {
+    if (reg & 8)
+        Write8(0x41);
+    Write8(0x58 + (reg & 7));
+}
+
+void XEmitter::INT3() {
+    Write8(0xCC);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Data movement
+
+void XEmitter::MOV(int bits, const OpArg& dst, const OpArg& src) {
+    if (src.IsImm()) {
+        if (dst.IsSimpleReg() && bits == 64 && src.imm_bits == 64) {
+            // mov r64, imm64
+            Write8(0x48 | ((dst.reg & 8) ? 0x01 : 0));
+            Write8(0xB8 + (dst.reg & 7));
+            Write64(src.imm);
+            return;
+        }
+        if (dst.IsSimpleReg() && bits == 32) {
+            // mov r32, imm32
+            if (dst.reg & 8)
+                Write8(0x41);
+            Write8(0xB8 + (dst.reg & 7));
+            Write32((u32)src.imm);
+            return;
+        }
+        WriteOp(bits, (bits == 8) ? 0xC6 : 0xC7, 1, 0, dst, bits == 8);
+        if (bits == 8) {
+            Write8((u8)src.imm);
+        } else if (bits == 16) {
+            Write16((u16)src.imm);
+        } else {
+            Write32((u32)src.imm);
+        }
+        return;
+    }
+
+    if (src.IsSimpleReg()) {
+        WriteOp(bits, (bits == 8) ? 0x88 : 0x89, 1, src.reg, dst, bits == 8);
+    } else {
+        _dbg_assert_msg_(DYNA_REC, dst.IsSimpleReg(), "memory to memory mov");
+        WriteOp(bits, (bits == 8) ? 0x8A : 0x8B, 1, dst.reg, src, bits == 8);
+    }
+}
+
+void XEmitter::MOVZX(int dst_bits, int src_bits, X64Reg dst, const OpArg& src) {
+    WriteOp(dst_bits, (src_bits == 8) ? 0x0FB6 : 0x0FB7, 2, dst, src, src_bits == 8);
+}
+
+void XEmitter::MOVSX(int dst_bits, int src_bits, X64Reg dst, const OpArg& src) {
+    if (src_bits == 32) {
+        WriteOp(64, 0x63, 1, dst, src, false);
+        return;
+    }
+    WriteOp(dst_bits, (src_bits == 8) ? 0x0FBE : 0x0FBF, 2, dst, src, src_bits == 8);
+}
+
+void XEmitter::LEA(int bits, X64Reg dst, const OpArg& src) {
+    WriteOp(bits, 0x8D, 1, dst, src, false);
+}
+
+void XEmitter::BSWAP(int bits, X64Reg reg) {
+    u8 rex = (bits == 64) ? 0x48 : 0;
+    if (reg & 8)
+        rex |= 0x41;
+    if (rex)
+        Write8(rex);
+    Write8(0x0F);
+    Write8(0xC8 + (reg & 7));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Arithmetic and logic
+
+void XEmitter::WriteALU(int bits, int ext, const OpArg& dst, const OpArg& src) {
+    if (src.IsImm()) {
+        const s32 imm = (s32)src.imm;
+        if (bits == 8) {
+            WriteOp(8, 0x80, 1, ext, dst, true);
+            Write8((u8)imm);
+        } else if (imm >= -128 && imm <= 127) {
+            WriteOp(bits, 0x83, 1, ext, dst, false);
+            Write8((u8)imm);
+        } else {
+            WriteOp(bits, 0x81, 1, ext, dst, false);
+            if (bits == 16) {
+                Write16((u16)imm);
+            } else {
+                Write32((u32)imm);
+            }
+        }
+        return;
+    }
+
+    const u32 base_opcode = ext << 3;
+    if (src.IsSimpleReg()) {
+        WriteOp(bits, base_opcode + ((bits == 8) ? 0 : 1), 1, src.reg, dst, bits == 8);
+    } else {
+        _dbg_assert_msg_(DYNA_REC, dst.IsSimpleReg(), "memory to memory ALU op");
+        WriteOp(bits, base_opcode + ((bits == 8) ? 2 : 3), 1, dst.reg, src, bits == 8);
+    }
+}
+
+void XEmitter::ADD(int bits, const OpArg& dst, const OpArg& src) { WriteALU(bits, 0, dst, src); }
+void XEmitter::OR (int bits, const OpArg& dst, const OpArg& src) { WriteALU(bits, 1, dst, src); }
+void XEmitter::ADC(int bits, const OpArg& dst, const OpArg& src) { WriteALU(bits, 2, dst, src); }
+void XEmitter::SBB(int bits, const OpArg& dst, const OpArg& src) { WriteALU(bits, 3, dst, src); }
+void XEmitter::AND(int bits, const OpArg& dst, const OpArg& src) { WriteALU(bits, 4, dst, src); }
+void XEmitter::SUB(int bits, const OpArg& dst, const OpArg& src) { WriteALU(bits, 5, dst, src); }
+void XEmitter::XOR(int bits, const OpArg& dst, const OpArg& src) { WriteALU(bits, 6, dst, src); }
+void XEmitter::CMP(int bits, const OpArg& dst, const OpArg& src) { WriteALU(bits, 7, dst, src); }
+
+void XEmitter::TEST(int bits, const OpArg& dst, const OpArg& src) {
+    if (src.IsImm()) {
+        WriteOp(bits, (bits == 8) ? 0xF6 : 0xF7, 1, 0, dst, bits == 8);
+        if (bits == 8) {
+            Write8((u8)src.imm);
+        } else if (bits == 16) {
+            Write16((u16)src.imm);
+        } else {
+            Write32((u32)src.imm);
+        }
+        return;
+    }
+    WriteOp(bits, (bits == 8) ? 0x84 : 0x85, 1, src.reg, dst, bits == 8);
+}
+
+void XEmitter::NOT(int bits, const OpArg& dst) {
+    WriteOp(bits, (bits == 8) ? 0xF6 : 0xF7, 1, 2, dst, bits == 8);
+}
+
+void XEmitter::NEG(int bits, const OpArg& dst) {
+    WriteOp(bits, (bits == 8) ? 0xF6 : 0xF7, 1, 3, dst, bits == 8);
+}
+
+void XEmitter::IMUL(int bits, X64Reg dst, const OpArg& src) {
+    WriteOp(bits, 0x0FAF, 2, dst, src, false);
+}
+
+void XEmitter::BSR(int bits, X64Reg dst, const OpArg& src) {
+    WriteOp(bits, 0x0FBD, 2, dst, src, false);
+}
+
+void XEmitter::BT(int bits, const OpArg& dst, const OpArg& bit) {
+    WriteOp(bits, 0x0FBA, 2, 4, dst, false);
+    Write8((u8)bit.imm);
+}
+
+void XEmitter::SETcc(CCFlags cc, const OpArg& dst) {
+    WriteOp(8, 0x0F90 + cc, 2, 0, dst, true);
+}
+
+void XEmitter::CMC() {
+    Write8(0xF5);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Shifts
+
+void XEmitter::WriteShift(int bits, int ext, const OpArg& dst, const OpArg& shift) {
+    if (shift.IsImm()) {
+        if (shift.imm == 1) {
+            WriteOp(bits, (bits == 8) ? 0xD0 : 0xD1, 1, ext, dst, bits == 8);
+        } else {
+            WriteOp(bits, (bits == 8) ? 0xC0 : 0xC1, 1, ext, dst, bits == 8);
+            Write8((u8)shift.imm);
+        }
+        return;
+    }
+    _dbg_assert_msg_(DYNA_REC, shift.IsSimpleReg(ECX), "shift amount must be in CL");
+    WriteOp(bits, (bits == 8) ? 0xD2 : 0xD3, 1, ext, dst, bits == 8);
+}
+
+void XEmitter::ROR(int bits, const OpArg& dst, const OpArg& shift) { WriteShift(bits, 1, dst, shift); }
+void XEmitter::RCR(int bits, const OpArg& dst, const OpArg& shift) { WriteShift(bits, 3, dst, shift); }
+void XEmitter::SHL(int bits, const OpArg& dst, const OpArg& shift) { WriteShift(bits, 4, dst, shift); }
+void XEmitter::SHR(int bits, const OpArg& dst, const OpArg& shift) { WriteShift(bits, 5, dst, shift); }
+void XEmitter::SAR(int bits, const OpArg& dst, const OpArg& shift) { WriteShift(bits, 7, dst, shift); }
+
+} // namespace
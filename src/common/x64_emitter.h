@@ -0,0 +1,179 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+namespace Gen {
+
+/// x86-64 general purpose registers, in encoding order
+enum X64Reg : u8 {
+    EAX = 0, ECX, EDX, EBX, ESP, EBP, ESI, EDI,
+    R8D, R9D, R10D, R11D, R12D, R13D, R14D, R15D,
+
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+
+    INVALID_REG = 0xFF,
+};
+
+/// Condition codes, in encoding order
+enum CCFlags {
+    CC_O = 0, CC_NO, CC_B, CC_NB, CC_Z, CC_NZ, CC_BE, CC_NBE,
+    CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_NL, CC_LE, CC_NLE,
+
+    CC_C = CC_B, CC_NC = CC_NB, CC_E = CC_Z, CC_NE = CC_NZ,
+    CC_A = CC_NBE, CC_AE = CC_NB, CC_GE = CC_NL, CC_G = CC_NLE,
+};
+
+/// Operand of an instruction: a register, an immediate or a [base + index * scale + disp] access
+struct OpArg {
+    enum Kind : u8 {
+        KIND_REGISTER,
+        KIND_IMMEDIATE,
+        KIND_MEMORY,
+    };
+
+    Kind kind;
+    u8 scale;           ///< Index scale (1, 2, 4 or 8) for memory operands
+    u8 imm_bits;        ///< Size of an immediate operand in bits
+    X64Reg reg;         ///< Register, or the base register of a memory operand
+    X64Reg index;       ///< Index register of a memory operand, or INVALID_REG
+    s32 disp;           ///< Displacement of a memory operand
+    u64 imm;            ///< Immediate value
+
+    bool IsImm() const { return kind == KIND_IMMEDIATE; }
+    bool IsSimpleReg() const { return kind == KIND_REGISTER; }
+    bool IsSimpleReg(X64Reg r) const { return kind == KIND_REGISTER && reg == r; }
+};
+
+inline OpArg R(X64Reg reg) {
+    OpArg arg = { OpArg::KIND_REGISTER, 0, 0, reg, INVALID_REG, 0, 0 };
+    return arg;
+}
+
+inline OpArg MDisp(X64Reg base, s32 disp) {
+    OpArg arg = { OpArg::KIND_MEMORY, 1, 0, base, INVALID_REG, disp, 0 };
+    return arg;
+}
+
+inline OpArg MatR(X64Reg base) {
+    return MDisp(base, 0);
+}
+
+inline OpArg MComplex(X64Reg base, X64Reg index, int scale, s32 disp) {
+    OpArg arg = { OpArg::KIND_MEMORY, (u8)scale, 0, base, index, disp, 0 };
+    return arg;
+}
+
+inline OpArg Imm8(u8 imm) {
+    OpArg arg = { OpArg::KIND_IMMEDIATE, 0, 8, INVALID_REG, INVALID_REG, 0, imm };
+    return arg;
+}
+
+inline OpArg Imm16(u16 imm) {
+    OpArg arg = { OpArg::KIND_IMMEDIATE, 0, 16, INVALID_REG, INVALID_REG, 0, imm };
+    return arg;
+}
+
+inline OpArg Imm32(u32 imm) {
+    OpArg arg = { OpArg::KIND_IMMEDIATE, 0, 32, INVALID_REG, INVALID_REG, 0, imm };
+    return arg;
+}
+
+inline OpArg Imm64(u64 imm) {
+    OpArg arg = { OpArg::KIND_IMMEDIATE, 0, 64, INVALID_REG, INVALID_REG, 0, imm };
+    return arg;
+}
+
+/// Forward branch whose target is filled in later with SetJumpTarget
+struct FixupBranch {
+    u8* ptr;    ///< Address just past the rel32 field
+};
+
+/**
+ * Minimal x86-64 code emitter, covering the integer instructions needed by the ARM JIT. Operand
+ * sizes are given in bits (8, 16, 32 or 64), following the conventions of Dolphin's emitter.
+ */
+class XEmitter {
+public:
+    XEmitter() : code(nullptr) {}
+    explicit XEmitter(u8* code_ptr) : code(code_ptr) {}
+
+    void SetCodePtr(u8* ptr) { code = ptr; }
+    const u8* GetCodePtr() const { return code; }
+    u8* GetWritableCodePtr() { return code; }
+
+    // Control flow
+    FixupBranch J();
+    FixupBranch J_CC(CCFlags cc);
+    void SetJumpTarget(const FixupBranch& branch);
+    void SetJumpTarget(const FixupBranch& branch, const u8* target);
+    void JMP(const u8* target);
+    void JMPptr(const OpArg& target);
+    void J_CC(CCFlags cc, const u8* target);
+    void CALL(const void* function);
+    void RET();
+    void PUSH(X64Reg reg);
+    void POP(X64Reg reg);
+    void INT3();
+
+    // Data movement
+    void MOV(int bits, const OpArg& dst, const OpArg& src);
+    void MOVZX(int dst_bits, int src_bits, X64Reg dst, const OpArg& src);
+    void MOVSX(int dst_bits, int src_bits, X64Reg dst, const OpArg& src);
+    void LEA(int bits, X64Reg dst, const OpArg& src);
+    void BSWAP(int bits, X64Reg reg);
+
+    // Arithmetic and logic
+    void ADD(int bits, const OpArg& dst, const OpArg& src);
+    void ADC(int bits, const OpArg& dst, const OpArg& src);
+    void SUB(int bits, const OpArg& dst, const OpArg& src);
+    void SBB(int bits, const OpArg& dst, const OpArg& src);
+    void AND(int bits, const OpArg& dst, const OpArg& src);
+    void OR(int bits, const OpArg& dst, const OpArg& src);
+    void XOR(int bits, const OpArg& dst, const OpArg& src);
+    void CMP(int bits, const OpArg& dst, const OpArg& src);
+    void TEST(int bits, const OpArg& dst, const OpArg& src);
+    void NOT(int bits, const OpArg& dst);
+    void NEG(int bits, const OpArg& dst);
+    void IMUL(int bits, X64Reg dst, const OpArg& src);
+    void BSR(int bits, X64Reg dst, const OpArg& src);
+    void BT(int bits, const OpArg& dst, const OpArg& bit);
+    void SETcc(CCFlags cc, const OpArg& dst);
+    void CMC();
+
+    // Shifts, by an Imm8 or by R(ECX)
+    void ROR(int bits, const OpArg& dst, const OpArg& shift);
+    void RCR(int bits, const OpArg& dst, const OpArg& shift);
+    void SHL(int bits, const OpArg& dst, const OpArg& shift);
+    void SHR(int bits, const OpArg& dst, const OpArg& shift);
+    void SAR(int bits, const OpArg& dst, const OpArg& shift);
+
+private:
+    void Write8(u8 value) { *code++ = value; }
+    void Write16(u16 value);
+    void Write32(u32 value);
+    void Write64(u64 value);
+
+    /**
+     * Writes the prefixes, opcode and ModRM/SIB/displacement bytes of an instruction
+     * @param bits Operand size, selects the 0x66 prefix and REX.W
+     * @param opcode Opcode bytes (up to 3, most significant byte first), excluding prefixes
+     * @param opcode_size Number of opcode bytes
+     * @param reg_field Register or opcode extension placed in ModRM.reg
+     * @param rm Register or memory operand placed in ModRM.rm
+     * @param byte_regs True if register operands are 8-bit, which need REX to access SPL-DIL
+     */
+    void WriteOp(int bits, u32 opcode, int opcode_size, int reg_field, const OpArg& rm,
+        bool byte_regs);
+
+    void WriteALU(int bits, int ext, const OpArg& dst, const OpArg& src);
+    void WriteShift(int bits, int ext, const OpArg& dst, const OpArg& shift);
+
+    u8* code;
+};
+
+} // namespace
@@ -16,7 +16,7 @@ public:
         num_instructions = 0;
     }
 
-    ~ARM_Interface() {
+    virtual ~ARM_Interface() {
     }
 
     /**
@@ -92,6 +92,16 @@ public:
     /// Prepare core for thread reschedule (if needed to correctly handle state)
     virtual void PrepareReschedule() = 0;
 
+    /// Discard any cached translations of guest code (must be called when code is replaced)
+    virtual void ClearInstructionCache() = 0;
+
+    /**
+     * Discards the cached translations of a range of guest memory that was written
+     * @param address Start address of the range
+     * @param size Size of the range in bytes
+     */
+    virtual void InvalidateCodeRange(u32 address, u32 size) = 0;
+
     /// Getter for num_instructions
     u64 GetNumInstructions() {
         return num_instructions;
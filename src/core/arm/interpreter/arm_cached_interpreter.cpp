@@ -0,0 +1,1398 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/math_util.h"
+
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/hle/hle.h"
+#include "core/arm/interpreter/arm_cached_interpreter.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Decoded instruction format
+
+/// Maximum number of instructions translated into a single block
+static const size_t kMaxBlockInstructions = 64;
+
+/// Forms of the second operand of data processing instructions
+enum class Operand2 {
+    Immediate,          ///< Rotated 8-bit immediate
+    ImmediateShift,     ///< Register shifted by an immediate
+    RegisterShift,      ///< Register shifted by the bottom byte of another register
+};
+
+typedef ARM_CachedInterpreter::ShiftType ShiftType;
+typedef ARM_CachedInterpreter::Instruction Instruction;
+typedef ARM_CachedInterpreter::ExecState ExecState;
+typedef ARM_CachedInterpreter::Handler Handler;
+
+enum {
+    FLAG_PRE_INDEX      = ARM_CachedInterpreter::FLAG_PRE_INDEX,
+    FLAG_UP             = ARM_CachedInterpreter::FLAG_UP,
+    FLAG_WRITEBACK      = ARM_CachedInterpreter::FLAG_WRITEBACK,
+    FLAG_ROTATED_IMM    = ARM_CachedInterpreter::FLAG_ROTATED_IMM,
+    FLAG_THUMB          = ARM_CachedInterpreter::FLAG_THUMB,
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+static inline u32 RotateRight(u32 value, u32 amount) {
+    amount &= 31;
+    return amount ? (value >> amount) | (value << (32 - amount)) : value;
+}
+
+static inline u32 AddWithCarry(u32 a, u32 b, u32 carry_in, u32& carry_out, u32& overflow) {
+    const u64 unsigned_sum = (u64)a + b + carry_in;
+    const u32 result = (u32)unsigned_sum;
+    carry_out = (u32)(unsigned_sum >> 32);
+    overflow = ((a ^ result) & (b ^ result)) >> 31;
+    return result;
+}
+
+/// Returns the address of the following instruction
+static inline u32 NextAddress(const Instruction& inst) {
+    return inst.address + ((inst.flags & FLAG_THUMB) ? 2 : 4);
+}
+
+/// Returns the link register value of a call, which has bit 0 set to return to Thumb code
+static inline u32 ReturnAddress(const Instruction& inst) {
+    return NextAddress(inst) | ((inst.flags & FLAG_THUMB) ? 1 : 0);
+}
+
+static inline bool ConditionPassed(const ARMul_State* state, u32 cond) {
+    switch (cond) {
+    case 0x0: return state->ZFlag != 0;                                     // EQ
+    case 0x1: return state->ZFlag == 0;                                     // NE
+    case 0x2: return state->CFlag != 0;                                     // CS
+    case 0x3: return state->CFlag == 0;                                     // CC
+    case 0x4: return state->NFlag != 0;                                     // MI
+    case 0x5: return state->NFlag == 0;                                     // PL
+    case 0x6: return state->VFlag != 0;                                     // VS
+    case 0x7: return state->VFlag == 0;                                     // VC
+    case 0x8: return state->CFlag && !state->ZFlag;                         // HI
+    case 0x9: return !state->CFlag || state->ZFlag;                         // LS
+    case 0xA: return state->NFlag == state->VFlag;                          // GE
+    case 0xB: return state->NFlag != state->VFlag;                          // LT
+    case 0xC: return !state->ZFlag && state->NFlag == state->VFlag;         // GT
+    case 0xD: return state->ZFlag || state->NFlag != state->VFlag;          // LE
+    }
+    return true;                                                            // AL
+}
+
+/**
+ * Applies a shift to a register value, with the semantics of a register specified shift amount
+ * (immediate amounts are normalized to these at decode time)
+ */
+static inline u32 Shift(u32 value, ShiftType type, u32 amount, u32 carry_in, u32& carry_out) {
+    switch (type) {
+    case ShiftType::Lsl:
+        if (amount == 0) {
+            carry_out = carry_in;
+            return value;
+        } else if (amount < 32) {
+            carry_out = (value >> (32 - amount)) & 1;
+            return value << amount;
+        }
+        carry_out = (amount == 32) ? (value & 1) : 0;
+        return 0;
+
+    case ShiftType::Lsr:
+        if (amount == 0) {
+            carry_out = carry_in;
+            return value;
+        } else if (amount < 32) {
+            carry_out = (value >> (amount - 1)) & 1;
+            return value >> amount;
+        }
+        carry_out = (amount == 32) ? (value >> 31) : 0;
+        return 0;
+
+    case ShiftType::Asr:
+        if (amount == 0) {
+            carry_out = carry_in;
+            return value;
+        } else if (amount < 32) {
+            carry_out = (value >> (amount - 1)) & 1;
+            return (u32)((s32)value >> amount);
+        }
+        carry_out = value >> 31;
+        return (u32)((s32)value >> 31);
+
+    case ShiftType::Ror:
+        if (amount == 0) {
+            carry_out = carry_in;
+            return value;
+        }
+        value = RotateRight(value, amount);
+        carry_out = value >> 31;
+        return value;
+
+    case ShiftType::Rrx:
+        carry_out = value & 1;
+        return (carry_in << 31) | (value >> 1);
+    }
+    return value;
+}
+
+/// Evaluates the second operand of a data processing instruction
+template <Operand2 form>
+static inline u32 GetOperand2(const ARMul_State* state, const Instruction& inst, u32& carry) {
+    switch (form) {
+    case Operand2::Immediate:
+        carry = (inst.flags & FLAG_ROTATED_IMM) ? (inst.imm >> 31) : state->CFlag;
+        return inst.imm;
+
+    case Operand2::ImmediateShift:
+        return Shift(state->Reg[inst.rm], inst.shift_type, inst.shift_amount, state->CFlag, carry);
+
+    case Operand2::RegisterShift:
+        return Shift(state->Reg[inst.rm], inst.shift_type, state->Reg[inst.rs] & 0xFF,
+            state->CFlag, carry);
+    }
+    return 0;
+}
+
+/// Ends the block with a jump to a value loaded from memory, switching to Thumb if bit 0 is set
+static inline bool LoadWritePC(ExecState& exec, u32 value) {
+    exec.state->TFlag = value & 1;
+    exec.next_pc = value & ((value & 1) ? ~1U : ~3U);
+    return false;
+}
+
+/// Leaves the block after a guest store discarded cached blocks, see Memory::Write
+static inline bool CheckCodeWrite(ExecState& exec, const Instruction& inst) {
+    if (!exec.cpu->TakeCodeInvalidated())
+        return true;
+
+    // The block being executed may have been discarded, continue with a freshly decoded one
+    exec.next_pc = NextAddress(inst);
+    return false;
+}
+
+/// Executes a single instruction with the SkyEye core and returns the address of the next one
+static u32 StepFallback(ARMul_State* state, u32 pc) {
+    state->Reg[15] = pc;
+    state->NextInstr = RESUME;
+    state->NumInstrsToExecute = 0;
+    ARMul_Emulate32(state);
+
+    // Work out where SkyEye's pipeline will continue
+    if (state->NextInstr >= PRIMEPIPE)
+        return state->Reg[15];
+    return state->pc + (state->TFlag ? 2 : 4);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Instruction handlers
+
+static bool Fallback(ExecState& exec, const Instruction& inst) {
+    exec.next_pc = StepFallback(exec.state, inst.address);
+    ++exec.stepped;
+    return false;
+}
+
+template <u32 opcode, Operand2 form, bool set_flags>
+static bool DataProcessing(ExecState& exec, const Instruction& inst) {
+    ARMul_State* state = exec.state;
+
+    u32 carry = state->CFlag;
+    const u32 operand = GetOperand2<form>(state, inst, carry);
+    const u32 rn = state->Reg[inst.rn];
+    u32 overflow = state->VFlag;
+    u32 result;
+
+    switch (opcode) {
+    case 0x0: result = rn & operand;                                                  break; // AND
+    case 0x1: result = rn ^ operand;                                                  break; // EOR
+    case 0x2: result = AddWithCarry(rn, ~operand, 1, carry, overflow);                break; // SUB
+    case 0x3: result = AddWithCarry(~rn, operand, 1, carry, overflow);                break; // RSB
+    case 0x4: result = AddWithCarry(rn, operand, 0, carry, overflow);                 break; // ADD
+    case 0x5: result = AddWithCarry(rn, operand, state->CFlag, carry, overflow);      break; // ADC
+    case 0x6: result = AddWithCarry(rn, ~operand, state->CFlag, carry, overflow);     break; // SBC
+    case 0x7: result = AddWithCarry(~rn, operand, state->CFlag, carry, overflow);     break; // RSC
+    case 0x8: result = rn & operand;                                                  break; // TST
+    case 0x9: result = rn ^ operand;                                                  break; // TEQ
+    case 0xA: result = AddWithCarry(rn, ~operand, 1, carry, overflow);                break; // CMP
+    case 0xB: result = AddWithCarry(rn, operand, 0, carry, overflow);                 break; // CMN
+    case 0xC: result = rn | operand;                                                  break; // ORR
+    case 0xD: result = operand;                                                       break; // MOV
+    case 0xE: result = rn & ~operand;                                                 break; // BIC
+    case 0xF: result = ~operand;                                                      break; // MVN
+    }
+
+    if (set_flags) {
+        state->NFlag = result >> 31;
+        state->ZFlag = (result == 0);
+        state->CFlag = carry;
+        state->VFlag = overflow;
+    }
+
+    // Compare instructions only update the flags
+    if ((opcode & 0xC) == 0x8)
+        return true;
+
+    if (inst.rd == 15) {
+        exec.next_pc = result & ~3U;
+        return false;
+    }
+    state->Reg[inst.rd] = result;
+    return true;
+}
+
+template <bool accumulate, bool set_flags>
+static bool Multiply(ExecState& exec, const Instruction& inst) {
+    ARMul_State* state = exec.state;
+
+    u32 result = state->Reg[inst.rm] * state->Reg[inst.rs];
+    if (accumulate)
+        result += state->Reg[inst.rn];
+    state->Reg[inst.rd] = result;
+
+    if (set_flags) {
+        state->NFlag = result >> 31;
+        state->ZFlag = (result == 0);
+    }
+    return true;
+}
+
+template <bool is_signed, bool accumulate, bool set_flags>
+static bool MultiplyLong(ExecState& exec, const Instruction& inst) {
+    ARMul_State* state = exec.state;
+
+    // rd holds RdHi and rn holds RdLo
+    u64 result;
+    if (is_signed)
+        result = (u64)((s64)(s32)state->Reg[inst.rm] * (s64)(s32)state->Reg[inst.rs]);
+    else
+        result = (u64)state->Reg[inst.rm] * state->Reg[inst.rs];
+    if (accumulate)
+        result += ((u64)state->Reg[inst.rd] << 32) | state->Reg[inst.rn];
+
+    state->Reg[inst.rn] = (u32)result;
+    state->Reg[inst.rd] = (u32)(result >> 32);
+
+    if (set_flags) {
+        state->NFlag = (u32)(result >> 63);
+        state->ZFlag = (result == 0);
+    }
+    return true;
+}
+
+template <bool load, bool byte, bool register_offset>
+static bool SingleDataTransfer(ExecState& exec, const Instruction& inst) {
+    ARMul_State* state = exec.state;
+
+    u32 offset = inst.imm;
+    if (register_offset) {
+        u32 carry;
+        offset = Shift(state->Reg[inst.rm], inst.shift_type, inst.shift_amount, state->CFlag,
+            carry);
+    }
+
+    const u32 base = state->Reg[inst.rn];
+    const u32 offset_address = (inst.flags & FLAG_UP) ? base + offset : base - offset;
+    const u32 address = (inst.flags & FLAG_PRE_INDEX) ? offset_address : base;
+    if (inst.flags & FLAG_WRITEBACK)
+        state->Reg[inst.rn] = offset_address;
+
+    if (load) {
+        u32 value;
+        if (byte) {
+            value = Memory::Read8(address);
+        } else {
+            // Unaligned words are rotated the same way the SkyEye core does
+            value = RotateRight(Memory::Read32(address), (address & 3) * 8);
+        }
+        if (inst.rd == 15)
+            return LoadWritePC(exec, value);
+        state->Reg[inst.rd] = value;
+        return true;
+    }
+
+    if (byte) {
+        Memory::Write8(address, (u8)state->Reg[inst.rd]);
+        return CheckCodeWrite(exec, inst);
+    }
+    Memory::Write32(address, state->Reg[inst.rd]);
+    return CheckCodeWrite(exec, inst);
+}
+
+/// Halfword and signed byte transfers (STRH, LDRH, LDRSB, LDRSH)
+template <bool load, bool is_signed, bool halfword, bool register_offset>
+static bool ExtraDataTransfer(ExecState& exec, const Instruction& inst) {
+    ARMul_State* state = exec.state;
+
+    const u32 offset = register_offset ? state->Reg[inst.rm] : inst.imm;
+    const u32 base = state->Reg[inst.rn];
+    const u32 offset_address = (inst.flags & FLAG_UP) ? base + offset : base - offset;
+    const u32 address = (inst.flags & FLAG_PRE_INDEX) ? offset_address : base;
+    if (inst.flags & FLAG_WRITEBACK)
+        state->Reg[inst.rn] = offset_address;
+
+    if (load) {
+        u32 value;
+        if (halfword) {
+            value = Memory::Read16(address);
+            if (is_signed)
+                value = (u32)(s32)(s16)value;
+        } else {
+            value = (u32)(s32)(s8)Memory::Read8(address);
+        }
+        state->Reg[inst.rd] = value;
+        return true;
+    }
+
+    Memory::Write16(address, (u16)state->Reg[inst.rd]);
+    return CheckCodeWrite(exec, inst);
+}
+
+/// LDM/STM, inst.imm holds the register list and inst.shift_amount the number of registers
+template <bool load>
+static bool BlockDataTransfer(ExecState& exec, const Instruction& inst) {
+    ARMul_State* state = exec.state;
+
+    const u32 base = state->Reg[inst.rn];
+    const u32 size = inst.shift_amount * 4;
+
+    u32 address;
+    if (inst.flags & FLAG_UP)
+        address = (inst.flags & FLAG_PRE_INDEX) ? base + 4 : base;
+    else
+        address = (inst.flags & FLAG_PRE_INDEX) ? base - size : base - size + 4;
+    address &= ~3U;
+
+    if (load) {
+        if (inst.flags & FLAG_WRITEBACK)
+            state->Reg[inst.rn] = (inst.flags & FLAG_UP) ? base + size : base - size;
+
+        for (int reg = 0; reg < 15; ++reg) {
+            if (inst.imm & (1 << reg)) {
+                state->Reg[reg] = Memory::Read32(address);
+                address += 4;
+            }
+        }
+        if (inst.imm & (1 << 15))
+            return LoadWritePC(exec, Memory::Read32(address));
+        return true;
+    }
+
+    for (int reg = 0; reg < 16; ++reg) {
+        if (inst.imm & (1 << reg)) {
+            Memory::Write32(address, state->Reg[reg]);
+            address += 4;
+        }
+    }
+    if (inst.flags & FLAG_WRITEBACK)
+        state->Reg[inst.rn] = (inst.flags & FLAG_UP) ? base + size : base - size;
+    return CheckCodeWrite(exec, inst);
+}
+
+template <bool link>
+static bool Branch(ExecState& exec, const Instruction& inst) {
+    if (link)
+        exec.state->Reg[14] = ReturnAddress(inst);
+    exec.next_pc = inst.imm;
+    return false;
+}
+
+/// BLX (immediate), which always switches between ARM and Thumb code
+static bool BranchLinkExchange(ExecState& exec, const Instruction& inst) {
+    exec.state->Reg[14] = ReturnAddress(inst);
+    exec.state->TFlag = (inst.flags & FLAG_THUMB) ? 0 : 1;
+    exec.next_pc = inst.imm;
+    return false;
+}
+
+template <bool link>
+static bool BranchExchange(ExecState& exec, const Instruction& inst) {
+    const u32 target = exec.state->Reg[inst.rm];
+    if (link)
+        exec.state->Reg[14] = ReturnAddress(inst);
+
+    exec.state->TFlag = target & 1;
+    exec.next_pc = target & ~1U;
+    return false;
+}
+
+static bool CountLeadingZeros(ExecState& exec, const Instruction& inst) {
+    const u32 value = exec.state->Reg[inst.rm];
+    exec.state->Reg[inst.rd] = value ? 31 - (u32)Log2(value) : 32;
+    return true;
+}
+
+/// SXTB/SXTH/UXTB/UXTH and their accumulating forms, inst.shift_amount holds the rotation
+template <bool is_signed, bool halfword>
+static bool Extend(ExecState& exec, const Instruction& inst) {
+    ARMul_State* state = exec.state;
+
+    const u32 value = RotateRight(state->Reg[inst.rm], inst.shift_amount);
+    u32 result;
+    if (halfword)
+        result = is_signed ? (u32)(s32)(s16)value : (value & 0xFFFF);
+    else
+        result = is_signed ? (u32)(s32)(s8)value : (value & 0xFF);
+
+    if (inst.rn != 15)
+        result += state->Reg[inst.rn];
+    state->Reg[inst.rd] = result;
+    return true;
+}
+
+static bool ByteReverse(ExecState& exec, const Instruction& inst) {
+    exec.state->Reg[inst.rd] = bswap32(exec.state->Reg[inst.rm]);
+    return true;
+}
+
+static bool ByteReverseHalfwords(ExecState& exec, const Instruction& inst) {
+    const u32 value = exec.state->Reg[inst.rm];
+    exec.state->Reg[inst.rd] = ((value & 0x00FF00FF) << 8) | ((value >> 8) & 0x00FF00FF);
+    return true;
+}
+
+static bool ByteReverseSignedHalfword(ExecState& exec, const Instruction& inst) {
+    const u32 value = exec.state->Reg[inst.rm];
+    exec.state->Reg[inst.rd] = (u32)(s32)(s16)(((value & 0xFF) << 8) | ((value >> 8) & 0xFF));
+    return true;
+}
+
+static bool SupervisorCall(ExecState& exec, const Instruction& inst) {
+    // Some SVCs log or inspect the PC of the caller
+    exec.state->pc = inst.address;
+    HLE::CallSVC(inst.raw);
+
+    // Return to the dispatcher, the SVC may have requested a reschedule
+    exec.next_pc = NextAddress(inst);
+    return false;
+}
+
+/// MCR p15 cache maintenance, which has to drop cached blocks when the instruction cache is hit
+static bool CacheMaintenance(ExecState& exec, const Instruction& inst) {
+    exec.next_pc = StepFallback(exec.state, inst.address);
+    ++exec.stepped;
+    exec.cpu->ClearInstructionCache();
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Decoder
+
+#define DATA_PROCESSING_HANDLERS(form, set_flags) { \
+    DataProcessing<0x0, form, set_flags>, DataProcessing<0x1, form, set_flags>,   \
+    DataProcessing<0x2, form, set_flags>, DataProcessing<0x3, form, set_flags>,   \
+    DataProcessing<0x4, form, set_flags>, DataProcessing<0x5, form, set_flags>,   \
+    DataProcessing<0x6, form, set_flags>, DataProcessing<0x7, form, set_flags>,   \
+    DataProcessing<0x8, form, set_flags>, DataProcessing<0x9, form, set_flags>,   \
+    DataProcessing<0xA, form, set_flags>, DataProcessing<0xB, form, set_flags>,   \
+    DataProcessing<0xC, form, set_flags>, DataProcessing<0xD, form, set_flags>,   \
+    DataProcessing<0xE, form, set_flags>, DataProcessing<0xF, form, set_flags>,   \
+}
+
+/// Data processing handlers, indexed by operand form, S bit and opcode
+static const Handler g_data_processing_handlers[3][2][16] = {
+    {
+        DATA_PROCESSING_HANDLERS(Operand2::Immediate, false),
+        DATA_PROCESSING_HANDLERS(Operand2::Immediate, true),
+    }, {
+        DATA_PROCESSING_HANDLERS(Operand2::ImmediateShift, false),
+        DATA_PROCESSING_HANDLERS(Operand2::ImmediateShift, true),
+    }, {
+        DATA_PROCESSING_HANDLERS(Operand2::RegisterShift, false),
+        DATA_PROCESSING_HANDLERS(Operand2::RegisterShift, true),
+    },
+};
+
+#undef DATA_PROCESSING_HANDLERS
+
+/// Single data transfer handlers, indexed by register offset, B bit and L bit
+static const Handler g_single_data_transfer_handlers[2][2][2] = {
+    {
+        { SingleDataTransfer<false, false, false>, SingleDataTransfer<true, false, false> },
+        { SingleDataTransfer<false, true, false>,  SingleDataTransfer<true, true, false> },
+    }, {
+        { SingleDataTransfer<false, false, true>,  SingleDataTransfer<true, false, true> },
+        { SingleDataTransfer<false, true, true>,   SingleDataTransfer<true, true, true> },
+    },
+};
+
+/// Marks an instruction to be executed by the SkyEye core, which also checks its condition
+static bool DecodeFallback(Instruction& inst) {
+    inst.handler = Fallback;
+    inst.cond = 0xE;
+    return true;
+}
+
+/// Decodes the shifted register operand of data processing and load/store instructions
+static void DecodeImmediateShift(u32 raw, Instruction& inst) {
+    inst.shift_type = (ShiftType)((raw >> 5) & 3);
+    inst.shift_amount = (raw >> 7) & 0x1F;
+
+    // LSR #0 and ASR #0 encode shifts by 32, ROR #0 encodes RRX
+    if (inst.shift_amount == 0) {
+        if (inst.shift_type == ShiftType::Lsr || inst.shift_type == ShiftType::Asr)
+            inst.shift_amount = 32;
+        else if (inst.shift_type == ShiftType::Ror)
+            inst.shift_type = ShiftType::Rrx;
+    }
+}
+
+static bool DecodeDataProcessing(u32 raw, Instruction& inst) {
+    const u32 opcode = (raw >> 21) & 0xF;
+    const bool set_flags = (raw >> 20) & 1;
+    const bool is_compare = (opcode & 0xC) == 0x8;
+
+    Operand2 form;
+    if (raw & (1 << 25)) {
+        const u32 rotation = ((raw >> 8) & 0xF) * 2;
+        form = Operand2::Immediate;
+        inst.imm = RotateRight(raw & 0xFF, rotation);
+        if (rotation != 0)
+            inst.flags |= FLAG_ROTATED_IMM;
+    } else if (raw & (1 << 4)) {
+        // Reading the PC in register shifted forms is unpredictable
+        if (inst.rd == 15 || inst.rn == 15 || inst.rm == 15 || inst.rs == 15)
+            return DecodeFallback(inst);
+        form = Operand2::RegisterShift;
+        inst.shift_type = (ShiftType)((raw >> 5) & 3);
+    } else {
+        form = Operand2::ImmediateShift;
+        DecodeImmediateShift(raw, inst);
+    }
+
+    // Flag setting writes to the PC also restore the CPSR from the SPSR
+    if (inst.rd == 15 && (set_flags || is_compare))
+        return DecodeFallback(inst);
+
+    inst.handler = g_data_processing_handlers[(int)form][set_flags][opcode];
+    return !is_compare && inst.rd == 15;
+}
+
+static bool DecodeMultiply(u32 raw, Instruction& inst) {
+    const bool accumulate = (raw >> 21) & 1;
+    const bool set_flags = (raw >> 20) & 1;
+
+    inst.rd = (raw >> 16) & 0xF;
+    inst.rn = (raw >> 12) & 0xF;
+
+    if ((raw & 0x0FC000F0) == 0x00000090) {
+        // MUL, MLA
+        if (inst.rd == 15 || inst.rm == 15 || inst.rs == 15 || (accumulate && inst.rn == 15))
+            return DecodeFallback(inst);
+
+        static const Handler handlers[2][2] = {
+            { Multiply<false, false>, Multiply<false, true> },
+            { Multiply<true, false>,  Multiply<true, true> },
+        };
+        inst.handler = handlers[accumulate][set_flags];
+        return false;
+    }
+
+    if ((raw & 0x0F8000F0) == 0x00800090) {
+        // UMULL, UMLAL, SMULL, SMLAL
+        const bool is_signed = (raw >> 22) & 1;
+        if (inst.rd == 15 || inst.rn == 15 || inst.rm == 15 || inst.rs == 15 || inst.rd == inst.rn)
+            return DecodeFallback(inst);
+
+        static const Handler handlers[2][2][2] = {
+            {
+                { MultiplyLong<false, false, false>, MultiplyLong<false, false, true> },
+                { MultiplyLong<false, true, false>,  MultiplyLong<false, true, true> },
+            }, {
+                { MultiplyLong<true, false, false>,  MultiplyLong<true, false, true> },
+                { MultiplyLong<true, true, false>,   MultiplyLong<true, true, true> },
+            },
+        };
+        inst.handler = handlers[is_signed][accumulate][set_flags];
+        return false;
+    }
+
+    // SWP, UMAAL, LDREX/STREX
+    return DecodeFallback(inst);
+}
+
+/// Decodes the P, U and W bits shared by all load/store instructions
+static bool DecodeAddressingMode(u32 raw, Instruction& inst) {
+    const bool pre_index = (raw >> 24) & 1;
+    const bool writeback = (raw >> 21) & 1;
+
+    // Post-indexed with W set are the user mode (LDRT/STRT) variants
+    if (!pre_index && writeback)
+        return false;
+
+    if (pre_index)
+        inst.flags |= FLAG_PRE_INDEX;
+    if ((raw >> 23) & 1)
+        inst.flags |= FLAG_UP;
+    if (!pre_index || writeback)
+        inst.flags |= FLAG_WRITEBACK;
+
+    // Base writeback to the PC or to the transfer register is unpredictable
+    if ((inst.flags & FLAG_WRITEBACK) && (inst.rn == 15 || inst.rn == inst.rd))
+        return false;
+    return true;
+}
+
+static bool DecodeExtraDataTransfer(u32 raw, Instruction& inst) {
+    const bool load = (raw >> 20) & 1;
+    const u32 type = (raw >> 5) & 3;
+    const bool immediate = (raw >> 22) & 1;
+
+    // LDRD/STRD are left to the SkyEye core
+    if ((!load && type != 1) || inst.rd == 15 || (!immediate && inst.rm == 15))
+        return DecodeFallback(inst);
+    if (!DecodeAddressingMode(raw, inst))
+        return DecodeFallback(inst);
+
+    if (immediate)
+        inst.imm = ((raw >> 4) & 0xF0) | (raw & 0xF);
+
+    if (!load) {
+        inst.handler = immediate ? ExtraDataTransfer<false, false, true, false> :
+            ExtraDataTransfer<false, false, true, true>;
+        return false;
+    }
+
+    // Loads, indexed by type (H, SB, SH) and register offset
+    static const Handler handlers[3][2] = {
+        { ExtraDataTransfer<true, false, true, false>, ExtraDataTransfer<true, false, true, true> },
+        { ExtraDataTransfer<true, true, false, false>, ExtraDataTransfer<true, true, false, true> },
+        { ExtraDataTransfer<true, true, true, false>,  ExtraDataTransfer<true, true, true, true> },
+    };
+    inst.handler = handlers[type - 1][!immediate];
+    return false;
+}
+
+static bool DecodeSingleDataTransfer(u32 raw, Instruction& inst) {
+    const bool register_offset = (raw >> 25) & 1;
+    const bool byte = (raw >> 22) & 1;
+    const bool load = (raw >> 20) & 1;
+
+    if ((register_offset && inst.rm == 15) || (byte && inst.rd == 15))
+        return DecodeFallback(inst);
+    if (!DecodeAddressingMode(raw, inst))
+        return DecodeFallback(inst);
+
+    if (register_offset)
+        DecodeImmediateShift(raw, inst);
+    else
+        inst.imm = raw & 0xFFF;
+
+    inst.handler = g_single_data_transfer_handlers[register_offset][byte][load];
+    return load && inst.rd == 15;
+}
+
+static bool DecodeBlockDataTransfer(u32 raw, Instruction& inst) {
+    const bool load = (raw >> 20) & 1;
+    const u32 register_list = raw & 0xFFFF;
+
+    // User bank transfers and exception returns (S bit) are left to the SkyEye core
+    if ((raw & (1 << 22)) || inst.rn == 15 || register_list == 0)
+        return DecodeFallback(inst);
+
+    inst.imm = register_list;
+    inst.shift_amount = 0;
+    for (int reg = 0; reg < 16; ++reg) {
+        if (register_list & (1 << reg))
+            inst.shift_amount++;
+    }
+
+    if ((raw >> 24) & 1)
+        inst.flags |= FLAG_PRE_INDEX;
+    if ((raw >> 23) & 1)
+        inst.flags |= FLAG_UP;
+    if ((raw >> 21) & 1)
+        inst.flags |= FLAG_WRITEBACK;
+
+    inst.handler = load ? BlockDataTransfer<true> : BlockDataTransfer<false>;
+    return load && (register_list & (1 << 15));
+}
+
+static bool DecodeMedia(u32 raw, Instruction& inst) {
+    if (inst.rd == 15 || inst.rm == 15)
+        return DecodeFallback(inst);
+
+    // SXTB, SXTH, UXTB, UXTH and the accumulating SXTAB, SXTAH, UXTAB, UXTAH
+    if ((raw & 0x0F8003F0) == 0x06800070 && ((raw >> 20) & 3) >= 2) {
+        const bool is_signed = ((raw >> 22) & 1) == 0;
+        const bool halfword = (raw >> 20) & 1;
+
+        static const Handler handlers[2][2] = {
+            { Extend<false, false>, Extend<false, true> },
+            { Extend<true, false>,  Extend<true, true> },
+        };
+        inst.shift_amount = ((raw >> 10) & 3) * 8;
+        inst.handler = handlers[is_signed][halfword];
+        return false;
+    }
+
+    if ((raw & 0x0FFF0FF0) == 0x06BF0F30) {
+        inst.handler = ByteReverse;
+        return false;
+    }
+    if ((raw & 0x0FFF0FF0) == 0x06BF0FB0) {
+        inst.handler = ByteReverseHalfwords;
+        return false;
+    }
+    if ((raw & 0x0FFF0FF0) == 0x06FF0FB0) {
+        inst.handler = ByteReverseSignedHalfword;
+        return false;
+    }
+    return DecodeFallback(inst);
+}
+
+static bool DecodeMiscellaneous(u32 raw, Instruction& inst) {
+    if ((raw & 0x0FFFFFD0) == 0x012FFF10) {
+        // BX, BLX (register)
+        const bool link = (raw >> 5) & 1;
+        if (inst.rm == 15)
+            return DecodeFallback(inst);
+        inst.handler = link ? BranchExchange<true> : BranchExchange<false>;
+        return true;
+    }
+
+    if ((raw & 0x0FFF0FF0) == 0x016F0F10) {
+        // CLZ
+        if (inst.rd == 15 || inst.rm == 15)
+            return DecodeFallback(inst);
+        inst.handler = CountLeadingZeros;
+        return false;
+    }
+
+    // MRS, MSR, saturating arithmetic, BKPT, ...
+    return DecodeFallback(inst);
+}
+
+/**
+ * Decodes an ARM instruction
+ * @param raw Instruction word
+ * @param address Guest address of the instruction
+ * @param inst Receives the decoded instruction
+ * @return True if the instruction ends the basic block
+ */
+static bool DecodeInstruction(u32 raw, u32 address, Instruction& inst) {
+    inst.address = address;
+    inst.raw = raw;
+    inst.imm = 0;
+    inst.cond = raw >> 28;
+    inst.rd = (raw >> 12) & 0xF;
+    inst.rn = (raw >> 16) & 0xF;
+    inst.rm = raw & 0xF;
+    inst.rs = (raw >> 8) & 0xF;
+    inst.shift_type = ShiftType::Lsl;
+    inst.shift_amount = 0;
+    inst.flags = 0;
+
+    // Unconditional instructions: BLX (immediate) to a Thumb target at PC + 8 + offset, with bit 1
+    // taken from the H bit. CPS, PLD, ... are left to SkyEye.
+    if (inst.cond == 0xF) {
+        if ((raw & 0xFE000000) != 0xFA000000)
+            return DecodeFallback(inst);
+        const s32 offset = (s32)(raw << 8) >> 6;
+        inst.imm = address + 8 + offset + ((raw >> 23) & 2);
+        inst.handler = BranchLinkExchange;
+        inst.cond = 0xE;
+        return true;
+    }
+
+    switch ((raw >> 25) & 7) {
+    case 0:
+        if ((raw & 0x90) == 0x90) {
+            if ((raw & 0x60) == 0)
+                return DecodeMultiply(raw, inst);
+            return DecodeExtraDataTransfer(raw, inst);
+        }
+        if ((raw & 0x01900000) == 0x01000000)
+            return DecodeMiscellaneous(raw, inst);
+        return DecodeDataProcessing(raw, inst);
+
+    case 1:
+        // MSR (immediate) and hints
+        if ((raw & 0x01900000) == 0x01000000)
+            return DecodeFallback(inst);
+        return DecodeDataProcessing(raw, inst);
+
+    case 2:
+        return DecodeSingleDataTransfer(raw, inst);
+
+    case 3:
+        if (raw & (1 << 4))
+            return DecodeMedia(raw, inst);
+        return DecodeSingleDataTransfer(raw, inst);
+
+    case 4:
+        return DecodeBlockDataTransfer(raw, inst);
+
+    case 5:
+    {
+        // Branch target is PC + 8 + sign extended immediate
+        const s32 offset = (s32)(raw << 8) >> 6;
+        inst.imm = address + 8 + offset;
+        inst.handler = (raw & (1 << 24)) ? Branch<true> : Branch<false>;
+        return true;
+    }
+
+    case 7:
+        if (raw & (1 << 24)) {
+            inst.handler = SupervisorCall;
+            return true;
+        }
+
+        // MCR p15, 0, Rd, c7, c5/c7, x invalidates the instruction cache
+        if ((raw & 0x0F100F10) == 0x0E000F10 && ((raw >> 16) & 0xF) == 7 &&
+            ((raw & 0xF) == 5 || (raw & 0xF) == 7)) {
+            inst.handler = CacheMaintenance;
+            inst.cond = 0xE;
+            return true;
+        }
+        return DecodeFallback(inst);
+    }
+
+    // Coprocessor loads and stores
+    return DecodeFallback(inst);
+}
+
+/**
+ * Decodes a Thumb instruction as the ARM instruction doing the same, which then shares the ARM
+ * handlers. Values the ARM form can't encode, branch targets and PC relative addresses, are patched
+ * into the decoded instruction.
+ * @param raw Instruction halfword
+ * @param previous Previous halfword of the block (the first half of a BL), or 0 at its start
+ * @param address Guest address of the instruction
+ * @param inst Receives the decoded instruction
+ * @return True if the instruction ends the basic block
+ */
+static bool DecodeThumbInstruction(u16 raw, u16 previous, u32 address, Instruction& inst) {
+    // Low registers at bits 0, 3 and 6, and at bit 8 for instructions with an 8-bit immediate
+    const u32 reg0 = raw & 7;
+    const u32 reg3 = (raw >> 3) & 7;
+    const u32 reg6 = (raw >> 6) & 7;
+    const u32 reg8 = (raw >> 8) & 7;
+    const u32 imm8 = raw & 0xFF;
+    const bool load = (raw >> 11) & 1;
+
+    // Instructions without an ARM equivalent are put in the unconditional ARM space, which is left
+    // to the SkyEye core
+    u32 arm = 0xF0000000 | raw;
+    bool patch_imm = false;
+    u32 imm = 0;
+
+    switch (raw >> 11) {
+    case 0x00: case 0x01: case 0x02:
+        // LSL, LSR, ASR (immediate): MOVS Rd, Rm, <shift> #imm5
+        arm = 0xE1B00000 | (reg0 << 12) | (((raw >> 6) & 0x1F) << 7) | ((raw >> 11) << 5) | reg3;
+        break;
+
+    case 0x03:
+    {
+        // ADD, SUB (register or 3-bit immediate): ADDS/SUBS Rd, Rn, Rm/#imm3
+        const u32 opcode = (raw & (1 << 9)) ? 0x00400000 : 0x00800000;
+        const u32 immediate = (raw & (1 << 10)) ? 0x02000000 : 0;
+        arm = 0xE0100000 | immediate | opcode | (reg3 << 16) | (reg0 << 12) | reg6;
+        break;
+    }
+
+    case 0x04: arm = 0xE3B00000 | (reg8 << 12) | imm8;                  break; // MOVS Rd, #imm8
+    case 0x05: arm = 0xE3500000 | (reg8 << 16) | imm8;                  break; // CMP Rn, #imm8
+    case 0x06: arm = 0xE2900000 | (reg8 << 16) | (reg8 << 12) | imm8;   break; // ADDS Rd, Rd, #imm8
+    case 0x07: arm = 0xE2500000 | (reg8 << 16) | (reg8 << 12) | imm8;   break; // SUBS Rd, Rd, #imm8
+
+    case 0x08:
+        if (!(raw & (1 << 10))) {
+            // Data processing, Rd is also the first operand and Rm the second. Shifts by a register
+            // are MOVS Rd, Rd, <shift> Rm, NEG is RSBS Rd, Rm, #0 and MUL is MULS Rd, Rm, Rd.
+            const u32 rd = reg0;
+            const u32 rm = reg3;
+            const u32 two_operand = (rd << 16) | (rd << 12) | rm;
+            switch ((raw >> 6) & 0xF) {
+            case 0x0: arm = 0xE0100000 | two_operand;                   break; // ANDS
+            case 0x1: arm = 0xE0300000 | two_operand;                   break; // EORS
+            case 0x2: arm = 0xE1B00010 | (rd << 12) | (rm << 8) | rd;   break; // LSL (register)
+            case 0x3: arm = 0xE1B00030 | (rd << 12) | (rm << 8) | rd;   break; // LSR (register)
+            case 0x4: arm = 0xE1B00050 | (rd << 12) | (rm << 8) | rd;   break; // ASR (register)
+            case 0x5: arm = 0xE0B00000 | two_operand;                   break; // ADCS
+            case 0x6: arm = 0xE0D00000 | two_operand;                   break; // SBCS
+            case 0x7: arm = 0xE1B00070 | (rd << 12) | (rm << 8) | rd;   break; // ROR (register)
+            case 0x8: arm = 0xE1100000 | (rd << 16) | rm;               break; // TST
+            case 0x9: arm = 0xE2700000 | (rm << 16) | (rd << 12);       break; // NEG (RSBS #0)
+            case 0xA: arm = 0xE1500000 | (rd << 16) | rm;               break; // CMP
+            case 0xB: arm = 0xE1700000 | (rd << 16) | rm;               break; // CMN
+            case 0xC: arm = 0xE1900000 | two_operand;                   break; // ORRS
+            case 0xD: arm = 0xE0100090 | (rd << 16) | (rd << 8) | rm;   break; // MULS Rd, Rm, Rd
+            case 0xE: arm = 0xE1D00000 | two_operand;                   break; // BICS
+            case 0xF: arm = 0xE1F00000 | (rd << 12) | rm;               break; // MVNS
+            }
+            break;
+        }
+
+        {
+            // High register operations and BX/BLX, which don't set flags (except CMP)
+            const u32 rd = reg0 | ((raw >> 4) & 8);
+            const u32 rm = (raw >> 3) & 0xF;
+            switch ((raw >> 8) & 3) {
+            case 0:
+                // Writes to the PC stay in Thumb code, unlike with the ARM instruction
+                if (rd != 15)
+                    arm = 0xE0800000 | (rd << 16) | (rd << 12) | rm;                // ADD
+                break;
+            case 1:
+                arm = 0xE1500000 | (rd << 16) | rm;                                 // CMP
+                break;
+            case 2:
+                if (rd != 15)
+                    arm = 0xE1A00000 | (rd << 12) | rm;                             // MOV
+                break;
+            case 3:
+                arm = 0xE12FFF10 | ((raw & (1 << 7)) ? 0x20 : 0) | rm;              // BX, BLX
+                break;
+            }
+        }
+        break;
+
+    case 0x09:
+    {
+        // LDR Rd, [PC, #imm8 * 4], where the PC is word aligned: the ARM form reads it as the
+        // address plus 4, so the offset makes up for a halfword aligned instruction
+        const u32 offset = imm8 * 4;
+        const u32 misalignment = address & 2;
+        if (offset >= misalignment)
+            arm = 0xE59F0000 | (reg8 << 12) | (offset - misalignment);
+        else
+            arm = 0xE51F0000 | (reg8 << 12) | misalignment;
+        break;
+    }
+
+    case 0x0A: case 0x0B:
+    {
+        // Loads and stores with a register offset
+        static const u32 opcodes[8] = {
+            0xE7800000, 0xE18000B0, 0xE7C00000, 0xE19000D0, // STR, STRH, STRB, LDRSB
+            0xE7900000, 0xE19000B0, 0xE7D00000, 0xE19000F0, // LDR, LDRH, LDRB, LDRSH
+        };
+        arm = opcodes[(raw >> 9) & 7] | (reg3 << 16) | (reg0 << 12) | reg6;
+        break;
+    }
+
+    case 0x0C: case 0x0D: case 0x0E: case 0x0F:
+    {
+        // LDR, STR, LDRB, STRB with an immediate offset, scaled for words
+        const bool byte = (raw >> 12) & 1;
+        const u32 offset = ((raw >> 6) & 0x1F) << (byte ? 0 : 2);
+        arm = 0xE5800000 | (byte ? 1 << 22 : 0) | (load ? 1 << 20 : 0) | (reg3 << 16) |
+            (reg0 << 12) | offset;
+        break;
+    }
+
+    case 0x10: case 0x11:
+    {
+        // LDRH, STRH with an immediate offset
+        const u32 offset = ((raw >> 6) & 0x1F) * 2;
+        arm = 0xE1C000B0 | (load ? 1 << 20 : 0) | (reg3 << 16) | (reg0 << 12) |
+            ((offset & 0xF0) << 4) | (offset & 0xF);
+        break;
+    }
+
+    case 0x12: case 0x13:
+        // LDR, STR Rd, [SP, #imm8 * 4]
+        arm = 0xE58D0000 | (load ? 1 << 20 : 0) | (reg8 << 12) | (imm8 * 4);
+        break;
+
+    case 0x14:
+        // ADR: the address is computed here, from the word aligned PC
+        arm = 0xE3A00000 | (reg8 << 12);
+        patch_imm = true;
+        imm = ((address + 4) & ~3U) + imm8 * 4;
+        break;
+
+    case 0x15:
+        // ADD Rd, SP, #imm8 * 4
+        arm = 0xE28D0F00 | (reg8 << 12) | imm8;
+        break;
+
+    case 0x16: case 0x17:
+        if ((raw & 0x0F00) == 0x0000) {
+            // ADD, SUB SP, SP, #imm7 * 4
+            arm = ((raw & (1 << 7)) ? 0xE24DDF00 : 0xE28DDF00) | (raw & 0x7F);
+        } else if ((raw & 0x0F00) == 0x0200) {
+            // SXTH, SXTB, UXTH, UXTB
+            static const u32 opcodes[4] = { 0xE6BF0070, 0xE6AF0070, 0xE6FF0070, 0xE6EF0070 };
+            arm = opcodes[(raw >> 6) & 3] | (reg0 << 12) | reg3;
+        } else if ((raw & 0x0600) == 0x0400) {
+            // PUSH {list, LR}: STMDB SP!, POP {list, PC}: LDMIA SP!
+            if (load)
+                arm = 0xE8BD0000 | imm8 | ((raw & (1 << 8)) << 7);
+            else
+                arm = 0xE92D0000 | imm8 | ((raw & (1 << 8)) << 6);
+        } else if ((raw & 0x0FC0) == 0x0A00) {
+            arm = 0xE6BF0F30 | (reg0 << 12) | reg3;                                 // REV
+        } else if ((raw & 0x0FC0) == 0x0A40) {
+            arm = 0xE6BF0FB0 | (reg0 << 12) | reg3;                                 // REV16
+        } else if ((raw & 0x0FC0) == 0x0AC0) {
+            arm = 0xE6FF0FB0 | (reg0 << 12) | reg3;                                 // REVSH
+        }
+        break;
+
+    case 0x18: case 0x19:
+        // LDMIA, STMIA Rn!, {list}, loads don't write back a base that is in the list
+        if (load)
+            arm = 0xE8900000 | (reg8 << 16) | imm8 | ((imm8 & (1 << reg8)) ? 0 : 1 << 21);
+        else
+            arm = 0xE8A00000 | (reg8 << 16) | imm8;
+        break;
+
+    case 0x1A: case 0x1B:
+    {
+        const u32 cond = (raw >> 8) & 0xF;
+        if (cond == 0xF) {
+            arm = 0xEF000000 | imm8;                                                // SVC
+        } else if (cond != 0xE) {
+            arm = (cond << 28) | 0x0A000000;                                        // B<cond>
+            patch_imm = true;
+            imm = address + 4 + ((s32)(s8)imm8 << 1);
+        }
+        break;
+    }
+
+    case 0x1C:
+        arm = 0xEA000000;                                                           // B
+        patch_imm = true;
+        imm = address + 4 + ((s32)((u32)raw << 21) >> 20);
+        break;
+
+    case 0x1D:
+        // Second half of BLX (immediate), a call to ARM code when the first half is in the same
+        // block. Otherwise SkyEye steps it, like the second half of BL.
+        if ((previous >> 11) == 0x1E && !(raw & 1)) {
+            arm = 0xFA000000;
+            patch_imm = true;
+            imm = (address + 2 + ((s32)((u32)previous << 21) >> 9) + ((raw & 0x7FF) << 1)) & ~3U;
+        }
+        break;
+
+    case 0x1E:
+        // First half of BL and BLX: MOV LR, #(PC + offset << 12)
+        arm = 0xE3A0E000;
+        patch_imm = true;
+        imm = address + 4 + ((s32)((u32)raw << 21) >> 9);
+        break;
+
+    case 0x1F:
+        // Second half of BL, a direct call when the first half is in the same block. Otherwise
+        // the target depends on LR, and SkyEye steps it.
+        if ((previous >> 11) == 0x1E) {
+            arm = 0xEB000000;
+            patch_imm = true;
+            imm = address + 2 + ((s32)((u32)previous << 21) >> 9) + ((raw & 0x7FF) << 1);
+        }
+        break;
+    }
+
+    const bool ends_block = DecodeInstruction(arm, address, inst);
+    inst.flags |= FLAG_THUMB;
+    if (patch_imm)
+        inst.imm = imm;
+    return ends_block;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Idle loop detection
+
+/// Bits of the masks used by IsIdleLoop, above the 16 general purpose registers
+enum {
+    USES_NZ     = 1 << 16,  ///< N and Z flags
+    USES_C      = 1 << 17,  ///< C flag
+    USES_V      = 1 << 18,  ///< V flag
+};
+
+static bool IsDataProcessingHandler(Handler handler) {
+    const Handler* handlers = &g_data_processing_handlers[0][0][0];
+    for (size_t i = 0; i < sizeof(g_data_processing_handlers) / sizeof(Handler); ++i) {
+        if (handlers[i] == handler)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Finds the registers and flags read and written by an instruction that can be part of an idle
+ * loop: data processing instructions and loads without base writeback
+ * @param inst Instruction to check
+ * @param reads Receives the mask of registers and USES_* flags that are read
+ * @param writes Receives the mask of registers and USES_* flags that are written
+ * @return False if the instruction has side effects or isn't understood
+ */
+static bool GetIdleLoopOperands(const Instruction& inst, u32& reads, u32& writes) {
+    const u32 raw = inst.raw;
+    if (inst.cond != 0xE || (raw >> 28) != 0xE || inst.handler == Fallback)
+        return false;
+
+    if (IsDataProcessingHandler(inst.handler)) {
+        const u32 opcode = (raw >> 21) & 0xF;
+        const bool set_flags = (raw >> 20) & 1;
+        const bool logical = opcode <= 1 || (opcode >= 8 && opcode != 0xA && opcode != 0xB);
+        if (inst.rd == 15 && (opcode & 0xC) != 0x8)
+            return false;
+
+        reads = 0;
+        if (opcode != 0xD && opcode != 0xF)
+            reads |= 1 << inst.rn;
+        if (!(raw & (1 << 25))) {
+            reads |= 1 << inst.rm;
+            if (raw & (1 << 4))
+                reads |= (1 << inst.rs) | USES_C;
+            else if (inst.shift_type == ShiftType::Rrx)
+                reads |= USES_C;
+        }
+        if (opcode >= 5 && opcode <= 7)
+            reads |= USES_C;
+
+        writes = ((opcode & 0xC) == 0x8) ? 0 : (1 << inst.rd);
+        if (set_flags) {
+            writes |= USES_NZ;
+            if (!logical) {
+                writes |= USES_C | USES_V;
+            } else if ((raw & (1 << 25)) ? (inst.flags & FLAG_ROTATED_IMM) != 0 :
+                    !(raw & (1 << 4)) &&
+                    (inst.shift_amount != 0 || inst.shift_type == ShiftType::Rrx)) {
+                // Logical instructions only set C when the shifter produces a carry out
+                writes |= USES_C;
+            }
+        }
+        return true;
+    }
+
+    // Loads, both word/byte and halfword/signed byte, but not LDRD
+    const u32 type = (raw >> 25) & 7;
+    const bool load = (raw >> 20) & 1;
+    const bool single_transfer = type == 2 || (type == 3 && !(raw & (1 << 4)));
+    const bool extra_transfer = type == 0 && (raw & 0x90) == 0x90 && (raw & 0x60) != 0;
+    if (!load || !(single_transfer || extra_transfer) || (inst.flags & FLAG_WRITEBACK) ||
+        inst.rd == 15) {
+        return false;
+    }
+
+    reads = 1 << inst.rn;
+    const bool register_offset = single_transfer ? (raw & (1 << 25)) != 0 : !(raw & (1 << 22));
+    if (register_offset) {
+        reads |= 1 << inst.rm;
+        if (single_transfer && inst.shift_type == ShiftType::Rrx)
+            reads |= USES_C;
+    }
+    writes = 1 << inst.rd;
+    return true;
+}
+
+/**
+ * Checks whether a block is a loop that only polls memory: it branches back to its own start, its
+ * other instructions are register operations and loads, and no value computed by one iteration is
+ * used by the next. Every iteration then behaves the same until something else changes memory,
+ * which only happens when an event fires or another thread runs.
+ * @param block Block to check
+ * @param pc Address of the first instruction of the block
+ * @return True if the block is an idle loop
+ */
+static bool IsIdleLoop(const ARM_CachedInterpreter::Block& block, u32 pc) {
+    const Instruction& branch = block.instructions.back();
+    if (branch.handler != Branch<false> || branch.imm != pc || (branch.raw >> 28) == 0xF)
+        return false;
+
+    const size_t num_operations = block.instructions.size() - 1;
+    std::vector<u32> reads(num_operations), writes(num_operations);
+    u32 all_writes = 0;
+    for (size_t i = 0; i < num_operations; ++i) {
+        if (!GetIdleLoopOperands(block.instructions[i], reads[i], writes[i]))
+            return false;
+        all_writes |= writes[i];
+    }
+
+    // Reading something before it is written in the same iteration uses the previous one's value
+    u32 written = 0;
+    for (size_t i = 0; i < num_operations; ++i) {
+        if (reads[i] & all_writes & ~written)
+            return false;
+        written |= writes[i];
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// ARM_CachedInterpreter
+
+ARM_CachedInterpreter::ARM_CachedInterpreter() {
+    reschedule_pending = false;
+    idle_loop_reached = false;
+    code_invalidated = false;
+}
+
+ARM_CachedInterpreter::~ARM_CachedInterpreter() {
+}
+
+/// Prepare core for thread reschedule (if needed to correctly handle state)
+void ARM_CachedInterpreter::PrepareReschedule() {
+    ARM_Interpreter::PrepareReschedule();
+    reschedule_pending = true;
+}
+
+/// Discard any cached translations of guest code (must be called when code is replaced)
+void ARM_CachedInterpreter::ClearInstructionCache() {
+    // Blocks may be discarded by the instruction that is executing, so they are only retired here
+    for (auto& block : blocks)
+        retired_blocks.push_back(std::move(block.second));
+    blocks.clear();
+
+    for (const auto& page : page_blocks)
+        Memory::g_code_pages[page.first] = 0;
+    page_blocks.clear();
+    code_invalidated = true;
+}
+
+/**
+ * Discards the cached blocks of every page overlapping a range of guest memory
+ * @param address Start address of the range that was written
+ * @param size Size of the range in bytes
+ */
+void ARM_CachedInterpreter::InvalidateCodeRange(u32 address, u32 size) {
+    if (size == 0)
+        return;
+
+    const u32 first_page = address >> Memory::PAGE_BITS;
+    const u32 last_page = (u32)(((u64)address + size - 1) >> Memory::PAGE_BITS);
+    for (u32 page = first_page; page <= last_page && page < Memory::NUM_PAGES; ++page) {
+        if (Memory::g_code_pages[page])
+            InvalidatePage(page);
+    }
+}
+
+/// Discards the cached blocks of a single page
+void ARM_CachedInterpreter::InvalidatePage(u32 page) {
+    auto page_iter = page_blocks.find(page);
+    if (page_iter == page_blocks.end())
+        return;
+
+    for (u32 start_address : page_iter->second) {
+        auto block_iter = blocks.find(start_address);
+        if (block_iter != blocks.end()) {
+            retired_blocks.push_back(std::move(block_iter->second));
+            blocks.erase(block_iter);
+        }
+    }
+
+    page_blocks.erase(page_iter);
+    Memory::g_code_pages[page] = 0;
+    code_invalidated = true;
+}
+
+/**
+ * Decodes the basic block starting at an address and adds it to the cache
+ * @param pc Guest address of the first instruction in the block
+ * @param thumb Whether the block is Thumb code
+ * @return Pointer to the new block
+ */
+ARM_CachedInterpreter::Block* ARM_CachedInterpreter::TranslateBlock(u32 pc, bool thumb) {
+    Block* block = new Block;
+    block->thumb = thumb;
+    u32 address = pc;
+
+    // Blocks never cross a page boundary, so that a single page can be invalidated on its own
+    for (;;) {
+        Instruction inst;
+        bool ends_block;
+        if (thumb) {
+            const u16 previous = block->instructions.empty() ? 0 : Memory::Read16(address - 2);
+            ends_block = DecodeThumbInstruction(Memory::Read16(address), previous, address, inst);
+            address += 2;
+        } else {
+            ends_block = DecodeInstruction(Memory::Read32(address), address, inst);
+            address += 4;
+        }
+        block->instructions.push_back(inst);
+
+        if (ends_block || (address & Memory::PAGE_MASK) == 0 ||
+            block->instructions.size() >= kMaxBlockInstructions) {
+            break;
+        }
+    }
+    block->end_address = address;
+    block->idle_loop = IsIdleLoop(*block, pc);
+
+    const u32 key = GetBlockKey(pc, thumb);
+    const u32 page = pc >> Memory::PAGE_BITS;
+    page_blocks[page].push_back(key);
+    Memory::g_code_pages[page] = 1;
+
+    blocks[key].reset(block);
+    return block;
+}
+
+/**
+ * Executes the given number of instructions
+ * @param num_instructions Number of instructions to executes
+ */
+void ARM_CachedInterpreter::ExecuteInstructions(int num_instructions) {
+    ExecuteCachedInstructions(num_instructions);
+
+    if (idle_loop_reached)
+        CoreTiming::Idle();
+}
+
+/**
+ * Executes up to the given number of instructions, stopping early if an idle loop is reached
+ * @param num_instructions Number of instructions to executes
+ */
+void ARM_CachedInterpreter::ExecuteCachedInstructions(int num_instructions) {
+    retired_blocks.clear();
+    reschedule_pending = false;
+    idle_loop_reached = false;
+
+    // Pick up where the SkyEye pipeline state says the next instruction is
+    u32 pc;
+    if (state->NextInstr >= PRIMEPIPE) {
+        pc = state->Reg[15];
+    } else {
+        pc = state->pc + (state->TFlag ? 2 : 4);
+    }
+
+    ExecState exec = { state, this, 0, 0 };
+    int remaining = num_instructions;
+    u32 executed = 0;
+
+    while (remaining > 0 && !reschedule_pending && !idle_loop_reached) {
+        const bool thumb = state->TFlag != 0;
+        auto block_iter = blocks.find(GetBlockKey(pc, thumb));
+        const Block* block = (block_iter != blocks.end()) ? block_iter->second.get() :
+            TranslateBlock(pc, thumb);
+
+        // Reading the PC yields the address of the instruction plus 8, or plus 4 in Thumb code
+        const u32 pc_offset = thumb ? 4 : 8;
+
+        const Instruction* inst = block->instructions.data();
+        const Instruction* end = inst + block->instructions.size();
+        for (;;) {
+            state->Reg[15] = inst->address + pc_offset;
+            --remaining;
+            ++executed;
+
+            if (ConditionPassed(state, inst->cond) && !inst->handler(exec, *inst)) {
+                pc = exec.next_pc;
+                if (block->idle_loop && pc == block->instructions[0].address)
+                    idle_loop_reached = true;
+                break;
+            }
+            if (++inst == end) {
+                pc = block->end_address;
+                break;
+            }
+            if (remaining <= 0) {
+                pc = inst->address;
+                break;
+            }
+        }
+    }
+
+    // Leave the state as if SkyEye had been told to resume at the next instruction
+    state->pc = state->Reg[15] = pc;
+    state->NextInstr = RESUME;
+
+    // Cached instructions are counted as a single cycle each, SkyEye accounts for the ones it steps
+    state->NumScycles += executed - exec.stepped;
+}
@@ -0,0 +1,146 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common.h"
+
+#include "core/arm/interpreter/arm_interpreter.h"
+
+/**
+ * ARM11 interpreter that decodes each guest basic block once and caches the result by PC. Every
+ * decoded instruction carries a pointer to its handler, so running a block is a short dispatch
+ * loop instead of a fetch and full decode per instruction. Thumb instructions are decoded as the
+ * ARM instructions doing the same and share their handlers. Instructions without a handler (VFP,
+ * coprocessor and system instructions) are single-stepped by the SkyEye core, which works on the
+ * same ARMul_State.
+ */
+class ARM_CachedInterpreter : public ARM_Interpreter {
+public:
+
+    /// Shifts that can be applied to a register operand (RRX is encoded as ROR #0)
+    enum class ShiftType : u8 {
+        Lsl, Lsr, Asr, Ror, Rrx,
+    };
+
+    /// Instruction specific flags stored in Instruction::flags
+    enum {
+        FLAG_PRE_INDEX      = 1 << 0,   ///< Load/store: offset is applied before the access
+        FLAG_UP             = 1 << 1,   ///< Load/store: offset is added to the base
+        FLAG_WRITEBACK      = 1 << 2,   ///< Load/store: updated address is written back to the base
+        FLAG_ROTATED_IMM    = 1 << 3,   ///< Data processing: immediate had a non-zero rotation
+        FLAG_THUMB          = 1 << 4,   ///< Translated from Thumb, the PC reads as the address + 4
+    };
+
+    struct ExecState;
+    struct Instruction;
+
+    /**
+     * Executes a decoded instruction whose condition passed
+     * @return True to continue with the next instruction of the block, false if the handler set
+     *         ExecState::next_pc and the block has to be left
+     */
+    typedef bool (*Handler)(ExecState& exec, const Instruction& inst);
+
+    /// Pre-decoded form of a single ARM instruction, or of the ARM equivalent of a Thumb one
+    struct Instruction {
+        Handler handler;    ///< Function executing the instruction
+        u32 address;        ///< Guest address of the instruction
+        u32 raw;            ///< Undecoded (ARM equivalent) instruction word
+        u32 imm;            ///< Immediate operand, offset, register list or branch target
+        u8 cond;            ///< Condition code
+        u8 rd, rn, rm, rs;  ///< Register operands (meaning depends on the instruction)
+        ShiftType shift_type;   ///< Shift applied to rm
+        u8 shift_amount;    ///< Immediate shift amount (or rotation, or register count)
+        u8 flags;           ///< Combination of FLAG_* values
+    };
+
+    /// Sequence of decoded instructions ending at a branch, a fallback or the end of a page
+    struct Block {
+        u32 end_address;                        ///< Address following the last instruction
+        bool thumb;                             ///< Block was decoded as Thumb code
+        bool idle_loop;                         ///< Block is a loop that only polls memory
+        std::vector<Instruction> instructions;  ///< Decoded instructions
+    };
+
+    /// State shared between the dispatch loop and the instruction handlers
+    struct ExecState {
+        ARMul_State* state;
+        ARM_CachedInterpreter* cpu;
+        u32 next_pc;            ///< Address to continue at when a handler leaves the block
+        u32 stepped;            ///< Instructions stepped by SkyEye, which charges their cycles
+    };
+
+    ARM_CachedInterpreter();
+    ~ARM_CachedInterpreter();
+
+    /// Prepare core for thread reschedule (if needed to correctly handle state)
+    void PrepareReschedule();
+
+    /// Discard any cached translations of guest code (must be called when code is replaced)
+    void ClearInstructionCache();
+
+    /**
+     * Discards the cached blocks of every page overlapping a range of guest memory
+     * @param address Start address of the range that was written
+     * @param size Size of the range in bytes
+     */
+    void InvalidateCodeRange(u32 address, u32 size);
+
+    /**
+     * Returns whether cached blocks were discarded since the last call, by a store to guest code or
+     * otherwise: the block being executed may be one of them
+     */
+    bool TakeCodeInvalidated() {
+        const bool invalidated = code_invalidated;
+        code_invalidated = false;
+        return invalidated;
+    }
+
+protected:
+
+    /**
+     * Executes the given number of instructions
+     * @param num_instructions Number of instructions to executes
+     */
+    void ExecuteInstructions(int num_instructions);
+
+    /**
+     * Executes up to the given number of instructions, stopping early if an idle loop is reached
+     * @param num_instructions Number of instructions to executes
+     */
+    void ExecuteCachedInstructions(int num_instructions);
+
+    /**
+     * Decodes the basic block starting at an address and adds it to the cache
+     * @param pc Guest address of the first instruction in the block
+     * @param thumb Whether the block is Thumb code
+     * @return Pointer to the new block
+     */
+    Block* TranslateBlock(u32 pc, bool thumb);
+
+    /**
+     * Returns the key a block is cached under: its address, with bit 0 set for Thumb code (whose
+     * instructions are only halfword aligned), so that both kinds of blocks never collide
+     */
+    static u32 GetBlockKey(u32 pc, bool thumb) {
+        return pc | (thumb ? 1 : 0);
+    }
+
+    /// Discards the cached blocks of a single page
+    virtual void InvalidatePage(u32 page);
+
+    std::unordered_map<u32, std::unique_ptr<Block>> blocks;     ///< Cached blocks by block key
+    std::unordered_map<u32, std::vector<u32>> page_blocks;      ///< Keys of the blocks in each page
+    std::vector<std::unique_ptr<Block>> retired_blocks;         ///< Invalidated, not yet freed blocks
+
+    bool reschedule_pending;    ///< Set by PrepareReschedule to leave ExecuteInstructions early
+    bool idle_loop_reached;     ///< Set when an idle loop jumps back to its start
+    bool code_invalidated;      ///< Set when cached blocks are discarded, see TakeCodeInvalidated
+
+};
@@ -152,3 +152,17 @@ void ARM_Interpreter::LoadContext(const ThreadContext& ctx) {
 void ARM_Interpreter::PrepareReschedule() {
     state->NumInstrsToExecute = 0;
 }
+
+/// Discard any cached translations of guest code (must be called when code is replaced)
+void ARM_Interpreter::ClearInstructionCache() {
+    // Nothing to do, every instruction is fetched from memory when it is executed
+}
+
+/**
+ * Discards the cached translations of a range of guest memory that was written
+ * @param address Start address of the range
+ * @param size Size of the range in bytes
+ */
+void ARM_Interpreter::InvalidateCodeRange(u32 address, u32 size) {
+    // Nothing to do, see ClearInstructionCache
+}
@@ -75,6 +75,16 @@ public:
     /// Prepare core for thread reschedule (if needed to correctly handle state)
     void PrepareReschedule();
 
+    /// Discard any cached translations of guest code (must be called when code is replaced)
+    void ClearInstructionCache();
+
+    /**
+     * Discards the cached translations of a range of guest memory that was written
+     * @param address Start address of the range
+     * @param size Size of the range in bytes
+     */
+    void InvalidateCodeRange(u32 address, u32 size);
+
 protected:
 
     /**
@@ -83,8 +93,6 @@ protected:
      */
     void ExecuteInstructions(int num_instructions);
 
-private:
-
     ARMul_State* state;
 
 };
@@ -25,6 +25,8 @@
 //#include "skyeye_arch.h"
 #include "armcpu.h"
 
+#include "core/settings.h"
+
 
 extern mmu_ops_t xscale_mmu_ops;
 exception_t arm_mmu_write(short size, u32 addr, uint32_t *value);
@@ -71,8 +73,14 @@ mmu_init (ARMul_State * state)
 	//	break;
 	/* case 0x560f5810: */
 	case 0x0007b000:
-		NOTICE_LOG(ARM11, "SKYEYE: use arm11jzf-s mmu ops\n");
-		state->mmu.ops = arm1176jzf_s_mmu_ops;
+		/* HLE userland never enables translation, skip the TLB and permission checks */
+		if (Settings::values.emulate_mmu) {
+			NOTICE_LOG(ARM11, "SKYEYE: use arm11jzf-s mmu ops\n");
+			state->mmu.ops = arm1176jzf_s_mmu_ops;
+		} else {
+			NOTICE_LOG(ARM11, "SKYEYE: use flat mmu ops\n");
+			state->mmu.ops = flat_mmu_ops;
+		}
 		break;
 
 	default:
@@ -885,7 +885,7 @@ arm1176jzf_s_mmu_mrc (ARMul_State *state, ARMword instr, ARMword *value)
 }
 
 
-static ARMword
+ARMword
 arm1176jzf_s_mmu_mcr (ARMul_State *state, ARMword instr, ARMword value)
 {
     int creg = BITS (16, 19) & 0xf;
@@ -32,6 +32,12 @@ typedef struct arm1176jzf-s_mmu_s
 #endif
 extern mmu_ops_t arm1176jzf_s_mmu_ops;
 
+int
+arm1176jzf_s_mmu_init (ARMul_State *state);
+void
+arm1176jzf_s_mmu_exit (ARMul_State *state);
 ARMword
 arm1176jzf_s_mmu_mrc (ARMul_State *state, ARMword instr, ARMword *value);
+ARMword
+arm1176jzf_s_mmu_mcr (ARMul_State *state, ARMword instr, ARMword value);
 #endif /*_ARM1176JZF_S_MMU_H_*/
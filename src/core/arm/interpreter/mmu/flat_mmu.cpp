@@ -0,0 +1,64 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "core/mem_map.h"
+
+#include "core/arm/interpreter/armdefs.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static fault_t flat_mmu_read_byte(ARMul_State* state, ARMword virt_addr, ARMword* data) {
+    *data = Memory::Read8(virt_addr);
+    return NO_FAULT;
+}
+
+static fault_t flat_mmu_write_byte(ARMul_State* state, ARMword virt_addr, ARMword data) {
+    Memory::Write8(virt_addr, (u8)data);
+    return NO_FAULT;
+}
+
+static fault_t flat_mmu_read_halfword(ARMul_State* state, ARMword virt_addr, ARMword* data) {
+    *data = Memory::Read16(virt_addr);
+    return NO_FAULT;
+}
+
+static fault_t flat_mmu_write_halfword(ARMul_State* state, ARMword virt_addr, ARMword data) {
+    Memory::Write16(virt_addr, (u16)data);
+    return NO_FAULT;
+}
+
+static fault_t flat_mmu_read_word(ARMul_State* state, ARMword virt_addr, ARMword* data) {
+    *data = Memory::Read32(virt_addr);
+    return NO_FAULT;
+}
+
+static fault_t flat_mmu_write_word(ARMul_State* state, ARMword virt_addr, ARMword data) {
+    Memory::Write32(virt_addr, data);
+    return NO_FAULT;
+}
+
+static fault_t flat_mmu_load_instr(ARMul_State* state, ARMword virt_addr, ARMword* instr) {
+    *instr = Memory::Read32(virt_addr);
+    return NO_FAULT;
+}
+
+static int flat_mmu_v2p_dbct(ARMul_State* state, ARMword virt_addr, ARMword* phys_addr) {
+    *phys_addr = virt_addr;
+    return 0;
+}
+
+mmu_ops_t flat_mmu_ops = {
+    arm1176jzf_s_mmu_init,
+    arm1176jzf_s_mmu_exit,
+    flat_mmu_read_byte,
+    flat_mmu_write_byte,
+    flat_mmu_read_halfword,
+    flat_mmu_write_halfword,
+    flat_mmu_read_word,
+    flat_mmu_write_word,
+    flat_mmu_load_instr,
+    arm1176jzf_s_mmu_mcr,
+    arm1176jzf_s_mmu_mrc,
+    flat_mmu_v2p_dbct,
+};
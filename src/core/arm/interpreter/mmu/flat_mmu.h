@@ -0,0 +1,13 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+/**
+ * MMU operations for HLE userland, which never enables address translation: data accesses and
+ * instruction fetches go straight to the Memory:: accessors, without TLB lookups, permission checks
+ * or FCSE remapping, and never fault. CP15 accesses are handled by the ARM1176JZF-S MMU, so system
+ * control registers such as the thread ID registers keep working.
+ */
+extern mmu_ops_t flat_mmu_ops;
@@ -0,0 +1,1019 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <cstddef>
+
+#include "common/memory_util.h"
+#include "common/x64_emitter.h"
+
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/arm/jit/arm_jit.h"
+
+// Defined by SkyEye's armemu.h, which this file doesn't otherwise use
+#undef NEG
+#undef ROR
+
+// R13 and R15 also name guest registers in arm_regformat.h, so they are always written qualified
+using namespace Gen;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Host register usage
+//
+// RBX: ARMul_State*            R13: Memory::g_code_pages
+// RBP: JitState*               R14: Memory::g_base (fastmem)
+// R15: guest address of the current load/store, preserved across calls
+// RAX, RCX, RDX: scratch
+
+#ifdef _WIN32
+static const X64Reg ABI_PARAM1 = RCX;
+static const X64Reg ABI_PARAM2 = RDX;
+static const X64Reg ABI_PARAM3 = R8;
+static const X64Reg ABI_PARAM4 = R9;
+
+/// Callee saved registers pushed by the entry trampoline
+static const X64Reg kSavedRegisters[] = { RBX, RBP, RSI, RDI, Gen::R13, R14, Gen::R15 };
+/// Shadow space for calls, keeps the stack 16-byte aligned after the pushes
+static const int kStackAdjust = 32;
+#else
+static const X64Reg ABI_PARAM1 = RDI;
+static const X64Reg ABI_PARAM2 = RSI;
+static const X64Reg ABI_PARAM3 = RDX;
+static const X64Reg ABI_PARAM4 = RCX;
+
+/// Callee saved registers pushed by the entry trampoline
+static const X64Reg kSavedRegisters[] = { RBX, RBP, Gen::R13, R14, Gen::R15 };
+/// Keeps the stack 16-byte aligned after the pushes
+static const int kStackAdjust = 0;
+#endif
+
+static const size_t kNumSavedRegisters = sizeof(kSavedRegisters) / sizeof(kSavedRegisters[0]);
+
+/// Size of the code cache
+static const size_t kCodeCacheSize = 16 * 1024 * 1024;
+/// Free space needed to compile a block, the cache is flushed when less is left
+static const size_t kMaxBlockCodeSize = 64 * 1024;
+
+static inline s32 RegisterOffset(u32 reg) {
+    return (s32)(offsetof(ARMul_State, Reg) + reg * sizeof(ARMword));
+}
+
+static const s32 N_FLAG_OFFSET = (s32)offsetof(ARMul_State, NFlag);
+static const s32 Z_FLAG_OFFSET = (s32)offsetof(ARMul_State, ZFlag);
+static const s32 C_FLAG_OFFSET = (s32)offsetof(ARMul_State, CFlag);
+static const s32 V_FLAG_OFFSET = (s32)offsetof(ARMul_State, VFlag);
+static const s32 T_FLAG_OFFSET = (s32)offsetof(ARMul_State, TFlag);
+
+typedef ARM_CachedInterpreter::Instruction Instruction;
+
+/// Value the PC reads as while an instruction executes
+static inline u32 GetPCValue(const Instruction& inst) {
+    return inst.address + ((inst.flags & ARM_CachedInterpreter::FLAG_THUMB) ? 4 : 8);
+}
+
+/// Address of the instruction following one
+static inline u32 GetNextAddress(const Instruction& inst) {
+    return inst.address + ((inst.flags & ARM_CachedInterpreter::FLAG_THUMB) ? 2 : 4);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Functions called from compiled code
+
+static u32 ReadByte(u32 address) {
+    return Memory::Read8(address);
+}
+
+static u32 ReadHalfword(u32 address) {
+    return Memory::Read16(address);
+}
+
+static u32 ReadWord(u32 address) {
+    // Undo the rotation Memory::Read32 applies to unaligned reads, the same way the SkyEye core does
+    const u32 value = Memory::Read32(address);
+    const u32 rotation = (address & 3) * 8;
+    return rotation ? (value >> rotation) | (value << (32 - rotation)) : value;
+}
+
+static void WriteByte(u32 address, u32 value) {
+    Memory::Write8(address, (u8)value);
+}
+
+static void WriteHalfword(u32 address, u32 value) {
+    Memory::Write16(address, (u16)value);
+}
+
+static void WriteWord(u32 address, u32 value) {
+    Memory::Write32(address, value);
+}
+
+/// Invalidates cached blocks after a guest store to a page containing translated code, unless
+/// Memory::Write already did
+static void InvalidateAfterWrite(ARM_CachedInterpreter::ExecState* exec, u32 address, u32 size,
+    u32 next_pc) {
+
+    exec->cpu->InvalidateCodeRange(address, size);
+    exec->cpu->TakeCodeInvalidated();
+
+    // The block being executed may have been discarded, continue with a freshly compiled one
+    exec->next_pc = next_pc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// ARM_Jit
+
+ARM_Jit::ARM_Jit() : emitter(new XEmitter) {
+    code_cache = (u8*)AllocateExecutableMemory(kCodeCacheSize);
+    GenerateTrampolines();
+
+    jit_state.exec.state = state;
+    jit_state.exec.cpu = this;
+    jit_state.exec.next_pc = 0;
+    jit_state.exec.stepped = 0;
+    jit_state.remaining = 0;
+    jit_state.reschedule_credit = 0;
+    jit_state.idle_loop = 0;
+    idle_loop_reached = false;
+}
+
+ARM_Jit::~ARM_Jit() {
+    FreeMemoryPages(code_cache, kCodeCacheSize);
+}
+
+/// Prepare core for thread reschedule (if needed to correctly handle state)
+void ARM_Jit::PrepareReschedule() {
+    ARM_CachedInterpreter::PrepareReschedule();
+
+    // Make the next block entry leave the compiled code, remembering what wasn't executed
+    if (jit_state.remaining > 0)
+        jit_state.reschedule_credit += jit_state.remaining;
+    jit_state.remaining = 0;
+}
+
+/// Discard any cached translations of guest code (must be called when code is replaced)
+void ARM_Jit::ClearInstructionCache() {
+    // This may be called from compiled code, which then returns into the code cache. That code is
+    // only overwritten by the next CompileBlock, which happens outside of compiled code.
+    entry_points.clear();
+    link_sites.clear();
+    emitter->SetCodePtr(code_cache_blocks);
+
+    ARM_CachedInterpreter::ClearInstructionCache();
+}
+
+/// Discards the cached blocks of a single page
+void ARM_Jit::InvalidatePage(u32 page) {
+    auto page_iter = page_blocks.find(page);
+    if (page_iter != page_blocks.end()) {
+        for (u32 start_address : page_iter->second) {
+            if (entry_points.erase(start_address) == 0)
+                continue;
+
+            // Blocks jumping here fall back to their exit stubs, the code itself stays until the
+            // next flush
+            auto sites_iter = link_sites.find(start_address);
+            if (sites_iter != link_sites.end()) {
+                for (u8* site : sites_iter->second)
+                    PatchLinkSite(site, nullptr);
+            }
+        }
+    }
+
+    ARM_CachedInterpreter::InvalidatePage(page);
+}
+
+/**
+ * Executes the given number of instructions
+ * @param num_instructions Number of instructions to executes
+ */
+void ARM_Jit::ExecuteInstructions(int num_instructions) {
+    retired_blocks.clear();
+    reschedule_pending = false;
+
+    // Pick up where the SkyEye pipeline state says the next instruction is
+    u32 pc;
+    if (state->NextInstr >= PRIMEPIPE) {
+        pc = state->Reg[15];
+    } else {
+        pc = state->pc + (state->TFlag ? 2 : 4);
+    }
+
+    jit_state.exec.state = state;
+    jit_state.exec.stepped = 0;
+    jit_state.remaining = num_instructions;
+    jit_state.reschedule_credit = 0;
+    // Instructions left to the interpreters, which do their own cycle accounting
+    s32 stepped = 0;
+
+    while (jit_state.remaining > 0 && !reschedule_pending) {
+        const bool thumb = state->TFlag != 0;
+        const u32 key = GetBlockKey(pc, thumb);
+        auto entry_iter = entry_points.find(key);
+        if (entry_iter == entry_points.end()) {
+            if ((size_t)(code_cache + kCodeCacheSize - emitter->GetCodePtr()) < kMaxBlockCodeSize)
+                ClearInstructionCache();
+
+            auto block_iter = blocks.find(key);
+            const Block* block = (block_iter != blocks.end()) ? block_iter->second.get() :
+                TranslateBlock(pc, thumb);
+            entry_iter = entry_points.emplace(key, CompileBlock(block, pc)).first;
+        }
+
+        // Compiled blocks run to completion, the cached interpreter can stop at any instruction
+        if (entry_iter->second.num_instructions > jit_state.remaining) {
+            const s32 tail = jit_state.remaining;
+            jit_state.remaining = 0;
+            stepped += tail;
+
+            state->pc = state->Reg[15] = pc;
+            state->NextInstr = RESUME;
+            ExecuteCachedInstructions(tail);
+            pc = state->Reg[15];
+            break;
+        }
+
+        pc = run_code(state, &jit_state, entry_iter->second.entry);
+        if (jit_state.idle_loop) {
+            jit_state.idle_loop = 0;
+            idle_loop_reached = true;
+            break;
+        }
+    }
+
+    // Leave the state as if SkyEye had been told to resume at the next instruction
+    state->pc = state->Reg[15] = pc;
+    state->NextInstr = RESUME;
+
+    // Compiled instructions are counted as a single cycle each, the others are accounted for by the
+    // interpreters
+    state->NumScycles += num_instructions - jit_state.remaining - jit_state.reschedule_credit -
+        stepped - jit_state.exec.stepped;
+
+    // Instructions that weren't executed because of an idle loop aren't charged either, CoreTiming
+    // skips ahead to the next event instead
+    if (idle_loop_reached)
+        CoreTiming::Idle();
+}
+
+/// Emits the entry trampoline and the common exit code at the start of the code cache
+void ARM_Jit::GenerateTrampolines() {
+    emitter->SetCodePtr(code_cache);
+
+    run_code = (RunCodeFunction)emitter->GetCodePtr();
+    for (size_t i = 0; i < kNumSavedRegisters; ++i)
+        emitter->PUSH(kSavedRegisters[i]);
+    if (kStackAdjust)
+        emitter->SUB(64, R(RSP), Imm8(kStackAdjust));
+
+    emitter->MOV(64, R(RBX), R(ABI_PARAM1));
+    emitter->MOV(64, R(RBP), R(ABI_PARAM2));
+    emitter->MOV(64, R(Gen::R13), Imm64((u64)Memory::g_code_pages));
+    emitter->MOV(64, R(R14), Imm64((u64)&Memory::g_base));
+    emitter->MOV(64, R(R14), MatR(R14));
+    emitter->JMPptr(R(ABI_PARAM3));
+
+    exit_code = emitter->GetCodePtr();
+    emitter->MOV(32, R(EAX), MDisp(RBP, offsetof(JitState, exec) + offsetof(ExecState, next_pc)));
+    if (kStackAdjust)
+        emitter->ADD(64, R(RSP), Imm8(kStackAdjust));
+    for (size_t i = kNumSavedRegisters; i > 0; --i)
+        emitter->POP(kSavedRegisters[i - 1]);
+    emitter->RET();
+
+    code_cache_blocks = emitter->GetWritableCodePtr();
+}
+
+/**
+ * Compiles a translated block into the code cache
+ * @param block Block decoded by the cached interpreter
+ * @param pc Guest address of the block
+ * @return Entry point and size of the compiled block
+ */
+ARM_Jit::CompiledBlock ARM_Jit::CompileBlock(const Block* block, u32 pc) {
+    const u8* entry = emitter->GetCodePtr();
+    const s32 remaining_offset = offsetof(JitState, remaining);
+
+    const s32 num_instructions = (s32)block->instructions.size();
+
+    // The whole block is charged on entry, exits taken part way through refund the rest
+    emitter->CMP(32, MDisp(RBP, remaining_offset), Imm32(num_instructions));
+    FixupBranch out_of_budget = emitter->J_CC(CC_L);
+    emitter->SUB(32, MDisp(RBP, remaining_offset), Imm32(num_instructions));
+
+    for (size_t index = 0; index < block->instructions.size(); ++index) {
+        const Instruction& inst = block->instructions[index];
+
+        // Unconditional instructions other than BLX are always executed by the SkyEye core
+        if ((inst.raw >> 28) == 0xF) {
+            if (!EmitBranch(inst))
+                EmitInterpreterCall(block, index);
+            continue;
+        }
+
+        const bool conditional = inst.cond != 0xE;
+        FixupBranch condition_failed;
+        if (conditional)
+            condition_failed = EmitConditionCheck(inst.cond);
+
+        if (block->idle_loop && index + 1 == block->instructions.size()) {
+            // Jumping back to the start of an idle loop returns to the dispatcher, which skips
+            // ahead to the next event instead of spinning
+            emitter->MOV(32, MDisp(RBP, offsetof(JitState, idle_loop)), Imm32(1));
+            emitter->MOV(32, MDisp(RBP, offsetof(JitState, exec) + offsetof(ExecState, next_pc)),
+                Imm32(inst.imm));
+            emitter->JMP(exit_code);
+        } else if (!EmitDataProcessing(inst) && !EmitMultiply(inst) &&
+            !EmitSingleDataTransfer(block, index) && !EmitExtraDataTransfer(block, index) &&
+            !EmitBlockDataTransfer(block, index) && !EmitBranch(inst) &&
+            !EmitBranchExchange(block, index)) {
+            EmitInterpreterCall(block, index);
+        }
+
+        if (conditional)
+            emitter->SetJumpTarget(condition_failed);
+    }
+
+    // Fall through to the following block
+    EmitLinkedExit(block->end_address, block->thumb);
+
+    emitter->SetJumpTarget(out_of_budget);
+    emitter->MOV(32, MDisp(RBP, offsetof(JitState, exec) + offsetof(ExecState, next_pc)), Imm32(pc));
+    emitter->JMP(exit_code);
+
+    auto sites_iter = link_sites.find(GetBlockKey(pc, block->thumb));
+    if (sites_iter != link_sites.end()) {
+        for (u8* site : sites_iter->second)
+            PatchLinkSite(site, entry);
+    }
+
+    CompiledBlock compiled = { entry, num_instructions };
+    return compiled;
+}
+
+/**
+ * Emits a check of the condition code of an instruction
+ * @return Branch taken when the condition fails
+ */
+FixupBranch ARM_Jit::EmitConditionCheck(u32 cond) {
+    const OpArg n_flag = MDisp(RBX, N_FLAG_OFFSET);
+    const OpArg z_flag = MDisp(RBX, Z_FLAG_OFFSET);
+    const OpArg c_flag = MDisp(RBX, C_FLAG_OFFSET);
+    const OpArg v_flag = MDisp(RBX, V_FLAG_OFFSET);
+
+    // Flags are stored as 0 or 1
+    switch (cond) {
+    case 0x0: emitter->CMP(32, z_flag, Imm8(0)); return emitter->J_CC(CC_E);     // EQ
+    case 0x1: emitter->CMP(32, z_flag, Imm8(0)); return emitter->J_CC(CC_NE);    // NE
+    case 0x2: emitter->CMP(32, c_flag, Imm8(0)); return emitter->J_CC(CC_E);     // CS
+    case 0x3: emitter->CMP(32, c_flag, Imm8(0)); return emitter->J_CC(CC_NE);    // CC
+    case 0x4: emitter->CMP(32, n_flag, Imm8(0)); return emitter->J_CC(CC_E);     // MI
+    case 0x5: emitter->CMP(32, n_flag, Imm8(0)); return emitter->J_CC(CC_NE);    // PL
+    case 0x6: emitter->CMP(32, v_flag, Imm8(0)); return emitter->J_CC(CC_E);     // VS
+    case 0x7: emitter->CMP(32, v_flag, Imm8(0)); return emitter->J_CC(CC_NE);    // VC
+
+    case 0x8:                                                                   // HI: C > Z
+    case 0x9:                                                                   // LS: C <= Z
+        emitter->MOV(32, R(EAX), c_flag);
+        emitter->CMP(32, R(EAX), z_flag);
+        return emitter->J_CC(cond == 0x8 ? CC_BE : CC_A);
+
+    case 0xA:                                                                   // GE: N == V
+    case 0xB:                                                                   // LT: N != V
+        emitter->MOV(32, R(EAX), n_flag);
+        emitter->CMP(32, R(EAX), v_flag);
+        return emitter->J_CC(cond == 0xA ? CC_NE : CC_E);
+
+    case 0xC:                                                                   // GT: !Z && N == V
+    case 0xD:                                                                   // LE: Z || N != V
+        emitter->MOV(32, R(EAX), n_flag);
+        emitter->XOR(32, R(EAX), v_flag);
+        emitter->OR(32, R(EAX), z_flag);
+        return emitter->J_CC(cond == 0xC ? CC_NZ : CC_Z);
+    }
+
+    _assert_msg_(DYNA_REC, false, "invalid condition code %u", cond);
+    return emitter->J();
+}
+
+/// Loads the value of a guest register (the PC reads as the address of the instruction plus 8, or
+/// plus 4 in Thumb code)
+void ARM_Jit::EmitLoadRegister(X64Reg host_reg, const Instruction& inst, u32 guest_reg) {
+    if (guest_reg == 15) {
+        emitter->MOV(32, R(host_reg), Imm32(GetPCValue(inst)));
+    } else {
+        emitter->MOV(32, R(host_reg), MDisp(RBX, RegisterOffset(guest_reg)));
+    }
+}
+
+/// Leaves the block after instruction `index`, un-charging the instructions that were skipped
+void ARM_Jit::EmitBlockExit(const Block* block, size_t index) {
+    const u32 skipped = (u32)(block->instructions.size() - index - 1);
+    if (skipped)
+        emitter->ADD(32, MDisp(RBP, offsetof(JitState, remaining)), Imm32(skipped));
+    emitter->JMP(exit_code);
+}
+
+/// Emits a jump to another block, linked directly once that block is compiled. TFlag must already
+/// match `thumb`.
+void ARM_Jit::EmitLinkedExit(u32 target, bool thumb) {
+    // Unlinked sites jump to the stub right after them, which returns to the dispatcher
+    u8* site = emitter->J().ptr;
+    emitter->MOV(32, MDisp(RBP, offsetof(JitState, exec) + offsetof(ExecState, next_pc)),
+        Imm32(target));
+    emitter->JMP(exit_code);
+
+    const u32 key = GetBlockKey(target, thumb);
+    link_sites[key].push_back(site);
+    auto entry_iter = entry_points.find(key);
+    PatchLinkSite(site, (entry_iter != entry_points.end()) ? entry_iter->second.entry : nullptr);
+}
+
+/// Points a link site at a compiled block, or back at its exit stub if entry is nullptr
+void ARM_Jit::PatchLinkSite(u8* site, const u8* entry) {
+    const FixupBranch branch = { site };
+    emitter->SetJumpTarget(branch, entry ? entry : site);
+}
+
+/// Emits a call to the cached interpreter's handler for an instruction
+void ARM_Jit::EmitInterpreterCall(const Block* block, size_t index) {
+    const Instruction& inst = block->instructions[index];
+
+    // Handlers read the PC from the register file
+    emitter->MOV(32, MDisp(RBX, RegisterOffset(15)), Imm32(GetPCValue(inst)));
+    emitter->MOV(64, R(ABI_PARAM1), R(RBP));
+    emitter->MOV(64, R(ABI_PARAM2), Imm64((u64)&inst));
+    emitter->CALL((const void*)inst.handler);
+
+    emitter->TEST(8, R(EAX), R(EAX));
+    FixupBranch next = emitter->J_CC(CC_NZ);
+    EmitBlockExit(block, index);
+    emitter->SetJumpTarget(next);
+}
+
+bool ARM_Jit::EmitDataProcessing(const Instruction& inst) {
+    const u32 raw = inst.raw;
+    const bool immediate = (raw >> 25) & 1;
+
+    const bool register_shift = !immediate && (raw & (1 << 4));
+
+    // Writes to the PC, miscellaneous instructions, multiplies and extra loads/stores are left to
+    // the interpreter, as are register shifted operands reading the PC
+    if (((raw >> 26) & 3) != 0 || inst.rd == 15 || (raw & 0x01900000) == 0x01000000 ||
+        (raw & 0x0E000090) == 0x00000090 ||
+        (register_shift && (inst.rn == 15 || inst.rm == 15 || inst.rs == 15))) {
+        return false;
+    }
+
+    const u32 opcode = (raw >> 21) & 0xF;
+    const bool set_flags = (raw >> 20) & 1;
+    const bool is_compare = (opcode & 0xC) == 0x8;
+    const bool is_logical = (opcode < 0x2) || (opcode == 0x8) || (opcode == 0x9) || (opcode >= 0xC);
+    const bool shifter_carry = set_flags && is_logical;
+    const OpArg c_flag = MDisp(RBX, C_FLAG_OFFSET);
+
+    // Second operand into EDX, logical instructions setting flags take C from the shifter
+    if (immediate) {
+        emitter->MOV(32, R(EDX), Imm32(inst.imm));
+        if (shifter_carry && (inst.flags & FLAG_ROTATED_IMM))
+            emitter->MOV(32, c_flag, Imm32(inst.imm >> 31));
+    } else if (register_shift) {
+        EmitRegisterShift(inst, shifter_carry);
+    } else {
+        EmitLoadRegister(EDX, inst, inst.rm);
+        const OpArg amount = Imm8(inst.shift_amount);
+
+        // Host shifts leave the last bit shifted out in CF, like the ARM shifter
+        bool carry_in_cf = false;
+        switch (inst.shift_type) {
+        case ShiftType::Lsl:
+            if (inst.shift_amount) {
+                emitter->SHL(32, R(EDX), amount);
+                carry_in_cf = true;
+            }
+            break;
+
+        case ShiftType::Lsr:
+            if (inst.shift_amount == 32) {
+                if (shifter_carry) {
+                    emitter->BT(32, R(EDX), Imm8(31));
+                    emitter->SETcc(CC_C, c_flag);
+                }
+                emitter->MOV(32, R(EDX), Imm32(0));
+            } else {
+                emitter->SHR(32, R(EDX), amount);
+                carry_in_cf = true;
+            }
+            break;
+
+        case ShiftType::Asr:
+            if (inst.shift_amount == 32) {
+                emitter->SAR(32, R(EDX), Imm8(31));
+                if (shifter_carry) {
+                    emitter->BT(32, R(EDX), Imm8(0));
+                    emitter->SETcc(CC_C, c_flag);
+                }
+            } else {
+                emitter->SAR(32, R(EDX), amount);
+                carry_in_cf = true;
+            }
+            break;
+
+        case ShiftType::Ror:
+            emitter->ROR(32, R(EDX), amount);
+            carry_in_cf = true;
+            break;
+
+        case ShiftType::Rrx:
+            emitter->BT(32, c_flag, Imm8(0));
+            emitter->RCR(32, R(EDX), Imm8(1));
+            carry_in_cf = true;
+            break;
+        }
+
+        if (shifter_carry && carry_in_cf)
+            emitter->SETcc(CC_C, c_flag);
+    }
+
+    // Result into EAX
+    if (opcode != 0xD && opcode != 0xF)
+        EmitLoadRegister(EAX, inst, inst.rn);
+
+    // Subtractions leave the inverted ARM carry (borrow) in CF
+    bool is_subtraction = false;
+    switch (opcode) {
+    case 0x0: // AND
+    case 0x8: // TST
+        emitter->AND(32, R(EAX), R(EDX));
+        break;
+    case 0x1: // EOR
+    case 0x9: // TEQ
+        emitter->XOR(32, R(EAX), R(EDX));
+        break;
+    case 0x2: // SUB
+    case 0xA: // CMP
+        emitter->SUB(32, R(EAX), R(EDX));
+        is_subtraction = true;
+        break;
+    case 0x3: // RSB
+        emitter->SUB(32, R(EDX), R(EAX));
+        emitter->MOV(32, R(EAX), R(EDX));
+        is_subtraction = true;
+        break;
+    case 0x4: // ADD
+    case 0xB: // CMN
+        emitter->ADD(32, R(EAX), R(EDX));
+        break;
+    case 0x5: // ADC
+        emitter->BT(32, c_flag, Imm8(0));
+        emitter->ADC(32, R(EAX), R(EDX));
+        break;
+    case 0x6: // SBC, borrows when C is clear
+        emitter->CMP(32, c_flag, Imm8(1));
+        emitter->SBB(32, R(EAX), R(EDX));
+        is_subtraction = true;
+        break;
+    case 0x7: // RSC
+        emitter->CMP(32, c_flag, Imm8(1));
+        emitter->SBB(32, R(EDX), R(EAX));
+        emitter->MOV(32, R(EAX), R(EDX));
+        is_subtraction = true;
+        break;
+    case 0xC: // ORR
+        emitter->OR(32, R(EAX), R(EDX));
+        break;
+    case 0xD: // MOV
+        emitter->MOV(32, R(EAX), R(EDX));
+        break;
+    case 0xE: // BIC
+        emitter->NOT(32, R(EDX));
+        emitter->AND(32, R(EAX), R(EDX));
+        break;
+    case 0xF: // MVN
+        emitter->NOT(32, R(EDX));
+        emitter->MOV(32, R(EAX), R(EDX));
+        break;
+    }
+
+    if (set_flags) {
+        if (is_logical)
+            emitter->TEST(32, R(EAX), R(EAX));
+        emitter->SETcc(CC_S, MDisp(RBX, N_FLAG_OFFSET));
+        emitter->SETcc(CC_Z, MDisp(RBX, Z_FLAG_OFFSET));
+        if (!is_logical) {
+            emitter->SETcc(is_subtraction ? CC_NC : CC_C, c_flag);
+            emitter->SETcc(CC_O, MDisp(RBX, V_FLAG_OFFSET));
+        }
+    }
+
+    if (!is_compare)
+        emitter->MOV(32, MDisp(RBX, RegisterOffset(inst.rd)), R(EAX));
+    return true;
+}
+
+/**
+ * Shifts the second operand in EDX by the low byte of a register, the amount in ECX
+ * @param inst Data processing instruction with a register specified shift
+ * @param set_carry Whether the shifter carry out is written to the C flag
+ */
+void ARM_Jit::EmitRegisterShift(const Instruction& inst, bool set_carry) {
+    const OpArg c_flag = MDisp(RBX, C_FLAG_OFFSET);
+
+    emitter->MOV(32, R(EDX), MDisp(RBX, RegisterOffset(inst.rm)));
+    emitter->MOVZX(32, 8, ECX, MDisp(RBX, RegisterOffset(inst.rs)));
+
+    // A zero amount leaves the value and C unchanged
+    emitter->TEST(32, R(ECX), R(ECX));
+    FixupBranch no_shift = emitter->J_CC(CC_Z);
+
+    // Amounts of 32 and more shift everything out, which the host masks to 5 (or 6) bits. LSL, LSR
+    // and ASR are done in 64 bits with the amount clamped instead: the operand is placed so the
+    // result ends up in one half and the last bit shifted out at the top of the other.
+    const u32 limit = (inst.shift_type == ShiftType::Asr) ? 32 : 33;
+    if (inst.shift_type != ShiftType::Ror) {
+        emitter->CMP(32, R(ECX), Imm8(limit));
+        FixupBranch in_range = emitter->J_CC(CC_B);
+        emitter->MOV(32, R(ECX), Imm32(limit));
+        emitter->SetJumpTarget(in_range);
+    }
+
+    switch (inst.shift_type) {
+    case ShiftType::Lsl:
+        emitter->SHL(64, R(RDX), R(ECX));
+        if (set_carry) {
+            emitter->BT(64, R(RDX), Imm8(32));
+            emitter->SETcc(CC_C, c_flag);
+        }
+        break;
+
+    case ShiftType::Lsr:
+    case ShiftType::Asr:
+        emitter->SHL(64, R(RDX), Imm8(32));
+        if (inst.shift_type == ShiftType::Lsr)
+            emitter->SHR(64, R(RDX), R(ECX));
+        else
+            emitter->SAR(64, R(RDX), R(ECX));
+        if (set_carry) {
+            emitter->BT(64, R(RDX), Imm8(31));
+            emitter->SETcc(CC_C, c_flag);
+        }
+        emitter->SHR(64, R(RDX), Imm8(32));
+        break;
+
+    case ShiftType::Ror:
+        // Multiples of 32 leave the value unchanged, and C set to its top bit
+        emitter->ROR(32, R(EDX), R(ECX));
+        if (set_carry) {
+            emitter->BT(32, R(EDX), Imm8(31));
+            emitter->SETcc(CC_C, c_flag);
+        }
+        break;
+
+    default:
+        _assert_msg_(DYNA_REC, false, "invalid register shift type %u", (u32)inst.shift_type);
+        break;
+    }
+
+    emitter->SetJumpTarget(no_shift);
+}
+
+bool ARM_Jit::EmitMultiply(const Instruction& inst) {
+    // MUL, MLA
+    if ((inst.raw & 0x0FC000F0) != 0x00000090)
+        return false;
+
+    const bool accumulate = (inst.raw >> 21) & 1;
+    const bool set_flags = (inst.raw >> 20) & 1;
+    if (inst.rd == 15 || inst.rm == 15 || inst.rs == 15 || (accumulate && inst.rn == 15))
+        return false;
+
+    emitter->MOV(32, R(EAX), MDisp(RBX, RegisterOffset(inst.rm)));
+    emitter->IMUL(32, EAX, MDisp(RBX, RegisterOffset(inst.rs)));
+    if (accumulate)
+        emitter->ADD(32, R(EAX), MDisp(RBX, RegisterOffset(inst.rn)));
+    emitter->MOV(32, MDisp(RBX, RegisterOffset(inst.rd)), R(EAX));
+
+    if (set_flags) {
+        emitter->TEST(32, R(EAX), R(EAX));
+        emitter->SETcc(CC_S, MDisp(RBX, N_FLAG_OFFSET));
+        emitter->SETcc(CC_Z, MDisp(RBX, Z_FLAG_OFFSET));
+    }
+    return true;
+}
+
+/// Computes the address of a load/store into R15 and writes back the base register
+void ARM_Jit::EmitTransferAddress(const Instruction& inst, bool register_offset) {
+    const bool pre_index = (inst.raw >> 24) & 1;
+    const bool up = (inst.raw >> 23) & 1;
+    const bool writeback = !pre_index || ((inst.raw >> 21) & 1);
+
+    // Base in EAX, offset address in ECX, address of the access in R15
+    EmitLoadRegister(EAX, inst, inst.rn);
+    if (register_offset) {
+        EmitLoadRegister(ECX, inst, inst.rm);
+        if (inst.shift_amount)
+            emitter->SHL(32, R(ECX), Imm8(inst.shift_amount));
+        if (!up)
+            emitter->NEG(32, R(ECX));
+        emitter->ADD(32, R(ECX), R(EAX));
+    } else {
+        emitter->MOV(32, R(ECX), R(EAX));
+        if (inst.imm) {
+            if (up)
+                emitter->ADD(32, R(ECX), Imm32(inst.imm));
+            else
+                emitter->SUB(32, R(ECX), Imm32(inst.imm));
+        }
+    }
+    emitter->MOV(32, R(Gen::R15), R(pre_index ? ECX : EAX));
+    if (writeback)
+        emitter->MOV(32, MDisp(RBX, RegisterOffset(inst.rn)), R(ECX));
+}
+
+/// Leaves the block if a store of `size` bytes at R15 hit a page holding translated code
+void ARM_Jit::EmitCodeWriteCheck(const Block* block, size_t index, u32 size) {
+    const Instruction& inst = block->instructions[index];
+
+    FixupBranch code_hit;
+    FixupBranch last_page_hit;
+    if (Memory::g_fastmem) {
+        // The store bypassed Memory::Write, look up the pages here
+        emitter->MOV(32, R(EAX), R(Gen::R15));
+        emitter->SHR(32, R(EAX), Imm8(Memory::PAGE_BITS));
+        emitter->CMP(8, MComplex(Gen::R13, RAX, 1, 0), Imm8(0));
+        code_hit = emitter->J_CC(CC_NE);
+        last_page_hit = code_hit;
+        if (size > 1) {
+            emitter->LEA(32, EAX, MDisp(Gen::R15, size - 1));
+            emitter->SHR(32, R(EAX), Imm8(Memory::PAGE_BITS));
+            emitter->CMP(8, MComplex(Gen::R13, RAX, 1, 0), Imm8(0));
+            last_page_hit = emitter->J_CC(CC_NE);
+        }
+    } else {
+        // Memory::Write discarded the blocks itself
+        emitter->MOV(64, R(RAX), Imm64((u64)&code_invalidated));
+        emitter->CMP(8, MatR(RAX), Imm8(0));
+        code_hit = emitter->J_CC(CC_NE);
+        last_page_hit = code_hit;
+    }
+    FixupBranch no_code = emitter->J();
+
+    // The stored pages are invalidated, and the block is left for a freshly compiled one
+    emitter->SetJumpTarget(code_hit);
+    emitter->SetJumpTarget(last_page_hit);
+    emitter->MOV(64, R(ABI_PARAM1), R(RBP));
+    emitter->MOV(32, R(ABI_PARAM2), R(Gen::R15));
+    emitter->MOV(32, R(ABI_PARAM3), Imm32(size));
+    emitter->MOV(32, R(ABI_PARAM4), Imm32(GetNextAddress(inst)));
+    emitter->CALL((const void*)InvalidateAfterWrite);
+    EmitBlockExit(block, index);
+
+    emitter->SetJumpTarget(no_code);
+}
+
+/// LDR, LDRB, STR and STRB with an immediate or LSL shifted register offset
+bool ARM_Jit::EmitSingleDataTransfer(const Block* block, size_t index) {
+    const Instruction& inst = block->instructions[index];
+    const u32 raw = inst.raw;
+    const u32 type = (raw >> 25) & 7;
+    const bool register_offset = (type == 3);
+
+    if (type != 2 && !(type == 3 && !(raw & (1 << 4))))
+        return false;
+
+    const bool pre_index = (raw >> 24) & 1;
+    const bool byte = (raw >> 22) & 1;
+    const bool writeback = !pre_index || ((raw >> 21) & 1);
+    const bool load = (raw >> 20) & 1;
+
+    // User mode transfers, unpredictable writebacks, PC loads (which end the block) and PC stores
+    if ((!pre_index && ((raw >> 21) & 1)) || (writeback && (inst.rn == 15 || inst.rn == inst.rd)) ||
+        inst.rd == 15 ||
+        (register_offset && (inst.rm == 15 || inst.shift_type != ShiftType::Lsl))) {
+        return false;
+    }
+
+    EmitTransferAddress(inst, register_offset);
+
+    // With fastmem, unmapped accesses fault into the handler installed by the memory system
+    const OpArg fastmem_address = MComplex(R14, Gen::R15, 1, 0);
+
+    if (load) {
+        if (Memory::g_fastmem) {
+            // Word loads are not rotated: Memory::Read32's rotation is undone by the SkyEye core
+            if (byte)
+                emitter->MOVZX(32, 8, EAX, fastmem_address);
+            else
+                emitter->MOV(32, R(EAX), fastmem_address);
+        } else {
+            emitter->MOV(32, R(ABI_PARAM1), R(Gen::R15));
+            emitter->CALL(byte ? (const void*)ReadByte : (const void*)ReadWord);
+        }
+        emitter->MOV(32, MDisp(RBX, RegisterOffset(inst.rd)), R(EAX));
+        return true;
+    }
+
+    if (Memory::g_fastmem) {
+        emitter->MOV(32, R(EAX), MDisp(RBX, RegisterOffset(inst.rd)));
+        emitter->MOV(byte ? 8 : 32, fastmem_address, R(EAX));
+    } else {
+        emitter->MOV(32, R(ABI_PARAM2), MDisp(RBX, RegisterOffset(inst.rd)));
+        emitter->MOV(32, R(ABI_PARAM1), R(Gen::R15));
+        emitter->CALL(byte ? (const void*)WriteByte : (const void*)WriteWord);
+    }
+
+    // Stores to pages holding translated code invalidate them and leave the block
+    EmitCodeWriteCheck(block, index, byte ? 1 : 4);
+    return true;
+}
+
+/// LDRH, LDRSH, LDRSB and STRH with an immediate or register offset
+bool ARM_Jit::EmitExtraDataTransfer(const Block* block, size_t index) {
+    const Instruction& inst = block->instructions[index];
+    const u32 raw = inst.raw;
+
+    if ((raw & 0x0E000090) != 0x00000090 || (raw & 0x60) == 0)
+        return false;
+
+    const bool pre_index = (raw >> 24) & 1;
+    const bool register_offset = !((raw >> 22) & 1);
+    const bool writeback = !pre_index || ((raw >> 21) & 1);
+    const bool load = (raw >> 20) & 1;
+    const u32 type = (raw >> 5) & 3;
+
+    // LDRD/STRD and the same unpredictable forms the cached interpreter leaves to SkyEye
+    if ((!load && type != 1) || inst.rd == 15 || (register_offset && inst.rm == 15) ||
+        (!pre_index && ((raw >> 21) & 1)) || (writeback && (inst.rn == 15 || inst.rn == inst.rd))) {
+        return false;
+    }
+
+    EmitTransferAddress(inst, register_offset);
+
+    const OpArg fastmem_address = MComplex(R14, Gen::R15, 1, 0);
+
+    if (load) {
+        const bool is_signed = type != 1;
+        const bool halfword = type != 2;
+        if (Memory::g_fastmem) {
+            if (is_signed)
+                emitter->MOVSX(32, halfword ? 16 : 8, EAX, fastmem_address);
+            else
+                emitter->MOVZX(32, 16, EAX, fastmem_address);
+        } else {
+            emitter->MOV(32, R(ABI_PARAM1), R(Gen::R15));
+            emitter->CALL(halfword ? (const void*)ReadHalfword : (const void*)ReadByte);
+            if (is_signed)
+                emitter->MOVSX(32, halfword ? 16 : 8, EAX, R(EAX));
+        }
+        emitter->MOV(32, MDisp(RBX, RegisterOffset(inst.rd)), R(EAX));
+        return true;
+    }
+
+    if (Memory::g_fastmem) {
+        emitter->MOV(32, R(EAX), MDisp(RBX, RegisterOffset(inst.rd)));
+        emitter->MOV(16, fastmem_address, R(EAX));
+    } else {
+        emitter->MOV(32, R(ABI_PARAM2), MDisp(RBX, RegisterOffset(inst.rd)));
+        emitter->MOV(32, R(ABI_PARAM1), R(Gen::R15));
+        emitter->CALL((const void*)WriteHalfword);
+    }
+
+    EmitCodeWriteCheck(block, index, 2);
+    return true;
+}
+
+/**
+ * LDM and STM, including PUSH and POP. inst.imm holds the register list and inst.shift_amount the
+ * number of registers, see the cached interpreter's BlockDataTransfer.
+ */
+bool ARM_Jit::EmitBlockDataTransfer(const Block* block, size_t index) {
+    const Instruction& inst = block->instructions[index];
+    const u32 raw = inst.raw;
+
+    // User bank transfers and exception returns are left to SkyEye, like in the decoder
+    if (((raw >> 25) & 7) != 4 || (raw & (1 << 22)) || inst.rn == 15 || (raw & 0xFFFF) == 0)
+        return false;
+
+    const bool load = (raw >> 20) & 1;
+    const bool pre_index = (inst.flags & FLAG_PRE_INDEX) != 0;
+    const bool up = (inst.flags & FLAG_UP) != 0;
+    const bool writeback = (inst.flags & FLAG_WRITEBACK) != 0;
+    const u32 size = inst.shift_amount * 4;
+
+    // Lowest address accessed into R15, the registers are transferred in ascending order from it
+    s32 start_offset;
+    if (up)
+        start_offset = pre_index ? 4 : 0;
+    else
+        start_offset = pre_index ? -(s32)size : -(s32)size + 4;
+    emitter->MOV(32, R(EAX), MDisp(RBX, RegisterOffset(inst.rn)));
+    emitter->LEA(32, Gen::R15, MDisp(RAX, start_offset));
+    emitter->AND(32, R(Gen::R15), Imm32(~3U));
+
+    const OpArg base = MDisp(RBX, RegisterOffset(inst.rn));
+    const OpArg fastmem_address = MComplex(R14, Gen::R15, 1, 0);
+
+    if (load) {
+        // The base is written back first, a loaded value for it takes precedence
+        if (writeback) {
+            if (up)
+                emitter->ADD(32, base, Imm32(size));
+            else
+                emitter->SUB(32, base, Imm32(size));
+        }
+
+        for (u32 reg = 0; reg < 16; ++reg) {
+            if (!(inst.imm & (1 << reg)))
+                continue;
+
+            if (Memory::g_fastmem) {
+                emitter->MOV(32, R(EAX), fastmem_address);
+            } else {
+                emitter->MOV(32, R(ABI_PARAM1), R(Gen::R15));
+                emitter->CALL((const void*)ReadWord);
+            }
+
+            if (reg == 15) {
+                // Bit 0 of the loaded PC selects Thumb, ARM targets are word aligned
+                emitter->MOV(32, R(ECX), R(EAX));
+                emitter->AND(32, R(ECX), Imm8(1));
+                emitter->MOV(32, MDisp(RBX, T_FLAG_OFFSET), R(ECX));
+                emitter->ADD(32, R(ECX), R(ECX));
+                emitter->OR(32, R(ECX), Imm32(~3U));
+                emitter->AND(32, R(EAX), R(ECX));
+                emitter->MOV(32,
+                    MDisp(RBP, offsetof(JitState, exec) + offsetof(ExecState, next_pc)), R(EAX));
+                EmitBlockExit(block, index);
+                return true;
+            }
+
+            emitter->MOV(32, MDisp(RBX, RegisterOffset(reg)), R(EAX));
+            emitter->ADD(32, R(Gen::R15), Imm8(4));
+        }
+        return true;
+    }
+
+    for (u32 reg = 0; reg < 16; ++reg) {
+        if (!(inst.imm & (1 << reg)))
+            continue;
+
+        if (Memory::g_fastmem) {
+            EmitLoadRegister(EAX, inst, reg);
+            emitter->MOV(32, fastmem_address, R(EAX));
+        } else {
+            EmitLoadRegister(ABI_PARAM2, inst, reg);
+            emitter->MOV(32, R(ABI_PARAM1), R(Gen::R15));
+            emitter->CALL((const void*)WriteWord);
+        }
+        emitter->ADD(32, R(Gen::R15), Imm8(4));
+    }
+
+    // Stored values are read before the base is written back
+    if (writeback) {
+        if (up)
+            emitter->ADD(32, base, Imm32(size));
+        else
+            emitter->SUB(32, base, Imm32(size));
+    }
+
+    emitter->SUB(32, R(Gen::R15), Imm32(size));
+    EmitCodeWriteCheck(block, index, size);
+    return true;
+}
+
+/// B, BL, BLX (immediate) and their Thumb forms
+bool ARM_Jit::EmitBranch(const Instruction& inst) {
+    if (((inst.raw >> 25) & 7) != 5)
+        return false;
+
+    // Calls from Thumb code return to Thumb code, BLX (immediate) always switches instruction set
+    const bool thumb = (inst.flags & FLAG_THUMB) != 0;
+    const bool exchange = (inst.raw >> 28) == 0xF;
+    if (((inst.raw >> 24) & 1) || exchange)
+        emitter->MOV(32, MDisp(RBX, RegisterOffset(14)), Imm32(GetNextAddress(inst) | thumb));
+    if (exchange)
+        emitter->MOV(32, MDisp(RBX, T_FLAG_OFFSET), Imm32(!thumb));
+    EmitLinkedExit(inst.imm, thumb != exchange);
+    return true;
+}
+
+/// BX and BLX (register), which end the block with a jump to a register
+bool ARM_Jit::EmitBranchExchange(const Block* block, size_t index) {
+    const Instruction& inst = block->instructions[index];
+    if ((inst.raw & 0x0FFFFFD0) != 0x012FFF10 || inst.rm == 15)
+        return false;
+
+    // The target is read before BLX LR overwrites it
+    emitter->MOV(32, R(EAX), MDisp(RBX, RegisterOffset(inst.rm)));
+    if ((inst.raw >> 5) & 1) {
+        const bool thumb = (inst.flags & FLAG_THUMB) != 0;
+        emitter->MOV(32, MDisp(RBX, RegisterOffset(14)), Imm32(GetNextAddress(inst) | thumb));
+    }
+
+    emitter->MOV(32, R(ECX), R(EAX));
+    emitter->AND(32, R(ECX), Imm8(1));
+    emitter->MOV(32, MDisp(RBX, T_FLAG_OFFSET), R(ECX));
+    emitter->AND(32, R(EAX), Imm32(~1U));
+    emitter->MOV(32, MDisp(RBP, offsetof(JitState, exec) + offsetof(ExecState, next_pc)), R(EAX));
+    EmitBlockExit(block, index);
+    return true;
+}
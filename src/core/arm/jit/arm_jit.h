@@ -0,0 +1,141 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common.h"
+
+#include "core/arm/interpreter/arm_cached_interpreter.h"
+
+// The emitter is only used by arm_jit.cpp, and its instruction names clash with SkyEye's macros
+namespace Gen {
+class XEmitter;
+struct FixupBranch;
+enum X64Reg : u8;
+}
+
+/**
+ * ARM11 dynamic recompiler for x86-64 hosts. Guest blocks are decoded by the cached interpreter and
+ * translated into host code that works directly on ARMul_State, so the register file, flags and
+ * thread context layout are the same as with the interpreters. Thumb blocks are decoded as their
+ * ARM equivalents and compiled the same way. Data processing (including register shifted operands),
+ * multiply, word, byte and halfword load/store, LDM/STM, branch and BX/BLX instructions are emitted
+ * natively, the remaining instructions call the cached interpreter's handlers (which hand VFP,
+ * coprocessor and unusual Thumb instructions to the SkyEye core). Blocks ending in a direct branch
+ * are linked to each other, and the code cache is flushed as a whole when it runs out of space.
+ */
+class ARM_Jit : public ARM_CachedInterpreter {
+public:
+
+    ARM_Jit();
+    ~ARM_Jit();
+
+    /// Prepare core for thread reschedule (if needed to correctly handle state)
+    void PrepareReschedule();
+
+    /// Discard any cached translations of guest code (must be called when code is replaced)
+    void ClearInstructionCache();
+
+protected:
+
+    /**
+     * Executes the given number of instructions
+     * @param num_instructions Number of instructions to executes
+     */
+    void ExecuteInstructions(int num_instructions);
+
+    /// Discards the cached blocks of a single page
+    void InvalidatePage(u32 page);
+
+private:
+
+    /// State of the compiled code, pointed to by RBP while it runs
+    struct JitState {
+        ExecState exec;             ///< Must come first, handlers are passed a pointer to it
+        s32 remaining;              ///< Instructions left to execute, may go negative
+        s32 reschedule_credit;      ///< Instructions skipped because a reschedule was requested
+        u32 idle_loop;              ///< Set by compiled code when an idle loop jumps back to its start
+    };
+
+    /// Host code of a guest block
+    struct CompiledBlock {
+        const u8* entry;            ///< Entry point in the code cache
+        s32 num_instructions;       ///< Guest instructions charged when the block is entered
+    };
+
+    /// Entry trampoline: sets up the host registers, runs compiled code and returns the next PC
+    typedef u32 (*RunCodeFunction)(ARMul_State* state, JitState* jit_state, const u8* entry);
+
+    /// Emits the entry trampoline and the common exit code at the start of the code cache
+    void GenerateTrampolines();
+
+    /**
+     * Compiles a translated block into the code cache
+     * @param block Block decoded by the cached interpreter
+     * @param pc Guest address of the block
+     * @return Entry point and size of the compiled block
+     */
+    CompiledBlock CompileBlock(const Block* block, u32 pc);
+
+    /**
+     * Emits a check of the condition code of an instruction
+     * @return Branch taken when the condition fails
+     */
+    Gen::FixupBranch EmitConditionCheck(u32 cond);
+
+    /// Loads the value of a guest register (the PC reads as the address of the instruction plus 8,
+    /// or plus 4 in Thumb code)
+    void EmitLoadRegister(Gen::X64Reg host_reg, const Instruction& inst, u32 guest_reg);
+
+    /// Leaves the block after instruction `index`, un-charging the instructions that were skipped
+    void EmitBlockExit(const Block* block, size_t index);
+
+    /// Emits a jump to another block, linked directly once that block is compiled. TFlag must
+    /// already match `thumb`.
+    void EmitLinkedExit(u32 target, bool thumb);
+
+    /// Points a link site at a compiled block, or back at its exit stub if entry is nullptr
+    void PatchLinkSite(u8* site, const u8* entry);
+
+    /// Emits a call to the cached interpreter's handler for an instruction
+    void EmitInterpreterCall(const Block* block, size_t index);
+
+    /**
+     * Shifts the second operand in EDX by the low byte of a register, the amount in ECX
+     * @param inst Data processing instruction with a register specified shift
+     * @param set_carry Whether the shifter carry out is written to the C flag
+     */
+    void EmitRegisterShift(const Instruction& inst, bool set_carry);
+
+    /// Computes the address of a load/store into R15 and writes back the base register
+    void EmitTransferAddress(const Instruction& inst, bool register_offset);
+
+    /// Leaves the block if a store of `size` bytes at R15 hit a page holding translated code
+    void EmitCodeWriteCheck(const Block* block, size_t index, u32 size);
+
+    // Natively compiled instructions, each returns false if it can't handle the instruction
+    bool EmitDataProcessing(const Instruction& inst);
+    bool EmitMultiply(const Instruction& inst);
+    bool EmitSingleDataTransfer(const Block* block, size_t index);
+    bool EmitExtraDataTransfer(const Block* block, size_t index);
+    bool EmitBlockDataTransfer(const Block* block, size_t index);
+    bool EmitBranch(const Instruction& inst);
+    bool EmitBranchExchange(const Block* block, size_t index);
+
+    std::unique_ptr<Gen::XEmitter> emitter;     ///< Emitter writing into the code cache
+    u8* code_cache;                             ///< Executable memory holding the compiled code
+    u8* code_cache_blocks;                      ///< First byte after the trampolines
+    RunCodeFunction run_code;                   ///< Entry trampoline
+    const u8* exit_code;                        ///< Common exit path, returns exec.next_pc
+
+    JitState jit_state;
+
+    std::unordered_map<u32, CompiledBlock> entry_points;    ///< Compiled blocks by block key
+    std::unordered_map<u32, std::vector<u8*>> link_sites;   ///< Jumps to each block key
+
+};
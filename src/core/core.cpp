@@ -4,14 +4,17 @@
 
 #include "common/common_types.h"
 #include "common/log.h"
+#include "common/profiler.h"
 #include "common/symbols.h"
 
 #include "core/core.h"
+#include "core/core_timing.h"
 #include "core/mem_map.h"
-#include "core/hw/hw.h"
-#include "core/hw/gpu.h"
+#include "core/settings.h"
 #include "core/arm/disassembler/arm_disasm.h"
 #include "core/arm/interpreter/arm_interpreter.h"
+#include "core/arm/interpreter/arm_cached_interpreter.h"
+#include "core/arm/jit/arm_jit.h"
 
 #include "core/hle/hle.h"
 #include "core/hle/kernel/thread.h"
@@ -23,30 +26,43 @@ ARM_Disasm*     g_disasm        = nullptr;  ///< ARM disassembler
 ARM_Interface*  g_app_core      = nullptr;  ///< ARM11 application core
 ARM_Interface*  g_sys_core      = nullptr;  ///< ARM11 system (OS) core
 
+static volatile bool g_stop_requested = false;  ///< Makes RunLoop return after the current slice
+
+/// Charges the executed ticks to CoreTiming, firing any events that are due, and reschedules
+static void EndSlice() {
+    CoreTiming::SyncCpuTicks();
+    if (CoreTiming::downcount <= 0) {
+        CoreTiming::Advance();
+    }
+    // While every thread waits, keep looking for one that an event made ready
+    if (HLE::g_reschedule || !Kernel::IsCurrentThreadRunning()) {
+        Kernel::Reschedule();
+    }
+}
+
 /// Run the core CPU loop
 void RunLoop() {
-    for (;;){
-        // This function loops for 100 instructions in the CPU before trying to update hardware.
-        // This is a little bit faster than SingleStep, and should be pretty much equivalent. The 
-        // number of instructions chosen is fairly arbitrary, however a large number will more 
-        // drastically affect the frequency of GSP interrupts and likely break things. The point of
-        // this is to just loop in the CPU for more than 1 instruction to reduce overhead and make
-        // it a little bit faster...
-        g_app_core->Run(100);
-        HW::Update();
-        if (HLE::g_reschedule) {
-            Kernel::Reschedule();
+    while (!g_stop_requested) {
+        // Hardware is driven by CoreTiming events, so the CPU runs until the next one is due (or
+        // until a thread switch cuts the slice short). ShortenSlice stops the CPU as well, so the
+        // downcount is read again here instead of being trusted for the whole slice.
+        if (!Kernel::IsCurrentThreadRunning()) {
+            // Every thread is waiting: skip ahead to the next event, which may wake one up
+            CoreTiming::Idle();
+        } else if (CoreTiming::downcount > 0) {
+            // Run takes an unsigned count of instructions, an empty slice is left to EndSlice
+            Common::Profiling::ScopedSection profile_section(Common::Profiling::SECTION_CPU);
+            g_app_core->Run(CoreTiming::downcount);
         }
+        EndSlice();
     }
+    g_stop_requested = false;
 }
 
 /// Step the CPU one instruction
 void SingleStep() {
     g_app_core->Step();
-    HW::Update();
-    if (HLE::g_reschedule) {
-        Kernel::Reschedule();
-    }
+    EndSlice();
 }
 
 /// Halt the core
@@ -56,7 +72,7 @@ void Halt(const char *msg) {
 
 /// Kill the core
 void Stop() {
-    // TODO(ShizZy): ImplementMe
+    g_stop_requested = true;
 }
 
 /// Initialize the core
@@ -64,10 +80,29 @@ int Init() {
     NOTICE_LOG(MASTER_LOG, "initialized OK");
 
     g_disasm = new ARM_Disasm();
-    g_app_core = new ARM_Interpreter();
-    g_sys_core = new ARM_Interpreter();
+
+    switch (Settings::values.cpu_core) {
+#ifdef _M_X64
+    case Settings::CpuCore::Jit:
+        g_app_core = new ARM_Jit();
+        g_sys_core = new ARM_Jit();
+        break;
+#endif
+
+    case Settings::CpuCore::CachedInterpreter:
+        g_app_core = new ARM_CachedInterpreter();
+        g_sys_core = new ARM_CachedInterpreter();
+        break;
+
+    case Settings::CpuCore::Interpreter:
+    default:
+        g_app_core = new ARM_Interpreter();
+        g_sys_core = new ARM_Interpreter();
+        break;
+    }
 
     g_last_ticks = Core::g_app_core->GetTicks();
+    g_stop_requested = false;
 
     return 0;
 }
@@ -19,7 +19,7 @@ extern ARM_Interface*   g_sys_core;     ///< ARM11 system (OS) core
 /// Start the core
 void Start();
 
-/// Run the core CPU loop
+/// Run the core CPU loop, until Stop is called
 void RunLoop();
 
 /// Step the CPU one instruction
@@ -28,7 +28,7 @@ void SingleStep();
 /// Halt the core
 void Halt(const char *msg);
 
-/// Kill the core
+/// Kill the core: makes RunLoop return once the current slice is done (may be called from an event)
 void Stop();
 
 /// Initialize the core
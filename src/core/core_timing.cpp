@@ -2,12 +2,12 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <cstdio>
 
 #include "common/msg_handler.h"
-#include "common/std_mutex.h"
-#include "common/atomic.h"
 #include "common/chunk_file.h"
 
 #include "core/core_timing.h"
@@ -35,36 +35,48 @@ struct EventType
 
 std::vector<EventType> event_types;
 
+// The part of an event that goes into save states
 struct BaseEvent
 {
     s64 time;
     u64 userdata;
     int type;
-    //	Event *next;
 };
 
-typedef LinkedListItem<BaseEvent> Event;
+// Entry of the event pool. Pending events are kept in a binary min-heap of pool indices, ordered
+// by time and then by scheduling order, so events due at the same time fire in the order they
+// were scheduled.
+struct Event : BaseEvent
+{
+    u64 order;          // Value of nextOrder when the event was scheduled
+    u32 generation;     // Bumped when the slot is freed, so stale handles don't match
+    s32 heapIndex;      // Position in the heap, -1 while the slot is free
+};
+
+std::vector<Event> eventPool;
+std::vector<u32> freeSlots;
+std::vector<u32> eventHeap;
+u64 nextOrder;
 
-Event *first;
-Event *tsFirst;
-Event *tsLast;
+// Events scheduled by other threads. Producers push onto this lock-free stack, and the CPU
+// thread takes the whole stack at once in MoveEvents. Producers can't read the CPU state, so
+// their time is relative until the CPU thread takes them.
+struct TsEvent : BaseEvent
+{
+    TsEvent *next;
+};
 
-// event pools
-Event *eventPool = 0;
-Event *eventTsPool = 0;
-int allocatedTsEvents = 0;
-// Optimization to skip MoveEvents when possible.
-volatile u32 hasTsEvents = false;
+std::atomic<TsEvent*> tsInbox(nullptr);
 
-// Downcount has been moved to currentMIPS, to save a couple of clocks in every ARM JIT block
-// as we can already reach that structure through a register.
 int slicelength;
+int downcount;
+
+// App core tick count when downcount was last brought up to date
+u64 lastCpuTicks;
 
 MEMORY_ALIGNED16(s64) globalTimer;
 s64 idledCycles;
 
-static std::recursive_mutex externalEventSection;
-
 // Warning: not included in save state.
 void(*advanceCallback)(int cyclesExecuted) = NULL;
 
@@ -79,40 +91,117 @@ int GetClockFrequencyMHz()
     return g_clock_rate_arm11 / 1000000;
 }
 
+static EventHandle MakeHandle(u32 slot)
+{
+    return ((u64)eventPool[slot].generation << 32) | (slot + 1);
+}
+
+static bool EventBefore(u32 a, u32 b)
+{
+    const Event &ea = eventPool[a];
+    const Event &eb = eventPool[b];
+    return ea.time < eb.time || (ea.time == eb.time && ea.order < eb.order);
+}
 
-Event* GetNewEvent()
+static void HeapSet(size_t pos, u32 slot)
 {
-    if (!eventPool)
-        return new Event;
+    eventHeap[pos] = slot;
+    eventPool[slot].heapIndex = (s32)pos;
+}
 
-    Event* ev = eventPool;
-    eventPool = ev->next;
-    return ev;
+static void SiftUp(size_t pos)
+{
+    u32 slot = eventHeap[pos];
+    while (pos > 0)
+    {
+        size_t parent = (pos - 1) / 2;
+        if (!EventBefore(slot, eventHeap[parent]))
+            break;
+        HeapSet(pos, eventHeap[parent]);
+        pos = parent;
+    }
+    HeapSet(pos, slot);
 }
 
-Event* GetNewTsEvent()
+static void SiftDown(size_t pos)
 {
-    allocatedTsEvents++;
+    u32 slot = eventHeap[pos];
+    size_t size = eventHeap.size();
+    for (;;)
+    {
+        size_t child = pos * 2 + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size && EventBefore(eventHeap[child + 1], eventHeap[child]))
+            child++;
+        if (!EventBefore(eventHeap[child], slot))
+            break;
+        HeapSet(pos, eventHeap[child]);
+        pos = child;
+    }
+    HeapSet(pos, slot);
+}
 
-    if (!eventTsPool)
-        return new Event;
+static void FreeSlot(u32 slot)
+{
+    eventPool[slot].heapIndex = -1;
+    eventPool[slot].generation++;
+    freeSlots.push_back(slot);
+}
 
-    Event* ev = eventTsPool;
-    eventTsPool = ev->next;
-    return ev;
+// Removes the event at the given heap position and returns its pool slot (which is not freed)
+static u32 HeapRemove(size_t pos)
+{
+    u32 slot = eventHeap[pos];
+    u32 last = eventHeap.back();
+    eventHeap.pop_back();
+    if (pos < eventHeap.size())
+    {
+        HeapSet(pos, last);
+        if (pos > 0 && EventBefore(last, eventHeap[(pos - 1) / 2]))
+            SiftUp(pos);
+        else
+            SiftDown(pos);
+    }
+    return slot;
 }
 
-void FreeEvent(Event* ev)
+// Removes all pending events matching a predicate, returns the cycles left on the last one
+template <typename Pred>
+static s64 RemoveMatchingEvents(Pred pred)
 {
-    ev->next = eventPool;
-    eventPool = ev;
+    s64 result = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < eventHeap.size(); i++)
+    {
+        u32 slot = eventHeap[i];
+        if (pred(eventPool[slot]))
+        {
+            result = eventPool[slot].time - globalTimer;
+            FreeSlot(slot);
+        }
+        else
+        {
+            eventHeap[kept++] = slot;
+        }
+    }
+    if (kept == eventHeap.size())
+        return result;
+
+    eventHeap.resize(kept);
+    for (size_t i = 0; i < kept; i++)
+        eventPool[eventHeap[i]].heapIndex = (s32)i;
+    for (size_t i = kept / 2; i-- > 0;)
+        SiftDown(i);
+    return result;
 }
 
-void FreeTsEvent(Event* ev)
+// Returns the pool slots of the pending events in the order they will fire
+static std::vector<u32> GetSortedEvents()
 {
-    ev->next = eventTsPool;
-    eventTsPool = ev;
-    allocatedTsEvents--;
+    std::vector<u32> sorted(eventHeap);
+    std::sort(sorted.begin(), sorted.end(), EventBefore);
+    return sorted;
 }
 
 int RegisterEvent(const char *name, TimedCallback callback)
@@ -137,18 +226,19 @@ void RestoreRegisterEvent(int event_type, const char *name, TimedCallback callba
 
 void UnregisterAllEvents()
 {
-    if (first)
+    if (!eventHeap.empty())
         PanicAlert("Cannot unregister events with events pending");
     event_types.clear();
 }
 
 void Init()
 {
-    //currentMIPS->downcount = INITIAL_SLICE_LENGTH;
-    //slicelength = INITIAL_SLICE_LENGTH;
+    downcount = INITIAL_SLICE_LENGTH;
+    slicelength = INITIAL_SLICE_LENGTH;
+    lastCpuTicks = Core::g_app_core->GetTicks();
     globalTimer = 0;
     idledCycles = 0;
-    hasTsEvents = 0;
+    nextOrder = 0;
 }
 
 void Shutdown()
@@ -157,27 +247,22 @@ void Shutdown()
     ClearPendingEvents();
     UnregisterAllEvents();
 
-    while (eventPool)
-    {
-        Event *ev = eventPool;
-        eventPool = ev->next;
-        delete ev;
-    }
-
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-    while (eventTsPool)
-    {
-        Event *ev = eventTsPool;
-        eventTsPool = ev->next;
-        delete ev;
-    }
+    std::vector<Event>().swap(eventPool);
+    std::vector<u32>().swap(freeSlots);
+    std::vector<u32>().swap(eventHeap);
 }
 
 u64 GetTicks()
 {
-    ERROR_LOG(TIME, "Unimplemented function!");
-    return 0;
-    //return (u64)globalTimer + slicelength - currentMIPS->downcount;
+    // Also count the ticks of a slice the CPU is still running
+    return (u64)globalTimer + slicelength - downcount + (Core::g_app_core->GetTicks() - lastCpuTicks);
+}
+
+void SyncCpuTicks()
+{
+    u64 cpuTicks = Core::g_app_core->GetTicks();
+    downcount -= (int)(cpuTicks - lastCpuTicks);
+    lastCpuTicks = cpuTicks;
 }
 
 u64 GetIdleTicks()
@@ -190,19 +275,16 @@ u64 GetIdleTicks()
 // schedule things to be executed on the main thread.
 void ScheduleEvent_Threadsafe(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-    Event *ne = GetNewTsEvent();
-    ne->time = GetTicks() + cyclesIntoFuture;
+    TsEvent *ne = new TsEvent;
+    ne->time = cyclesIntoFuture;
     ne->type = event_type;
-    ne->next = 0;
     ne->userdata = userdata;
-    if (!tsFirst)
-        tsFirst = ne;
-    if (tsLast)
-        tsLast->next = ne;
-    tsLast = ne;
 
-    Common::AtomicStoreRelease(hasTsEvents, 1);
+    ne->next = tsInbox.load(std::memory_order_relaxed);
+    while (!tsInbox.compare_exchange_weak(ne->next, ne, std::memory_order_release,
+                                          std::memory_order_relaxed))
+    {
+    }
 }
 
 // Same as ScheduleEvent_Threadsafe(0, ...) EXCEPT if we are already on the CPU thread
@@ -211,7 +293,6 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata)
 {
     if (false) //Core::IsCPUThread())
     {
-        std::lock_guard<std::recursive_mutex> lk(externalEventSection);
         event_types[event_type].callback(userdata, 0);
     }
     else
@@ -220,140 +301,131 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata)
 
 void ClearPendingEvents()
 {
-    while (first)
+    for (size_t i = 0; i < eventHeap.size(); i++)
+        FreeSlot(eventHeap[i]);
+    eventHeap.clear();
+}
+
+// Ends the current slice early if the event is due before it, so it isn't fired late
+void ShortenSlice(s64 time)
+{
+    s64 cyclesLeft = globalTimer + slicelength - time;
+    if (cyclesLeft > 0)
     {
-        Event *e = first->next;
-        FreeEvent(first);
-        first = e;
+        slicelength -= (int)cyclesLeft;
+        downcount -= (int)cyclesLeft;
+        // The CPU may be running the slice: make it stop, RunLoop resumes it with what is left
+        Core::g_app_core->PrepareReschedule();
     }
 }
 
-void AddEventToQueue(Event* ne)
+static EventHandle AddEventToQueue(s64 time, int event_type, u64 userdata)
 {
-    Event* prev = NULL;
-    Event** pNext = &first;
-    for (;;)
+    u32 slot;
+    if (freeSlots.empty())
     {
-        Event*& next = *pNext;
-        if (!next || ne->time < next->time)
-        {
-            ne->next = next;
-            next = ne;
-            break;
-        }
-        prev = next;
-        pNext = &prev->next;
+        slot = (u32)eventPool.size();
+        eventPool.push_back(Event());
+    }
+    else
+    {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
     }
+
+    Event &ne = eventPool[slot];
+    ne.time = time;
+    ne.userdata = userdata;
+    ne.type = event_type;
+    ne.order = nextOrder++;
+
+    eventHeap.push_back(slot);
+    SiftUp(eventHeap.size() - 1);
+    return MakeHandle(slot);
 }
 
 // This must be run ONLY from within the cpu thread
 // cyclesIntoFuture may be VERY inaccurate if called from anything else
-// than Advance 
-void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
+// than Advance
+EventHandle ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-    Event *ne = GetNewEvent();
-    ne->userdata = userdata;
-    ne->type = event_type;
-    ne->time = GetTicks() + cyclesIntoFuture;
-    AddEventToQueue(ne);
+    s64 time = GetTicks() + cyclesIntoFuture;
+    ShortenSlice(time);
+    return AddEventToQueue(time, event_type, userdata);
+}
+
+s64 UnscheduleEvent(EventHandle handle)
+{
+    u32 slot = (u32)handle - 1;
+    if (slot >= eventPool.size() || eventPool[slot].generation != (u32)(handle >> 32) ||
+        eventPool[slot].heapIndex < 0)
+        return 0;
+
+    s64 result = eventPool[slot].time - globalTimer;
+    HeapRemove(eventPool[slot].heapIndex);
+    FreeSlot(slot);
+    return result;
 }
 
 // Returns cycles left in timer.
 s64 UnscheduleEvent(int event_type, u64 userdata)
 {
-    s64 result = 0;
-    if (!first)
-        return result;
-    while (first)
-    {
-        if (first->type == event_type && first->userdata == userdata)
-        {
-            result = first->time - globalTimer;
+    return RemoveMatchingEvents([=](const Event &e) {
+        return e.type == event_type && e.userdata == userdata;
+    });
+}
 
-            Event *next = first->next;
-            FreeEvent(first);
-            first = next;
-        }
-        else
-        {
-            break;
-        }
-    }
-    if (!first)
-        return result;
-    Event *prev = first;
-    Event *ptr = prev->next;
-    while (ptr)
-    {
-        if (ptr->type == event_type && ptr->userdata == userdata)
-        {
-            result = ptr->time - globalTimer;
+// Takes the events posted by other threads, in the order they were scheduled
+static TsEvent* TakeThreadsafeEvents()
+{
+    TsEvent *list = tsInbox.exchange(nullptr, std::memory_order_acquire);
 
-            prev->next = ptr->next;
-            FreeEvent(ptr);
-            ptr = prev->next;
-        }
-        else
-        {
-            prev = ptr;
-            ptr = ptr->next;
-        }
+    TsEvent *ordered = nullptr;
+    while (list)
+    {
+        TsEvent *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
     }
-
-    return result;
+    return ordered;
 }
 
-s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata)
+// Moves the events posted by other threads into the queue, dropping those matching a predicate.
+// Returns the cycles left on the last dropped event.
+template <typename Pred>
+static s64 MoveThreadsafeEvents(Pred drop)
 {
     s64 result = 0;
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-    if (!tsFirst)
-        return result;
-    while (tsFirst)
+    TsEvent *ev = TakeThreadsafeEvents();
+    const s64 now = ev ? GetTicks() : 0;
+    while (ev)
     {
-        if (tsFirst->type == event_type && tsFirst->userdata == userdata)
-        {
-            result = tsFirst->time - globalTimer;
-
-            Event *next = tsFirst->next;
-            FreeTsEvent(tsFirst);
-            tsFirst = next;
-        }
+        ev->time += now;
+        if (drop(*ev))
+            result = ev->time - globalTimer;
         else
         {
-            break;
+            ShortenSlice(ev->time);
+            AddEventToQueue(ev->time, ev->type, ev->userdata);
         }
-    }
-    if (!tsFirst)
-    {
-        tsLast = NULL;
-        return result;
-    }
-
-    Event *prev = tsFirst;
-    Event *ptr = prev->next;
-    while (ptr)
-    {
-        if (ptr->type == event_type && ptr->userdata == userdata)
-        {
-            result = ptr->time - globalTimer;
 
-            prev->next = ptr->next;
-            if (ptr == tsLast)
-                tsLast = prev;
-            FreeTsEvent(ptr);
-            ptr = prev->next;
-        }
-        else
-        {
-            prev = ptr;
-            ptr = ptr->next;
-        }
+        TsEvent *next = ev->next;
+        delete ev;
+        ev = next;
     }
-
     return result;
 }
 
+s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata)
+{
+    // Only the CPU thread takes events from the inbox, so the pending ones can be filtered
+    // while they are moved into the main queue
+    return MoveThreadsafeEvents([=](const BaseEvent &e) {
+        return e.type == event_type && e.userdata == userdata;
+    });
+}
+
 // Warning: not included in save state.
 void RegisterAdvanceCallback(void(*callback)(int cyclesExecuted))
 {
@@ -362,97 +434,26 @@ void RegisterAdvanceCallback(void(*callback)(int cyclesExecuted))
 
 bool IsScheduled(int event_type)
 {
-    if (!first)
-        return false;
-    Event *e = first;
-    while (e) {
-        if (e->type == event_type)
+    for (size_t i = 0; i < eventHeap.size(); i++)
+    {
+        if (eventPool[eventHeap[i]].type == event_type)
             return true;
-        e = e->next;
     }
     return false;
 }
 
 void RemoveEvent(int event_type)
 {
-    if (!first)
-        return;
-    while (first)
-    {
-        if (first->type == event_type)
-        {
-            Event *next = first->next;
-            FreeEvent(first);
-            first = next;
-        }
-        else
-        {
-            break;
-        }
-    }
-    if (!first)
-        return;
-    Event *prev = first;
-    Event *ptr = prev->next;
-    while (ptr)
-    {
-        if (ptr->type == event_type)
-        {
-            prev->next = ptr->next;
-            FreeEvent(ptr);
-            ptr = prev->next;
-        }
-        else
-        {
-            prev = ptr;
-            ptr = ptr->next;
-        }
-    }
+    RemoveMatchingEvents([=](const Event &e) {
+        return e.type == event_type;
+    });
 }
 
 void RemoveThreadsafeEvent(int event_type)
 {
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-    if (!tsFirst)
-    {
-        return;
-    }
-    while (tsFirst)
-    {
-        if (tsFirst->type == event_type)
-        {
-            Event *next = tsFirst->next;
-            FreeTsEvent(tsFirst);
-            tsFirst = next;
-        }
-        else
-        {
-            break;
-        }
-    }
-    if (!tsFirst)
-    {
-        tsLast = NULL;
-        return;
-    }
-    Event *prev = tsFirst;
-    Event *ptr = prev->next;
-    while (ptr)
-    {
-        if (ptr->type == event_type)
-        {
-            prev->next = ptr->next;
-            if (ptr == tsLast)
-                tsLast = prev;
-            FreeTsEvent(ptr);
-            ptr = prev->next;
-        }
-        else
-        {
-            prev = ptr;
-            ptr = ptr->next;
-        }
-    }
+    MoveThreadsafeEvents([=](const BaseEvent &e) {
+        return e.type == event_type;
+    });
 }
 
 void RemoveAllEvents(int event_type)
@@ -464,145 +465,133 @@ void RemoveAllEvents(int event_type)
 //This raise only the events required while the fifo is processing data
 void ProcessFifoWaitEvents()
 {
-    while (first)
+    while (!eventHeap.empty())
     {
-        if (first->time <= globalTimer)
-        {
-            //			LOG(TIMER, "[Scheduler] %s		 (%lld, %lld) ", 
-            //				first->name ? first->name : "?", (u64)globalTimer, (u64)first->time);
-            Event* evt = first;
-            first = first->next;
-            event_types[evt->type].callback(evt->userdata, (int)(globalTimer - evt->time));
-            FreeEvent(evt);
-        }
-        else
-        {
+        u32 slot = eventHeap[0];
+        if (eventPool[slot].time > globalTimer)
             break;
-        }
+
+        //			LOG(TIMER, "[Scheduler] %s		 (%lld, %lld) ",
+        //				first->name ? first->name : "?", (u64)globalTimer, (u64)first->time);
+        // The callback may schedule events, which can reallocate the pool
+        BaseEvent evt = eventPool[slot];
+        HeapRemove(0);
+        FreeSlot(slot);
+        event_types[evt.type].callback(evt.userdata, (int)(globalTimer - evt.time));
     }
 }
 
 void MoveEvents()
 {
-    Common::AtomicStoreRelease(hasTsEvents, 0);
+    if (tsInbox.load(std::memory_order_relaxed))
+        MoveThreadsafeEvents([](const BaseEvent &e) { return false; });
+}
+
+void Advance()
+{
+    SyncCpuTicks();
+
+    int cyclesExecuted = slicelength - downcount;
+    globalTimer += cyclesExecuted;
+    downcount = slicelength;
 
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-    // Move events from async queue into main queue
-    while (tsFirst)
+    MoveEvents();
+    ProcessFifoWaitEvents();
+
+    if (eventHeap.empty())
     {
-        Event *next = tsFirst->next;
-        AddEventToQueue(tsFirst);
-        tsFirst = next;
+        // WARN_LOG(TIMER, "WARNING - no events in queue. Setting downcount to 10000");
+        slicelength = 10000;
     }
-    tsLast = NULL;
-
-    // Move free events to threadsafe pool
-    while (allocatedTsEvents > 0 && eventPool)
+    else
     {
-        Event *ev = eventPool;
-        eventPool = ev->next;
-        ev->next = eventTsPool;
-        eventTsPool = ev;
-        allocatedTsEvents--;
+        s64 cyclesNextEvent = eventPool[eventHeap[0]].time - globalTimer;
+        slicelength = (int)(cyclesNextEvent > MAX_SLICE_LENGTH ? MAX_SLICE_LENGTH : cyclesNextEvent);
     }
-}
+    downcount = slicelength;
 
-void Advance()
-{
-    ERROR_LOG(TIME, "Unimplemented function!");
-    //int cyclesExecuted = slicelength - currentMIPS->downcount;
-    //globalTimer += cyclesExecuted;
-    //currentMIPS->downcount = slicelength;
-
-    //if (Common::AtomicLoadAcquire(hasTsEvents))
-    //	MoveEvents();
-    //ProcessFifoWaitEvents();
-
-    //if (!first)
-    //{
-    //	// WARN_LOG(TIMER, "WARNING - no events in queue. Setting currentMIPS->downcount to 10000");
-    //	currentMIPS->downcount += 10000;
-    //}
-    //else
-    //{
-    //	slicelength = (int)(first->time - globalTimer);
-    //	if (slicelength > MAX_SLICE_LENGTH)
-    //		slicelength = MAX_SLICE_LENGTH;
-    //	currentMIPS->downcount = slicelength;
-    //}
-    //if (advanceCallback)
-    //	advanceCallback(cyclesExecuted);
+    if (advanceCallback)
+        advanceCallback(cyclesExecuted);
 }
 
 void LogPendingEvents()
 {
-    Event *ptr = first;
-    while (ptr)
+    std::vector<u32> sorted = GetSortedEvents();
+    for (size_t i = 0; i < sorted.size(); i++)
     {
-        //INFO_LOG(TIMER, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, ptr->time, ptr->type);
-        ptr = ptr->next;
+        //INFO_LOG(TIMER, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, eventPool[sorted[i]].time, eventPool[sorted[i]].type);
     }
 }
 
 void Idle(int maxIdle)
 {
-    ERROR_LOG(TIME, "Unimplemented function!");
-    //int cyclesDown = currentMIPS->downcount;
-    //if (maxIdle != 0 && cyclesDown > maxIdle)
-    //	cyclesDown = maxIdle;
-
-    //if (first && cyclesDown > 0)
-    //{
-    //	int cyclesExecuted = slicelength - currentMIPS->downcount;
-    //	int cyclesNextEvent = (int) (first->time - globalTimer);
-
-    //	if (cyclesNextEvent < cyclesExecuted + cyclesDown)
-    //	{
-    //		cyclesDown = cyclesNextEvent - cyclesExecuted;
-    //		// Now, now... no time machines, please.
-    //		if (cyclesDown < 0)
-    //			cyclesDown = 0;
-    //	}
-    //}
+    // The slice always ends at the next event, so what is left of it can be skipped
+    SyncCpuTicks();
+    int cyclesDown = downcount;
+    if (maxIdle != 0 && cyclesDown > maxIdle)
+        cyclesDown = maxIdle;
+    if (cyclesDown <= 0)
+        return;
 
-    //INFO_LOG(TIME, "Idle for %i cycles! (%f ms)", cyclesDown, cyclesDown / (float)(g_clock_rate_arm11 * 0.001f));
+    DEBUG_LOG(TIME, "Idle for %i cycles! (%f ms)", cyclesDown, cyclesDown / (float)(g_clock_rate_arm11 * 0.001f));
 
-    //idledCycles += cyclesDown;
-    //currentMIPS->downcount -= cyclesDown;
-    //if (currentMIPS->downcount == 0)
-    //	currentMIPS->downcount = -1;
+    idledCycles += cyclesDown;
+    downcount -= cyclesDown;
 }
 
 std::string GetScheduledEventsSummary()
 {
-    Event *ptr = first;
+    std::vector<u32> sorted = GetSortedEvents();
     std::string text = "Scheduled events\n";
     text.reserve(1000);
-    while (ptr)
+    for (size_t i = 0; i < sorted.size(); i++)
     {
-        unsigned int t = ptr->type;
+        const Event &ev = eventPool[sorted[i]];
+        unsigned int t = ev.type;
         if (t >= event_types.size())
             PanicAlert("Invalid event type"); // %i", t);
-        const char *name = event_types[ptr->type].name;
+        const char *name = event_types[ev.type].name;
         if (!name)
             name = "[unknown]";
         char temp[512];
-        sprintf(temp, "%s : %i %08x%08x\n", name, (int)ptr->time, (u32)(ptr->userdata >> 32), (u32)(ptr->userdata));
+        sprintf(temp, "%s : %i %08x%08x\n", name, (int)ev.time, (u32)(ev.userdata >> 32), (u32)(ev.userdata));
         text += temp;
-        ptr = ptr->next;
     }
     return text;
 }
 
-void Event_DoState(PointerWrap &p, BaseEvent *ev)
+// Saves or loads a list of events, in the format of PointerWrap::DoLinkedList. Loaded events are
+// added to the queue in the order they were saved in.
+static void DoEventList(PointerWrap &p, const std::vector<u32> &events)
 {
-    p.Do(*ev);
+    if (p.GetMode() == PointerWrap::MODE_READ)
+    {
+        for (;;)
+        {
+            u8 shouldExist = 0;
+            p.Do(shouldExist);
+            if (shouldExist != 1)
+                break;
+            BaseEvent ev;
+            p.Do(ev);
+            AddEventToQueue(ev.time, ev.type, ev.userdata);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        u8 shouldExist = 1;
+        p.Do(shouldExist);
+        BaseEvent ev = eventPool[events[i]];
+        p.Do(ev);
+    }
+    u8 shouldExist = 0;
+    p.Do(shouldExist);
 }
 
 void DoState(PointerWrap &p)
 {
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-
     auto s = p.Section("CoreTiming", 1);
     if (!s)
         return;
@@ -612,8 +601,20 @@ void DoState(PointerWrap &p)
     // These (should) be filled in later by the modules.
     event_types.resize(n, EventType(AntiCrashCallback, "INVALID EVENT"));
 
-    p.DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoState>(first, (Event **)NULL);
-    p.DoLinkedList<BaseEvent, GetNewTsEvent, FreeTsEvent, Event_DoState>(tsFirst, &tsLast);
+    // Events posted by other threads are moved into the main queue first, so the threadsafe list
+    // is always saved empty. One that was saved non-empty is loaded into the main queue.
+    if (p.GetMode() == PointerWrap::MODE_READ)
+    {
+        ClearPendingEvents();
+        MoveThreadsafeEvents([](const BaseEvent &e) { return true; });
+    }
+    else
+    {
+        MoveEvents();
+    }
+    std::vector<u32> sorted = GetSortedEvents();
+    DoEventList(p, sorted);
+    DoEventList(p, std::vector<u32>());
 
     p.Do(g_clock_rate_arm11);
     p.Do(slicelength);
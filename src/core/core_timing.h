@@ -51,6 +51,10 @@ inline s64 usToCycles(u64 us) {
     return (s64)(g_clock_rate_arm11 / 1000000 * us);
 }
 
+inline s64 nsToCycles(s64 ns) {
+    return (s64)(g_clock_rate_arm11 * (ns * 0.000000001));
+}
+
 inline s64 cyclesToUs(s64 cycles) {
     return cycles / (g_clock_rate_arm11 / 1000000);
 }
@@ -71,11 +75,19 @@ int RegisterEvent(const char *name, TimedCallback callback);
 void RestoreRegisterEvent(int event_type, const char *name, TimedCallback callback);
 void UnregisterAllEvents();
 
+// Identifies a scheduled event. Handles of events that fired or were unscheduled are never
+// reused, so unscheduling with a stale handle does nothing. Not valid across save states.
+typedef u64 EventHandle;
+
 // userdata MAY NOT CONTAIN POINTERS. userdata might get written and reloaded from disk,
 // when we implement state saves.
-void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata = 0);
+EventHandle ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata = 0);
+// Can be called from any thread. cyclesIntoFuture counts from when the CPU thread picks the
+// event up, at the latest once the current slice ends.
 void ScheduleEvent_Threadsafe(s64 cyclesIntoFuture, int event_type, u64 userdata = 0);
 void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata = 0);
+// Returns the cycles that were left until the event, or 0 if it isn't scheduled anymore.
+s64 UnscheduleEvent(EventHandle handle);
 s64 UnscheduleEvent(int event_type, u64 userdata);
 s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata);
 
@@ -83,11 +95,15 @@ void RemoveEvent(int event_type);
 void RemoveThreadsafeEvent(int event_type);
 void RemoveAllEvents(int event_type);
 bool IsScheduled(int event_type);
+// Fires the events that are due and starts the next slice, which lasts until the next event.
 void Advance();
+// Charges the ticks the app core has executed since the last sync to the current slice.
+void SyncCpuTicks();
 void MoveEvents();
 void ProcessFifoWaitEvents();
 
-// Pretend that the main CPU has executed enough cycles to reach the next event.
+// Pretend that the main CPU has executed enough cycles to reach the next event (or maxIdle
+// cycles, if it is non-zero). The CPU must stop running its current slice afterwards.
 void Idle(int maxIdle = 0);
 
 // Clear all pending events. This should ONLY be done on exit or state load.
@@ -105,5 +121,7 @@ void DoState(PointerWrap &p);
 void SetClockFrequencyMHz(int cpuMhz);
 int GetClockFrequencyMHz();
 extern int slicelength;
+// Ticks left in the current slice, Advance must be called once it is used up.
+extern int downcount;
 
 }; // namespace
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <string>
+
 #include "common/common_types.h"
 
 #include "core/hle/kernel/kernel.h"
@@ -36,7 +38,8 @@ public:
     virtual IdCode GetIdCode() const = 0;
 
     /**
-     * Read data from the archive
+     * Read data from the archive. May be called from the I/O threads (see
+     * Settings::Values::num_io_threads), concurrently with other reads and writes.
      * @param offset Offset in bytes to start reading data from
      * @param length Length in bytes of data to read from archive
      * @param buffer Buffer to read data into
@@ -45,7 +48,7 @@ public:
     virtual size_t Read(const u64 offset, const u32 length, u8* buffer) const = 0;
 
     /**
-     * Write data to the archive
+     * Write data to the archive. May be called from the I/O threads, like Read.
      * @param offset Offset in bytes to start writing data to
      * @param length Length in bytes of data to write to archive
      * @param buffer Buffer to write data from
@@ -64,6 +67,18 @@ public:
      * Set the size of the archive in bytes
      */
     virtual void SetSize(const u64 size) = 0;
+
+    /**
+     * Find a file of the archive from its path, for archives storing files in a single contiguous
+     * range each (e.g. RomFS)
+     * @param path Path of the file, as UTF-16
+     * @param offset Receives the offset of the file data in the archive
+     * @param size Receives the size of the file in bytes
+     * @return True if the file exists, false if it doesn't or the archive doesn't support paths
+     */
+    virtual bool FindFile(const std::u16string& path, u64& offset, u64& size) const {
+        return false;
+    }
 };
 
 } // namespace FileSys
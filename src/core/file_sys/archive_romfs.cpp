@@ -2,7 +2,11 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+
 #include "common/common_types.h"
+#include "common/file_util.h"
+#include "common/string_util.h"
 
 #include "core/file_sys/archive_romfs.h"
 
@@ -11,16 +15,65 @@
 
 namespace FileSys {
 
-Archive_RomFS::Archive_RomFS(const Loader::AppLoader& app_loader) {
-    // Load the RomFS from the app
-    if (Loader::ResultStatus::Success != app_loader.ReadRomFS(raw_data)) {
-        WARN_LOG(FILESYS, "Unable to read RomFS!");
+/// Data prefetched past the end of each read, for titles streaming files sequentially
+static const u64 kReadAheadSize = 0x100000;
+
+Archive_RomFS::Archive_RomFS(const Loader::AppLoader& app_loader) : data(nullptr), size(0) {
+    // Map the RomFS straight from the application file: nothing is read until it is accessed
+    std::string filename;
+    u64 offset, romfs_size;
+    if (Loader::ResultStatus::Success == app_loader.GetRomFSLocation(filename, offset, romfs_size) &&
+        mapping.Open(filename, offset, romfs_size)) {
+        mapping.AdviseSequential();
+        data = mapping.GetData();
+        size = (size_t)mapping.GetSize();
+    } else {
+        // Otherwise load the RomFS from the app
+        if (Loader::ResultStatus::Success != app_loader.ReadRomFS(raw_data)) {
+            WARN_LOG(FILESYS, "Unable to read RomFS!");
+        }
+        data = raw_data.empty() ? nullptr : &raw_data[0];
+        size = raw_data.size();
+    }
+
+    if (data != nullptr) {
+        LoadIndex(app_loader);
     }
 }
 
 Archive_RomFS::~Archive_RomFS() {
 }
 
+/**
+ * Loads the file index of the RomFS from the cache directory, or builds it and saves it there
+ * @param app_loader Loader of the application the RomFS belongs to
+ */
+void Archive_RomFS::LoadIndex(const Loader::AppLoader& app_loader) {
+    // The index of a RomFS is cached under the hash of its superblock, which identifies its contents
+    u64 hash = 0;
+    std::string cache_filename;
+    if (Loader::ResultStatus::Success == app_loader.GetRomFSHash(hash)) {
+        cache_filename = StringFromFormat("%sromfs" DIR_SEP "%016llX.idx",
+            File::GetUserPath(D_CACHE_IDX).c_str(), (unsigned long long)hash);
+        if (index.Load(cache_filename, hash)) {
+            INFO_LOG(FILESYS, "loaded RomFS index of %u files from %s", (u32)index.GetNumFiles(),
+                cache_filename.c_str());
+            return;
+        }
+    }
+
+    if (!index.Build(data, size)) {
+        WARN_LOG(FILESYS, "RomFS has no valid file metadata, files can't be opened by path");
+        return;
+    }
+    INFO_LOG(FILESYS, "built RomFS index of %u files", (u32)index.GetNumFiles());
+
+    if (!cache_filename.empty()) {
+        File::CreateFullPath(cache_filename);
+        index.Save(cache_filename, hash);
+    }
+}
+
 /**
  * Read data from the archive
  * @param offset Offset in bytes to start reading data from
@@ -30,8 +83,16 @@ Archive_RomFS::~Archive_RomFS() {
  */
 size_t Archive_RomFS::Read(const u64 offset, const u32 length, u8* buffer) const {
     DEBUG_LOG(FILESYS, "called offset=%d, length=%d", offset, length);
-    memcpy(buffer, &raw_data[(u32)offset], length);
-    return length;
+    if (offset >= size) {
+        return 0;
+    }
+    const size_t read_length = std::min<size_t>(length, size - (size_t)offset);
+    memcpy(buffer, data + offset, read_length);
+
+    if (mapping.IsOpen()) {
+        mapping.AdviseWillNeed(offset + read_length, kReadAheadSize);
+    }
+    return read_length;
 }
 
 /**
@@ -52,7 +113,7 @@ size_t Archive_RomFS::Write(const u64 offset, const u32 length, const u32 flush,
  * @return Size of the archive in bytes
  */
 size_t Archive_RomFS::GetSize() const {
-    return sizeof(u8) * raw_data.size();
+    return size;
 }
 
 /**
@@ -62,4 +123,15 @@ void Archive_RomFS::SetSize(const u64 size) {
     ERROR_LOG(FILESYS, "Attempted to set the size of ROMFS");
 }
 
+/**
+ * Find a file of the archive from its path
+ * @param path Path of the file, as UTF-16
+ * @param offset Receives the offset of the file data in the archive
+ * @param size Receives the size of the file in bytes
+ * @return True if the file exists
+ */
+bool Archive_RomFS::FindFile(const std::u16string& path, u64& offset, u64& size) const {
+    return index.FindFile(path, offset, size);
+}
+
 } // namespace FileSys
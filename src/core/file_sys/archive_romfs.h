@@ -7,8 +7,10 @@
 #include <vector>
 
 #include "common/common_types.h"
+#include "common/mapped_file.h"
 
 #include "core/file_sys/archive.h"
+#include "core/file_sys/romfs_index.h"
 #include "core/loader/loader.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -58,8 +60,29 @@ public:
      */
     void SetSize(const u64 size) override;
 
+    /**
+     * Find a file of the archive from its path
+     * @param path Path of the file, as UTF-16
+     * @param offset Receives the offset of the file data in the archive
+     * @param size Receives the size of the file in bytes
+     * @return True if the file exists
+     */
+    bool FindFile(const std::u16string& path, u64& offset, u64& size) const override;
+
 private:
-    std::vector<u8> raw_data;
+    /**
+     * Loads the file index of the RomFS from the cache directory, or builds it and saves it there
+     * @param app_loader Loader of the application the RomFS belongs to
+     */
+    void LoadIndex(const Loader::AppLoader& app_loader);
+
+    Common::MappedFile mapping;     ///< RomFS mapped from the application file, if possible
+    std::vector<u8> raw_data;       ///< RomFS read from the application, if it couldn't be mapped
+
+    const u8* data;                 ///< Start of the RomFS, in the mapping or raw_data
+    size_t size;                    ///< Size of the RomFS in bytes
+
+    RomFSIndex index;               ///< Files of the RomFS, by path
 };
 
 } // namespace FileSys
@@ -0,0 +1,382 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <cstring>
+#include <unordered_map>
+
+#include "common/common.h"
+#include "common/file_util.h"
+
+#include "core/file_sys/romfs_index.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// FileSys namespace
+
+namespace FileSys {
+
+/// Header of the level 3 partition of a RomFS, offsets are from the start of the partition
+struct Level3Header {
+    u32 header_length;
+    u32 dir_hash_table_offset;
+    u32 dir_hash_table_length;
+    u32 dir_meta_offset;
+    u32 dir_meta_length;
+    u32 file_hash_table_offset;
+    u32 file_hash_table_length;
+    u32 file_meta_offset;
+    u32 file_meta_length;
+    u32 file_data_offset;
+};
+
+/// Directory metadata entry, followed by its UTF-16 name padded to 4 bytes
+struct DirectoryMeta {
+    u32 parent_offset;
+    u32 next_sibling_offset;
+    u32 first_child_offset;
+    u32 first_file_offset;
+    u32 next_in_bucket_offset;
+    u32 name_length;            ///< In bytes
+};
+
+/// File metadata entry, followed by its UTF-16 name padded to 4 bytes
+struct FileMeta {
+    u32 parent_offset;
+    u32 next_sibling_offset;
+    u64 data_offset;            ///< From the start of the file data
+    u64 data_size;
+    u32 next_in_bucket_offset;
+    u32 name_length;            ///< In bytes
+};
+
+static_assert(sizeof(Level3Header) == 0x28, "Level3Header layout changed");
+static_assert(sizeof(DirectoryMeta) == 0x18, "DirectoryMeta layout changed");
+static_assert(sizeof(FileMeta) == 0x20, "FileMeta layout changed");
+
+/// Header of an index saved by RomFSIndex::Save
+struct CacheHeader {
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 num_directories;
+    u32 num_files;
+    u32 num_name_chars;
+    u32 reserved;
+};
+
+static const u32 kCacheMagic    = 0x49534652; ///< "RFSI"
+static const u32 kCacheVersion  = 1;
+
+static const u32 kNoEntry = 0xFFFFFFFF;
+
+/// Hashes one more component of a path (FNV-1a over "/" and the UTF-16 characters of the name)
+static u64 HashPathComponent(u64 hash, const char16_t* name, size_t length) {
+    static const u64 kPrime = 0x100000001B3ULL;
+    hash = (hash ^ '/') * kPrime;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ name[i]) * kPrime;
+    }
+    return hash;
+}
+
+static const u64 kRootPathHash = 0xCBF29CE484222325ULL;   ///< FNV-1a offset basis
+
+RomFSIndex::RomFSIndex() {
+}
+
+/**
+ * Builds the index from the level 3 partition of a RomFS
+ * @param data Start of the level 3 partition (the level 3 header)
+ * @param size Size of the partition in bytes
+ * @return True on success, otherwise the index is left empty
+ */
+bool RomFSIndex::Build(const u8* data, size_t size) {
+    directories.clear();
+    files.clear();
+    names.clear();
+    hash_table.clear();
+
+    Level3Header header;
+    if (data == nullptr || size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.header_length != sizeof(header) ||
+        (u64)header.dir_meta_offset + header.dir_meta_length > size ||
+        (u64)header.file_meta_offset + header.file_meta_length > size) {
+        ERROR_LOG(FILESYS, "Invalid RomFS level 3 header");
+        return false;
+    }
+
+    // Metadata offsets of the entries, which link them to each other
+    std::unordered_map<u32, u32> directory_indices;
+    std::vector<u32> parent_offsets;
+
+    // Directories, the first one being the root
+    const u8* dir_meta = data + header.dir_meta_offset;
+    for (u32 offset = 0; offset + sizeof(DirectoryMeta) <= header.dir_meta_length; ) {
+        DirectoryMeta meta;
+        memcpy(&meta, dir_meta + offset, sizeof(meta));
+        const u32 name_offset = offset + sizeof(meta);
+        if (meta.name_length % 2 != 0 || name_offset + meta.name_length > header.dir_meta_length) {
+            ERROR_LOG(FILESYS, "Invalid RomFS directory entry at 0x%08X", offset);
+            directories.clear();
+            names.clear();
+            return false;
+        }
+
+        DirectoryEntry entry;
+        entry.parent = 0;
+        entry.name_offset = (u32)names.size();
+        entry.name_length = meta.name_length / 2;
+        entry.reserved = 0;
+        entry.path_hash = kRootPathHash;
+        names.resize(names.size() + entry.name_length);
+        memcpy(&names[entry.name_offset], dir_meta + name_offset, meta.name_length);
+
+        directory_indices[offset] = (u32)directories.size();
+        directories.push_back(entry);
+        parent_offsets.push_back(meta.parent_offset);
+
+        offset = name_offset + ((meta.name_length + 3) & ~3);
+    }
+    if (directories.empty()) {
+        ERROR_LOG(FILESYS, "RomFS has no root directory");
+        return false;
+    }
+
+    for (size_t i = 0; i < directories.size(); ++i) {
+        auto parent = directory_indices.find(parent_offsets[i]);
+        if (parent == directory_indices.end()) {
+            ERROR_LOG(FILESYS, "Invalid RomFS directory parent 0x%08X", parent_offsets[i]);
+            directories.clear();
+            names.clear();
+            return false;
+        }
+        directories[i].parent = (i == 0) ? 0 : parent->second;
+    }
+
+    // Path hashes of the directories, from their parents (which may come after them)
+    std::vector<bool> hashed(directories.size(), false);
+    hashed[0] = true;
+    std::vector<u32> stack;
+    for (u32 i = 1; i < directories.size(); ++i) {
+        for (u32 dir = i; !hashed[dir]; dir = directories[dir].parent) {
+            stack.push_back(dir);
+            if (stack.size() > directories.size()) {
+                ERROR_LOG(FILESYS, "RomFS directory tree has a cycle");
+                directories.clear();
+                names.clear();
+                return false;
+            }
+        }
+        while (!stack.empty()) {
+            DirectoryEntry& entry = directories[stack.back()];
+            entry.path_hash = HashPathComponent(directories[entry.parent].path_hash,
+                &names[entry.name_offset], entry.name_length);
+            hashed[stack.back()] = true;
+            stack.pop_back();
+        }
+    }
+
+    // Files
+    const u8* file_meta = data + header.file_meta_offset;
+    for (u32 offset = 0; offset + sizeof(FileMeta) <= header.file_meta_length; ) {
+        FileMeta meta;
+        memcpy(&meta, file_meta + offset, sizeof(meta));
+        const u32 name_offset = offset + sizeof(meta);
+        auto parent = directory_indices.find(meta.parent_offset);
+        if (meta.name_length % 2 != 0 || name_offset + meta.name_length > header.file_meta_length ||
+            parent == directory_indices.end()) {
+            ERROR_LOG(FILESYS, "Invalid RomFS file entry at 0x%08X", offset);
+            directories.clear();
+            files.clear();
+            names.clear();
+            return false;
+        }
+
+        FileEntry entry;
+        entry.parent = parent->second;
+        entry.name_offset = (u32)names.size();
+        entry.name_length = meta.name_length / 2;
+        entry.reserved = 0;
+        entry.data_offset = header.file_data_offset + meta.data_offset;
+        entry.data_size = meta.data_size;
+        names.resize(names.size() + entry.name_length);
+        memcpy(&names[entry.name_offset], file_meta + name_offset, meta.name_length);
+        entry.path_hash = HashPathComponent(directories[entry.parent].path_hash,
+            &names[entry.name_offset], entry.name_length);
+        files.push_back(entry);
+
+        offset = name_offset + ((meta.name_length + 3) & ~3);
+    }
+
+    BuildHashTable();
+    return true;
+}
+
+/// Fills the path hash table from the files
+void RomFSIndex::BuildHashTable() {
+    // At most half full, so probe sequences stay short
+    size_t table_size = 16;
+    while (table_size < files.size() * 2) {
+        table_size *= 2;
+    }
+    hash_table.assign(table_size, kNoEntry);
+
+    const size_t mask = table_size - 1;
+    for (u32 i = 0; i < files.size(); ++i) {
+        size_t slot = (size_t)files[i].path_hash & mask;
+        while (hash_table[slot] != kNoEntry) {
+            slot = (slot + 1) & mask;
+        }
+        hash_table[slot] = i;
+    }
+}
+
+/**
+ * Checks that an entry has the name and parent directories given by the components of a path
+ * @param parent Parent directory of the entry
+ * @param name_offset Offset of the name of the entry in the name pool
+ * @param name_length Length of the name of the entry
+ * @param path Path being looked up
+ * @param components Start and end of each component of the path
+ * @return True if the path is the one of the entry
+ */
+bool RomFSIndex::MatchPath(u32 parent, u32 name_offset, u32 name_length,
+    const std::u16string& path, const std::vector<std::pair<size_t, size_t>>& components) const {
+
+    // Compare the components from the last one, walking up the directories
+    for (size_t i = components.size(); i-- > 0; ) {
+        const size_t length = components[i].second - components[i].first;
+        if (length != name_length ||
+            memcmp(&path[components[i].first], &names[name_offset], length * 2) != 0) {
+            return false;
+        }
+        if (i == 0) {
+            break;
+        }
+        if (parent == 0) {
+            return false;   // The path is deeper than the entry
+        }
+        name_offset = directories[parent].name_offset;
+        name_length = directories[parent].name_length;
+        parent = directories[parent].parent;
+    }
+    return parent == 0;
+}
+
+/**
+ * Finds a file from its path
+ * @param path Path of the file from the root of the RomFS, as UTF-16 ("/dir/file.bin")
+ * @param offset Receives the offset of the file data from the start of the level 3 partition
+ * @param size Receives the size of the file in bytes
+ * @return True if the file exists
+ */
+bool RomFSIndex::FindFile(const std::u16string& path, u64& offset, u64& size) const {
+    if (hash_table.empty()) {
+        return false;
+    }
+
+    // Split the path, empty components (leading or doubled slashes) are ignored
+    std::vector<std::pair<size_t, size_t>> components;
+    u64 hash = kRootPathHash;
+    for (size_t start = 0; start < path.size(); ) {
+        size_t end = path.find(u'/', start);
+        if (end == std::u16string::npos) {
+            end = path.size();
+        }
+        if (end > start) {
+            components.push_back(std::make_pair(start, end));
+            hash = HashPathComponent(hash, &path[start], end - start);
+        }
+        start = end + 1;
+    }
+    if (components.empty()) {
+        return false;
+    }
+
+    const size_t mask = hash_table.size() - 1;
+    for (size_t slot = (size_t)hash & mask; hash_table[slot] != kNoEntry; slot = (slot + 1) & mask) {
+        const FileEntry& file = files[hash_table[slot]];
+        if (file.path_hash == hash &&
+            MatchPath(file.parent, file.name_offset, file.name_length, path, components)) {
+            offset = file.data_offset;
+            size = file.data_size;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Checks that the entries only reference existing directories and names, for loaded indices
+bool RomFSIndex::IsValid() const {
+    for (const auto& dir : directories) {
+        if (dir.parent >= directories.size() || (u64)dir.name_offset + dir.name_length > names.size())
+            return false;
+    }
+    for (const auto& file : files) {
+        if (file.parent >= directories.size() || (u64)file.name_offset + file.name_length > names.size())
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Loads an index saved by Save
+ * @param filename Path of the file
+ * @param key Key the index was saved with, identifying the RomFS
+ * @return True on success, false if the file doesn't exist or is for another key
+ */
+bool RomFSIndex::Load(const std::string& filename, u64 key) {
+    ::File::IOFile file(filename, "rb");
+    CacheHeader header;
+    if (!file.IsOpen() || !file.ReadBytes(&header, sizeof(header)) || header.magic != kCacheMagic ||
+        header.version != kCacheVersion || header.key != key || header.num_directories == 0) {
+        return false;
+    }
+
+    directories.resize(header.num_directories);
+    files.resize(header.num_files);
+    names.resize(header.num_name_chars);
+    if (!file.ReadArray(directories.data(), directories.size()) ||
+        !file.ReadArray(files.data(), files.size()) ||
+        !file.ReadArray(names.data(), names.size()) || !IsValid()) {
+        directories.clear();
+        files.clear();
+        names.clear();
+        return false;
+    }
+
+    BuildHashTable();
+    return true;
+}
+
+/**
+ * Saves the index, so it doesn't need to be built again
+ * @param filename Path of the file
+ * @param key Key identifying the RomFS, checked by Load
+ * @return True on success
+ */
+bool RomFSIndex::Save(const std::string& filename, u64 key) const {
+    CacheHeader header;
+    header.magic = kCacheMagic;
+    header.version = kCacheVersion;
+    header.key = key;
+    header.num_directories = (u32)directories.size();
+    header.num_files = (u32)files.size();
+    header.num_name_chars = (u32)names.size();
+    header.reserved = 0;
+
+    ::File::IOFile file(filename, "wb");
+    if (!file.IsOpen() || !file.WriteBytes(&header, sizeof(header)) ||
+        !file.WriteArray(directories.data(), directories.size()) ||
+        !file.WriteArray(files.data(), files.size()) ||
+        !file.WriteArray(names.data(), names.size())) {
+        WARN_LOG(FILESYS, "Unable to write the RomFS index to %s", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace FileSys
@@ -0,0 +1,107 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// FileSys namespace
+
+namespace FileSys {
+
+/**
+ * Index of the files of a RomFS, built once from the level 3 directory and file metadata. Entries
+ * are kept in flat arrays, their names in a single pool, and files are found through a hash table
+ * of their full paths: a lookup costs O(path length), whatever the number of files.
+ */
+class RomFSIndex {
+public:
+    RomFSIndex();
+
+    /**
+     * Builds the index from the level 3 partition of a RomFS
+     * @param data Start of the level 3 partition (the level 3 header)
+     * @param size Size of the partition in bytes
+     * @return True on success, otherwise the index is left empty
+     */
+    bool Build(const u8* data, size_t size);
+
+    /**
+     * Loads an index saved by Save
+     * @param filename Path of the file
+     * @param key Key the index was saved with, identifying the RomFS
+     * @return True on success, false if the file doesn't exist or is for another key
+     */
+    bool Load(const std::string& filename, u64 key);
+
+    /**
+     * Saves the index, so it doesn't need to be built again
+     * @param filename Path of the file
+     * @param key Key identifying the RomFS, checked by Load
+     * @return True on success
+     */
+    bool Save(const std::string& filename, u64 key) const;
+
+    /**
+     * Finds a file from its path
+     * @param path Path of the file from the root of the RomFS, as UTF-16 ("/dir/file.bin")
+     * @param offset Receives the offset of the file data from the start of the level 3 partition
+     * @param size Receives the size of the file in bytes
+     * @return True if the file exists
+     */
+    bool FindFile(const std::u16string& path, u64& offset, u64& size) const;
+
+    /// Returns the number of files in the index
+    size_t GetNumFiles() const {
+        return files.size();
+    }
+
+private:
+    struct DirectoryEntry {
+        u32 parent;         ///< Index of the parent directory (the root is its own parent)
+        u32 name_offset;    ///< Offset of the name in the name pool
+        u32 name_length;    ///< Length of the name in UTF-16 characters
+        u32 reserved;
+        u64 path_hash;      ///< Hash of the full path of the directory
+    };
+
+    struct FileEntry {
+        u32 parent;         ///< Index of the directory containing the file
+        u32 name_offset;    ///< Offset of the name in the name pool
+        u32 name_length;    ///< Length of the name in UTF-16 characters
+        u32 reserved;
+        u64 path_hash;      ///< Hash of the full path of the file
+        u64 data_offset;    ///< Offset of the data from the start of the level 3 partition
+        u64 data_size;      ///< Size of the data in bytes
+    };
+
+    /// Fills the path hash table from the files
+    void BuildHashTable();
+
+    /// Checks that the entries only reference existing directories and names, for loaded indices
+    bool IsValid() const;
+
+    /**
+     * Checks that an entry has the name and parent directories given by the components of a path
+     * @param parent Parent directory of the entry
+     * @param name_offset Offset of the name of the entry in the name pool
+     * @param name_length Length of the name of the entry
+     * @param path Path being looked up
+     * @param components Start and end of each component of the path
+     * @return True if the path is the one of the entry
+     */
+    bool MatchPath(u32 parent, u32 name_offset, u32 name_length, const std::u16string& path,
+        const std::vector<std::pair<size_t, size_t>>& components) const;
+
+    std::vector<DirectoryEntry> directories;
+    std::vector<FileEntry> files;
+    std::vector<char16_t> names;    ///< Names of all the entries, without terminators
+    std::vector<u32> hash_table;    ///< Open addressing table of file indices, by path hash
+};
+
+} // namespace FileSys
@@ -2,11 +2,16 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.  
 
+#include <array>
 #include <vector>
 
+#include "common/profiler.h"
+
 #include "core/mem_map.h"
+#include "core/settings.h"
 #include "core/hle/hle.h"
 #include "core/hle/svc.h"
+#include "core/hle/trace.h"
 #include "core/hle/kernel/thread.h"
 #include "core/hle/service/service.h"
 
@@ -18,9 +23,11 @@ static std::vector<ModuleDef> g_module_db;
 
 bool g_reschedule = false;  ///< If true, immediately reschedules the CPU to a new thread
 
+static std::array<u64, 0x100> g_svc_call_counts;   ///< Number of calls to each SVC
+
 const FunctionDef* GetSVCInfo(u32 opcode) {
     u32 func_num = opcode & 0xFFFFFF; // 8 bits
-    if (func_num > 0xFF) {
+    if (func_num >= (u32)g_module_db[0].num_funcs) {
         ERROR_LOG(HLE,"unknown svc=0x%02X", func_num); 
         return nullptr;
     }
@@ -33,11 +40,30 @@ void CallSVC(u32 opcode) {
     if (!info) {
         return;
     }
+    g_svc_call_counts[opcode & 0xFF]++;
+
+    Common::Profiling::ScopedSection profile_section(Common::Profiling::SECTION_HLE);
+    const bool trace = Trace::IsEnabled();
+    u32 args[4];
+    if (trace) {
+        for (int i = 0; i < 4; ++i) {
+            args[i] = Core::g_app_core->GetReg(i);
+        }
+    }
+
     if (info->func) {
         info->func();
     } else {
         ERROR_LOG(HLE, "unimplemented SVC function %s(..)", info->name.c_str());
     }
+
+    if (trace) {
+        Trace::Append(Trace::RECORD_SVC, 0, opcode & 0xFF, args, Core::g_app_core->GetReg(0));
+    }
+}
+
+u64 GetSVCCallCount(u32 func_num) {
+    return func_num < g_svc_call_counts.size() ? g_svc_call_counts[func_num] : 0;
 }
 
 void Reschedule(const char *reason) {
@@ -59,6 +85,10 @@ void RegisterAllModules() {
 
 void Init() {
     Service::Init();
+
+    g_svc_call_counts.fill(0);
+    Trace::Clear();
+    Trace::SetEnabled(!Settings::values.hle_trace_path.empty());
     
     RegisterAllModules();
 
@@ -66,6 +96,12 @@ void Init() {
 }
 
 void Shutdown() {
+    // Names of the traced calls are looked up in the service tables, so dump before they go away
+    if (!Settings::values.hle_trace_path.empty()) {
+        Trace::Dump(Settings::values.hle_trace_path);
+    }
+    Trace::SetEnabled(false);
+
     Service::Shutdown();
 
     g_module_db.clear();
@@ -30,8 +30,17 @@ struct ModuleDef {
 
 void RegisterModule(std::string name, int num_functions, const FunctionDef *func_table);
 
+const FunctionDef* GetSVCInfo(u32 opcode);
+
 void CallSVC(u32 opcode);
 
+/**
+ * Returns how many times an SVC has been called since HLE was initialized
+ * @param func_num SVC number (0x00-0xFF)
+ * @return Number of calls
+ */
+u64 GetSVCCallCount(u32 func_num);
+
 void Reschedule(const char *reason);
 
 void Init();
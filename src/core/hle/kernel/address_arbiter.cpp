@@ -50,15 +50,17 @@ Result ArbitrateAddress(Handle handle, ArbitrationType type, u32 address, s32 va
             ArbitrateAllThreads(handle, address);
         } else {
             // Resume first N threads
-            for(int i = 0; i < value; i++)
-                ArbitrateHighestPriorityThread(handle, address);
+            for(int i = 0; i < value; i++) {
+                if (0 == ArbitrateHighestPriorityThread(handle, address))
+                    break;
+            }
         }
         break;
 
     // Wait current thread (acquire the arbiter)...
     case ArbitrationType::WaitIfLessThan:
         if ((s32)Memory::Read32(address) <= value) {
-            Kernel::WaitCurrentThread(WAITTYPE_ARB, handle);
+            Kernel::WaitCurrentThread(WAITTYPE_ARB, handle, address);
             HLE::Reschedule(__func__);
         }
         break;
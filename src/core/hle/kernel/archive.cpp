@@ -2,13 +2,24 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+
 #include "common/common_types.h"
 #include "common/math_util.h"
+#include "common/thread_pool.h"
 
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/settings.h"
 #include "core/file_sys/archive.h"
+#include "core/hle/hle.h"
 #include "core/hle/service/service.h"
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/archive.h"
+#include "core/hle/kernel/thread.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Kernel namespace
@@ -30,6 +41,52 @@ enum class FileCommand : u32 {
     Flush           = 0x08090000,
 };
 
+static std::unique_ptr<Common::ThreadPool> g_io_pool; ///< Runs asynchronous reads and writes
+static int g_io_completion_event_type;  ///< CoreTiming event resuming the requesting thread
+static std::map<Handle, u32> g_io_read_buffers; ///< Guest buffers being read into, by thread
+
+/**
+ * Ends an asynchronous read or write: resumes the thread that requested it, which receives the
+ * result in its command buffer
+ * @param userdata Number of bytes transferred in the upper word, requesting thread in the lower
+ * @param cycles_late Unused
+ */
+static void IOCompletionCallback(u64 userdata, int cycles_late) {
+    const Handle thread = (Handle)userdata;
+    const u32 size = (u32)(userdata >> 32);
+
+    // Code translated from the buffer of a read is stale now
+    auto buffer_iter = g_io_read_buffers.find(thread);
+    if (buffer_iter != g_io_read_buffers.end()) {
+        Memory::InvalidateCode(buffer_iter->second, size);
+        g_io_read_buffers.erase(buffer_iter);
+    }
+
+    // Other threads may have made requests since, the command buffer is shared by all threads for
+    // now. The reply is written once the requesting thread runs again.
+    SetThreadResumeCallback(thread, [size] {
+        u32* cmd_buff = Service::GetCommandBuffer();
+        cmd_buff[1] = 0; // No error
+        cmd_buff[2] = size;
+    });
+
+    ResumeThreadFromWait(thread);
+    HLE::Reschedule(__func__);
+}
+
+/**
+ * Runs a read or write on the I/O threads, the current thread waits until it is done
+ * @param request Transfer to run, returns the number of bytes transferred
+ */
+static void QueueIORequest(std::function<u32()> request) {
+    const Handle thread = GetCurrentThreadHandle();
+    g_io_pool->Push([=] {
+        const u32 size = request();
+        CoreTiming::ScheduleEvent_Threadsafe(0, g_io_completion_event_type,
+            ((u64)size << 32) | thread);
+    });
+}
+
 class Archive : public Object {
 public:
     std::string GetTypeName() const { return "Archive"; }
@@ -41,6 +98,10 @@ public:
     std::string name;           ///< Name of archive (optional)
     FileSys::Archive* backend;  ///< Archive backend interface
 
+    bool is_file;               ///< Whether the object is a file opened in the archive
+    u64 file_offset;            ///< Start of the file in the archive, if is_file
+    u64 file_size;              ///< Size of the file in bytes, if is_file
+
     /**
      * Synchronize kernel object 
      * @param wait Boolean wait set if current thread should wait as a result of sync operation
@@ -57,9 +118,31 @@ public:
             u64 offset  = cmd_buff[1] | ((u64)cmd_buff[2] << 32);
             u32 length  = cmd_buff[3];
             u32 address = cmd_buff[5];
+            u8* buffer  = Memory::GetPointer(address);
+
+            if (buffer == nullptr) {
+                ERROR_LOG(KERNEL, "Invalid read buffer 0x%08X for %s", address, name.c_str());
+                cmd_buff[2] = 0;
+                break;
+            }
+
+            // Files only see their own part of the archive
+            if (is_file) {
+                length = (u32)std::min<u64>(length, offset < file_size ? file_size - offset : 0);
+                offset += file_offset;
+            }
+
+            if (g_io_pool) {
+                FileSys::Archive* backend = this->backend;
+                g_io_read_buffers[GetCurrentThreadHandle()] = address;
+                QueueIORequest([=] { return (u32)backend->Read(offset, length, buffer); });
+                *wait = true;
+                return 0;
+            }
 
             // Number of bytes read
-            cmd_buff[2] = backend->Read(offset, length, Memory::GetPointer(address));
+            cmd_buff[2] = backend->Read(offset, length, buffer);
+            Memory::InvalidateCode(address, cmd_buff[2]);
             break;
         }
         // Write to archive...
@@ -69,23 +152,58 @@ public:
             u32 length  = cmd_buff[3];
             u32 flush   = cmd_buff[4];
             u32 address = cmd_buff[6];
+            u8* buffer  = Memory::GetPointer(address);
+
+            if (buffer == nullptr) {
+                ERROR_LOG(KERNEL, "Invalid write buffer 0x%08X for %s", address, name.c_str());
+                cmd_buff[2] = 0;
+                break;
+            }
+
+            if (is_file) {
+                ERROR_LOG(KERNEL, "Attempted to write to read-only file %s", name.c_str());
+                cmd_buff[2] = 0;
+                break;
+            }
+
+            if (g_io_pool) {
+                FileSys::Archive* backend = this->backend;
+                QueueIORequest([=] { return (u32)backend->Write(offset, length, flush, buffer); });
+                *wait = true;
+                return 0;
+            }
 
             // Number of bytes written
-            cmd_buff[2] = backend->Write(offset, length, flush, Memory::GetPointer(address));
+            cmd_buff[2] = backend->Write(offset, length, flush, buffer);
             break;
         }
         case FileCommand::GetSize:
         {
-            u64 filesize = (u64) backend->GetSize();
+            u64 filesize = is_file ? file_size : (u64) backend->GetSize();
             cmd_buff[2]  = (u32) filesize;         // Lower word
             cmd_buff[3]  = (u32) (filesize >> 32); // Upper word
             break;
         }
         case FileCommand::SetSize:
         {
+            if (is_file) {
+                ERROR_LOG(KERNEL, "Attempted to set the size of read-only file %s", name.c_str());
+                break;
+            }
             backend->SetSize(cmd_buff[1] | ((u64)cmd_buff[2] << 32));
             break;
         }
+        case FileCommand::Close:
+        {
+            // Archives stay mounted, only the files opened in them are closed
+            if (is_file) {
+                DEBUG_LOG(KERNEL, "Closed file %s", name.c_str());
+                cmd_buff[1] = 0; // No error
+                g_object_pool.Destroy<Archive>(GetHandle()); // Deletes this object
+                return 0;
+            }
+            break;
+        }
         // Unknown command...
         default:
         {
@@ -154,6 +272,9 @@ Archive* CreateArchive(Handle& handle, FileSys::Archive* backend, const std::str
     handle = Kernel::g_object_pool.Create(archive);
     archive->name = name;
     archive->backend = backend;
+    archive->is_file = false;
+    archive->file_offset = 0;
+    archive->file_size = 0;
 
     MountArchive(archive);
     
@@ -172,13 +293,59 @@ Handle CreateArchive(FileSys::Archive* backend, const std::string& name) {
     return handle;
 }
 
+/**
+ * Opens a file of an archive: the returned handle serves the file commands on the part of the
+ * archive the file occupies
+ * @param archive_handle Handle of the archive
+ * @param path Path of the file in the archive, as UTF-16
+ * @return Handle to the file if it exists, otherwise a null handle (0)
+ */
+Handle OpenFileFromArchive(Handle archive_handle, const std::u16string& path) {
+    u32 error;
+    Archive* archive = g_object_pool.Get<Archive>(archive_handle, error);
+    if (archive == nullptr) {
+        return 0;
+    }
+    u64 offset, size;
+    if (!archive->backend->FindFile(path, offset, size)) {
+        return 0;
+    }
+
+    Archive* file = new Archive;
+    Handle handle = g_object_pool.Create(file);
+    file->name = archive->GetName() + ":" + std::string(path.begin(), path.end());
+    file->backend = archive->backend;
+    file->is_file = true;
+    file->file_offset = offset;
+    file->file_size = size;
+
+    DEBUG_LOG(KERNEL, "Opened file %s (offset=0x%llx, size=0x%llx)", file->GetName().c_str(),
+        (unsigned long long)offset, (unsigned long long)size);
+    return handle;
+}
+
 /// Initialize archives
 void ArchiveInit() {
     g_archive_map.clear();
+
+    g_io_completion_event_type = CoreTiming::RegisterEvent("Kernel::IOCompletionCallback",
+        IOCompletionCallback);
+    if (Settings::values.num_io_threads > 0) {
+        g_io_pool.reset(new Common::ThreadPool(Settings::values.num_io_threads));
+    }
+}
+
+/// Waits for the asynchronous reads and writes in flight to finish
+void FinishArchiveIO() {
+    if (g_io_pool) {
+        g_io_pool->WaitForIdle();
+    }
 }
 
 /// Shutdown archives
 void ArchiveShutdown() {
+    g_io_pool.reset();
+    g_io_read_buffers.clear();
     g_archive_map.clear();
 }
 
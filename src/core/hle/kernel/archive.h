@@ -29,9 +29,24 @@ Handle OpenArchive(FileSys::Archive::IdCode id_code);
  */
 Handle CreateArchive(FileSys::Archive* backend, const std::string& name);
 
+/**
+ * Opens a file of an archive: the returned handle serves the file commands on the part of the
+ * archive the file occupies
+ * @param archive_handle Handle of the archive
+ * @param path Path of the file in the archive, as UTF-16
+ * @return Handle to the file if it exists, otherwise a null handle (0)
+ */
+Handle OpenFileFromArchive(Handle archive_handle, const std::u16string& path);
+
 /// Initialize archives
 void ArchiveInit();
 
+/**
+ * Waits for the asynchronous reads and writes in flight to finish. Must be called before the
+ * memory and the CPU core they use are shut down.
+ */
+void FinishArchiveIO();
+
 /// Shutdown archives
 void ArchiveShutdown();
 
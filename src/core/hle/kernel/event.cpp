@@ -3,8 +3,6 @@
 // Refer to the license.txt file included.  
 
 #include <map>
-#include <algorithm>
-#include <vector>
 
 #include "common/common.h"
 
@@ -27,7 +25,7 @@ public:
 
     bool locked;                            ///< Event signal wait
     bool permanent_locked;                  ///< Hack - to set event permanent state (for easy passthrough)
-    std::vector<Handle> waiting_threads;    ///< Threads that are waiting for the event
+    WaitList waiting_threads;               ///< Threads that are waiting for the event
     std::string name;                       ///< Name of event (optional)
 
     /**
@@ -38,11 +36,8 @@ public:
     Result WaitSynchronization(bool* wait) {
         *wait = locked;
         if (locked) {
-            Handle thread = GetCurrentThreadHandle();
-            if (std::find(waiting_threads.begin(), waiting_threads.end(), thread) == waiting_threads.end()) {
-                waiting_threads.push_back(thread);
-            }
             Kernel::WaitCurrentThread(WAITTYPE_EVENT, GetHandle());
+            Kernel::AddToWaitList(waiting_threads);
         }
         if (reset_type != RESETTYPE_STICKY && !permanent_locked) {
             locked = true;
@@ -91,17 +86,12 @@ Result SignalEvent(const Handle handle) {
     _assert_msg_(KERNEL, (evt != nullptr), "called, but event is nullptr!");
 
     // Resume threads waiting for event to signal
-    bool event_caught = false;
-    for (size_t i = 0; i < evt->waiting_threads.size(); ++i) {
-        ResumeThreadFromWait( evt->waiting_threads[i]);
-
-        // If any thread is signalled awake by this event, assume the event was "caught" and reset 
-        // the event. This will result in the next thread waiting on the event to block. Otherwise,
-        // the event will not be reset, and the next thread to call WaitSynchronization on it will
-        // not block. Not sure if this is correct behavior, but it seems to work.
-        event_caught = true;
-    }
-    evt->waiting_threads.clear();
+    bool event_caught = WakeAllWaiters(evt->waiting_threads);
+
+    // If any thread is signalled awake by this event, assume the event was "caught" and reset 
+    // the event. This will result in the next thread waiting on the event to block. Otherwise,
+    // the event will not be reset, and the next thread to call WaitSynchronization on it will
+    // not block. Not sure if this is correct behavior, but it seems to work.
 
     if (!evt->permanent_locked) {
         evt->locked = event_caught;
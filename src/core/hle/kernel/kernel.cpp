@@ -17,72 +17,86 @@ Handle g_main_thread = 0;
 ObjectPool g_object_pool;
 
 ObjectPool::ObjectPool() {
-    next_id = INITIAL_NEXT_ID;
+    slots.reserve(INITIAL_COUNT);
+    free_head = free_tail = NO_SLOT;
+    count = 0;
 }
 
-Handle ObjectPool::Create(Object* obj, int range_bottom, int range_top) {
-    if (range_top > MAX_COUNT) {
-        range_top = MAX_COUNT;
-    }
-    if (next_id >= range_bottom && next_id < range_top) {
-        range_bottom = next_id++;
-    }
-    for (int i = range_bottom; i < range_top; i++) {
-        if (!occupied[i]) {
-            occupied[i] = true;
-            pool[i] = obj;
-            pool[i]->handle = i + HANDLE_OFFSET;
-            return i + HANDLE_OFFSET;
+Handle ObjectPool::Create(Object* obj) {
+    u32 index;
+    if (free_head != NO_SLOT) {
+        index = free_head;
+        free_head = slots[index].next_free;
+        if (free_head == NO_SLOT) {
+            free_tail = NO_SLOT;
         }
+    } else if (slots.size() < MAX_COUNT) {
+        // Every slot is in use, grow the table
+        index = slots.size();
+        Slot slot = { nullptr, 0, NO_SLOT };
+        slots.push_back(slot);
+    } else {
+        ERROR_LOG(HLE, "Unable to allocate kernel object, too many objects slots in use.");
+        return 0;
     }
-    ERROR_LOG(HLE, "Unable to allocate kernel object, too many objects slots in use.");
-    return 0;
+
+    Slot& slot = slots[index];
+    slot.object = obj;
+    slot.next_free = NO_SLOT;
+    count++;
+
+    obj->handle = (slot.generation << INDEX_BITS) | (index + HANDLE_OFFSET);
+    return obj->handle;
 }
 
-bool ObjectPool::IsValid(Handle handle) {
-    int index = handle - HANDLE_OFFSET;
-    if (index < 0)
-        return false;
-    if (index >= MAX_COUNT)
-        return false;
+/// Deletes the object of a valid handle and frees its slot
+void ObjectPool::Release(Handle handle) {
+    const u32 index = GetSlotIndex(handle);
+    Slot& slot = slots[index];
+    Object* obj = slot.object;
+
+    // Freed slots go to the back of the list, so that a slot (and its handles) is reused as late
+    // as possible
+    slot.object = nullptr;
+    slot.generation = (slot.generation + 1) & GENERATION_MASK;
+    slot.next_free = NO_SLOT;
+    if (free_tail != NO_SLOT) {
+        slots[free_tail].next_free = index;
+    } else {
+        free_head = index;
+    }
+    free_tail = index;
+    count--;
 
-    return occupied[index];
+    delete obj;
 }
 
 void ObjectPool::Clear() {
-    for (int i = 0; i < MAX_COUNT; i++) {
+    for (Slot& slot : slots) {
         //brutally clear everything, no validation
-        if (occupied[i])
-            delete pool[i];
-        occupied[i] = false;
+        delete slot.object;
     }
-    pool.fill(nullptr);
-    next_id = INITIAL_NEXT_ID;
+    slots.clear();
+    free_head = free_tail = NO_SLOT;
+    count = 0;
 }
 
 Object* &ObjectPool::operator [](Handle handle)
 {
     _dbg_assert_msg_(KERNEL, IsValid(handle), "GRABBING UNALLOCED KERNEL OBJ");
-    return pool[handle - HANDLE_OFFSET];
+    return slots[GetSlotIndex(handle)].object;
 }
 
 void ObjectPool::List() {
-    for (int i = 0; i < MAX_COUNT; i++) {
-        if (occupied[i]) {
-            if (pool[i]) {
-                INFO_LOG(KERNEL, "KO %i: %s \"%s\"", i + HANDLE_OFFSET, pool[i]->GetTypeName().c_str(), 
-                    pool[i]->GetName().c_str());
-            }
+    for (const Slot& slot : slots) {
+        if (slot.object) {
+            INFO_LOG(KERNEL, "KO %i: %s \"%s\"", slot.object->GetHandle(),
+                slot.object->GetTypeName().c_str(), slot.object->GetName().c_str());
         }
     }
 }
 
 int ObjectPool::GetCount() {
-    int count = 0;
-    for (int i = 0; i < MAX_COUNT; i++) {
-        if (occupied[i])
-            count++;
-    }
     return count;
 }
 
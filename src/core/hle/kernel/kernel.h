@@ -4,8 +4,9 @@
 
 #pragma once
 
-#include <array>
 #include <string>
+#include <vector>
+
 #include "common/common.h"
 
 typedef u32 Handle;
@@ -38,6 +39,9 @@ enum {
     DEFAULT_STACK_SIZE  = 0x4000,
 };
 
+/// Result of a wait that ended because its timeout expired
+static const Result RESULT_TIMEOUT = 0x09401BFE;
+
 class ObjectPool;
 
 class Object : NonCopyable {
@@ -68,13 +72,20 @@ public:
     virtual Result WaitSynchronization(bool* wait) = 0;
 };
 
+/**
+ * Table of the live kernel objects, indexed by handle. A handle encodes the slot of its object and
+ * the generation of that slot, which is bumped every time the slot is freed: handles of destroyed
+ * objects are detected as stale instead of aliasing whatever object reuses the slot. Free slots
+ * are kept in a FIFO list, so creation, destruction and lookups are all O(1), and the table grows
+ * when every slot is in use.
+ */
 class ObjectPool : NonCopyable {
 public:
     ObjectPool();
     ~ObjectPool() {}
 
-    // Allocates a handle within the range and inserts the object into the map.
-    Handle Create(Object* obj, int range_bottom=INITIAL_NEXT_ID, int range_top=0x7FFFFFFF);
+    // Allocates a handle and inserts the object into the table.
+    Handle Create(Object* obj);
 
     static Object* CreateByIDType(int type);
 
@@ -82,20 +93,22 @@ public:
     u32 Destroy(Handle handle) {
         u32 error;
         if (Get<T>(handle, error)) {
-            occupied[handle - HANDLE_OFFSET] = false;
-            delete pool[handle - HANDLE_OFFSET];
+            Release(handle);
         }
         return error;
     };
 
-    bool IsValid(Handle handle);
+    bool IsValid(Handle handle) const {
+        return FindSlot(handle) != nullptr;
+    }
 
     template <class T>
     T* Get(Handle handle, u32& outError) {
-        if (handle < HANDLE_OFFSET || handle >= HANDLE_OFFSET + MAX_COUNT || !occupied[handle - HANDLE_OFFSET]) {
+        const Slot* slot = FindSlot(handle);
+        if (slot == nullptr) {
             // Tekken 6 spams 0x80020001 gets wrong with no ill effects, also on the real PSP
             if (handle != 0 && (u32)handle != 0x80020001) {
-                WARN_LOG(KERNEL, "Kernel: Bad object handle %i (%08x)", handle, handle);
+                WARN_LOG(KERNEL, "Kernel: Bad or stale object handle %i (%08x)", handle, handle);
             }
             outError = 0;//T::GetMissingErrorCode();
             return 0;
@@ -103,8 +116,8 @@ public:
             // Previously we had a dynamic_cast here, but since RTTI was disabled traditionally,
             // it just acted as a static case and everything worked. This means that we will never
             // see the Wrong type object error below, but we'll just have to live with that danger.
-            T* t = static_cast<T*>(pool[handle - HANDLE_OFFSET]);
-            if (t == 0 || t->GetHandleType() != T::GetStaticHandleType()) {
+            T* t = static_cast<T*>(slot->object);
+            if (t->GetHandleType() != T::GetStaticHandleType()) {
                 WARN_LOG(KERNEL, "Kernel: Wrong object type for %i (%08x)", handle, handle);
                 outError = 0;//T::GetMissingErrorCode();
                 return 0;
@@ -117,19 +130,17 @@ public:
     // ONLY use this when you know the handle is valid.
     template <class T>
     T *GetFast(Handle handle) {
-        const Handle realHandle = handle - HANDLE_OFFSET;
-        _dbg_assert_(KERNEL, realHandle >= 0 && realHandle < MAX_COUNT && occupied[realHandle]);
-        return static_cast<T*>(pool[realHandle]);
+        _dbg_assert_(KERNEL, IsValid(handle));
+        return static_cast<T*>(slots[GetSlotIndex(handle)].object);
     }
 
     template <class T, typename ArgT>
     void Iterate(bool func(T*, ArgT), ArgT arg) {
         int type = T::GetStaticIDType();
-        for (int i = 0; i < MAX_COUNT; i++)
-        {
-            if (!occupied[i])
+        for (const Slot& slot : slots) {
+            if (slot.object == nullptr)
                 continue;
-            T* t = static_cast<T*>(pool[i]);
+            T* t = static_cast<T*>(slot.object);
             if (t->GetIDType() == type) {
                 if (!func(t, arg))
                     break;
@@ -138,13 +149,12 @@ public:
     }
 
     bool GetIDType(Handle handle, HandleType* type) const {
-        if ((handle < HANDLE_OFFSET) || (handle >= HANDLE_OFFSET + MAX_COUNT) || 
-            !occupied[handle - HANDLE_OFFSET]) {
+        const Slot* slot = FindSlot(handle);
+        if (slot == nullptr) {
             ERROR_LOG(KERNEL, "Kernel: Bad object handle %i (%08x)", handle, handle);
             return false;
         }
-        Object* t = pool[handle - HANDLE_OFFSET];
-        *type = t->GetHandleType();
+        *type = slot->object->GetHandleType();
         return true;
     }
 
@@ -156,14 +166,50 @@ public:
 private:
     
     enum {
-        MAX_COUNT       = 0x1000,
-        HANDLE_OFFSET   = 0x100,
-        INITIAL_NEXT_ID = 0x10,
+        INITIAL_COUNT   = 0x1000,       ///< Slots allocated up front, the table grows past it
+        HANDLE_OFFSET   = 0x100,        ///< Added to slot indices, so that no handle is 0
+        INDEX_BITS      = 20,           ///< Handle bits holding the (offset) slot index
+        INDEX_MASK      = (1 << INDEX_BITS) - 1,
+        MAX_COUNT       = INDEX_MASK + 1 - HANDLE_OFFSET,
+        GENERATION_BITS = 11,           ///< Handle bits holding the generation, the top bit is
+        GENERATION_MASK = (1 << GENERATION_BITS) - 1, ///< left clear to avoid the 0xFFFF8000 aliases
+        NO_SLOT         = -1,
+    };
+
+    struct Slot {
+        Object* object;     ///< Object in the slot, or nullptr if it is free
+        u32 generation;     ///< Incremented every time the slot is freed
+        s32 next_free;      ///< Next slot of the free list, or NO_SLOT
     };
 
-    std::array<Object*, MAX_COUNT> pool;
-    std::array<bool, MAX_COUNT> occupied;
-    int next_id;
+    static u32 GetSlotIndex(Handle handle) {
+        return (handle & INDEX_MASK) - HANDLE_OFFSET;
+    }
+
+    static u32 GetGeneration(Handle handle) {
+        return handle >> INDEX_BITS;
+    }
+
+    /// Returns the slot of a live object, or nullptr if the handle is invalid or stale
+    const Slot* FindSlot(Handle handle) const {
+        const u32 index = GetSlotIndex(handle);
+        if (index >= slots.size()) {
+            return nullptr;
+        }
+        const Slot& slot = slots[index];
+        if (slot.object == nullptr || slot.generation != GetGeneration(handle)) {
+            return nullptr;
+        }
+        return &slot;
+    }
+
+    /// Deletes the object of a valid handle and frees its slot
+    void Release(Handle handle);
+
+    std::vector<Slot> slots;
+    s32 free_head;      ///< Slot reused first, or NO_SLOT if all of them are in use
+    s32 free_tail;      ///< Slot freed last, or NO_SLOT
+    int count;          ///< Number of live objects
 };
 
 extern ObjectPool g_object_pool;
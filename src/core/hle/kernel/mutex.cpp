@@ -3,7 +3,6 @@
 // Refer to the license.txt file included.  
 
 #include <map>
-#include <vector>
 
 #include "common/common.h"
 
@@ -24,7 +23,7 @@ public:
     bool initial_locked;                        ///< Initial lock state when mutex was created
     bool locked;                                ///< Current locked state
     Handle lock_thread;                         ///< Handle to thread that currently has mutex
-    std::vector<Handle> waiting_threads;        ///< Threads that are waiting for the mutex
+    WaitList waiting_threads;                   ///< Threads that are waiting for the mutex
     std::string name;                           ///< Name of mutex (optional)
 
     /**
@@ -49,6 +48,7 @@ public:
 
         if (locked) {
             Kernel::WaitCurrentThread(WAITTYPE_MUTEX, GetHandle());
+            Kernel::AddToWaitList(waiting_threads);
         }
 
         return 0;
@@ -91,28 +91,19 @@ bool LockMutex(Mutex* mutex) {
     return true;
 }
 
-bool ReleaseMutexForThread(Mutex* mutex, Handle thread) {
-    MutexAcquireLock(mutex, thread);
-    Kernel::ResumeThreadFromWait(thread);
-    return true;
-}
-
 bool ReleaseMutex(Mutex* mutex) {
     MutexEraseLock(mutex);
-    bool woke_threads = false;
 
-    // Find the next waiting thread for the mutex...
-    while (!woke_threads && !mutex->waiting_threads.empty()) {
-        std::vector<Handle>::iterator iter = mutex->waiting_threads.begin();
-        woke_threads |= ReleaseMutexForThread(mutex, *iter);
-        mutex->waiting_threads.erase(iter);
+    // Hand the mutex over to the highest priority thread waiting for it...
+    Handle thread = Kernel::WakeFirstWaiter(mutex->waiting_threads);
+    if (thread != 0) {
+        MutexAcquireLock(mutex, thread);
+        return true;
     }
     // Reset mutex lock thread handle, nothing is waiting
-    if (!woke_threads) {
-        mutex->locked = false;
-        mutex->lock_thread = -1;
-    }
-    return woke_threads;
+    mutex->locked = false;
+    mutex->lock_thread = -1;
+    return false;
 }
 
 /**
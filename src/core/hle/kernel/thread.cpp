@@ -4,15 +4,18 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <functional>
 #include <list>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "common/common.h"
-#include "common/thread_queue_list.h"
+#include "common/scheduler_queue.h"
 
 #include "core/core.h"
+#include "core/core_timing.h"
 #include "core/mem_map.h"
 #include "core/hle/hle.h"
 #include "core/hle/svc.h"
@@ -21,8 +24,14 @@
 
 namespace Kernel {
 
+static void EndWait(Thread* thread);
+static void ResumeThread(Thread* thread);
+
 class Thread : public Kernel::Object {
 public:
+    ~Thread() {
+        EndWait(this);
+    }
 
     std::string GetName() const { return name; }
     std::string GetTypeName() const { return "Thread"; }
@@ -43,11 +52,8 @@ public:
      */
     Result WaitSynchronization(bool* wait) {
         if (status != THREADSTATUS_DORMANT) {
-            Handle thread = GetCurrentThreadHandle();
-            if (std::find(waiting_threads.begin(), waiting_threads.end(), thread) == waiting_threads.end()) {
-                waiting_threads.push_back(thread);
-            }
             WaitCurrentThread(WAITTYPE_THREADEND, this->GetHandle());
+            AddToWaitList(waiting_threads);
             *wait = true;
         }
         return 0;
@@ -67,17 +73,36 @@ public:
 
     WaitType wait_type;
     Handle wait_handle;
+    u32 wait_address;   ///< Arbitrated address, valid when wait_type is WAITTYPE_ARB
+
+    CoreTiming::EventHandle wakeup_event;   ///< Pending timeout of the current wait, or 0
+
+    WaitList waiting_threads;   ///< Threads waiting for this thread to end
+
+    WaitListNode wait_nodes[MAX_WAIT_OBJECTS];  ///< Links the thread in the lists it waits in
+    int num_wait_nodes;         ///< Number of nodes used by the current wait
+    int num_pending_objects;    ///< Objects of the current wait that were not signalled yet
+    s32 wait_object_index;      ///< Index given to the next node, see SetWaitObjectIndex
+    bool wait_multiple;         ///< Waiting in WaitSynchronizationN
+    bool wait_all;              ///< Waiting for all the objects rather than any of them
 
-    std::vector<Handle> waiting_threads;
+    std::function<void()> resume_callback;  ///< Called once the thread runs again, or empty
 
     std::string name;
+
+    Common::SchedulerQueueHook<Thread> ready_queue_hook;    ///< Links the thread in the ready queue
 };
 
 // Lists all thread ids that aren't deleted/etc.
 std::vector<Handle> g_thread_queue;
 
-// Lists only ready thread ids.
-Common::ThreadQueueList<Handle> g_thread_ready_queue;
+// Lists only ready threads.
+Common::SchedulerQueue<Thread, &Thread::ready_queue_hook> g_thread_ready_queue;
+
+// Lists the threads waiting on each arbitrated address, keyed by ArbiterWaitKey
+static std::unordered_map<u64, WaitList> g_arbiter_wait_lists;
+
+static int g_thread_wakeup_event_type;  ///< CoreTiming event ending timed waits
 
 Handle g_current_thread_handle;
 Thread* g_current_thread;
@@ -127,20 +152,20 @@ void ResetThread(Thread* t, u32 arg, s32 lowest_priority) {
     }
     t->wait_type = WAITTYPE_NONE;
     t->wait_handle = 0;
+    t->wait_address = 0;
 }
 
 /// Change a thread to "ready" state
 void ChangeReadyState(Thread* t, bool ready) {
-    Handle handle = t->GetHandle();
     if (t->IsReady()) {
         if (!ready) {
-            g_thread_ready_queue.remove(t->current_priority, handle);
+            g_thread_ready_queue.remove(t);
         }
     }  else if (ready) {
         if (t->IsRunning()) {
-            g_thread_ready_queue.push_front(t->current_priority, handle);
+            g_thread_ready_queue.push_front(t->current_priority, t);
         } else {
-            g_thread_ready_queue.push_back(t->current_priority, handle);
+            g_thread_ready_queue.push_back(t->current_priority, t);
         }
         t->status = THREADSTATUS_READY;
     }
@@ -164,15 +189,10 @@ void StopThread(Handle handle, const char* reason) {
     
     ChangeReadyState(thread, false);
     thread->status = THREADSTATUS_DORMANT;
-    for (size_t i = 0; i < thread->waiting_threads.size(); ++i) {
-        const Handle waiting_thread = thread->waiting_threads[i];
-        if (VerifyWait(waiting_thread, WAITTYPE_THREADEND, handle)) {
-            ResumeThreadFromWait(waiting_thread);
-        }
-    }
-    thread->waiting_threads.clear();
+    WakeAllWaiters(thread->waiting_threads);
 
     // Stopped threads are never waiting.
+    EndWait(thread);
     thread->wait_type = WAITTYPE_NONE;
     thread->wait_handle = 0;
 }
@@ -192,43 +212,210 @@ void ChangeThreadState(Thread* t, ThreadStatus new_status) {
     }
 }
 
-/// Arbitrate the highest priority thread that is waiting
+/// Returns the key of the wait list of an arbitrated address
+static inline u64 ArbiterWaitKey(Handle arbiter, u32 address) {
+    return ((u64)arbiter << 32) | address;
+}
+
+/// Arbitrate the highest priority thread that is waiting on an address
 Handle ArbitrateHighestPriorityThread(u32 arbiter, u32 address) {
-    Handle highest_priority_thread = 0;
-    s32 priority = THREADPRIO_LOWEST;
+    auto it = g_arbiter_wait_lists.find(ArbiterWaitKey(arbiter, address));
+    if (it == g_arbiter_wait_lists.end())
+        return 0;
+
+    Handle highest_priority_thread = WakeFirstWaiter(it->second);
+    if (it->second.empty())
+        g_arbiter_wait_lists.erase(it);
+
+    return highest_priority_thread;
+}
 
-    // Iterate through threads, find highest priority thread that is waiting to be arbitrated...
-    for (const auto& handle : g_thread_queue) {
+/// Arbitrate all threads currently waiting on an address
+void ArbitrateAllThreads(u32 arbiter, u32 address) {
+    auto it = g_arbiter_wait_lists.find(ArbiterWaitKey(arbiter, address));
+    if (it == g_arbiter_wait_lists.end())
+        return;
 
-        // TODO(bunnei): Verify arbiter address...
-        if (!VerifyWait(handle, WAITTYPE_ARB, arbiter))
-            continue;
+    WakeAllWaiters(it->second);
+    g_arbiter_wait_lists.erase(it);
+}
 
-        Thread* thread = g_object_pool.GetFast<Thread>(handle);
-        if(thread->current_priority <= priority) {
-            highest_priority_thread = handle;
-            priority = thread->current_priority;
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Wait lists
+
+/// Links a node into a wait list, behind the threads with the same or a better priority
+static void LinkWaitListNode(WaitList& list, WaitListNode* node) {
+    const s32 priority = node->thread->current_priority;
+    WaitListNode* prev = list.tail;
+    while (prev != nullptr && prev->thread->current_priority > priority) {
+        prev = prev->prev;
+    }
+
+    node->list = &list;
+    node->prev = prev;
+    node->next = (prev != nullptr) ? prev->next : list.head;
+    if (node->next != nullptr) {
+        node->next->prev = node;
+    } else {
+        list.tail = node;
+    }
+    if (prev != nullptr) {
+        prev->next = node;
+    } else {
+        list.head = node;
+    }
+}
+
+/// Unlinks a node from the wait list it is in
+static void UnlinkWaitListNode(WaitListNode* node) {
+    WaitList& list = *node->list;
+    if (node->prev != nullptr) {
+        node->prev->next = node->next;
+    } else {
+        list.head = node->next;
+    }
+    if (node->next != nullptr) {
+        node->next->prev = node->prev;
+    } else {
+        list.tail = node->prev;
+    }
+    node->prev = node->next = nullptr;
+    node->list = nullptr;
+}
+
+/// Removes a thread from all the wait lists it is in and resets the state of its wait
+static void EndWait(Thread* thread) {
+    for (int i = 0; i < thread->num_wait_nodes; ++i) {
+        if (thread->wait_nodes[i].list != nullptr) {
+            UnlinkWaitListNode(&thread->wait_nodes[i]);
         }
     }
-    // If a thread was arbitrated, resume it
-    if (0 != highest_priority_thread)
-        ResumeThreadFromWait(highest_priority_thread);
+    thread->num_wait_nodes = 0;
+    thread->num_pending_objects = 0;
+    thread->wait_object_index = 0;
+    thread->wait_multiple = false;
+    thread->wait_all = false;
+}
 
-    return highest_priority_thread;
+WaitList::~WaitList() {
+    // Threads waiting on a destroyed object keep waiting (until their timeout, if any)
+    while (head != nullptr) {
+        UnlinkWaitListNode(head);
+    }
 }
 
-/// Arbitrate all threads currently waiting
-void ArbitrateAllThreads(u32 arbiter, u32 address) {
-    
-    // Iterate through threads, find highest priority thread that is waiting to be arbitrated...
-    for (const auto& handle : g_thread_queue) {
+/**
+ * Adds the current thread to the wait list of an object it is waiting on
+ * @param list Wait list of the object
+ */
+void AddToWaitList(WaitList& list) {
+    Thread* thread = GetCurrentThread();
+    if (thread->num_wait_nodes >= MAX_WAIT_OBJECTS) {
+        ERROR_LOG(KERNEL, "thread 0x%08X waits on too many objects", thread->GetHandle());
+        return;
+    }
+
+    WaitListNode* node = &thread->wait_nodes[thread->num_wait_nodes++];
+    node->thread = thread;
+    node->index = thread->wait_object_index;
+    LinkWaitListNode(list, node);
+    thread->num_pending_objects++;
+}
+
+/// Signals the thread of a node that was just unlinked from the list of a signalled object
+static Handle SignalWaiter(WaitListNode* node) {
+    Thread* thread = node->thread;
+    thread->num_pending_objects--;
+    if (thread->wait_all && thread->num_pending_objects > 0) {
+        return thread->GetHandle();
+    }
+
+    // WaitSynchronizationN returns the index of the object that ended the wait in r1
+    if (thread->wait_multiple && !thread->wait_all) {
+        if (thread == GetCurrentThread()) {
+            Core::g_app_core->SetReg(1, node->index);
+        } else {
+            thread->context.cpu_registers[1] = node->index;
+        }
+    }
+
+    ResumeThread(thread);
+    return thread->GetHandle();
+}
+
+/**
+ * Signals the highest priority thread of a wait list. A thread waiting on several objects is
+ * resumed right away, unless it waits on all of them and some are not signalled yet.
+ * @param list Wait list of the signalled object
+ * @return Handle of the signalled thread, or 0 if the list was empty
+ */
+Handle WakeFirstWaiter(WaitList& list) {
+    WaitListNode* node = list.head;
+    if (node == nullptr) {
+        return 0;
+    }
+    UnlinkWaitListNode(node);
+    return SignalWaiter(node);
+}
+
+/**
+ * Signals all the threads of a wait list, see WakeFirstWaiter
+ * @param list Wait list of the signalled object
+ * @return True if any thread was signalled
+ */
+bool WakeAllWaiters(WaitList& list) {
+    bool woken = false;
+    while (!list.empty()) {
+        WakeFirstWaiter(list);
+        woken = true;
+    }
+    return woken;
+}
+
+/**
+ * Makes the current thread wait on the objects it is about to synchronize with, in
+ * WaitSynchronizationN, as a group
+ * @param wait_all True if the thread waits for all the objects, false if any of them will do
+ */
+void BeginWaitSynchronizationN(bool wait_all) {
+    Thread* thread = GetCurrentThread();
+    thread->wait_multiple = true;
+    thread->wait_all = wait_all;
+}
 
-        // TODO(bunnei): Verify arbiter address...
-        if (VerifyWait(handle, WAITTYPE_ARB, arbiter))
-            ResumeThreadFromWait(handle);
+/**
+ * Sets the index reported to the current thread (in r1) if the object it synchronizes with next
+ * is the one ending its WaitSynchronizationN
+ * @param index Index of the object in the handles passed to WaitSynchronizationN
+ */
+void SetWaitObjectIndex(s32 index) {
+    GetCurrentThread()->wait_object_index = index;
+}
+
+/**
+ * Ends the wait of the current thread on the objects it synchronized with so far in
+ * WaitSynchronizationN, once another one turned out to be signalled. The thread keeps running
+ * instead of being put in the ready queue.
+ */
+void EndWaitSynchronizationN() {
+    Thread* thread = GetCurrentThread();
+    EndWait(thread);
+
+    if (thread->wakeup_event != 0) {
+        CoreTiming::UnscheduleEvent(thread->wakeup_event);
+        thread->wakeup_event = 0;
+    }
+
+    if (thread->IsWaiting()) {
+        thread->status = (thread->status & ~THREADSTATUS_WAIT) | THREADSTATUS_RUNNING;
     }
+    thread->wait_type = WAITTYPE_NONE;
+    thread->wait_handle = 0;
+    thread->wait_address = 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 /// Calls a thread by marking it as "ready" (note: will not actually execute until current thread yields)
 void CallThread(Thread* t) {
     // Stop waiting
@@ -257,6 +444,12 @@ void SwitchContext(Thread* t) {
         t->status = (t->status | THREADSTATUS_RUNNING) & ~THREADSTATUS_READY;
         t->wait_type = WAITTYPE_NONE;
         LoadContext(t->context);
+
+        if (t->resume_callback) {
+            std::function<void()> callback;
+            callback.swap(t->resume_callback);
+            callback();
+        }
     } else {
         SetCurrentThread(nullptr);
     }
@@ -264,42 +457,124 @@ void SwitchContext(Thread* t) {
 
 /// Gets the next thread that is ready to be run by priority
 Thread* NextThread() {
-    Handle next;
     Thread* cur = GetCurrentThread();
     
     if (cur && cur->IsRunning()) {
-        next = g_thread_ready_queue.pop_first_better(cur->current_priority);
-    } else  {
-        next = g_thread_ready_queue.pop_first();
+        return g_thread_ready_queue.pop_first_better(cur->current_priority);
     }
-    if (next == 0) {
-        return nullptr;
-    }
-    return Kernel::g_object_pool.GetFast<Thread>(next);
+    return g_thread_ready_queue.pop_first();
 }
 
 /**
  * Puts the current thread in the wait state for the given type
  * @param wait_type Type of wait
  * @param wait_handle Handle of Kernel object that we are waiting on, defaults to current thread
+ * @param wait_address Arbitrated address, for WAITTYPE_ARB
  */
-void WaitCurrentThread(WaitType wait_type, Handle wait_handle) {
+void WaitCurrentThread(WaitType wait_type, Handle wait_handle, u32 wait_address) {
     Thread* thread = GetCurrentThread();
     thread->wait_type = wait_type;
     thread->wait_handle = wait_handle;
+    thread->wait_address = wait_address;
     ChangeThreadState(thread, ThreadStatus(THREADSTATUS_WAIT | (thread->status & THREADSTATUS_SUSPEND)));
+
+    if (wait_type == WAITTYPE_ARB) {
+        AddToWaitList(g_arbiter_wait_lists[ArbiterWaitKey(wait_handle, wait_address)]);
+    }
 }
 
-/// Resumes a thread from waiting by marking it as "ready"
+/// Resumes a thread from waiting by marking it as "ready", removing it from all wait lists
+static void ResumeThread(Thread* thread) {
+    EndWait(thread);
+
+    // Woken up before its timeout
+    if (thread->wakeup_event != 0) {
+        CoreTiming::UnscheduleEvent(thread->wakeup_event);
+        thread->wakeup_event = 0;
+    }
+
+    if (!thread->IsWaiting()) {
+        return;
+    }
+    thread->status &= ~THREADSTATUS_WAIT;
+    if (!(thread->status & (THREADSTATUS_WAITSUSPEND | THREADSTATUS_DORMANT | THREADSTATUS_DEAD))) {
+        ChangeReadyState(thread, true);
+    }
+}
+
+/// Resumes a thread from waiting by marking it as "ready", removing it from all wait lists
 void ResumeThreadFromWait(Handle handle) {
     u32 error;
     Thread* thread = Kernel::g_object_pool.Get<Thread>(handle, error);
     if (thread) {
-        thread->status &= ~THREADSTATUS_WAIT;
-        if (!(thread->status & (THREADSTATUS_WAITSUSPEND | THREADSTATUS_DORMANT | THREADSTATUS_DEAD))) {
-            ChangeReadyState(thread, true);
+        ResumeThread(thread);
+    }
+}
+
+/**
+ * Sets a function called once a waiting thread runs again, e.g. to write the reply of a request
+ * that completed while other threads were using the command buffer
+ * @param handle Handle of the waiting thread
+ * @param callback Function to call, replaces the one set earlier if any
+ */
+void SetThreadResumeCallback(Handle handle, std::function<void()> callback) {
+    u32 error;
+    Thread* thread = g_object_pool.Get<Thread>(handle, error);
+    if (thread) {
+        thread->resume_callback = std::move(callback);
+    }
+}
+
+/**
+ * Ends the wait of a thread whose timeout expired
+ * @param handle Handle of the waiting thread
+ * @param cycles_late Unused
+ */
+static void ThreadWakeupCallback(u64 handle, int cycles_late) {
+    Thread* thread = g_object_pool.GetFast<Thread>((Handle)handle);
+    thread->wakeup_event = 0;
+    if (!thread->IsWaiting()) {
+        return;
+    }
+
+    // A timed out WaitSynchronization returns an error instead of the result it was called with
+    if (thread->wait_type != WAITTYPE_SLEEP) {
+        if (thread == GetCurrentThread()) {
+            Core::g_app_core->SetReg(0, RESULT_TIMEOUT);
+        } else {
+            thread->context.cpu_registers[0] = RESULT_TIMEOUT;
         }
     }
+
+    ResumeThreadFromWait((Handle)handle);
+    HLE::Reschedule(__func__);
+}
+
+/**
+ * Resumes a waiting thread once a delay has passed, unless it is resumed earlier. A thread that
+ * wasn't sleeping sees its wait fail with RESULT_TIMEOUT.
+ * @param handle Handle of the waiting thread
+ * @param nanoseconds Delay before the thread is resumed
+ */
+void WakeThreadAfterDelay(Handle handle, s64 nanoseconds) {
+    Thread* thread = g_object_pool.GetFast<Thread>(handle);
+    _assert_msg_(KERNEL, (thread != nullptr), "called, but thread is nullptr!");
+
+    if (!thread->IsWaiting()) {
+        return;
+    }
+    if (thread->wakeup_event != 0) {
+        CoreTiming::UnscheduleEvent(thread->wakeup_event);
+    }
+    // CoreTiming ticks are counted in instructions, at about 3 cycles each (see GPU::kFrameTicks)
+    s64 ticks = nsToCycles(nanoseconds) / 3;
+    thread->wakeup_event = CoreTiming::ScheduleEvent(ticks, g_thread_wakeup_event_type, handle);
+}
+
+/// Returns true if the current thread is running, false if it is waiting with nothing to run
+bool IsCurrentThreadRunning() {
+    Thread* thread = GetCurrentThread();
+    return thread != nullptr && thread->IsRunning();
 }
 
 /// Prints the thread queue for debugging purposes
@@ -311,7 +586,7 @@ void DebugThreadQueue() {
     INFO_LOG(KERNEL, "0x%02X 0x%08X (current)", thread->current_priority, GetCurrentThreadHandle());
     for (u32 i = 0; i < g_thread_queue.size(); i++) {
         Handle handle = g_thread_queue[i];
-        s32 priority = g_thread_ready_queue.contains(handle);
+        s32 priority = g_thread_ready_queue.contains(g_object_pool.GetFast<Thread>(handle));
         if (priority != -1) {
             INFO_LOG(KERNEL, "0x%02X 0x%08X", priority, handle);
         }
@@ -330,7 +605,6 @@ Thread* CreateThread(Handle& handle, const char* name, u32 entry_point, s32 prio
     handle = Kernel::g_object_pool.Create(thread);
 
     g_thread_queue.push_back(handle);
-    g_thread_ready_queue.prepare(priority);
 
     thread->status = THREADSTATUS_DORMANT;
     thread->entry_point = entry_point;
@@ -340,6 +614,13 @@ Thread* CreateThread(Handle& handle, const char* name, u32 entry_point, s32 prio
     thread->processor_id = processor_id;
     thread->wait_type = WAITTYPE_NONE;
     thread->wait_handle = 0;
+    thread->wait_address = 0;
+    thread->wakeup_event = 0;
+    thread->num_wait_nodes = 0;
+    thread->num_pending_objects = 0;
+    thread->wait_object_index = 0;
+    thread->wait_multiple = false;
+    thread->wait_all = false;
     thread->name = name;
 
     return thread;
@@ -407,17 +688,25 @@ Result SetThreadPriority(Handle handle, s32 priority) {
     }
 
     // Change thread priority
-    s32 old = thread->current_priority;
-    g_thread_ready_queue.remove(old, handle);
+    g_thread_ready_queue.remove(thread);
     thread->current_priority = priority;
-    g_thread_ready_queue.prepare(thread->current_priority);
+
+    // Keep the wait lists the thread is in ordered
+    for (int i = 0; i < thread->num_wait_nodes; ++i) {
+        WaitListNode* node = &thread->wait_nodes[i];
+        if (node->list != nullptr) {
+            WaitList& list = *node->list;
+            UnlinkWaitListNode(node);
+            LinkWaitListNode(list, node);
+        }
+    }
 
     // Change thread status to "ready" and push to ready queue
     if (thread->IsRunning()) {
         thread->status = (thread->status & ~THREADSTATUS_RUNNING) | THREADSTATUS_READY;
     }
     if (thread->IsReady()) {
-        g_thread_ready_queue.push_back(thread->current_priority, handle);
+        g_thread_ready_queue.push_back(thread->current_priority, thread);
     }
 
     return 0;
@@ -453,7 +742,14 @@ void Reschedule() {
     Thread* prev = GetCurrentThread();
     Thread* next = NextThread();
     HLE::g_reschedule = false;
-    if (next > 0) {
+
+    // See the hack below: with no other thread to yield to, the VBLANK wait ends right away
+    if (next == nullptr && prev != nullptr && prev->wait_type == WAITTYPE_VBLANK) {
+        ResumeThreadFromWait(prev->GetHandle());
+        next = NextThread();
+    }
+
+    if (next != nullptr) {
         INFO_LOG(KERNEL, "context switch 0x%08X -> 0x%08X", prev->GetHandle(), next->GetHandle());
         
         SwitchContext(next);
@@ -471,9 +767,12 @@ void Reschedule() {
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void ThreadingInit() {
+    g_thread_wakeup_event_type = CoreTiming::RegisterEvent("Kernel::ThreadWakeupCallback",
+        ThreadWakeupCallback);
 }
 
 void ThreadingShutdown() {
+    g_arbiter_wait_lists.clear();
 }
 
 } // namespace
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <functional>
+
 #include "common/common_types.h"
 #include "core/hle/kernel/kernel.h"
 
@@ -44,6 +46,78 @@ enum WaitType {
 
 namespace Kernel {
 
+/// Maximum number of objects a thread can wait on at once (handles of WaitSynchronizationN)
+static const int MAX_WAIT_OBJECTS = 256;
+
+class Thread;
+struct WaitList;
+
+/// Links a waiting thread into the WaitList of one of the objects it waits on
+struct WaitListNode {
+    WaitListNode* prev;
+    WaitListNode* next;
+    WaitList* list;     ///< List the node is linked in, or nullptr
+    Thread* thread;     ///< Waiting thread, the node is embedded in it
+    s32 index;          ///< Index of the object in the handles passed to WaitSynchronizationN
+};
+
+/**
+ * Threads waiting on a kernel object, highest priority first (FIFO for equal priorities). The
+ * nodes are embedded in the threads, one per object they wait on, so the list never allocates.
+ * Waking or cancelling a waiter is O(1), a thread is unlinked from all the lists it is in as soon
+ * as its wait ends, however it ends.
+ */
+struct WaitList : NonCopyable {
+    WaitList() : head(nullptr), tail(nullptr) {}
+    ~WaitList();
+
+    bool empty() const { return head == nullptr; }
+
+    WaitListNode* head;
+    WaitListNode* tail;
+};
+
+/**
+ * Adds the current thread to the wait list of an object it is waiting on
+ * @param list Wait list of the object
+ */
+void AddToWaitList(WaitList& list);
+
+/**
+ * Signals the highest priority thread of a wait list. A thread waiting on several objects is
+ * resumed right away, unless it waits on all of them and some are not signalled yet.
+ * @param list Wait list of the signalled object
+ * @return Handle of the signalled thread, or 0 if the list was empty
+ */
+Handle WakeFirstWaiter(WaitList& list);
+
+/**
+ * Signals all the threads of a wait list, see WakeFirstWaiter
+ * @param list Wait list of the signalled object
+ * @return True if any thread was signalled
+ */
+bool WakeAllWaiters(WaitList& list);
+
+/**
+ * Makes the current thread wait on the objects it is about to synchronize with, in
+ * WaitSynchronizationN, as a group
+ * @param wait_all True if the thread waits for all the objects, false if any of them will do
+ */
+void BeginWaitSynchronizationN(bool wait_all);
+
+/**
+ * Sets the index reported to the current thread (in r1) if the object it synchronizes with next
+ * is the one ending its WaitSynchronizationN
+ * @param index Index of the object in the handles passed to WaitSynchronizationN
+ */
+void SetWaitObjectIndex(s32 index);
+
+/**
+ * Ends the wait of the current thread on the objects it synchronized with so far in
+ * WaitSynchronizationN, leaving it running
+ */
+void EndWaitSynchronizationN();
+
 /// Creates a new thread - wrapper for external user
 Handle CreateThread(const char* name, u32 entry_point, s32 priority, u32 arg, s32 processor_id,
     u32 stack_top, int stack_size=Kernel::DEFAULT_STACK_SIZE);
@@ -57,13 +131,37 @@ void Reschedule();
 /// Stops the current thread
 void StopThread(Handle thread, const char* reason);
 
-/// Resumes a thread from waiting by marking it as "ready"
+/// Resumes a thread from waiting by marking it as "ready", removing it from all wait lists
 void ResumeThreadFromWait(Handle handle);
 
-/// Arbitrate the highest priority thread that is waiting
+/**
+ * Sets a function called once a waiting thread runs again, e.g. to write the reply of a request
+ * that completed while other threads were using the command buffer
+ * @param handle Handle of the waiting thread
+ * @param callback Function to call, replaces the one set earlier if any
+ */
+void SetThreadResumeCallback(Handle handle, std::function<void()> callback);
+
+/**
+ * Resumes a waiting thread once a delay has passed, unless it is resumed earlier. A thread that
+ * wasn't sleeping sees its wait fail with RESULT_TIMEOUT.
+ * @param handle Handle of the waiting thread
+ * @param nanoseconds Delay before the thread is resumed
+ */
+void WakeThreadAfterDelay(Handle handle, s64 nanoseconds);
+
+/// Returns true if the current thread is running, false if it is waiting with nothing to run
+bool IsCurrentThreadRunning();
+
+/**
+ * Arbitrate the highest priority thread that is waiting on an address
+ * @param arbiter Handle of the address arbiter
+ * @param address Address the threads are waiting on
+ * @return Handle of the resumed thread, or 0 if no thread was waiting
+ */
 Handle ArbitrateHighestPriorityThread(u32 arbiter, u32 address);
 
-/// Arbitrate all threads currently waiting...
+/// Arbitrate all threads currently waiting on an address
 void ArbitrateAllThreads(u32 arbiter, u32 address);
 
 /// Gets the current thread handle
@@ -73,8 +171,10 @@ Handle GetCurrentThreadHandle();
  * Puts the current thread in the wait state for the given type
  * @param wait_type Type of wait
  * @param wait_handle Handle of Kernel object that we are waiting on, defaults to current thread
+ * @param wait_address Arbitrated address, for WAITTYPE_ARB
  */
-void WaitCurrentThread(WaitType wait_type, Handle wait_handle=GetCurrentThreadHandle());
+void WaitCurrentThread(WaitType wait_type, Handle wait_handle=GetCurrentThreadHandle(),
+    u32 wait_address=0);
 
 /// Put current thread in a wait state - on WaitSynchronization
 void WaitThread_Synchronization();
@@ -2,8 +2,12 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <string>
+
 #include "common/common.h"
 
+#include "core/mem_map.h"
 #include "core/loader/loader.h"
 #include "core/hle/hle.h"
 #include "core/hle/service/fs.h"
@@ -14,6 +18,91 @@
 
 namespace FS_User {
 
+/// Types of the paths ("low paths") passed to the FS commands
+enum class LowPathType : u32 {
+    Invalid = 0,
+    Empty   = 1,
+    Binary  = 2,
+    Char    = 3,
+    Wchar   = 4,
+};
+
+/// Result of the commands opening a file that doesn't exist
+static const u32 kResultFileNotFound = 0xC8804464;
+
+/// Size limit of the paths passed to the FS commands in bytes, 256 UTF-16 characters
+static const u32 kMaxLowPathSize = 0x200;
+
+/**
+ * Gets a pointer to a path passed to an FS command, clamping its size to the memory mapped there
+ * @param address Address of the path in memory
+ * @param size Size of the path in bytes, receives the size that can be read
+ * @return Pointer to the path, or nullptr if its address isn't mapped
+ */
+static const u8* GetLowPathPointer(u32 address, u32& size) {
+    const u8* data = Memory::GetPointer(address);
+    if (data == nullptr) {
+        return nullptr;
+    }
+    size = std::min(size, kMaxLowPathSize);
+
+    // The path may run into an unmapped page, or one that isn't next to the first one in host memory
+    if (size > 0 && Memory::GetPointer(address + size - 1) != data + size - 1) {
+        size = std::min(size, (u32)Memory::PAGE_SIZE - (address & Memory::PAGE_MASK));
+    }
+    return data;
+}
+
+/**
+ * Reads a path passed to an FS command
+ * @param type Type of the path
+ * @param size Size of the path in bytes, including its terminator
+ * @param address Address of the path in memory
+ * @return Path as UTF-16 without terminator, empty for empty and binary paths
+ */
+static std::u16string ReadLowPath(LowPathType type, u32 size, u32 address) {
+    std::u16string path;
+    switch (type) {
+    case LowPathType::Char:
+    {
+        const u8* data = GetLowPathPointer(address, size);
+        if (data != nullptr) {
+            path.assign(data, data + size);
+        }
+        break;
+    }
+    case LowPathType::Wchar:
+    {
+        const u16* data = (const u16*)GetLowPathPointer(address, size);
+        if (data != nullptr) {
+            path.assign(data, data + size / 2);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    while (!path.empty() && path.back() == u'\0') {
+        path.pop_back();
+    }
+    return path;
+}
+
+/**
+ * Opens a file of an archive from its path, or the whole archive if the path isn't a text path
+ * @param archive_handle Handle of the archive
+ * @param type Type of the path of the file
+ * @param size Size of the path in bytes
+ * @param address Address of the path in memory
+ * @return Handle to the file, otherwise a null handle (0)
+ */
+static Handle OpenFileFromPath(Handle archive_handle, LowPathType type, u32 size, u32 address) {
+    if (type != LowPathType::Char && type != LowPathType::Wchar) {
+        return archive_handle;
+    }
+    return Kernel::OpenFileFromArchive(archive_handle, ReadLowPath(type, size, address));
+}
+
 void Initialize(Service::Interface* self) {
     u32* cmd_buff = Service::GetCommandBuffer();
     cmd_buff[1] = 0; // No error
@@ -29,28 +118,79 @@ void OpenFileDirectly(Service::Interface* self) {
     //u32 transaction       = cmd_buff[1];
     //u32 arch_lowpath_type = cmd_buff[3];
     //u32 arch_lowpath_sz   = cmd_buff[4];
-    //u32 file_lowpath_type = cmd_buff[5];
-    //u32 file_lowpath_sz   = cmd_buff[6];
+    LowPathType file_lowpath_type = static_cast<LowPathType>(cmd_buff[5]);
+    u32 file_lowpath_sz     = cmd_buff[6];
     //u32 flags             = cmd_buff[7];
     //u32 attr              = cmd_buff[8];
     //u32 arch_lowpath_desc = cmd_buff[9];
     //u32 arch_lowpath_ptr  = cmd_buff[10];
     //u32 file_lowpath_desc = cmd_buff[11];
-    //u32 file_lowpath_ptr  = cmd_buff[12];
+    u32 file_lowpath_ptr    = cmd_buff[12];
 
     Handle handle = Kernel::OpenArchive(arch_id);
+    if (0 != handle) {
+        handle = OpenFileFromPath(handle, file_lowpath_type, file_lowpath_sz, file_lowpath_ptr);
+        if (0 != handle) {
+            cmd_buff[1] = 0; // No error
+            cmd_buff[3] = handle;
+        } else {
+            cmd_buff[1] = kResultFileNotFound;
+        }
+    }
+    DEBUG_LOG(KERNEL, "called");
+}
+
+void OpenFile(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+
+    // TODO: Properly implement use of these...
+    //u32 transaction       = cmd_buff[1];
+    Handle archive_handle   = cmd_buff[2]; // Lower word of the 64-bit archive handle
+    LowPathType lowpath_type = static_cast<LowPathType>(cmd_buff[4]);
+    u32 lowpath_sz          = cmd_buff[5];
+    //u32 flags             = cmd_buff[6];
+    //u32 attr              = cmd_buff[7];
+    //u32 lowpath_desc      = cmd_buff[8];
+    u32 lowpath_ptr         = cmd_buff[9];
+
+    Handle handle = OpenFileFromPath(archive_handle, lowpath_type, lowpath_sz, lowpath_ptr);
     if (0 != handle) {
         cmd_buff[1] = 0; // No error
         cmd_buff[3] = handle;
+    } else {
+        cmd_buff[1] = kResultFileNotFound;
     }
-    DEBUG_LOG(KERNEL, "called");
+    DEBUG_LOG(KERNEL, "called archive=0x%08X, handle=0x%08X", archive_handle, handle);
+}
+
+void OpenArchive(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+
+    FileSys::Archive::IdCode arch_id = static_cast<FileSys::Archive::IdCode>(cmd_buff[1]);
+
+    // TODO: Properly implement use of these...
+    //u32 lowpath_type      = cmd_buff[2];
+    //u32 lowpath_sz        = cmd_buff[3];
+    //u32 lowpath_desc      = cmd_buff[4];
+    //u32 lowpath_ptr       = cmd_buff[5];
+
+    Handle handle = Kernel::OpenArchive(arch_id);
+    if (0 != handle) {
+        cmd_buff[1] = 0; // No error
+        cmd_buff[2] = handle;   // Lower word
+        cmd_buff[3] = 0;        // Upper word
+    } else {
+        ERROR_LOG(KERNEL, "archive 0x%08X is not mounted", (u32)arch_id);
+        cmd_buff[1] = -1;
+    }
+    DEBUG_LOG(KERNEL, "called archive=0x%08X", (u32)arch_id);
 }
 
 const Interface::FunctionInfo FunctionTable[] = {
     {0x000100C6, nullptr,               "Dummy1"},
     {0x040100C4, nullptr,               "Control"},
     {0x08010002, Initialize,            "Initialize"},
-    {0x080201C2, nullptr,               "OpenFile"},
+    {0x080201C2, OpenFile,              "OpenFile"},
     {0x08030204, OpenFileDirectly,      "OpenFileDirectly"},
     {0x08040142, nullptr,               "DeleteFile"},
     {0x08050244, nullptr,               "RenameFile"},
@@ -60,7 +200,7 @@ const Interface::FunctionInfo FunctionTable[] = {
     {0x08090182, nullptr,               "CreateDirectory"},
     {0x080A0244, nullptr,               "RenameDirectory"},
     {0x080B0102, nullptr,               "OpenDirectory"},
-    {0x080C00C2, nullptr,               "OpenArchive"},
+    {0x080C00C2, OpenArchive,           "OpenArchive"},
     {0x080D0144, nullptr,               "ControlArchive"},
     {0x080E0080, nullptr,               "CloseArchive"},
     {0x080F0180, nullptr,               "FormatThisUserSaveData"},
@@ -14,6 +14,7 @@
 #include "core/hw/gpu.h"
 
 #include "video_core/gpu_debugger.h"
+#include "video_core/rasterizer.h"
 
 // Main graphics debugger object - TODO: Here is probably not the best place for this
 GraphicsDebugger g_debugger;
@@ -216,6 +217,7 @@ void ExecuteCommand(const Command& command, u32 thread_id) {
         memcpy(Memory::GetPointer(command.dma_request.dest_address),
                Memory::GetPointer(command.dma_request.source_address),
                command.dma_request.size);
+        Memory::InvalidateCode(command.dma_request.dest_address, command.dma_request.size);
         break;
 
     // ctrulib homebrew sends all relevant command list data with this command,
@@ -230,6 +232,8 @@ void ExecuteCommand(const Command& command, u32 thread_id) {
         // TODO: Not sure if we are supposed to always write this .. seems to trigger processing though
         WriteGPURegister(GPU_REG_INDEX(command_processor_config.trigger), 1);
 
+        // The application may read what the command list rendered once it gets the interrupt
+        Pica::Rasterizer::Flush();
         SignalInterrupt(InterruptId::P3D);
         break;
     }
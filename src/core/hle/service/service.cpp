@@ -2,11 +2,16 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <chrono>
+
 #include "common/common.h"
+#include "common/file_util.h"
 #include "common/log.h"
 #include "common/string_util.h"
 
+#include "core/settings.h"
 #include "core/hle/hle.h"
+#include "core/hle/trace.h"
 
 #include "core/hle/service/service.h"
 #include "core/hle/service/apt.h"
@@ -17,11 +22,99 @@
 #include "core/hle/service/srv.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/thread.h"
 
 namespace Service {
 
 Manager* g_manager = nullptr;  ///< Service manager
 
+static bool g_command_profiling = false;   ///< If true, per-command statistics are collected
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Service Interface class
+
+/**
+ * Synchronize kernel object 
+ * @param wait Boolean wait set if current thread should wait as a result of sync operation
+ * @return Result of operation, 0 on success, otherwise error code
+ */
+Result Interface::SyncRequest(bool* wait) {
+    u32* cmd_buff = GetCommandBuffer();
+    const u32 header = cmd_buff[0];
+    int index = FindFunction(header);
+
+    const bool trace = HLE::Trace::IsEnabled();
+    u32 args[4];
+    if (trace) {
+        for (int i = 0; i < 4; ++i) {
+            args[i] = cmd_buff[i + 1];
+        }
+    }
+
+    if (index < 0) {
+        ERROR_LOG(OSHLE, "unknown/unimplemented function: port=%s, command=0x%08X", 
+            GetPortName().c_str(), cmd_buff[0]);
+
+        // TODO(bunnei): Hack - ignore error
+        cmd_buff[1] = 0;
+    } else if (m_functions[index].func == nullptr) {
+        ERROR_LOG(OSHLE, "unimplemented function: port=%s, name=%s", 
+            GetPortName().c_str(), m_functions[index].name);
+
+        // TODO(bunnei): Hack - ignore error
+        cmd_buff[1] = 0;
+    } else if (g_command_profiling) {
+        FunctionStats& stats = m_function_stats[index];
+        stats.call_count++;
+        stats.last_caller = Kernel::GetCurrentThreadHandle();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        m_functions[index].func(this);
+        auto time = std::chrono::high_resolution_clock::now() - start;
+        stats.host_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+    } else {
+        m_functions[index].func(this);
+    }
+
+    if (trace) {
+        HLE::Trace::Append(HLE::Trace::RECORD_IPC, GetHandle(), header, args, cmd_buff[1]);
+    }
+
+    return 0; // TODO: Implement return from actual function
+}
+
+/**
+ * Registers the functions in the service
+ */
+void Interface::Register(const FunctionInfo* functions, int len) {
+    for (int i = 0; i < len; i++) {
+        int index = FindFunction(functions[i].id);
+        if (index >= 0) {
+            m_functions[index] = functions[i];
+            continue;
+        }
+        auto position = std::upper_bound(m_functions.begin(), m_functions.end(), functions[i].id,
+            [](u32 id, const FunctionInfo& info) { return id < info.id; });
+        m_function_stats.insert(m_function_stats.begin() + (position - m_functions.begin()),
+            FunctionStats());
+        m_functions.insert(position, functions[i]);
+    }
+}
+
+/**
+ * Looks up the function handling a command
+ * @param id Command header
+ * @return Index in m_functions, or -1 if the command is unknown
+ */
+int Interface::FindFunction(u32 id) const {
+    auto itr = std::lower_bound(m_functions.begin(), m_functions.end(), id,
+        [](const FunctionInfo& info, u32 id) { return info.id < id; });
+    if (itr == m_functions.end() || itr->id != id) {
+        return -1;
+    }
+    return itr - m_functions.begin();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Service Manager class
 
@@ -29,8 +122,9 @@ Manager::Manager() {
 }
 
 Manager::~Manager() {
-    for(Interface* service : m_services) {
-        DeleteService(service->GetPortName());
+    // DeleteService removes the service from m_services
+    while (!m_services.empty()) {
+        DeleteService(m_services.back()->GetPortName());
     }
 }
 
@@ -44,8 +138,9 @@ void Manager::AddService(Interface* service) {
 void Manager::DeleteService(std::string port_name) {
     Interface* service = FetchFromPortName(port_name);
     m_services.erase(std::remove(m_services.begin(), m_services.end(), service), m_services.end());
+    // Frees the handle as well, or Kernel::Shutdown would delete the service a second time
+    Kernel::g_object_pool.Destroy<Interface>(m_port_map[port_name]);
     m_port_map.erase(port_name);
-    delete service;
 }
 
 /// Get a Service Interface from its Handle
@@ -62,6 +157,48 @@ Interface* Manager::FetchFromPortName(std::string port_name) {
     return FetchFromHandle(itr->second);
 }
 
+/**
+ * Writes the statistics collected by command profiling
+ * @param filename Path of the report, written as JSON if it ends in ".json", CSV otherwise
+ * @return True on success
+ */
+bool Manager::WriteCommandProfile(const std::string& filename) const {
+    const bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+    std::string report = json ? "[\n" : "port,command,name,calls,host_ns,last_caller\n";
+    bool first = true;
+
+    for (const Interface* service : m_services) {
+        for (size_t i = 0; i < service->m_functions.size(); ++i) {
+            const Interface::FunctionInfo& info = service->m_functions[i];
+            const Interface::FunctionStats& stats = service->m_function_stats[i];
+            if (stats.call_count == 0) {
+                continue;
+            }
+            // Port and function names are plain identifiers, they need no escaping
+            const char* format = json ?
+                "%s  {\"port\": \"%s\", \"command\": \"0x%08X\", \"name\": \"%s\", \"calls\": %llu, "
+                "\"host_ns\": %llu, \"last_caller\": \"0x%08X\"}" :
+                "%s%s,0x%08X,%s,%llu,%llu,0x%08X\n";
+            report += StringFromFormat(format, (json && !first) ? ",\n" : "",
+                service->GetPortName().c_str(), info.id, info.name ? info.name : "",
+                (unsigned long long)stats.call_count, (unsigned long long)stats.host_time_ns,
+                stats.last_caller);
+            first = false;
+        }
+    }
+    if (json) {
+        report += "\n]\n";
+    }
+
+    File::IOFile file(filename, "w");
+    if (!file.IsOpen() || !file.WriteBytes(report.data(), report.size())) {
+        ERROR_LOG(HLE, "failed to write service profile to %s", filename.c_str());
+        return false;
+    }
+    NOTICE_LOG(HLE, "service profile written to %s", filename.c_str());
+    return true;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Module interface
@@ -77,14 +214,24 @@ void Init() {
     g_manager->AddService(new HID_User::Interface);
     g_manager->AddService(new NDM_U::Interface);
 
+    SetCommandProfilingEnabled(!Settings::values.service_profile_path.empty());
+
     NOTICE_LOG(HLE, "initialized OK");
 }
 
 /// Shutdown ServiceManager
 void Shutdown() {
+    if (g_command_profiling) {
+        g_manager->WriteCommandProfile(Settings::values.service_profile_path);
+    }
     delete g_manager;
     NOTICE_LOG(HLE, "shutdown OK");
 }
 
+/// Enables or disables the collection of per-command statistics (disabled by default)
+void SetCommandProfilingEnabled(bool enabled) {
+    g_command_profiling = enabled;
+}
+
 
 }
@@ -50,7 +50,14 @@ public:
     struct FunctionInfo {
         u32         id;
         Function    func;
-        std::string name;
+        const char* name;
+    };
+
+    /// Statistics of a command, collected while command profiling is enabled
+    struct FunctionStats {
+        u64         call_count;     ///< Number of calls
+        u64         host_time_ns;   ///< Host time spent in the handler, in nanoseconds
+        Handle      last_caller;    ///< Thread that last sent the command
     };
 
     /**
@@ -80,32 +87,16 @@ public:
      * @param wait Boolean wait set if current thread should wait as a result of sync operation
      * @return Result of operation, 0 on success, otherwise error code
      */
-    Result SyncRequest(bool* wait) {
-        u32* cmd_buff = GetCommandBuffer();
-        auto itr = m_functions.find(cmd_buff[0]);
-
-        if (itr == m_functions.end()) {
-            ERROR_LOG(OSHLE, "unknown/unimplemented function: port=%s, command=0x%08X", 
-                GetPortName().c_str(), cmd_buff[0]);
-
-            // TODO(bunnei): Hack - ignore error
-            u32* cmd_buff = Service::GetCommandBuffer();
-            cmd_buff[1] = 0;
-            return 0; 
-        }
-        if (itr->second.func == nullptr) {
-            ERROR_LOG(OSHLE, "unimplemented function: port=%s, name=%s", 
-                GetPortName().c_str(), itr->second.name.c_str());
-
-            // TODO(bunnei): Hack - ignore error
-            u32* cmd_buff = Service::GetCommandBuffer();
-            cmd_buff[1] = 0;
-            return 0; 
-        } 
-
-        itr->second.func(this);
-
-        return 0; // TODO: Implement return from actual function
+    Result SyncRequest(bool* wait);
+
+    /**
+     * Returns the name of a command
+     * @param id Command header
+     * @return Name of the command, or nullptr if it isn't registered
+     */
+    const char* GetFunctionName(u32 id) const {
+        int index = FindFunction(id);
+        return index < 0 ? nullptr : m_functions[index].name;
     }
 
     /**
@@ -124,16 +115,20 @@ protected:
     /**
      * Registers the functions in the service
      */
-    void Register(const FunctionInfo* functions, int len) {
-        for (int i = 0; i < len; i++) {
-            m_functions[functions[i].id] = functions[i];
-        }
-    }
+    void Register(const FunctionInfo* functions, int len);
 
 private:
 
+    /**
+     * Looks up the function handling a command
+     * @param id Command header
+     * @return Index in m_functions, or -1 if the command is unknown
+     */
+    int FindFunction(u32 id) const;
+
     std::vector<Handle>         m_handles;
-    std::map<u32, FunctionInfo> m_functions;
+    std::vector<FunctionInfo>   m_functions;        ///< Registered functions, sorted by id
+    std::vector<FunctionStats>  m_function_stats;   ///< Statistics of m_functions, same order
 
 };
 
@@ -157,6 +152,13 @@ public:
     /// Get a Service Interface from its port
     Interface* FetchFromPortName(std::string port_name);
 
+    /**
+     * Writes the statistics collected by command profiling
+     * @param filename Path of the report, written as JSON if it ends in ".json", CSV otherwise
+     * @return True on success
+     */
+    bool WriteCommandProfile(const std::string& filename) const;
+
 private:
 
     std::vector<Interface*>     m_services;
@@ -170,6 +172,9 @@ void Init();
 /// Shutdown ServiceManager
 void Shutdown();
 
+/// Enables or disables the collection of per-command statistics (disabled by default)
+void SetCommandProfilingEnabled(bool enabled);
+
 
 extern Manager* g_manager; ///< Service manager
 
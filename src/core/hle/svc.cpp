@@ -8,6 +8,8 @@
 #include "common/string_util.h"
 #include "common/symbols.h"
 
+#include "core/core.h"
+#include "core/core_timing.h"
 #include "core/mem_map.h"
 
 #include "core/hle/kernel/address_arbiter.h"
@@ -52,6 +54,9 @@ Result ControlMemory(u32* out_addr, u32 operation, u32 addr0, u32 addr1, u32 siz
     default:
         ERROR_LOG(SVC, "unknown operation=0x%08X", operation);
     }
+
+    // Translated code may refer to memory that was just remapped
+    Core::g_app_core->ClearInstructionCache();
     return 0;
 }
 
@@ -98,6 +103,7 @@ Result SendSyncRequest(Handle handle) {
     Result res = object->SyncRequest(&wait);
     if (wait) {
         Kernel::WaitCurrentThread(WAITTYPE_SYNCH); // TODO(bunnei): Is this correct?
+        HLE::Reschedule(__func__);
     }
 
     return res;
@@ -112,9 +118,8 @@ Result CloseHandle(Handle handle) {
 
 /// Wait for a handle to synchronize, timeout after the specified nanoseconds
 Result WaitSynchronization1(Handle handle, s64 nano_seconds) {
-    // TODO(bunnei): Do something with nano_seconds, currently ignoring this
     bool wait = false;
-    bool wait_infinite = (nano_seconds == -1); // Used to wait until a thread has terminated
+    bool wait_infinite = (nano_seconds < 0); // Used to wait until a thread has terminated
 
     Kernel::Object* object = Kernel::g_object_pool.GetFast<Kernel::Object>(handle);
 
@@ -127,6 +132,9 @@ Result WaitSynchronization1(Handle handle, s64 nano_seconds) {
 
     // Check for next thread to schedule
     if (wait) {
+        if (!wait_infinite) {
+            Kernel::WakeThreadAfterDelay(Kernel::GetCurrentThreadHandle(), nano_seconds);
+        }
         HLE::Reschedule(__func__);
         return 0;
     }
@@ -137,13 +145,19 @@ Result WaitSynchronization1(Handle handle, s64 nano_seconds) {
 /// Wait for the given handles to synchronize, timeout after the specified nanoseconds
 Result WaitSynchronizationN(s32* out, Handle* handles, s32 handle_count, bool wait_all, 
     s64 nano_seconds) {
-    // TODO(bunnei): Do something with nano_seconds, currently ignoring this
     bool unlock_all = true;
-    bool wait_infinite = (nano_seconds == -1); // Used to wait until a thread has terminated
+    bool wait_infinite = (nano_seconds < 0); // Used to wait until a thread has terminated
 
     DEBUG_LOG(SVC, "called handle_count=%d, wait_all=%s, nanoseconds=%d", 
         handle_count, (wait_all ? "true" : "false"), nano_seconds);
 
+    if (handle_count < 0 || handle_count > Kernel::MAX_WAIT_OBJECTS) {
+        ERROR_LOG(SVC, "called with invalid handle_count=%d", handle_count);
+        return -1;
+    }
+
+    Kernel::BeginWaitSynchronizationN(wait_all);
+
     // Iterate through each handle, synchronize kernel object
     for (s32 i = 0; i < handle_count; i++) {
         bool wait = false;
@@ -155,22 +169,34 @@ Result WaitSynchronizationN(s32* out, Handle* handles, s32 handle_count, bool wa
         DEBUG_LOG(SVC, "\thandle[%d] = 0x%08X(%s:%s)", i, handles[i], object->GetTypeName().c_str(), 
             object->GetName().c_str());
 
+        Kernel::SetWaitObjectIndex(i);
         Result res = object->WaitSynchronization(&wait);
 
         if (!wait && !wait_all) {
+            // Stop waiting on the objects checked so far
+            Kernel::EndWaitSynchronizationN();
             *out = i;
             return 0;
-        } else {
+        } else if (wait) {
             unlock_all = false;
         }
     }
 
     if (wait_all && unlock_all) {
+        Kernel::EndWaitSynchronizationN();
         *out = handle_count;
         return 0;
     }
 
+    // No object was waited on, the wait state set up above must not outlive the call
+    if (handle_count == 0) {
+        Kernel::EndWaitSynchronizationN();
+    }
+
     // Check for next thread to schedule
+    if (!wait_infinite) {
+        Kernel::WakeThreadAfterDelay(Kernel::GetCurrentThreadHandle(), nano_seconds);
+    }
     HLE::Reschedule(__func__);
 
     return 0;
@@ -328,11 +354,19 @@ Result ClearEvent(Handle evt) {
 /// Sleep the current thread
 void SleepThread(s64 nanoseconds) {
     DEBUG_LOG(SVC, "called nanoseconds=%d", nanoseconds);
+
+    // A zero (or negative) delay only gives other threads a chance to run
+    if (nanoseconds > 0) {
+        Kernel::WaitCurrentThread(WAITTYPE_SLEEP);
+        Kernel::WakeThreadAfterDelay(Kernel::GetCurrentThreadHandle(), nanoseconds);
+    }
+    HLE::Reschedule(__func__);
 }
 
 /// This returns the total CPU ticks elapsed since the CPU was powered-on
 s64 GetSystemTick() {
-    return (s64)Core::g_app_core->GetTicks();
+    // Includes the ticks skipped while the CPU was idle
+    return (s64)CoreTiming::GetTicks();
 }
 
 const HLE::FunctionDef SVC_Table[] = {
@@ -0,0 +1,151 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <atomic>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "common/common.h"
+#include "common/file_util.h"
+
+#include "core/core_timing.h"
+#include "core/hle/hle.h"
+#include "core/hle/trace.h"
+#include "core/hle/kernel/thread.h"
+#include "core/hle/service/service.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace HLE {
+namespace Trace {
+
+static const u64 kNumRecords = 1 << 16;    ///< Capacity of the ring buffer, a power of two
+
+std::atomic<bool> g_enabled(false);
+
+static Record g_records[kNumRecords];
+static std::atomic<u64> g_write_index(0);   ///< Total number of records ever appended
+
+/// Enables or disables tracing, records already in the buffer are kept
+void SetEnabled(bool enabled) {
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * Appends a record to the ring buffer, overwriting the oldest one when it is full. Must only be
+ * called from the emulation thread.
+ * @param type Kind of call
+ * @param object Service handle, for RECORD_IPC
+ * @param id SVC number or command header
+ * @param args First four arguments of the call
+ * @param result Result of the call
+ */
+void Append(RecordType type, u32 object, u32 id, const u32 args[4], u32 result) {
+    // Single producer: the index is only published once the record is complete
+    u64 index = g_write_index.load(std::memory_order_relaxed);
+    Record& record = g_records[index & (kNumRecords - 1)];
+
+    record.tick = CoreTiming::GetTicks();
+    record.type = type;
+    record.thread = Kernel::GetCurrentThreadHandle();
+    record.object = object;
+    record.id = id;
+    for (int i = 0; i < 4; ++i) {
+        record.args[i] = args[i];
+    }
+    record.result = result;
+    record.reserved = 0;
+
+    g_write_index.store(index + 1, std::memory_order_release);
+}
+
+/// Returns the name of an SVC or service command, or nullptr if it is unknown
+static const char* GetName(u32 type, u32 object, u32 id, std::string& buffer) {
+    if (type == RECORD_SVC) {
+        const FunctionDef* info = GetSVCInfo(id);
+        return info ? info->name.c_str() : nullptr;
+    }
+    Service::Interface* service = Service::g_manager->FetchFromHandle(object);
+    if (service == nullptr) {
+        return nullptr;
+    }
+    const char* function = service->GetFunctionName(id);
+    buffer = service->GetPortName() + "::" + (function ? function : "Unknown");
+    return buffer.c_str();
+}
+
+/**
+ * Writes the records currently in the ring buffer to a file. May be called from any thread while
+ * the emulation thread keeps appending records.
+ * @param filename Path of the file to write
+ * @return True on success
+ */
+bool Dump(const std::string& filename) {
+    // Copy the records, then drop those the producer may have overwritten during the copy. While
+    // it writes record new_end, the slot of record new_end - kNumRecords is torn as well.
+    u64 end = g_write_index.load(std::memory_order_acquire);
+    u64 begin = end > kNumRecords ? end - kNumRecords : 0;
+    std::vector<Record> records;
+    records.reserve((size_t)(end - begin));
+    for (u64 index = begin; index < end; ++index) {
+        records.push_back(g_records[index & (kNumRecords - 1)]);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    u64 new_end = g_write_index.load(std::memory_order_relaxed);
+    u64 first_intact = new_end + 1 > kNumRecords ? new_end + 1 - kNumRecords : 0;
+    u64 overwritten = first_intact > begin ? first_intact - begin : 0;
+    if (overwritten > records.size()) {
+        overwritten = records.size();
+    }
+    records.erase(records.begin(), records.begin() + (size_t)overwritten);
+    begin += overwritten;
+
+    // One name entry per distinct call in the trace
+    std::set<std::tuple<u32, u32, u32>> calls;
+    for (const auto& record : records) {
+        calls.insert(std::make_tuple(record.type, record.type == RECORD_IPC ? record.object : 0,
+            record.id));
+    }
+    std::vector<u8> names;
+    u32 num_names = 0;
+    for (const auto& call : calls) {
+        std::string buffer;
+        const char* name = GetName(std::get<0>(call), std::get<1>(call), std::get<2>(call), buffer);
+        if (name == nullptr) {
+            continue;
+        }
+        NameEntry entry = { std::get<0>(call), std::get<1>(call), std::get<2>(call),
+            (u32)strlen(name) };
+        names.insert(names.end(), (const u8*)&entry, (const u8*)(&entry + 1));
+        names.insert(names.end(), (const u8*)name, (const u8*)name + entry.length);
+        num_names++;
+    }
+
+    FileHeader header;
+    header.magic = kFileMagic;
+    header.version = kFileVersion;
+    header.record_size = sizeof(Record);
+    header.num_records = (u32)records.size();
+    header.num_names = num_names;
+    header.num_dropped = (u32)std::min<u64>(begin, 0xFFFFFFFF);
+
+    File::IOFile file(filename, "wb");
+    if (!file.IsOpen() || !file.WriteBytes(&header, sizeof(header)) ||
+        !file.WriteBytes(records.data(), records.size() * sizeof(Record)) ||
+        !file.WriteBytes(names.data(), names.size())) {
+        ERROR_LOG(HLE, "failed to write HLE trace to %s", filename.c_str());
+        return false;
+    }
+    NOTICE_LOG(HLE, "%u HLE trace records written to %s", header.num_records, filename.c_str());
+    return true;
+}
+
+/// Discards all records
+void Clear() {
+    g_write_index.store(0, std::memory_order_release);
+}
+
+} // namespace
+} // namespace
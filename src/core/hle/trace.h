@@ -0,0 +1,96 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// HLE call tracing: SVCs and service commands are recorded as fixed-size binary records in a ring
+// buffer, which can be dumped to a file at any time and decoded by the citra-trace tool.
+//
+// File layout (little endian):
+//   FileHeader
+//   Record      x FileHeader::num_records, oldest first
+//   NameEntry   x FileHeader::num_names, each followed by NameEntry::length characters
+//
+// Names are only stored once per SVC or service command present in the trace.
+
+namespace HLE {
+namespace Trace {
+
+static const u32 kFileMagic     = 0x43525443; ///< "CTRC"
+static const u32 kFileVersion   = 1;
+
+enum RecordType : u32 {
+    RECORD_SVC = 0,     ///< id is the SVC number, object is unused
+    RECORD_IPC = 1,     ///< id is the command header, object is the handle of the service
+};
+
+struct FileHeader {
+    u32 magic;          ///< kFileMagic
+    u32 version;        ///< kFileVersion
+    u32 record_size;    ///< sizeof(Record)
+    u32 num_records;    ///< Number of records following the header
+    u32 num_names;      ///< Number of name entries following the records
+    u32 num_dropped;    ///< Records that were overwritten before the dump (saturated)
+};
+
+struct Record {
+    u64 tick;           ///< CoreTiming ticks when the call returned
+    u32 type;           ///< RecordType
+    u32 thread;         ///< Handle of the calling thread
+    u32 object;         ///< Service handle, for RECORD_IPC
+    u32 id;             ///< SVC number or command header
+    u32 args[4];        ///< r0-r3 for SVCs, the first command buffer parameters for IPC
+    u32 result;         ///< r0 (SVCs) or the command buffer result word (IPC) after the call
+    u32 reserved;
+};
+static_assert(sizeof(Record) == 48, "Trace record layout changed");
+
+struct NameEntry {
+    u32 type;           ///< RecordType of the records this name applies to
+    u32 object;         ///< Service handle, for RECORD_IPC
+    u32 id;             ///< SVC number or command header
+    u32 length;         ///< Length of the name following the entry, without terminator
+};
+
+/// Checked before building records, so disabled tracing costs a branch. Set from the UI thread.
+extern std::atomic<bool> g_enabled;
+
+/// Returns true if HLE calls are being traced
+inline bool IsEnabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+/// Enables or disables tracing, records already in the buffer are kept
+void SetEnabled(bool enabled);
+
+/**
+ * Appends a record to the ring buffer, overwriting the oldest one when it is full. Must only be
+ * called from the emulation thread.
+ * @param type Kind of call
+ * @param object Service handle, for RECORD_IPC
+ * @param id SVC number or command header
+ * @param args First four arguments of the call
+ * @param result Result of the call
+ */
+void Append(RecordType type, u32 object, u32 id, const u32 args[4], u32 result);
+
+/**
+ * Writes the records currently in the ring buffer to a file. May be called from any thread while
+ * the emulation thread keeps appending records.
+ * @param filename Path of the file to write
+ * @return True on success
+ */
+bool Dump(const std::string& filename);
+
+/// Discards all records
+void Clear();
+
+} // namespace
+} // namespace
@@ -4,8 +4,10 @@
 
 #include "common/common_types.h"
 #include "common/log.h"
+#include "common/profiler.h"
 
 #include "core/core.h"
+#include "core/core_timing.h"
 #include "core/mem_map.h"
 
 #include "core/hle/hle.h"
@@ -15,6 +17,7 @@
 #include "core/hw/gpu.h"
 
 #include "video_core/command_processor.h"
+#include "video_core/rasterizer.h"
 #include "video_core/video_core.h"
 
 
@@ -23,7 +26,8 @@ namespace GPU {
 Regs g_regs;
 
 u32 g_cur_line = 0;         ///< Current vertical screen line
-u64 g_last_line_ticks = 0;  ///< CPU tick count from last vertical screen line
+
+static int line_event_type; ///< CoreTiming event fired at the end of each screen line
 
 template <typename T>
 inline void Read(T &var, const u32 raw_addr) {
@@ -59,11 +63,15 @@ inline void Write(u32 addr, const T data) {
     case GPU_REG_INDEX_WORKAROUND(memory_fill_config[0].value, 0x00004 + 0x3):
     case GPU_REG_INDEX_WORKAROUND(memory_fill_config[1].value, 0x00008 + 0x3):
     {
+        Common::Profiling::ScopedSection profile_section(Common::Profiling::SECTION_PICA);
         const bool is_second_filler = (index != GPU_REG_INDEX(memory_fill_config[0].value));
         const auto& config = g_regs.memory_fill_config[is_second_filler];
 
         // TODO: Not sure if this check should be done at GSP level instead
         if (config.address_start) {
+            // Triangles still being rasterized must not overwrite the fill
+            Pica::Rasterizer::Flush();
+
             // TODO: Not sure if this algorithm is correct, particularly because it doesn't use the size member at all
             u32* start = (u32*)Memory::GetPointer(Memory::PhysicalToVirtualAddress(config.GetStartAddress()));
             u32* end = (u32*)Memory::GetPointer(Memory::PhysicalToVirtualAddress(config.GetEndAddress()));
@@ -77,8 +85,12 @@ inline void Write(u32 addr, const T data) {
 
     case GPU_REG_INDEX(display_transfer_config.trigger):
     {
+        Common::Profiling::ScopedSection profile_section(Common::Profiling::SECTION_PICA);
         const auto& config = g_regs.display_transfer_config;
         if (config.trigger & 1) {
+            // The source is usually the color buffer triangles were just rasterized into
+            Pica::Rasterizer::Flush();
+
             u8* source_pointer = Memory::GetPointer(Memory::PhysicalToVirtualAddress(config.GetPhysicalInputAddress()));
             u8* dest_pointer = Memory::GetPointer(Memory::PhysicalToVirtualAddress(config.GetPhysicalOutputAddress()));
 
@@ -147,6 +159,7 @@ inline void Write(u32 addr, const T data) {
     // Seems like writing to this register triggers processing
     case GPU_REG_INDEX(command_processor_config.trigger):
     {
+        Common::Profiling::ScopedSection profile_section(Common::Profiling::SECTION_PICA);
         const auto& config = g_regs.command_processor_config;
         if (config.trigger & 1)
         {
@@ -174,32 +187,43 @@ template void Write<u32>(u32 addr, const u32 data);
 template void Write<u16>(u32 addr, const u16 data);
 template void Write<u8>(u32 addr, const u8 data);
 
-/// Update hardware
-void Update() {
+/// Returns the number of ticks it takes to draw one line of the top screen
+static s64 GetLineTicks() {
+    u32 height = g_regs.framebuffer_config[0].height;
+    return GPU::kFrameTicks / (height ? height : 1);
+}
+
+/**
+ * Signals the end of a screen line, and the VBlank once the last line of the frame is done
+ * @param userdata Unused
+ * @param cycles_late Number of ticks the event fired late, subtracted from the next line
+ */
+static void LineCallback(u64 userdata, int cycles_late) {
     auto& framebuffer_top = g_regs.framebuffer_config[0];
-    u64 current_ticks = Core::g_app_core->GetTicks();
 
     // Synchronize line...
-    if ((current_ticks - g_last_line_ticks) >= GPU::kFrameTicks / framebuffer_top.height) {
-        GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PDC0);
-        g_cur_line++;
-        g_last_line_ticks = current_ticks;
-    }
+    GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PDC0);
+    g_cur_line++;
 
     // Synchronize frame...
     if (g_cur_line >= framebuffer_top.height) {
         g_cur_line = 0;
         GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PDC1);
         VideoCore::g_renderer->SwapBuffers();
-        Kernel::WaitCurrentThread(WAITTYPE_VBLANK);
-        HLE::Reschedule(__func__);
+
+        // A thread that is already waiting (e.g. sleeping) keeps its wait
+        if (Kernel::IsCurrentThreadRunning()) {
+            Kernel::WaitCurrentThread(WAITTYPE_VBLANK);
+            HLE::Reschedule(__func__);
+        }
     }
+
+    CoreTiming::ScheduleEvent(GetLineTicks() - cycles_late, line_event_type);
 }
 
 /// Initialize hardware
 void Init() {
     g_cur_line = 0;
-    g_last_line_ticks = Core::g_app_core->GetTicks();
 
     auto& framebuffer_top = g_regs.framebuffer_config[0];
     auto& framebuffer_sub = g_regs.framebuffer_config[1];
@@ -229,6 +253,9 @@ void Init() {
     framebuffer_sub.color_format = Regs::FramebufferFormat::RGB8;
     framebuffer_sub.active_fb = 0;
 
+    line_event_type = CoreTiming::RegisterEvent("GPU::LineCallback", LineCallback);
+    CoreTiming::ScheduleEvent(GetLineTicks(), line_event_type);
+
     NOTICE_LOG(GPU, "initialized OK");
 }
 
@@ -101,4 +101,25 @@ ResultStatus LoadFile(const std::string& filename) {
     return ResultStatus::Error;
 }
 
+/**
+ * Decompresses the code of a bootable file into the code cache, so that booting it later is
+ * faster. Unlike LoadFile, may be called for several files at once from different threads.
+ * @param filename String filename of bootable file
+ * @return ResultStatus result of function, ErrorNotUsed if the file has no code to cache
+ */
+ResultStatus CacheCode(const std::string& filename) {
+    switch (IdentifyFile(filename)) {
+    case FileType::CXI:
+    case FileType::CCI:
+        return AppLoader_NCCH(filename).CacheCode();
+
+    case FileType::Error:
+    case FileType::Unknown:
+        return ResultStatus::ErrorInvalidFormat;
+
+    default:
+        return ResultStatus::ErrorNotUsed;
+    }
+}
+
 } // namespace Loader
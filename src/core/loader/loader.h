@@ -92,6 +92,26 @@ public:
     virtual ResultStatus ReadRomFS(std::vector<u8>& buffer) const {
         return ResultStatus::ErrorNotImplemented;
     }
+
+    /**
+     * Get where the RomFS of the application is stored, so it can be mapped instead of read
+     * @param filename Reference to string to store the path of the file containing the RomFS
+     * @param offset Reference to store the offset of the RomFS in the file
+     * @param size Reference to store the size of the RomFS
+     * @return ResultStatus result of function
+     */
+    virtual ResultStatus GetRomFSLocation(std::string& filename, u64& offset, u64& size) const {
+        return ResultStatus::ErrorNotImplemented;
+    }
+
+    /**
+     * Get a hash identifying the contents of the RomFS, to key caches of data derived from it
+     * @param hash Reference to store the hash
+     * @return ResultStatus result of function
+     */
+    virtual ResultStatus GetRomFSHash(u64& hash) const {
+        return ResultStatus::ErrorNotImplemented;
+    }
 };
 
 /**
@@ -108,4 +128,12 @@ FileType IdentifyFile(const std::string &filename);
  */
 ResultStatus LoadFile(const std::string& filename);
 
+/**
+ * Decompresses the code of a bootable file into the code cache, so that booting it later is
+ * faster. Unlike LoadFile, may be called for several files at once from different threads.
+ * @param filename String filename of bootable file
+ * @return ResultStatus result of function, ErrorNotUsed if the file has no code to cache
+ */
+ResultStatus CacheCode(const std::string& filename);
+
 } // namespace
@@ -5,6 +5,8 @@
 #include <memory>
 
 #include "common/file_util.h"
+#include "common/hash.h"
+#include "common/keyed_disk_cache.h"
 
 #include "core/loader/ncch.h"
 #include "core/hle/kernel/kernel.h"
@@ -18,6 +20,13 @@ namespace Loader {
 static const int kMaxSections   = 8;        ///< Maximum number of sections (files) in an ExeFs
 static const int kBlockSize     = 0x200;    ///< Size of ExeFS blocks (in bytes)
 
+static const u32 kCodeCacheVersion = 1;     ///< Version of the decompressed code in the code cache
+
+/// Returns the cache of decompressed .code sections, keyed by the hash of the compressed section
+static Common::KeyedDiskCache GetCodeCache() {
+    return Common::KeyedDiskCache(File::GetUserPath(D_CACHE_IDX) + "code", kCodeCacheVersion);
+}
+
 /**
  * Get the decompressed size of an LZSS compressed ExeFS file
  * @param buffer Buffer of compressed file
@@ -123,6 +132,24 @@ ResultStatus AppLoader_NCCH::LoadExec() const {
     if (!is_loaded) 
         return ResultStatus::ErrorNotLoaded;
 
+    // Compressed code is decompressed (or read from the code cache) straight into memory
+    if (is_compressed && entry_point >= Memory::EXEFS_CODE_VADDR &&
+        entry_point < Memory::EXEFS_CODE_VADDR_END) {
+        std::vector<u8> compressed;
+        u32 size;
+        ResultStatus result = LoadSectionExeFS(".code", compressed);
+        if (ResultStatus::Success == result) {
+            result = DecompressCode(compressed,
+                Memory::g_exefs_code + (entry_point - Memory::EXEFS_CODE_VADDR),
+                Memory::EXEFS_CODE_VADDR_END - entry_point, size);
+        }
+        if (ResultStatus::Success != result) {
+            return result;
+        }
+        Kernel::LoadExec(entry_point);
+        return ResultStatus::Success;
+    }
+
     std::vector<u8> code;
     if (ResultStatus::Success == ReadCode(code)) {
         Memory::WriteBlock(entry_point, &code[0], code.size());
@@ -133,7 +160,8 @@ ResultStatus AppLoader_NCCH::LoadExec() const {
 }
 
 /**
- * Reads an application ExeFS section of an NCCH file into AppLoader (e.g. .code, .logo, etc.)
+ * Reads an application ExeFS section of an NCCH file into AppLoader (e.g. .code, .logo, etc.),
+ * as stored in the file (the .code section may be compressed)
  * @param name Name of section to read out of NCCH file
  * @param buffer Vector to read data into
  * @return ResultStatus result of function
@@ -154,31 +182,8 @@ ResultStatus AppLoader_NCCH::LoadSectionExeFS(const char* name, std::vector<u8>&
                     sizeof(ExeFs_Header)+ncch_offset);
                 file.Seek(section_offset, 0);
 
-                // Section is compressed...
-                if (i == 0 && is_compressed) {
-                    // Read compressed .code section...
-                    std::unique_ptr<u8[]> temp_buffer;
-                    try {
-                        temp_buffer.reset(new u8[exefs_header.section[i].size]);
-                    } catch (std::bad_alloc&) {
-                        return ResultStatus::ErrorMemoryAllocationFailed;
-                    }
-                    file.ReadBytes(&temp_buffer[0], exefs_header.section[i].size);
-
-                    // Decompress .code section...
-                    u32 decompressed_size = LZSS_GetDecompressedSize(&temp_buffer[0],
-                        exefs_header.section[i].size);
-                    buffer.resize(decompressed_size);
-                    if (!LZSS_Decompress(&temp_buffer[0], exefs_header.section[i].size, &buffer[0],
-                        decompressed_size)) {
-                        return ResultStatus::ErrorInvalidFormat;
-                    }
-                    // Section is uncompressed...
-                }
-                else {
-                    buffer.resize(exefs_header.section[i].size);
-                    file.ReadBytes(&buffer[0], exefs_header.section[i].size);
-                }
+                buffer.resize(exefs_header.section[i].size);
+                file.ReadBytes(&buffer[0], exefs_header.section[i].size);
                 return ResultStatus::Success;
             }
         }
@@ -190,17 +195,49 @@ ResultStatus AppLoader_NCCH::LoadSectionExeFS(const char* name, std::vector<u8>&
 } 
 
 /**
- * Loads an NCCH file (e.g. from a CCI, or the first NCCH in a CXI)
- * @param error_string Pointer to string to put error message if an error has occurred
- * @todo Move NCSD parsing out of here and create a separate function for loading these
- * @return True on success, otherwise false
+ * Decompresses the .code section, or reads it from the code cache if it was decompressed before
+ * @param compressed Compressed .code section
+ * @param buffer Buffer to decompress the code into
+ * @param max_size Size of the buffer
+ * @param size Receives the size of the decompressed code
+ * @return ResultStatus result of function
  */
-ResultStatus AppLoader_NCCH::Load() {
-    INFO_LOG(LOADER, "Loading NCCH file %s...", filename.c_str());
+ResultStatus AppLoader_NCCH::DecompressCode(std::vector<u8>& compressed, u8* buffer, u32 max_size,
+    u32& size) const {
 
-    if (is_loaded)
-        return ResultStatus::ErrorAlreadyLoaded;
+    if (compressed.size() < 8) {
+        return ResultStatus::ErrorInvalidFormat;
+    }
+    const u32 compressed_size = (u32)compressed.size();
+    const u32 decompressed_size = LZSS_GetDecompressedSize(&compressed[0], compressed_size);
+    if (decompressed_size > max_size) {
+        ERROR_LOG(LOADER, "Decompressed code (0x%08X bytes) doesn't fit in memory",
+            decompressed_size);
+        return ResultStatus::ErrorInvalidFormat;
+    }
+
+    // Decompression is slow for large titles, so its result is kept across boots
+    const Common::KeyedDiskCache cache = GetCodeCache();
+    const u64 hash = GetHash64(&compressed[0], compressed_size, 0);
+    if (cache.Read(hash, buffer, decompressed_size, size) && size == decompressed_size) {
+        INFO_LOG(LOADER, "Code read from the code cache (%016llX)", (unsigned long long)hash);
+        return ResultStatus::Success;
+    }
 
+    if (!LZSS_Decompress(&compressed[0], compressed_size, buffer, decompressed_size)) {
+        return ResultStatus::ErrorInvalidFormat;
+    }
+    size = decompressed_size;
+    cache.Write(hash, buffer, size);
+    return ResultStatus::Success;
+}
+
+/**
+ * Reads the headers of an NCCH file (e.g. from a CCI, or the first NCCH in a CXI)
+ * @todo Move NCSD parsing out of here and create a separate function for loading these
+ * @return ResultStatus result of function
+ */
+ResultStatus AppLoader_NCCH::LoadHeaders() {
     File::IOFile file(filename, "rb");
     if (file.IsOpen()) {
         file.ReadBytes(&ncch_header, sizeof(NCCH_Header));
@@ -241,8 +278,6 @@ ResultStatus AppLoader_NCCH::Load() {
 
         is_loaded = true; // Set state to loaded
 
-        LoadExec(); // Load the executable into memory for booting
-
         return ResultStatus::Success;
     } else {
         ERROR_LOG(LOADER, "Unable to read file %s!", filename.c_str());
@@ -250,13 +285,66 @@ ResultStatus AppLoader_NCCH::Load() {
     return ResultStatus::Error;
 }
 
+/**
+ * Loads an NCCH file (e.g. from a CCI, or the first NCCH in a CXI)
+ * @return ResultStatus result of function
+ */
+ResultStatus AppLoader_NCCH::Load() {
+    INFO_LOG(LOADER, "Loading NCCH file %s...", filename.c_str());
+
+    if (is_loaded)
+        return ResultStatus::ErrorAlreadyLoaded;
+
+    ResultStatus result = LoadHeaders();
+    if (ResultStatus::Success != result) {
+        return result;
+    }
+
+    LoadExec(); // Load the executable into memory for booting
+
+    return ResultStatus::Success;
+}
+
 /**
  * Get the code (typically .code section) of the application
  * @param buffer Reference to buffer to store data
  * @return ResultStatus result of function
  */
 ResultStatus AppLoader_NCCH::ReadCode(std::vector<u8>& buffer) const {
-    return LoadSectionExeFS(".code", buffer);
+    if (!is_compressed) {
+        return LoadSectionExeFS(".code", buffer);
+    }
+
+    std::vector<u8> compressed;
+    ResultStatus result = LoadSectionExeFS(".code", compressed);
+    if (ResultStatus::Success != result) {
+        return result;
+    }
+    if (compressed.size() < 8) {
+        return ResultStatus::ErrorInvalidFormat;
+    }
+    u32 size;
+    buffer.resize(LZSS_GetDecompressedSize(&compressed[0], (u32)compressed.size()));
+    return DecompressCode(compressed, &buffer[0], (u32)buffer.size(), size);
+}
+
+/**
+ * Decompresses the code of the application into the code cache, if it isn't there yet, without
+ * loading the application
+ * @return ResultStatus result of function
+ */
+ResultStatus AppLoader_NCCH::CacheCode() {
+    if (!is_loaded) {
+        ResultStatus result = LoadHeaders();
+        if (ResultStatus::Success != result) {
+            return result;
+        }
+    }
+    if (!is_compressed) {
+        return ResultStatus::ErrorNotUsed;
+    }
+    std::vector<u8> code;
+    return ReadCode(code);
 }
 
 /**
@@ -294,27 +382,64 @@ ResultStatus AppLoader_NCCH::ReadLogo(std::vector<u8>& buffer) const {
 ResultStatus AppLoader_NCCH::ReadRomFS(std::vector<u8>& buffer) const {
     File::IOFile file(filename, "rb");
     if (file.IsOpen()) {
-        // Check if the NCCH has a RomFS...
-        if (ncch_header.romfs_offset != 0 && ncch_header.romfs_size != 0) {
-            u32 romfs_offset = ncch_offset + (ncch_header.romfs_offset * kBlockSize) + 0x1000;
-            u32 romfs_size = (ncch_header.romfs_size * kBlockSize) - 0x1000;
-
-            INFO_LOG(LOADER, "RomFS offset:    0x%08X", romfs_offset);
-            INFO_LOG(LOADER, "RomFS size:      0x%08X", romfs_size);
+        std::string romfs_filename;
+        u64 romfs_offset, romfs_size;
+        ResultStatus result = GetRomFSLocation(romfs_filename, romfs_offset, romfs_size);
+        if (ResultStatus::Success != result) {
+            return result;
+        }
 
-            buffer.resize(romfs_size);
+        buffer.resize((size_t)romfs_size);
 
-            file.Seek(romfs_offset, 0);
-            file.ReadBytes(&buffer[0], romfs_size);
+        file.Seek(romfs_offset, 0);
+        file.ReadBytes(&buffer[0], (size_t)romfs_size);
 
-            return ResultStatus::Success;
-        }
-        NOTICE_LOG(LOADER, "RomFS unused");
-        return ResultStatus::ErrorNotUsed;
+        return ResultStatus::Success;
     } else {
         ERROR_LOG(LOADER, "Unable to read file %s!", filename.c_str());
     }
     return ResultStatus::Error;
 }
 
+/**
+ * Get where the RomFS of the application is stored, so it can be mapped instead of read
+ * @param filename Reference to string to store the path of the file containing the RomFS
+ * @param offset Reference to store the offset of the RomFS in the file
+ * @param size Reference to store the size of the RomFS
+ * @return ResultStatus result of function
+ */
+ResultStatus AppLoader_NCCH::GetRomFSLocation(std::string& filename, u64& offset,
+    u64& size) const {
+
+    // Check if the NCCH has a RomFS...
+    if (ncch_header.romfs_offset != 0 && ncch_header.romfs_size != 0) {
+        filename = this->filename;
+        offset = ncch_offset + ((u64)ncch_header.romfs_offset * kBlockSize) + 0x1000;
+        size = ((u64)ncch_header.romfs_size * kBlockSize) - 0x1000;
+
+        INFO_LOG(LOADER, "RomFS offset:    0x%08llX", (unsigned long long)offset);
+        INFO_LOG(LOADER, "RomFS size:      0x%08llX", (unsigned long long)size);
+
+        return ResultStatus::Success;
+    }
+    NOTICE_LOG(LOADER, "RomFS unused");
+    return ResultStatus::ErrorNotUsed;
+}
+
+/**
+ * Get a hash identifying the contents of the RomFS, to key caches of data derived from it
+ * @param hash Reference to store the hash
+ * @return ResultStatus result of function
+ */
+ResultStatus AppLoader_NCCH::GetRomFSHash(u64& hash) const {
+    // The NCCH header has a SHA-256 of the RomFS superblock, which covers all of its hashes
+    static const u8 kNoHash[sizeof(ncch_header.romfs_super_block_hash)] = {};
+    if (ncch_header.romfs_size == 0 || !memcmp(ncch_header.romfs_super_block_hash, kNoHash,
+        sizeof(kNoHash))) {
+        return ResultStatus::ErrorNotUsed;
+    }
+    hash = GetHash64(ncch_header.romfs_super_block_hash, sizeof(kNoHash), 0);
+    return ResultStatus::Success;
+}
+
 } // namespace Loader
@@ -191,16 +191,57 @@ public:
      */
     ResultStatus ReadRomFS(std::vector<u8>& buffer) const override;
 
+    /**
+     * Get where the RomFS of the application is stored, so it can be mapped instead of read
+     * @param filename Reference to string to store the path of the file containing the RomFS
+     * @param offset Reference to store the offset of the RomFS in the file
+     * @param size Reference to store the size of the RomFS
+     * @return ResultStatus result of function
+     */
+    ResultStatus GetRomFSLocation(std::string& filename, u64& offset, u64& size) const override;
+
+    /**
+     * Get a hash identifying the contents of the RomFS, to key caches of data derived from it
+     * @param hash Reference to store the hash
+     * @return ResultStatus result of function
+     */
+    ResultStatus GetRomFSHash(u64& hash) const override;
+
+    /**
+     * Decompresses the code of the application into the code cache, if it isn't there yet, without
+     * loading the application
+     * @return ResultStatus result of function
+     */
+    ResultStatus CacheCode();
+
 private:
 
     /**
-     * Reads an application ExeFS section of an NCCH file into AppLoader (e.g. .code, .logo, etc.)
+     * Reads the headers of an NCCH file (e.g. from a CCI, or the first NCCH in a CXI)
+     * @return ResultStatus result of function
+     */
+    ResultStatus LoadHeaders();
+
+    /**
+     * Reads an application ExeFS section of an NCCH file into AppLoader (e.g. .code, .logo, etc.),
+     * as stored in the file (the .code section may be compressed)
      * @param name Name of section to read out of NCCH file
      * @param buffer Vector to read data into
      * @return ResultStatus result of function
      */
     ResultStatus LoadSectionExeFS(const char* name, std::vector<u8>& buffer) const;
 
+    /**
+     * Decompresses the .code section, or reads it from the code cache if it was decompressed before
+     * @param compressed Compressed .code section
+     * @param buffer Buffer to decompress the code into
+     * @param max_size Size of the buffer
+     * @param size Receives the size of the decompressed code
+     * @return ResultStatus result of function
+     */
+    ResultStatus DecompressCode(std::vector<u8>& compressed, u8* buffer, u32 max_size,
+        u32& size) const;
+
     /**
      * Loads .code section into memory for booting
      * @return ResultStatus result of function
@@ -7,12 +7,14 @@
 
 #include "core/mem_map.h"
 #include "core/core.h"
+#include "core/settings.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 namespace Memory {
 
 u8*    g_base                   = NULL;         ///< The base pointer to the auto-mirrored arena.
+bool   g_fastmem                = false;        ///< Whether g_base + vaddr is valid for all accesses
 
 MemArena g_arena;                               ///< The MemArena class
 
@@ -70,15 +72,40 @@ void Init() {
             g_views[i].size = FCRAM_SIZE;
     }
 
+    if (Settings::values.use_fastmem)
+        flags |= MM_RESERVE_4GB;
+
     g_base = MemoryMap_Setup(g_views, kNumMemViews, flags, &g_arena);
 
+    // Without the full 4GB reserved, addresses outside the views could alias other host memory
+    if (g_arena.HasReserved4GBSpace())
+        g_fastmem = InstallFastmemHandler();
+    if (Settings::values.use_fastmem && !g_fastmem)
+        WARN_LOG(MEMMAP, "fastmem unavailable, using the page table for all accesses");
+
+    // Build the page table. Special regions are marked first, so that views overlapping them
+    // (VRAM sits inside the I/O window) are accessed as RAM.
+    MapSpecialPages(HARDWARE_IO_VADDR, HARDWARE_IO_SIZE);
+    MapSpecialPages(CONFIG_MEMORY_VADDR, CONFIG_MEMORY_SIZE);
+
+    // Views are mapped whole, like with fastmem: the heap view also holds the main thread's stack
+    // (SCRATCHPAD_VADDR), which is used before any heap block is mapped
+    for (size_t i = 0; i < ARRAY_SIZE(g_views); i++) {
+        MapPages(g_views[i].virtual_address, g_views[i].size, *g_views[i].out_ptr_low);
+    }
+
     NOTICE_LOG(MEMMAP, "initialized OK, RAM at %p (mirror at 0 @ %p)", g_heap,
         g_physical_fcram);
 }
 
 void Shutdown() {
     u32 flags = 0;
+    if (g_fastmem) {
+        RemoveFastmemHandler();
+        g_fastmem = false;
+    }
     MemoryMap_Shutdown(g_views, kNumMemViews, flags, &g_arena);
+    UnmapPages(0, 0xFFFFFFFF);
 
     g_arena.ReleaseSpace();
     g_base = NULL;
@@ -81,6 +81,18 @@ enum {
     SCRATCHPAD_VADDR_END    = 0x10000000,
     SCRATCHPAD_VADDR        = (SCRATCHPAD_VADDR_END - SCRATCHPAD_SIZE), ///< Stack space
     SCRATCHPAD_MASK         = (SCRATCHPAD_SIZE - 1),            ///< Scratchpad memory mask
+
+    PAGE_BITS               = 12,                               ///< Page table granularity (4KB)
+    PAGE_SIZE               = (1 << PAGE_BITS),
+    PAGE_MASK               = (PAGE_SIZE - 1),
+    NUM_PAGES               = (1 << (32 - PAGE_BITS)),          ///< Pages in the virtual space
+};
+
+/// Type of a page in the virtual address space page table
+enum class PageType : u8 {
+    Unmapped,   ///< Page is not mapped, accesses are errors
+    Memory,     ///< Page is backed by host memory, accessed directly through the page table
+    Special,    ///< Page is handled by a slow path (hardware I/O, configuration memory)
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -112,6 +124,10 @@ struct MemoryBlock {
 // so be sure to load it into a 64-bit register.
 extern u8 *g_base;
 
+// If true, every guest virtual address is valid at g_base + vaddr: RAM is mapped there directly and
+// the remaining pages fault into a handler that services the access through the slow path.
+extern bool g_fastmem;
+
 // These are guaranteed to point to "low memory" addresses (sub-32-bit).
 // 64-bit: Pointers to low-mem (sub-0x10000000) mirror
 // 32-bit: Same as the corresponding physical/virtual pointers.
@@ -147,6 +163,66 @@ void WriteBlock(const u32 addr, const u8* data, const int size);
 
 u8* GetPointer(const u32 virtual_address);
 
+/// Non-zero for each page holding code translated by the CPU core, see InvalidateCode
+extern u8 g_code_pages[NUM_PAGES];
+
+/**
+ * Discards the CPU core's translations of a range of guest memory. The Write functions do this for
+ * the pages in g_code_pages, anything else writing guest memory (through GetPointer, or on the I/O
+ * threads) has to call it on the CPU thread once it is done.
+ * @param vaddr Virtual address of the range that was written
+ * @param size Size of the range in bytes
+ */
+void InvalidateCode(u32 vaddr, u32 size);
+
+/**
+ * Services an access to a page that is not backed by host memory (hardware I/O, configuration
+ * memory, or an unmapped address). Used by the fastmem fault handler.
+ * @param vaddr Virtual address of the access
+ * @param size Size of the access in bytes (1, 2, 4 or 8)
+ * @return Value read
+ */
+u64 ReadUnmapped(u32 vaddr, int size);
+
+/**
+ * Services a write to a page that is not backed by host memory. Used by the fastmem fault handler.
+ * @param vaddr Virtual address of the access
+ * @param size Size of the access in bytes (1, 2, 4 or 8)
+ * @param data Value to write
+ */
+void WriteUnmapped(u32 vaddr, int size, u64 data);
+
+/**
+ * Installs the fault handler that services fastmem accesses to unmapped pages
+ * @return True on success, false if fastmem is not supported on this host
+ */
+bool InstallFastmemHandler();
+
+/// Removes the fastmem fault handler, restoring the previous one
+void RemoveFastmemHandler();
+
+/**
+ * Maps a region of host memory into the virtual address space page table
+ * @param vaddr Virtual address of the region
+ * @param size Size of the region in bytes
+ * @param memory Host pointer backing vaddr
+ */
+void MapPages(u32 vaddr, u32 size, u8* memory);
+
+/**
+ * Marks a region of the virtual address space as special, so accesses take the slow path
+ * @param vaddr Virtual address of the region
+ * @param size Size of the region in bytes
+ */
+void MapSpecialPages(u32 vaddr, u32 size);
+
+/**
+ * Removes a region of the virtual address space from the page table
+ * @param vaddr Virtual address of the region
+ * @param size Size of the region in bytes
+ */
+void UnmapPages(u32 vaddr, u32 size);
+
 /**
  * Maps a block of memory on the heap
  * @param size Size of block in bytes
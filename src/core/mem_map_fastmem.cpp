@@ -0,0 +1,136 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/common.h"
+
+#include "core/mem_map.h"
+
+#if defined(__linux__) && defined(_M_X64)
+#include <signal.h>
+#include <ucontext.h>
+
+#include "common/x64_analyzer.h"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace Memory {
+
+#if defined(__linux__) && defined(_M_X64)
+
+static struct sigaction g_old_segv_action;  ///< Handler that was installed before ours
+
+/// Returns the saved value of an x86-64 register (in encoding order) in a signal context
+static greg_t* GetContextRegister(mcontext_t& context, int reg) {
+    static const int register_map[16] = {
+        REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+        REG_R8,  REG_R9,  REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+    };
+    return &context.gregs[register_map[reg]];
+}
+
+/// Passes a fault we can't handle on to whatever handler was installed before ours
+static void ForwardFault(int sig, siginfo_t* info, void* raw_context) {
+    if (g_old_segv_action.sa_flags & SA_SIGINFO) {
+        g_old_segv_action.sa_sigaction(sig, info, raw_context);
+    } else if (g_old_segv_action.sa_handler == SIG_DFL) {
+        // Restore the default action, the faulting instruction will trap again and terminate
+        sigaction(SIGSEGV, &g_old_segv_action, nullptr);
+    } else if (g_old_segv_action.sa_handler != SIG_IGN) {
+        g_old_segv_action.sa_handler(sig);
+    }
+}
+
+/**
+ * SIGSEGV handler for accesses that fall on unmapped pages of the fastmem region. The faulting mov
+ * is decoded, serviced through the page table slow path (hardware I/O, config memory, or an
+ * unmapped access error) and then skipped.
+ */
+static void FastmemFaultHandler(int sig, siginfo_t* info, void* raw_context) {
+    ucontext_t* context = static_cast<ucontext_t*>(raw_context);
+    u8* fault_address = static_cast<u8*>(info->si_addr);
+
+    if (g_base == nullptr || fault_address < g_base || fault_address >= g_base + 0x100000000ULL) {
+        ForwardFault(sig, info, raw_context);
+        return;
+    }
+
+    mcontext_t& mcontext = context->uc_mcontext;
+    const u8* rip = reinterpret_cast<const u8*>(mcontext.gregs[REG_RIP]);
+
+    Common::X64MovInfo mov;
+    if (!Common::DisassembleMov(rip, &mov)) {
+        ERROR_LOG(MEMMAP, "unhandled fastmem access @ 0x%08X (host pc %p: %02X %02X %02X %02X)",
+            (u32)(fault_address - g_base), rip, rip[0], rip[1], rip[2], rip[3]);
+        ForwardFault(sig, info, raw_context);
+        return;
+    }
+
+    const u32 vaddr = (u32)(fault_address - g_base);
+    const u64 operand_mask = (mov.operand_size == 8) ? ~0ULL : ((1ULL << (mov.operand_size * 8)) - 1);
+    greg_t* reg = GetContextRegister(mcontext, mov.reg);
+
+    if (mov.is_load) {
+        u64 value = ReadUnmapped(vaddr, mov.operand_size);
+        if (mov.sign_extend) {
+            const int shift = 64 - mov.operand_size * 8;
+            value = (u64)((s64)(value << shift) >> shift);
+        }
+
+        if (mov.high_byte) {
+            *reg = (*reg & ~0xFF00LL) | (greg_t)((value & 0xFF) << 8);
+        } else if (mov.register_size >= 4) {
+            // 32-bit register writes clear the upper half of the register
+            *reg = (greg_t)(mov.register_size == 8 ? value : (value & 0xFFFFFFFF));
+        } else {
+            const u64 register_mask = (1ULL << (mov.register_size * 8)) - 1;
+            *reg = (greg_t)(((u64)*reg & ~register_mask) | (value & register_mask));
+        }
+    } else {
+        u64 value;
+        if (mov.has_immediate) {
+            value = mov.immediate;
+        } else if (mov.high_byte) {
+            value = (u64)*reg >> 8;
+        } else {
+            value = (u64)*reg;
+        }
+        WriteUnmapped(vaddr, mov.operand_size, value & operand_mask);
+    }
+
+    mcontext.gregs[REG_RIP] += mov.instruction_size;
+}
+
+bool InstallFastmemHandler() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = FastmemFaultHandler;
+    // Handled accesses may call into hardware emulation, which can access memory in turn
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(SIGSEGV, &action, &g_old_segv_action) != 0) {
+        ERROR_LOG(MEMMAP, "failed to install fastmem fault handler");
+        return false;
+    }
+    return true;
+}
+
+void RemoveFastmemHandler() {
+    sigaction(SIGSEGV, &g_old_segv_action, nullptr);
+}
+
+#else
+
+bool InstallFastmemHandler() {
+    WARN_LOG(MEMMAP, "fastmem is not supported on this platform");
+    return false;
+}
+
+void RemoveFastmemHandler() {
+}
+
+#endif
+
+} // namespace
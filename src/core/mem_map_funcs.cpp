@@ -2,11 +2,14 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <array>
 #include <map>
 
 #include "common/common.h"
 
+#include "core/core.h"
 #include "core/mem_map.h"
+#include "core/arm/arm_interface.h"
 #include "core/hw/hw.h"
 #include "hle/hle.h"
 #include "hle/config_mem.h"
@@ -49,90 +52,66 @@ u32 VirtualToPhysicalAddress(const u32 addr) {
     return addr;
 }
 
-template <typename T>
-inline void Read(T &var, const u32 vaddr) {
-    // TODO: Figure out the fastest order of tests for both read and write (they are probably different).
-    // TODO: Make sure this represents the mirrors in a correct way.
-    // Could just do a base-relative read, too.... TODO
+static std::array<u8*, NUM_PAGES> g_page_pointers;   ///< Host pointer for each page, or nullptr
+static std::array<PageType, NUM_PAGES> g_page_types;  ///< Type of each page
 
-    // Kernel memory command buffer
-    if (vaddr >= KERNEL_MEMORY_VADDR && vaddr < KERNEL_MEMORY_VADDR_END) {
-        var = *((const T*)&g_kernel_mem[vaddr & KERNEL_MEMORY_MASK]);
-
-    // Hardware I/O register reads
-    // 0x10XXXXXX- is physical address space, 0x1EXXXXXX is virtual address space
-    } else if ((vaddr >= HARDWARE_IO_VADDR) && (vaddr < HARDWARE_IO_VADDR_END)) {
-        HW::Read<T>(var, vaddr);
+u8 g_code_pages[NUM_PAGES];
 
-    // ExeFS:/.code is loaded here
-    } else if ((vaddr >= EXEFS_CODE_VADDR)  && (vaddr < EXEFS_CODE_VADDR_END)) {
-        var = *((const T*)&g_exefs_code[vaddr & EXEFS_CODE_MASK]);
+static void SetPages(u32 vaddr, u32 size, u8* memory, PageType type) {
+    // Partial pages at either end of the region are mapped in full
+    if (memory != nullptr) {
+        memory -= (vaddr & PAGE_MASK);
+    }
+    u32 page = vaddr >> PAGE_BITS;
+    u64 end = ((u64)vaddr + size + PAGE_MASK) >> PAGE_BITS;
+
+    _assert_msg_(MEMMAP, end <= NUM_PAGES, "out of range mapping @ 0x%08X (size 0x%08X)", vaddr,
+        size);
+
+    for (; page < end; ++page) {
+        g_page_pointers[page] = memory;
+        g_page_types[page] = type;
+        if (memory != nullptr) {
+            memory += PAGE_SIZE;
+        }
+    }
+}
 
-    // FCRAM - GSP heap
-    } else if ((vaddr >= HEAP_GSP_VADDR) && (vaddr < HEAP_GSP_VADDR_END)) {
-        var = *((const T*)&g_heap_gsp[vaddr & HEAP_GSP_MASK]);
+void MapPages(u32 vaddr, u32 size, u8* memory) {
+    SetPages(vaddr, size, memory, PageType::Memory);
+}
 
-    // FCRAM - application heap
-    } else if ((vaddr >= HEAP_VADDR)  && (vaddr < HEAP_VADDR_END)) {
-        var = *((const T*)&g_heap[vaddr & HEAP_MASK]);
+void MapSpecialPages(u32 vaddr, u32 size) {
+    SetPages(vaddr, size, nullptr, PageType::Special);
+}
 
-    // Shared memory
-    } else if ((vaddr >= SHARED_MEMORY_VADDR)  && (vaddr < SHARED_MEMORY_VADDR_END)) {
-        var = *((const T*)&g_shared_mem[vaddr & SHARED_MEMORY_MASK]);
+void UnmapPages(u32 vaddr, u32 size) {
+    SetPages(vaddr, size, nullptr, PageType::Unmapped);
+}
 
-    // System memory
-    } else if ((vaddr >= SYSTEM_MEMORY_VADDR)  && (vaddr < SYSTEM_MEMORY_VADDR_END)) {
-        var = *((const T*)&g_system_mem[vaddr & SYSTEM_MEMORY_MASK]);
+template <typename T>
+static void ReadSpecial(T &var, const u32 vaddr) {
+    // Hardware I/O register reads
+    // 0x10XXXXXX- is physical address space, 0x1EXXXXXX is virtual address space
+    if ((vaddr >= HARDWARE_IO_VADDR) && (vaddr < HARDWARE_IO_VADDR_END)) {
+        HW::Read<T>(var, vaddr);
 
     // Config memory
     } else if ((vaddr >= CONFIG_MEMORY_VADDR)  && (vaddr < CONFIG_MEMORY_VADDR_END)) {
         ConfigMem::Read<T>(var, vaddr);
 
-    // VRAM
-    } else if ((vaddr >= VRAM_VADDR)  && (vaddr < VRAM_VADDR_END)) {
-        var = *((const T*)&g_vram[vaddr & VRAM_MASK]);
-
     } else {
-        ERROR_LOG(MEMMAP, "unknown Read%d @ 0x%08X", sizeof(var) * 8, vaddr);
+        ERROR_LOG(MEMMAP, "unknown Read%d @ 0x%08X", (int)sizeof(var) * 8, vaddr);
     }
 }
 
 template <typename T>
-inline void Write(u32 vaddr, const T data) {
-
-    // Kernel memory command buffer
-    if (vaddr >= KERNEL_MEMORY_VADDR && vaddr < KERNEL_MEMORY_VADDR_END) {
-        *(T*)&g_kernel_mem[vaddr & KERNEL_MEMORY_MASK] = data;
-
+static void WriteSpecial(u32 vaddr, const T data) {
     // Hardware I/O register writes
     // 0x10XXXXXX- is physical address space, 0x1EXXXXXX is virtual address space
-    } else if ((vaddr >= HARDWARE_IO_VADDR) && (vaddr < HARDWARE_IO_VADDR_END)) {
+    if ((vaddr >= HARDWARE_IO_VADDR) && (vaddr < HARDWARE_IO_VADDR_END)) {
         HW::Write<T>(vaddr, data);
 
-    // ExeFS:/.code is loaded here
-    } else if ((vaddr >= EXEFS_CODE_VADDR)  && (vaddr < EXEFS_CODE_VADDR_END)) {
-        *(T*)&g_exefs_code[vaddr & EXEFS_CODE_MASK] = data;
-
-    // FCRAM - GSP heap
-    } else if ((vaddr >= HEAP_GSP_VADDR)  && (vaddr < HEAP_GSP_VADDR_END)) {
-        *(T*)&g_heap_gsp[vaddr & HEAP_GSP_MASK] = data;
-
-    // FCRAM - application heap
-    } else if ((vaddr >= HEAP_VADDR)  && (vaddr < HEAP_VADDR_END)) {
-        *(T*)&g_heap[vaddr & HEAP_MASK] = data;
-
-    // Shared memory
-    } else if ((vaddr >= SHARED_MEMORY_VADDR)  && (vaddr < SHARED_MEMORY_VADDR_END)) {
-        *(T*)&g_shared_mem[vaddr & SHARED_MEMORY_MASK] = data;
-
-    // System memory
-    } else if ((vaddr >= SYSTEM_MEMORY_VADDR)  && (vaddr < SYSTEM_MEMORY_VADDR_END)) {
-         *(T*)&g_system_mem[vaddr & SYSTEM_MEMORY_MASK] = data;
-
-    // VRAM
-    } else if ((vaddr >= VRAM_VADDR)  && (vaddr < VRAM_VADDR_END)) {
-        *(T*)&g_vram[vaddr & VRAM_MASK] = data;
-
     //} else if ((vaddr & 0xFFF00000) == 0x1FF00000) {
     //    _assert_msg_(MEMMAP, false, "umimplemented write to DSP memory");
     //} else if ((vaddr & 0xFFFF0000) == 0x1FF80000) {
@@ -140,45 +119,110 @@ inline void Write(u32 vaddr, const T data) {
     //} else if ((vaddr & 0xFFFFF000) == 0x1FF81000) {
     //    _assert_msg_(MEMMAP, false, "umimplemented write to shared page");
 
-    // Error out...
     } else {
-        ERROR_LOG(MEMMAP, "unknown Write%d 0x%08X @ 0x%08X", sizeof(data) * 8, data, vaddr);
+        ERROR_LOG(MEMMAP, "unknown Write%d 0x%08X @ 0x%08X", (int)sizeof(data) * 8, (u32)data,
+            vaddr);
     }
 }
 
-u8 *GetPointer(const u32 vaddr) {
-    // Kernel memory command buffer
-    if (vaddr >= KERNEL_MEMORY_VADDR && vaddr < KERNEL_MEMORY_VADDR_END) {
-        return g_kernel_mem + (vaddr & KERNEL_MEMORY_MASK);
+template <typename T>
+static void ReadPageTable(T &var, const u32 vaddr) {
+    const u32 page = vaddr >> PAGE_BITS;
+
+    // RAM is accessed directly through the page table
+    const u8* page_pointer = g_page_pointers[page];
+    if (page_pointer != nullptr) {
+        var = *((const T*)&page_pointer[vaddr & PAGE_MASK]);
+        return;
+    }
 
-    // ExeFS:/.code is loaded here
-    } else if ((vaddr >= EXEFS_CODE_VADDR)  && (vaddr < EXEFS_CODE_VADDR_END)) {
-        return g_exefs_code + (vaddr & EXEFS_CODE_MASK);
+    if (g_page_types[page] == PageType::Special) {
+        ReadSpecial<T>(var, vaddr);
+    } else {
+        ERROR_LOG(MEMMAP, "unknown Read%d @ 0x%08X", (int)sizeof(var) * 8, vaddr);
+    }
+}
+
+template <typename T>
+static void WritePageTable(u32 vaddr, const T data) {
+    const u32 page = vaddr >> PAGE_BITS;
+
+    // RAM is accessed directly through the page table
+    u8* page_pointer = g_page_pointers[page];
+    if (page_pointer != nullptr) {
+        *(T*)&page_pointer[vaddr & PAGE_MASK] = data;
+        return;
+    }
+
+    if (g_page_types[page] == PageType::Special) {
+        WriteSpecial<T>(vaddr, data);
+    } else {
+        ERROR_LOG(MEMMAP, "unknown Write%d 0x%08X @ 0x%08X", (int)sizeof(data) * 8, (u32)data,
+            vaddr);
+    }
+}
 
-    // FCRAM - GSP heap
-    } else if ((vaddr >= HEAP_GSP_VADDR)  && (vaddr < HEAP_GSP_VADDR_END)) {
-        return g_heap_gsp + (vaddr & HEAP_GSP_MASK);
+template <typename T>
+inline void Read(T &var, const u32 vaddr) {
+    if (g_fastmem) {
+        // Pages without RAM behind them fault into the fastmem handler
+        var = *(volatile const T*)(g_base + vaddr);
+        return;
+    }
+    ReadPageTable<T>(var, vaddr);
+}
+
+template <typename T>
+inline void Write(u32 vaddr, const T data) {
+    if (g_fastmem) {
+        // Pages without RAM behind them fault into the fastmem handler
+        *(volatile T*)(g_base + vaddr) = data;
+    } else {
+        WritePageTable<T>(vaddr, data);
+    }
 
-    // FCRAM - application heap
-    } else if ((vaddr >= HEAP_VADDR)  && (vaddr < HEAP_VADDR_END)) {
-        return g_heap + (vaddr & HEAP_MASK);
+    // Stores to translated code discard it, whether the CPU or HLE code made them
+    const u32 last_vaddr = vaddr + sizeof(T) - 1;
+    if (g_code_pages[vaddr >> PAGE_BITS] || g_code_pages[last_vaddr >> PAGE_BITS]) {
+        InvalidateCode(vaddr, sizeof(T));
+    }
+}
 
-    // Shared memory
-    } else if ((vaddr >= SHARED_MEMORY_VADDR)  && (vaddr < SHARED_MEMORY_VADDR_END)) {
-        return g_shared_mem + (vaddr & SHARED_MEMORY_MASK);
+u64 ReadUnmapped(u32 vaddr, int size) {
+    switch (size) {
+    case 1: { u8 data = 0;      ReadPageTable<u8>(data, vaddr);     return data; }
+    case 2: { u16_le data = 0;  ReadPageTable<u16_le>(data, vaddr); return data; }
+    case 4: { u32_le data = 0;  ReadPageTable<u32_le>(data, vaddr); return data; }
+    case 8: { u64_le data = 0;  ReadPageTable<u64_le>(data, vaddr); return data; }
+    }
+    ERROR_LOG(MEMMAP, "invalid Read%d @ 0x%08X", size * 8, vaddr);
+    return 0;
+}
 
-    // System memory
-    } else if ((vaddr >= SYSTEM_MEMORY_VADDR)  && (vaddr < SYSTEM_MEMORY_VADDR_END)) {
-         return g_system_mem + (vaddr & SYSTEM_MEMORY_MASK);
+void WriteUnmapped(u32 vaddr, int size, u64 data) {
+    switch (size) {
+    case 1: WritePageTable<u8>(vaddr, (u8)data);        return;
+    case 2: WritePageTable<u16_le>(vaddr, (u16)data);   return;
+    case 4: WritePageTable<u32_le>(vaddr, (u32)data);   return;
+    case 8: WritePageTable<u64_le>(vaddr, data);        return;
+    }
+    ERROR_LOG(MEMMAP, "invalid Write%d 0x%08X @ 0x%08X", size * 8, (u32)data, vaddr);
+}
 
-    // VRAM
-    } else if ((vaddr >= VRAM_VADDR)  && (vaddr < VRAM_VADDR_END)) {
-        return g_vram + (vaddr & VRAM_MASK);
+void InvalidateCode(u32 vaddr, u32 size) {
+    if (Core::g_app_core != nullptr) {
+        Core::g_app_core->InvalidateCodeRange(vaddr, size);
+    }
+}
 
-    } else {
-        ERROR_LOG(MEMMAP, "unknown GetPointer @ 0x%08x", vaddr);
-        return 0;
+u8 *GetPointer(const u32 vaddr) {
+    u8* page_pointer = g_page_pointers[vaddr >> PAGE_BITS];
+    if (page_pointer != nullptr) {
+        return page_pointer + (vaddr & PAGE_MASK);
     }
+
+    ERROR_LOG(MEMMAP, "unknown GetPointer @ 0x%08x", vaddr);
+    return 0;
 }
 
 /**
@@ -201,6 +245,8 @@ u32 MapBlock_Heap(u32 size, u32 operation, u32 permissions) {
     }
     g_heap_map[block.GetVirtualAddress()] = block;
 
+    MapPages(block.GetVirtualAddress(), block.size, g_heap + block.address);
+
     return block.GetVirtualAddress();
 }
 
@@ -224,6 +270,8 @@ u32 MapBlock_HeapGSP(u32 size, u32 operation, u32 permissions) {
     }
     g_heap_gsp_map[block.GetVirtualAddress()] = block;
 
+    MapPages(block.GetVirtualAddress(), block.size, g_heap_gsp + block.address);
+
     return block.GetVirtualAddress();
 }
 
@@ -0,0 +1,11 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "core/settings.h"
+
+namespace Settings {
+
+Values values = {};
+
+} // namespace
@@ -0,0 +1,50 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace Settings {
+
+/// ARM11 CPU backends
+enum class CpuCore : u8 {
+    Interpreter,        ///< SkyEye interpreter, fetches and decodes every instruction it executes
+    CachedInterpreter,  ///< Interpreter executing cached, pre-decoded basic blocks
+    Jit,                ///< Dynamic recompiler to x86-64 (falls back to the interpreter elsewhere)
+};
+
+/// Runtime options for the emulated system, set by the frontend before System::Init
+struct Values {
+    // Core
+    CpuCore cpu_core;   ///< Backend used for the ARM11 application and system cores
+
+    // Memory
+    bool use_fastmem;   ///< Map the guest address space at Memory::g_base, trapping I/O accesses
+    bool emulate_mmu;   ///< Route SkyEye memory accesses through the ARM1176 MMU instead of the
+                        ///< flat path (only needed by code that enables address translation)
+
+    // File system
+    int num_io_threads; ///< Worker threads running archive reads and writes asynchronously, while
+                        ///< the requesting guest thread waits (0 runs them on the CPU thread)
+
+    // Video
+    int num_rasterizer_threads; ///< Worker threads rasterizing triangles in screen tiles (0
+                                ///< rasterizes them on the CPU thread, as they are submitted)
+
+    // Debugging
+    std::string service_profile_path;   ///< If set, service commands are profiled and a report is
+                                        ///< written there at shutdown (JSON if it ends in .json,
+                                        ///< CSV otherwise)
+    std::string hle_trace_path;         ///< If set, SVCs and service commands are traced and the
+                                        ///< trace is written there at shutdown
+};
+
+extern Values values;
+
+} // namespace
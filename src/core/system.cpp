@@ -9,6 +9,7 @@
 #include "core/hw/hw.h"
 #include "core/hle/hle.h"
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/archive.h"
 
 #include "video_core/video_core.h"
 
@@ -19,13 +20,13 @@ volatile State g_state;
 void UpdateState(State state) {
 }
 
-void Init(EmuWindow* emu_window) {
+void Init(EmuWindow* emu_window, RendererBase* renderer) {
     Core::Init();
+    CoreTiming::Init();
     Memory::Init();
     HW::Init();
     HLE::Init();
-    CoreTiming::Init();
-    VideoCore::Init(emu_window);
+    VideoCore::Init(emu_window, renderer);
     Kernel::Init();
 }
 
@@ -37,6 +38,7 @@ void RunLoopUntil(u64 global_cycles) {
 }
 
 void Shutdown() {
+    Kernel::FinishArchiveIO();
     Core::Shutdown();
     Memory::Shutdown();
     HW::Shutdown();
@@ -6,6 +6,8 @@
 
 #include "common/emu_window.h"
 
+class RendererBase;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 namespace System {
@@ -25,7 +27,7 @@ typedef enum {
 extern volatile State g_state;
 
 void UpdateState(State state);
-void Init(EmuWindow* emu_window);
+void Init(EmuWindow* emu_window, RendererBase* renderer);
 void RunLoopFor(int cycles);
 void RunLoopUntil(u64 global_cycles);
 void Shutdown();
@@ -7,6 +7,8 @@
 #include "math.h"
 #include "pica.h"
 #include "primitive_assembly.h"
+#include "tev_compiler.h"
+#include "texture_cache.h"
 #include "vertex_shader.h"
 
 #include "debug_utils/debug_utils.h"
@@ -36,6 +38,11 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
 
     DebugUtils::OnPicaRegWrite(id, registers[id]);
 
+    if (registers[id] != old_value) {
+        TevCompiler::OnRegisterChanged(id);
+        TextureCache::OnRegisterChanged(id);
+    }
+
     switch(id) {
         // It seems like these trigger vertex rendering
         case PICA_REG_INDEX(trigger_draw):
@@ -260,6 +267,9 @@ static std::ptrdiff_t ExecuteCommandBlock(const u32* first_command_word) {
 void ProcessCommandList(const u32* list, u32 size) {
     u32* read_pointer = (u32*)list;
 
+    // The application may have written to textures since the previous command list
+    TextureCache::OnMemoryChanged();
+
     while (read_pointer < list + size) {
         read_pointer += ExecuteCommandBlock(read_pointer);
     }
@@ -109,7 +109,7 @@ struct Regs {
 
         u32 address;
 
-        u32 GetPhysicalAddress() {
+        u32 GetPhysicalAddress() const {
             return DecodeAddressRegister(address) - Memory::FCRAM_PADDR + Memory::HEAP_GSP_VADDR;
         }
 
@@ -125,9 +125,15 @@ struct Regs {
         RGBA5551     =  2,
         RGB565       =  3,
         RGBA4        =  4,
-
-        // TODO: Support for the other formats is not implemented, yet.
-        // Seems like they are luminance formats and compressed textures.
+        IA8          =  5,  ///< 8-bit intensity (replicated to RGB) and 8-bit alpha
+        HILO8        =  6,  ///< Two 8-bit channels, stored in red and green
+        I8           =  7,
+        A8           =  8,
+        IA4          =  9,
+        I4           = 10,
+        A4           = 11,
+        ETC1         = 12,  ///< Ericsson Texture Compression, 4x4 blocks of 64 bits
+        ETC1A4       = 13,  ///< ETC1 blocks, each preceded by 64 bits of 4-bit alpha
     };
 
     BitField<0, 1, u32> texturing_enable;
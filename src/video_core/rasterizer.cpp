@@ -3,45 +3,402 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <vector>
 
-#include "common/common_types.h"
+#include "common/common.h"
+#include "common/cpu_detect.h"
+#include "common/math_util.h"
+#include "common/thread_pool.h"
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+#include "core/settings.h"
 
 #include "math.h"
 #include "pica.h"
 #include "rasterizer.h"
+#include "tev_compiler.h"
+#include "texture_cache.h"
 #include "vertex_shader.h"
 
-#include "debug_utils/debug_utils.h"
-
 namespace Pica {
 
 namespace Rasterizer {
 
-static void DrawPixel(int x, int y, const Math::Vec4<u8>& color) {
-    u32* color_buffer = (u32*)Memory::GetPointer(registers.framebuffer.GetColorBufferAddress());
-    u32 value = (color.a() << 24) | (color.r() << 16) | (color.g() << 8) | color.b();
+/**
+ * Registers the pixel pipeline depends on, captured when a triangle is submitted: triangles may be
+ * rasterized on worker threads while the emulation thread keeps writing registers.
+ */
+struct RenderState {
+    u8* color_buffer;
+    u8* depth_buffer;
+    int framebuffer_width;
+    int framebuffer_height;
+
+    bool texturing_enable;
+    Regs::TextureConfig texture0;
+    const u32* texture_data;    ///< Texels of texture0 decoded by the texture cache, row by row
+
+    TevCompiler::Program tev_program;
+    std::array<Regs::TevStageConfig, 6> tev_stages;     ///< Only set if tev_program isn't supported
+};
+
+/// Copies a register structure through its raw words, since BitFields can't be assigned
+template <typename T>
+static void CopyRegisterWords(T& dest, const T& source) {
+    static_assert(sizeof(T) % sizeof(u32) == 0, "Register structures are made of whole words");
+    const u32* words = reinterpret_cast<const u32*>(&source);
+    std::copy(words, words + sizeof(T) / sizeof(u32), reinterpret_cast<u32*>(&dest));
+}
+
+/**
+ * Captures the current render state from the registers
+ * @param state Value-initialized state to fill in: zero-initialization clears its padding too, so
+ *              that states can be compared with memcmp
+ */
+static void CaptureRenderState(RenderState& state) {
+    state.color_buffer = Memory::GetPointer(registers.framebuffer.GetColorBufferAddress());
+    state.depth_buffer = Memory::GetPointer(registers.framebuffer.GetDepthBufferAddress());
+    state.framebuffer_width = registers.framebuffer.GetWidth();
+    state.framebuffer_height = registers.framebuffer.GetHeight();
+
+    state.tev_program = TevCompiler::GetProgram();
+    if (!state.tev_program.supported) {
+        CopyRegisterWords(state.tev_stages, registers.GetTevStages());
+    }
+
+    // Textures the combiner doesn't use aren't decoded
+    state.texturing_enable = registers.texturing_enable != 0 &&
+                             (state.tev_program.uses_texture0 || !state.tev_program.supported);
+    if (state.texturing_enable) {
+        CopyRegisterWords(state.texture0, registers.texture0);
+        const Regs::TextureFormat format = registers.texture0_format;
+
+        state.texture_data = TextureCache::Lookup(state.texture0, format);
+        if (state.texture_data == nullptr) {
+            // Loading reads the texture memory, which pending triangles may render to, and may
+            // overwrite the texels they sample
+            Flush();
+            state.texture_data = TextureCache::Load(state.texture0, format);
+            state.texturing_enable = (state.texture_data != nullptr);
+        }
+    }
+}
+
+/// Packs a color as BGRA8, the format of the color buffer and of TEV programs
+static u32 PackColor(const Math::Vec4<u8>& color) {
+    return (color.a() << 24) | (color.r() << 16) | (color.g() << 8) | color.b();
+}
+
+/// Unpacks a BGRA8 color
+static Math::Vec4<u8> UnpackColor(u32 value) {
+    return Math::MakeVec<u8>((value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF, value >> 24);
+}
+
+static void DrawPixel(const RenderState& state, int x, int y, const Math::Vec4<u8>& color) {
+    u32* color_buffer = (u32*)state.color_buffer;
+    u32 value = PackColor(color);
 
     // Assuming RGBA8 format until actual framebuffer format handling is implemented
-    *(color_buffer + x + y * registers.framebuffer.GetWidth()) = value;
+    *(color_buffer + x + y * state.framebuffer_width) = value;
 }
 
-static u32 GetDepth(int x, int y) {
-    u16* depth_buffer = (u16*)Memory::GetPointer(registers.framebuffer.GetDepthBufferAddress());
+static u32 GetDepth(const RenderState& state, int x, int y) {
+    u16* depth_buffer = (u16*)state.depth_buffer;
 
     // Assuming 16-bit depth buffer format until actual format handling is implemented
-    return *(depth_buffer + x + y * registers.framebuffer.GetWidth());
+    return *(depth_buffer + x + y * state.framebuffer_width);
 }
 
-static void SetDepth(int x, int y, u16 value) {
-    u16* depth_buffer = (u16*)Memory::GetPointer(registers.framebuffer.GetDepthBufferAddress());
+static void SetDepth(const RenderState& state, int x, int y, u16 value) {
+    u16* depth_buffer = (u16*)state.depth_buffer;
 
     // Assuming 16-bit depth buffer format until actual format handling is implemented
-    *(depth_buffer + x + y * registers.framebuffer.GetWidth()) = value;
+    *(depth_buffer + x + y * state.framebuffer_width) = value;
 }
 
-void ProcessTriangle(const VertexShader::OutputVertex& v0,
-                     const VertexShader::OutputVertex& v1,
-                     const VertexShader::OutputVertex& v2)
+/// Values interpolated linearly in screen space across a triangle
+enum Interpolant {
+    INTERPOLANT_R,              ///< Primary color components, divided by the clip space w
+    INTERPOLANT_G,
+    INTERPOLANT_B,
+    INTERPOLANT_A,
+    INTERPOLANT_U,              ///< Texture coordinates, divided by the clip space w
+    INTERPOLANT_V,
+    INTERPOLANT_W_INVERSE,      ///< Inverse of the clip space w
+    INTERPOLANT_Z,              ///< Depth, which is not perspective corrected
+    NUM_INTERPOLANTS
+};
+
+/**
+ * Gets a texel of the texture, clamping the coordinates to its edges
+ * @param state Render state with the texture
+ * @param s S coordinate of the texel
+ * @param t T coordinate of the texel
+ * @return Texel, as BGRA8
+ */
+static u32 GetTexel(const RenderState& state, int s, int t) {
+    const int width = state.texture0.width;
+    const int height = state.texture0.height;
+    s = MathUtil::Clamp(s, 0, width - 1);
+    t = MathUtil::Clamp(t, 0, height - 1);
+    return state.texture_data[s + t * width];
+}
+
+/**
+ * Evaluates the configured texture environment stages for a pixel, for configurations the TEV
+ * compiler doesn't support
+ * @param state Render state of the pixel
+ * @param primary_color Primary color of the pixel
+ * @param texture_color Texture color of the pixel
+ * @return Output color of the last stage
+ */
+static Math::Vec4<u8> InterpretTev(const RenderState& state, const Math::Vec4<u8>& primary_color,
+                                   const Math::Vec4<u8>& texture_color) {
+    // Texture environment - consists of 6 stages of color and alpha combining.
+    //
+    // Color combiners take three input color values from some source (e.g. interpolated
+    // vertex color, texture color, previous stage, etc), perform some very simple
+    // operations on each of them (e.g. inversion) and then calculate the output color
+    // with some basic arithmetic. Alpha combiners can be configured separately but work
+    // analogously.
+    Math::Vec4<u8> combiner_output;
+    for (const auto& tev_stage : state.tev_stages) {
+        using Source = Regs::TevStageConfig::Source;
+        using ColorModifier = Regs::TevStageConfig::ColorModifier;
+        using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
+        using Operation = Regs::TevStageConfig::Operation;
+
+        auto GetColorSource = [&](Source source) -> Math::Vec3<u8> {
+            switch (source) {
+            case Source::PrimaryColor:
+                return primary_color.rgb();
+
+            case Source::Texture0:
+                return texture_color.rgb();
+
+            case Source::Constant:
+                return {tev_stage.const_r, tev_stage.const_g, tev_stage.const_b};
+
+            case Source::Previous:
+                return combiner_output.rgb();
+
+            default:
+                ERROR_LOG(GPU, "Unknown color combiner source %d\n", (int)source);
+                return {};
+            }
+        };
+
+        auto GetAlphaSource = [&](Source source) -> u8 {
+            switch (source) {
+            case Source::PrimaryColor:
+                return primary_color.a();
+
+            case Source::Texture0:
+                return texture_color.a();
+
+            case Source::Constant:
+                return tev_stage.const_a;
+
+            case Source::Previous:
+                return combiner_output.a();
+
+            default:
+                ERROR_LOG(GPU, "Unknown alpha combiner source %d\n", (int)source);
+                return 0;
+            }
+        };
+
+        auto GetColorModifier = [](ColorModifier factor, const Math::Vec3<u8>& values) -> Math::Vec3<u8> {
+            switch (factor)
+            {
+            case ColorModifier::SourceColor:
+                return values;
+            default:
+                ERROR_LOG(GPU, "Unknown color factor %d\n", (int)factor);
+                return {};
+            }
+        };
+
+        auto GetAlphaModifier = [](AlphaModifier factor, u8 value) -> u8 {
+            switch (factor) {
+            case AlphaModifier::SourceAlpha:
+                return value;
+            default:
+                ERROR_LOG(GPU, "Unknown color factor %d\n", (int)factor);
+                return 0;
+            }
+        };
+
+        auto ColorCombine = [](Operation op, const Math::Vec3<u8> input[3]) -> Math::Vec3<u8> {
+            switch (op) {
+            case Operation::Replace:
+                return input[0];
+
+            case Operation::Modulate:
+                return ((input[0] * input[1]) / 255).Cast<u8>();
+
+            default:
+                ERROR_LOG(GPU, "Unknown color combiner operation %d\n", (int)op);
+                return {};
+            }
+        };
+
+        auto AlphaCombine = [](Operation op, const std::array<u8,3>& input) -> u8 {
+            switch (op) {
+            case Operation::Replace:
+                return input[0];
+
+            case Operation::Modulate:
+                return input[0] * input[1] / 255;
+
+            default:
+                ERROR_LOG(GPU, "Unknown alpha combiner operation %d\n", (int)op);
+                return 0;
+            }
+        };
+
+        // color combiner
+        // NOTE: Not sure if the alpha combiner might use the color output of the previous
+        //       stage as input. Hence, we currently don't directly write the result to
+        //       combiner_output.rgb(), but instead store it in a temporary variable until
+        //       alpha combining has been done.
+        Math::Vec3<u8> color_result[3] = {
+            GetColorModifier(tev_stage.color_modifier1, GetColorSource(tev_stage.color_source1)),
+            GetColorModifier(tev_stage.color_modifier2, GetColorSource(tev_stage.color_source2)),
+            GetColorModifier(tev_stage.color_modifier3, GetColorSource(tev_stage.color_source3))
+        };
+        auto color_output = ColorCombine(tev_stage.color_op, color_result);
+
+        // alpha combiner
+        std::array<u8,3> alpha_result = {
+            GetAlphaModifier(tev_stage.alpha_modifier1, GetAlphaSource(tev_stage.alpha_source1)),
+            GetAlphaModifier(tev_stage.alpha_modifier2, GetAlphaSource(tev_stage.alpha_source2)),
+            GetAlphaModifier(tev_stage.alpha_modifier3, GetAlphaSource(tev_stage.alpha_source3))
+        };
+        auto alpha_output = AlphaCombine(tev_stage.alpha_op, alpha_result);
+
+        combiner_output = Math::MakeVec(color_output, alpha_output);
+    }
+
+    return combiner_output;
+}
+
+/**
+ * Shades a pixel covered by a triangle and writes it to the color and depth buffers
+ * @param state Render state of the triangle
+ * @param x X coordinate of the pixel
+ * @param y Y coordinate of the pixel
+ * @param interpolants Interpolated values at the pixel, indexed by Interpolant
+ */
+static void ShadePixel(const RenderState& state, int x, int y,
+                       const float interpolants[NUM_INTERPOLANTS]) {
+    // Perspective correct attribute interpolation:
+    // Attribute values cannot be calculated by simple linear interpolation since
+    // they are not linear in screen space. For example, when interpolating a
+    // texture coordinate across two vertices, something simple like
+    //     u = (u0*w0 + u1*w1)/(w0+w1)
+    // will not work. However, the attribute value divided by the
+    // clipspace w-coordinate (u/w) and and the inverse w-coordinate (1/w) are linear
+    // in screenspace. Hence, we can linearly interpolate these two independently and
+    // calculate the interpolated attribute by dividing the results.
+    // I.e.
+    //     u_over_w   = ((u0/v0.pos.w)*w0 + (u1/v1.pos.w)*w1)/(w0+w1)
+    //     one_over_w = (( 1/v0.pos.w)*w0 + ( 1/v1.pos.w)*w1)/(w0+w1)
+    //     u = u_over_w / one_over_w
+    //
+    // Both are interpolated by the caller, which leaves a single division per pixel.
+    const float w = 1.0f / interpolants[INTERPOLANT_W_INVERSE];
+
+    Math::Vec4<u8> primary_color{
+        (u8)(interpolants[INTERPOLANT_R] * w * 255),
+        (u8)(interpolants[INTERPOLANT_G] * w * 255),
+        (u8)(interpolants[INTERPOLANT_B] * w * 255),
+        (u8)(interpolants[INTERPOLANT_A] * w * 255)
+    };
+    float24 u = float24::FromFloat32(interpolants[INTERPOLANT_U] * w);
+    float24 v = float24::FromFloat32(interpolants[INTERPOLANT_V] * w);
+
+    Math::Vec4<u8> texture_color{};
+    if (state.texturing_enable) {
+        int s = (int)(u * float24::FromFloat32(state.texture0.width)).ToFloat32();
+        int t = (int)(v * float24::FromFloat32(state.texture0.height)).ToFloat32();
+        texture_color = UnpackColor(GetTexel(state, s, t));
+    }
+
+    const TevCompiler::Program& tev_program = state.tev_program;
+    const Math::Vec4<u8> combiner_output = tev_program.supported ?
+        UnpackColor(TevCompiler::Evaluate(tev_program, PackColor(primary_color),
+                                          PackColor(texture_color))) :
+        InterpretTev(state, primary_color, texture_color);
+
+    // TODO: Not sure if the multiplication by 65535 has already been taken care
+    // of when transforming to screen coordinates or not.
+    u16 z = (u16)(interpolants[INTERPOLANT_Z] * 65535.f);
+    SetDepth(state, x, y, z);
+
+    DrawPixel(state, x, y, combiner_output);
+}
+
+/// Pixels are rasterized in square blocks of this size, which are first tested as a whole
+static const int kBlockSize = 8;
+
+/**
+ * Edge function of a triangle edge, i.e. orient2d of the edge and a pixel, which is positive for
+ * pixels on the inner side. It is linear in the pixel coordinates, so it is stepped from pixel to
+ * pixel with additions only.
+ */
+struct EdgeFunction {
+    int value;          ///< Value at the origin pixel, including the fill rule bias
+    int dx;             ///< Change of the value from one pixel to the next in x
+    int dy;             ///< Change of the value from one pixel to the next in y
+    int block_min;      ///< Offset from the value at the corner of a block to its minimum in it
+    int block_max;      ///< Offset from the value at the corner of a block to its maximum in it
+
+    int Evaluate(int x, int y) const {
+        return value + dx * x + dy * y;
+    }
+};
+
+/// Plane equation of an interpolated value
+struct Plane {
+    float value;        ///< Value at the origin pixel
+    float dx;           ///< Change of the value from one pixel to the next in x
+    float dy;           ///< Change of the value from one pixel to the next in y
+
+    float Evaluate(int x, int y) const {
+        return value + dx * x + dy * y;
+    }
+};
+
+/// A triangle set up for rasterization
+struct Triangle {
+    EdgeFunction edges[3];              ///< Edge functions giving w0, w1 and w2
+    Plane planes[NUM_INTERPOLANTS];     ///< Plane equations of the interpolated values
+
+    int begin_x, begin_y;   ///< First pixel of the bounding box
+    int end_x, end_y;       ///< Pixel past the end of the bounding box
+    int origin_x, origin_y; ///< Block aligned pixel the edge functions and planes are relative to
+
+    size_t state;           ///< Index of the render state of the triangle in its batch
+};
+
+/**
+ * Sets up the edge functions and plane equations of a triangle
+ * @param v0 First vertex
+ * @param v1 Second vertex
+ * @param v2 Third vertex
+ * @param triangle Receives the set up triangle
+ * @return False if the triangle covers no pixel
+ */
+static bool SetupTriangle(const VertexShader::OutputVertex& v0,
+                          const VertexShader::OutputVertex& v1,
+                          const VertexShader::OutputVertex& v2, Triangle& triangle)
 {
     // NOTE: Assuming that rasterizer coordinates are 12.4 fixed-point values
     struct Fix12P4 {
@@ -106,259 +463,787 @@ void ProcessTriangle(const VertexShader::OutputVertex& v0,
     int bias1 = IsRightSideOrFlatBottomEdge(vtxpos[1].xy(), vtxpos[2].xy(), vtxpos[0].xy()) ? -1 : 0;
     int bias2 = IsRightSideOrFlatBottomEdge(vtxpos[2].xy(), vtxpos[0].xy(), vtxpos[1].xy()) ? -1 : 0;
 
-    // TODO: Not sure if looping through x first might be faster
-    for (u16 y = min_y; y < max_y; y += 0x10) {
-        for (u16 x = min_x; x < max_x; x += 0x10) {
-
-            // Calculate the barycentric coordinates w0, w1 and w2
-            auto orient2d = [](const Math::Vec2<Fix12P4>& vtx1,
-                               const Math::Vec2<Fix12P4>& vtx2,
-                               const Math::Vec2<Fix12P4>& vtx3) {
-                const auto vec1 = Math::MakeVec(vtx2 - vtx1, 0);
-                const auto vec2 = Math::MakeVec(vtx3 - vtx1, 0);
-                // TODO: There is a very small chance this will overflow for sizeof(int) == 4
-                return Math::Cross(vec1, vec2).z;
-            };
+    // Pixels covered by the bounding box, and the block aligned origin all values are relative to
+    triangle.begin_x = min_x >> 4;
+    triangle.begin_y = min_y >> 4;
+    triangle.end_x = max_x >> 4;
+    triangle.end_y = max_y >> 4;
+    triangle.origin_x = triangle.begin_x & ~(kBlockSize - 1);
+    triangle.origin_y = triangle.begin_y & ~(kBlockSize - 1);
+
+    // The barycentric coordinates w0, w1 and w2 of a pixel are the edge functions
+    // orient2d(vtx1, vtx2, pixel) = (vtx2 - vtx1) x (pixel - vtx1) of the opposite edges.
+    // TODO: There is a very small chance this will overflow for sizeof(int) == 4
+    auto MakeEdgeFunction = [&](const Math::Vec2<Fix12P4>& vtx1, const Math::Vec2<Fix12P4>& vtx2,
+                                int bias) {
+        const int edge_x = (int)vtx2.x - (int)vtx1.x;
+        const int edge_y = (int)vtx2.y - (int)vtx1.y;
+        EdgeFunction edge;
+        edge.value = bias + edge_x * ((triangle.origin_y << 4) - (int)vtx1.y) -
+                     edge_y * ((triangle.origin_x << 4) - (int)vtx1.x);
+        edge.dx = -edge_y * 16;
+        edge.dy = edge_x * 16;
+        edge.block_min = std::min(0, edge.dx * (kBlockSize - 1)) +
+                         std::min(0, edge.dy * (kBlockSize - 1));
+        edge.block_max = std::max(0, edge.dx * (kBlockSize - 1)) +
+                         std::max(0, edge.dy * (kBlockSize - 1));
+        return edge;
+    };
+    EdgeFunction* edges = triangle.edges;
+    edges[0] = MakeEdgeFunction(vtxpos[1].xy(), vtxpos[2].xy(), bias0);
+    edges[1] = MakeEdgeFunction(vtxpos[2].xy(), vtxpos[0].xy(), bias1);
+    edges[2] = MakeEdgeFunction(vtxpos[0].xy(), vtxpos[1].xy(), bias2);
+
+    // The barycentric coordinates always sum up to the same value, which is zero (or less) for
+    // degenerate and back facing triangles, which cover no pixel
+    const int wsum = edges[0].value + edges[1].value + edges[2].value;
+    if (wsum <= 0)
+        return false;
+
+    // Plane equations of the interpolated values, set up once for the whole triangle: a value
+    // interpolated with the barycentric coordinates is (attr0*w0 + attr1*w1 + attr2*w2)/wsum,
+    // which is linear in the pixel coordinates as well
+    const VertexShader::OutputVertex* vertices[3] = { &v0, &v1, &v2 };
+    float vertex_values[3][NUM_INTERPOLANTS];
+    for (int i = 0; i < 3; ++i) {
+        const VertexShader::OutputVertex& vtx = *vertices[i];
+        const float w_inverse = 1.0f / vtx.pos.w.ToFloat32();
+        vertex_values[i][INTERPOLANT_R] = vtx.color.r().ToFloat32() * w_inverse;
+        vertex_values[i][INTERPOLANT_G] = vtx.color.g().ToFloat32() * w_inverse;
+        vertex_values[i][INTERPOLANT_B] = vtx.color.b().ToFloat32() * w_inverse;
+        vertex_values[i][INTERPOLANT_A] = vtx.color.a().ToFloat32() * w_inverse;
+        vertex_values[i][INTERPOLANT_U] = vtx.tc0.u().ToFloat32() * w_inverse;
+        vertex_values[i][INTERPOLANT_V] = vtx.tc0.v().ToFloat32() * w_inverse;
+        vertex_values[i][INTERPOLANT_W_INVERSE] = w_inverse;
+        vertex_values[i][INTERPOLANT_Z] = vtx.screenpos[2].ToFloat32();
+    }
+    Plane* planes = triangle.planes;
+    for (int i = 0; i < NUM_INTERPOLANTS; ++i) {
+        double value = 0, dx = 0, dy = 0;
+        for (int vtx = 0; vtx < 3; ++vtx) {
+            value += (double)vertex_values[vtx][i] * edges[vtx].value;
+            dx += (double)vertex_values[vtx][i] * edges[vtx].dx;
+            dy += (double)vertex_values[vtx][i] * edges[vtx].dy;
+        }
+        planes[i].value = (float)(value / wsum);
+        planes[i].dx = (float)(dx / wsum);
+        planes[i].dy = (float)(dy / wsum);
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Vectorized pixel pipeline
 
-            int w0 = bias0 + orient2d(vtxpos[1].xy(), vtxpos[2].xy(), {x, y});
-            int w1 = bias1 + orient2d(vtxpos[2].xy(), vtxpos[0].xy(), {x, y});
-            int w2 = bias2 + orient2d(vtxpos[0].xy(), vtxpos[1].xy(), {x, y});
-            int wsum = w0 + w1 + w2;
+/**
+ * Shades the pixels of a block covered by a triangle and writes them to the color and depth
+ * buffers, several pixels at a time. Only used for supported TEV programs.
+ * @param triangle Triangle to rasterize
+ * @param state Render state of the triangle
+ * @param x0 First pixel to shade in x
+ * @param y0 First pixel to shade in y
+ * @param x1 Pixel past the last one to shade in x
+ * @param y1 Pixel past the last one to shade in y
+ */
+typedef void (*ShadeBlockFunction)(const Triangle& triangle, const RenderState& state,
+                                   int x0, int y0, int x1, int y1);
 
-            // If current pixel is not covered by the current primitive
-            if (w0 < 0 || w1 < 0 || w2 < 0)
+/// Vectorized ShadeBlock function supported by the host, or nullptr to use the scalar pipeline
+static ShadeBlockFunction g_shade_block = nullptr;
+
+#if defined(_M_X64) || defined(_M_IX86)
+
+/// Multiplies packed 8-bit values, dividing the products by 255 like the scalar combiner does
+FUNCTION_TARGET_SSE41 static inline __m128i Modulate(__m128i a, __m128i b) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+    // x / 255 == (x * 0x8081) >> 23 for any 16-bit x
+    const __m128i reciprocal = _mm_set1_epi16((s16)0x8081);
+    lo = _mm_srli_epi16(_mm_mulhi_epu16(lo, reciprocal), 7);
+    hi = _mm_srli_epi16(_mm_mulhi_epu16(hi, reciprocal), 7);
+    return _mm_packus_epi16(lo, hi);
+}
+
+FUNCTION_TARGET_AVX2 static inline __m256i Modulate(__m256i a, __m256i b) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+    __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+
+    const __m256i reciprocal = _mm256_set1_epi16((s16)0x8081);
+    lo = _mm256_srli_epi16(_mm256_mulhi_epu16(lo, reciprocal), 7);
+    hi = _mm256_srli_epi16(_mm256_mulhi_epu16(hi, reciprocal), 7);
+    return _mm256_packus_epi16(lo, hi);
+}
+
+/**
+ * Evaluates a TEV program for packed BGRA8 pixels
+ * @param program TEV program to evaluate
+ * @param constants Constants of the inputs of the stages, as vectors
+ * @param primary_color Primary colors of the pixels
+ * @param texture_color Texture colors of the pixels
+ * @return Output colors
+ */
+FUNCTION_TARGET_SSE41 static inline __m128i CombineTev(const TevCompiler::Program& program,
+                                                       const __m128i constants[][2],
+                                                       __m128i primary_color,
+                                                       __m128i texture_color) {
+    using TevCompiler::Input;
+    using TevCompiler::Operation;
+
+    const __m128i alpha_mask = _mm_set1_epi32(0xFF000000);
+    __m128i sources[4];
+    sources[(int)Input::PrimaryColor] = primary_color;
+    sources[(int)Input::Texture0] = texture_color;
+    sources[(int)Input::Previous] = _mm_set1_epi32(program.constant_output);
+
+    for (int i = 0; i < program.num_stages; ++i) {
+        const TevCompiler::Stage& stage = program.stages[i];
+
+        // Inputs take their color channels from one source and their alpha from another
+        sources[(int)Input::Constant] = constants[i][0];
+        const __m128i input1 = _mm_blendv_epi8(sources[(int)stage.color_inputs[0]],
+                                               sources[(int)stage.alpha_inputs[0]], alpha_mask);
+        if (stage.op == Operation::Replace) {
+            sources[(int)Input::Previous] = input1;
+            continue;
+        }
+
+        sources[(int)Input::Constant] = constants[i][1];
+        const __m128i input2 = _mm_blendv_epi8(sources[(int)stage.color_inputs[1]],
+                                               sources[(int)stage.alpha_inputs[1]], alpha_mask);
+        const __m128i product = Modulate(input1, input2);
+        switch (stage.op) {
+        case Operation::ModulateColor:
+            sources[(int)Input::Previous] = _mm_blendv_epi8(product, input1, alpha_mask);
+            break;
+
+        case Operation::ModulateAlpha:
+            sources[(int)Input::Previous] = _mm_blendv_epi8(input1, product, alpha_mask);
+            break;
+
+        default:
+            sources[(int)Input::Previous] = product;
+            break;
+        }
+    }
+    return sources[(int)Input::Previous];
+}
+
+FUNCTION_TARGET_AVX2 static inline __m256i CombineTev(const TevCompiler::Program& program,
+                                                      const __m256i constants[][2],
+                                                      __m256i primary_color,
+                                                      __m256i texture_color) {
+    using TevCompiler::Input;
+    using TevCompiler::Operation;
+
+    const __m256i alpha_mask = _mm256_set1_epi32(0xFF000000);
+    __m256i sources[4];
+    sources[(int)Input::PrimaryColor] = primary_color;
+    sources[(int)Input::Texture0] = texture_color;
+    sources[(int)Input::Previous] = _mm256_set1_epi32(program.constant_output);
+
+    for (int i = 0; i < program.num_stages; ++i) {
+        const TevCompiler::Stage& stage = program.stages[i];
+
+        sources[(int)Input::Constant] = constants[i][0];
+        const __m256i input1 = _mm256_blendv_epi8(sources[(int)stage.color_inputs[0]],
+                                                  sources[(int)stage.alpha_inputs[0]], alpha_mask);
+        if (stage.op == Operation::Replace) {
+            sources[(int)Input::Previous] = input1;
+            continue;
+        }
+
+        sources[(int)Input::Constant] = constants[i][1];
+        const __m256i input2 = _mm256_blendv_epi8(sources[(int)stage.color_inputs[1]],
+                                                  sources[(int)stage.alpha_inputs[1]], alpha_mask);
+        const __m256i product = Modulate(input1, input2);
+        switch (stage.op) {
+        case Operation::ModulateColor:
+            sources[(int)Input::Previous] = _mm256_blendv_epi8(product, input1, alpha_mask);
+            break;
+
+        case Operation::ModulateAlpha:
+            sources[(int)Input::Previous] = _mm256_blendv_epi8(input1, product, alpha_mask);
+            break;
+
+        default:
+            sources[(int)Input::Previous] = product;
+            break;
+        }
+    }
+    return sources[(int)Input::Previous];
+}
+
+/**
+ * Looks up the texels of the covered pixels of a quad, which are gathered one at a time
+ * @param state Render state with the texture
+ * @param indices Indices of the texels in the decoded texture
+ * @param coverage Bit mask of the covered pixels
+ * @param texels Receives the texels, packed like the color buffer (BGRA)
+ */
+static inline void GatherTexels(const RenderState& state, const u32 indices[4], int coverage,
+                                u32 texels[4]) {
+    for (int i = 0; i < 4; ++i) {
+        texels[i] = (coverage & (1 << i)) ? state.texture_data[indices[i]] : 0;
+    }
+}
+
+/**
+ * SSE4.1 ShadeBlock function, which shades 2x2 quads of pixels. The lanes of the vectors hold the
+ * pixels (x, y), (x + 1, y), (x, y + 1) and (x + 1, y + 1) of a quad.
+ */
+FUNCTION_TARGET_SSE41 static void ShadeBlockSSE41(const Triangle& triangle,
+                                                  const RenderState& state,
+                                                  int x0, int y0, int x1, int y1) {
+    const EdgeFunction* edges = triangle.edges;
+    const Plane* planes = triangle.planes;
+    const TevCompiler::Program& tev_program = state.tev_program;
+
+    const __m128i lane_x = _mm_setr_epi32(0, 1, 0, 1);
+    const __m128i lane_y = _mm_setr_epi32(0, 0, 1, 1);
+
+    // Differences between the values at the pixels of a quad and at its first pixel
+    __m128i edge_steps[3];
+    for (int i = 0; i < 3; ++i) {
+        edge_steps[i] = _mm_add_epi32(_mm_mullo_epi32(lane_x, _mm_set1_epi32(edges[i].dx)),
+                                      _mm_mullo_epi32(lane_y, _mm_set1_epi32(edges[i].dy)));
+    }
+    __m128 plane_steps[NUM_INTERPOLANTS];
+    for (int i = 0; i < NUM_INTERPOLANTS; ++i) {
+        plane_steps[i] = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lane_x), _mm_set1_ps(planes[i].dx)),
+                                    _mm_mul_ps(_mm_cvtepi32_ps(lane_y), _mm_set1_ps(planes[i].dy)));
+    }
+
+    // Pixels of the quads outside of the block are masked out like uncovered ones
+    const __m128i min_x = _mm_set1_epi32(x0 - 1);
+    const __m128i min_y = _mm_set1_epi32(y0 - 1);
+    const __m128i max_x = _mm_set1_epi32(x1);
+    const __m128i max_y = _mm_set1_epi32(y1);
+
+    __m128i tev_constants[6][2];
+    for (int i = 0; i < tev_program.num_stages; ++i) {
+        tev_constants[i][0] = _mm_set1_epi32(tev_program.stages[i].constants[0]);
+        tev_constants[i][1] = _mm_set1_epi32(tev_program.stages[i].constants[1]);
+    }
+
+    // Texture coordinates are clamped to the edges like GetTexel does
+    const bool texturing_enable = state.texturing_enable;
+    const __m128 texture_width = _mm_set1_ps((float)state.texture0.width);
+    const __m128 texture_height = _mm_set1_ps((float)state.texture0.height);
+    const __m128i max_s = _mm_set1_epi32(state.texture0.width - 1);
+    const __m128i max_t = _mm_set1_epi32(state.texture0.height - 1);
+    const __m128i texture_stride = _mm_set1_epi32(state.texture0.width);
+    const __m128i byte_mask = _mm_set1_epi32(0xFF);
+
+    for (int y = y0 & ~1; y < y1; y += 2) {
+        for (int x = x0 & ~1; x < x1; x += 2) {
+            const int rel_x = x - triangle.origin_x;
+            const int rel_y = y - triangle.origin_y;
+
+            // Covered pixels have non-negative w0, w1 and w2, i.e. a clear sign bit in w0|w1|w2
+            __m128i w_or = _mm_setzero_si128();
+            for (int i = 0; i < 3; ++i) {
+                const __m128i w = _mm_add_epi32(_mm_set1_epi32(edges[i].Evaluate(rel_x, rel_y)),
+                                                edge_steps[i]);
+                w_or = _mm_or_si128(w_or, w);
+            }
+            const __m128i pixel_x = _mm_add_epi32(_mm_set1_epi32(x), lane_x);
+            const __m128i pixel_y = _mm_add_epi32(_mm_set1_epi32(y), lane_y);
+            __m128i mask = _mm_and_si128(_mm_cmpgt_epi32(pixel_x, min_x),
+                                         _mm_cmplt_epi32(pixel_x, max_x));
+            mask = _mm_and_si128(mask, _mm_and_si128(_mm_cmpgt_epi32(pixel_y, min_y),
+                                                     _mm_cmplt_epi32(pixel_y, max_y)));
+            mask = _mm_andnot_si128(_mm_srai_epi32(w_or, 31), mask);
+
+            const int coverage = _mm_movemask_ps(_mm_castsi128_ps(mask));
+            if (coverage == 0)
                 continue;
 
-            // Perspective correct attribute interpolation:
-            // Attribute values cannot be calculated by simple linear interpolation since
-            // they are not linear in screen space. For example, when interpolating a
-            // texture coordinate across two vertices, something simple like
-            //     u = (u0*w0 + u1*w1)/(w0+w1)
-            // will not work. However, the attribute value divided by the
-            // clipspace w-coordinate (u/w) and and the inverse w-coordinate (1/w) are linear
-            // in screenspace. Hence, we can linearly interpolate these two independently and
-            // calculate the interpolated attribute by dividing the results.
-            // I.e.
-            //     u_over_w   = ((u0/v0.pos.w)*w0 + (u1/v1.pos.w)*w1)/(w0+w1)
-            //     one_over_w = (( 1/v0.pos.w)*w0 + ( 1/v1.pos.w)*w1)/(w0+w1)
-            //     u = u_over_w / one_over_w
-            //
-            // The generalization to three vertices is straightforward in baricentric coordinates.
-            auto GetInterpolatedAttribute = [&](float24 attr0, float24 attr1, float24 attr2) {
-                auto attr_over_w = Math::MakeVec(attr0 / v0.pos.w,
-                                                 attr1 / v1.pos.w,
-                                                 attr2 / v2.pos.w);
-                auto w_inverse   = Math::MakeVec(float24::FromFloat32(1.f) / v0.pos.w,
-                                                 float24::FromFloat32(1.f) / v1.pos.w,
-                                                 float24::FromFloat32(1.f) / v2.pos.w);
-                auto baricentric_coordinates = Math::MakeVec(float24::FromFloat32(w0),
-                                                             float24::FromFloat32(w1),
-                                                             float24::FromFloat32(w2));
-
-                float24 interpolated_attr_over_w = Math::Dot(attr_over_w, baricentric_coordinates);
-                float24 interpolated_w_inverse   = Math::Dot(w_inverse,   baricentric_coordinates);
-                return interpolated_attr_over_w / interpolated_w_inverse;
-            };
+            __m128 interpolants[NUM_INTERPOLANTS];
+            for (int i = 0; i < NUM_INTERPOLANTS; ++i) {
+                interpolants[i] = _mm_add_ps(_mm_set1_ps(planes[i].Evaluate(rel_x, rel_y)),
+                                             plane_steps[i]);
+            }
 
-            Math::Vec4<u8> primary_color{
-                (u8)(GetInterpolatedAttribute(v0.color.r(), v1.color.r(), v2.color.r()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.g(), v1.color.g(), v2.color.g()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.b(), v1.color.b(), v2.color.b()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.a(), v1.color.a(), v2.color.a()).ToFloat32() * 255)
-            };
+            // Perspective correction and conversions as in ShadePixel, with the color channels
+            // truncated to 8 bits like its u8 casts
+            const __m128 w = _mm_div_ps(_mm_set1_ps(1.0f), interpolants[INTERPOLANT_W_INVERSE]);
+            const __m128 color_scale = _mm_mul_ps(w, _mm_set1_ps(255.0f));
+            const __m128i r = _mm_cvttps_epi32(
+                _mm_mul_ps(interpolants[INTERPOLANT_R], color_scale));
+            const __m128i g = _mm_cvttps_epi32(
+                _mm_mul_ps(interpolants[INTERPOLANT_G], color_scale));
+            const __m128i b = _mm_cvttps_epi32(
+                _mm_mul_ps(interpolants[INTERPOLANT_B], color_scale));
+            const __m128i a = _mm_cvttps_epi32(
+                _mm_mul_ps(interpolants[INTERPOLANT_A], color_scale));
+            const __m128i primary_color = _mm_or_si128(
+                _mm_or_si128(_mm_slli_epi32(a, 24),
+                             _mm_slli_epi32(_mm_and_si128(r, byte_mask), 16)),
+                _mm_or_si128(_mm_slli_epi32(_mm_and_si128(g, byte_mask), 8),
+                             _mm_and_si128(b, byte_mask)));
+
+            __m128i texture_color = _mm_setzero_si128();
+            if (texturing_enable) {
+                const __m128 u = _mm_mul_ps(interpolants[INTERPOLANT_U], w);
+                const __m128 v = _mm_mul_ps(interpolants[INTERPOLANT_V], w);
+                const __m128i s = _mm_min_epi32(_mm_max_epi32(
+                    _mm_cvttps_epi32(_mm_mul_ps(u, texture_width)), _mm_setzero_si128()), max_s);
+                const __m128i t = _mm_min_epi32(_mm_max_epi32(
+                    _mm_cvttps_epi32(_mm_mul_ps(v, texture_height)), _mm_setzero_si128()), max_t);
+                u32 indices[4], texels[4];
+                _mm_storeu_si128((__m128i*)indices,
+                                 _mm_add_epi32(s, _mm_mullo_epi32(t, texture_stride)));
+                GatherTexels(state, indices, coverage, texels);
+                texture_color = _mm_loadu_si128((const __m128i*)texels);
+            }
+
+            const __m128i color = CombineTev(tev_program, tev_constants, primary_color,
+                                             texture_color);
 
-            Math::Vec4<u8> texture_color{};
-            float24 u = GetInterpolatedAttribute(v0.tc0.u(), v1.tc0.u(), v2.tc0.u());
-            float24 v = GetInterpolatedAttribute(v0.tc0.v(), v1.tc0.v(), v2.tc0.v());
-            if (registers.texturing_enable) {
-                // Images are split into 8x8 tiles. Each tile is composed of four 4x4 subtiles each
-                // of which is composed of four 2x2 subtiles each of which is composed of four texels.
-                // Each structure is embedded into the next-bigger one in a diagonal pattern, e.g.
-                // texels are laid out in a 2x2 subtile like this:
-                // 2 3
-                // 0 1
-                //
-                // The full 8x8 tile has the texels arranged like this:
-                //
-                // 42 43 46 47 58 59 62 63
-                // 40 41 44 45 56 57 60 61
-                // 34 35 38 39 50 51 54 55
-                // 32 33 36 37 48 49 52 53
-                // 10 11 14 15 26 27 30 31
-                // 08 09 12 13 24 25 28 29
-                // 02 03 06 07 18 19 22 23
-                // 00 01 04 05 16 17 20 21
-
-                // TODO: This is currently hardcoded for RGB8
-                u32* texture_data = (u32*)Memory::GetPointer(registers.texture0.GetPhysicalAddress());
-
-                // TODO(neobrain): Not sure if this swizzling pattern is used for all textures.
-                // To be flexible in case different but similar patterns are used, we keep this
-                // somewhat inefficient code around for now.
-                int s = (int)(u * float24::FromFloat32(registers.texture0.width)).ToFloat32();
-                int t = (int)(v * float24::FromFloat32(registers.texture0.height)).ToFloat32();
-                int texel_index_within_tile = 0;
-                for (int block_size_index = 0; block_size_index < 3; ++block_size_index) {
-                    int sub_tile_width = 1 << block_size_index;
-                    int sub_tile_height = 1 << block_size_index;
-
-                    int sub_tile_index = (s & sub_tile_width) << block_size_index;
-                    sub_tile_index += 2 * ((t & sub_tile_height) << block_size_index);
-                    texel_index_within_tile += sub_tile_index;
+            // Depth truncated to 16 bits like the u16 cast of ShadePixel
+            const __m128i z = _mm_cvttps_epi32(_mm_mul_ps(interpolants[INTERPOLANT_Z],
+                                                          _mm_set1_ps(65535.0f)));
+            const __m128i depth = _mm_packus_epi32(_mm_and_si128(z, _mm_set1_epi32(0xFFFF)), z);
+
+            // Rows of the quad are stored at once, pixels of partially covered rows one by one
+            u32* color_buffer = (u32*)state.color_buffer + x + y * state.framebuffer_width;
+            u16* depth_buffer = (u16*)state.depth_buffer + x + y * state.framebuffer_width;
+            if (coverage == 0xF) {
+                _mm_storel_epi64((__m128i*)color_buffer, color);
+                _mm_storel_pd((double*)(color_buffer + state.framebuffer_width),
+                              _mm_castsi128_pd(_mm_unpackhi_epi64(color, color)));
+                const u32 depth_rows[2] = {
+                    (u32)_mm_cvtsi128_si32(depth), (u32)_mm_extract_epi32(depth, 1)
+                };
+                memcpy(depth_buffer, &depth_rows[0], sizeof(u32));
+                memcpy(depth_buffer + state.framebuffer_width, &depth_rows[1], sizeof(u32));
+            } else {
+                u32 colors[4];
+                u16 depths[8];
+                _mm_storeu_si128((__m128i*)colors, color);
+                _mm_storeu_si128((__m128i*)depths, depth);
+                for (int i = 0; i < 4; ++i) {
+                    if (coverage & (1 << i)) {
+                        const int offset = (i & 1) + (i >> 1) * state.framebuffer_width;
+                        color_buffer[offset] = colors[i];
+                        depth_buffer[offset] = depths[i];
+                    }
                 }
+            }
+        }
+    }
+}
 
-                const int block_width = 8;
-                const int block_height = 8;
+/**
+ * AVX2 ShadeBlock function, which shades two horizontally adjacent 2x2 quads of pixels at once.
+ * The lanes of the vectors hold the pixels x to x + 3 of row y, then those of row y + 1.
+ */
+FUNCTION_TARGET_AVX2 static void ShadeBlockAVX2(const Triangle& triangle, const RenderState& state,
+                                                int x0, int y0, int x1, int y1) {
+    const EdgeFunction* edges = triangle.edges;
+    const Plane* planes = triangle.planes;
+    const TevCompiler::Program& tev_program = state.tev_program;
 
-                int coarse_s = (s / block_width) * block_width;
-                int coarse_t = (t / block_height) * block_height;
+    const __m256i lane_x = _mm256_setr_epi32(0, 1, 2, 3, 0, 1, 2, 3);
+    const __m256i lane_y = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
 
-                const int row_stride = registers.texture0.width * 3;
-                u8* source_ptr = (u8*)texture_data + coarse_s * block_height * 3 + coarse_t * row_stride + texel_index_within_tile * 3;
-                texture_color.r() = source_ptr[2];
-                texture_color.g() = source_ptr[1];
-                texture_color.b() = source_ptr[0];
-                texture_color.a() = 0xFF;
+    __m256i edge_steps[3];
+    for (int i = 0; i < 3; ++i) {
+        edge_steps[i] = _mm256_add_epi32(
+            _mm256_mullo_epi32(lane_x, _mm256_set1_epi32(edges[i].dx)),
+            _mm256_mullo_epi32(lane_y, _mm256_set1_epi32(edges[i].dy)));
+    }
+    __m256 plane_steps[NUM_INTERPOLANTS];
+    for (int i = 0; i < NUM_INTERPOLANTS; ++i) {
+        plane_steps[i] = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_cvtepi32_ps(lane_x), _mm256_set1_ps(planes[i].dx)),
+            _mm256_mul_ps(_mm256_cvtepi32_ps(lane_y), _mm256_set1_ps(planes[i].dy)));
+    }
+
+    const __m256i min_x = _mm256_set1_epi32(x0 - 1);
+    const __m256i min_y = _mm256_set1_epi32(y0 - 1);
+    const __m256i max_x = _mm256_set1_epi32(x1);
+    const __m256i max_y = _mm256_set1_epi32(y1);
+
+    __m256i tev_constants[6][2];
+    for (int i = 0; i < tev_program.num_stages; ++i) {
+        tev_constants[i][0] = _mm256_set1_epi32(tev_program.stages[i].constants[0]);
+        tev_constants[i][1] = _mm256_set1_epi32(tev_program.stages[i].constants[1]);
+    }
+
+    // Texture coordinates are clamped to the edges like GetTexel does
+    const bool texturing_enable = state.texturing_enable;
+    const __m256 texture_width = _mm256_set1_ps((float)state.texture0.width);
+    const __m256 texture_height = _mm256_set1_ps((float)state.texture0.height);
+    const __m256i max_s = _mm256_set1_epi32(state.texture0.width - 1);
+    const __m256i max_t = _mm256_set1_epi32(state.texture0.height - 1);
+    const __m256i texture_stride = _mm256_set1_epi32(state.texture0.width);
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
 
-                DebugUtils::DumpTexture(registers.texture0, (u8*)texture_data);
+    for (int y = y0 & ~1; y < y1; y += 2) {
+        for (int x = x0 & ~3; x < x1; x += 4) {
+            const int rel_x = x - triangle.origin_x;
+            const int rel_y = y - triangle.origin_y;
+
+            __m256i w_or = _mm256_setzero_si256();
+            for (int i = 0; i < 3; ++i) {
+                const __m256i w = _mm256_add_epi32(
+                    _mm256_set1_epi32(edges[i].Evaluate(rel_x, rel_y)), edge_steps[i]);
+                w_or = _mm256_or_si256(w_or, w);
             }
+            const __m256i pixel_x = _mm256_add_epi32(_mm256_set1_epi32(x), lane_x);
+            const __m256i pixel_y = _mm256_add_epi32(_mm256_set1_epi32(y), lane_y);
+            __m256i mask = _mm256_and_si256(_mm256_cmpgt_epi32(pixel_x, min_x),
+                                            _mm256_cmpgt_epi32(max_x, pixel_x));
+            mask = _mm256_and_si256(mask, _mm256_and_si256(_mm256_cmpgt_epi32(pixel_y, min_y),
+                                                           _mm256_cmpgt_epi32(max_y, pixel_y)));
+            mask = _mm256_andnot_si256(_mm256_srai_epi32(w_or, 31), mask);
 
-            // Texture environment - consists of 6 stages of color and alpha combining.
-            //
-            // Color combiners take three input color values from some source (e.g. interpolated
-            // vertex color, texture color, previous stage, etc), perform some very simple
-            // operations on each of them (e.g. inversion) and then calculate the output color
-            // with some basic arithmetic. Alpha combiners can be configured separately but work
-            // analogously.
-            Math::Vec4<u8> combiner_output;
-            for (auto tev_stage : registers.GetTevStages()) {
-                using Source = Regs::TevStageConfig::Source;
-                using ColorModifier = Regs::TevStageConfig::ColorModifier;
-                using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
-                using Operation = Regs::TevStageConfig::Operation;
-
-                auto GetColorSource = [&](Source source) -> Math::Vec3<u8> {
-                    switch (source) {
-                    case Source::PrimaryColor:
-                        return primary_color.rgb();
-
-                    case Source::Texture0:
-                        return texture_color.rgb();
-
-                    case Source::Constant:
-                        return {tev_stage.const_r, tev_stage.const_g, tev_stage.const_b};
-
-                    case Source::Previous:
-                        return combiner_output.rgb();
-
-                    default:
-                        ERROR_LOG(GPU, "Unknown color combiner source %d\n", (int)source);
-                        return {};
-                    }
-                };
+            const int coverage = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+            if (coverage == 0)
+                continue;
 
-                auto GetAlphaSource = [&](Source source) -> u8 {
-                    switch (source) {
-                    case Source::PrimaryColor:
-                        return primary_color.a();
+            __m256 interpolants[NUM_INTERPOLANTS];
+            for (int i = 0; i < NUM_INTERPOLANTS; ++i) {
+                interpolants[i] = _mm256_add_ps(_mm256_set1_ps(planes[i].Evaluate(rel_x, rel_y)),
+                                                plane_steps[i]);
+            }
 
-                    case Source::Texture0:
-                        return texture_color.a();
+            const __m256 w = _mm256_div_ps(_mm256_set1_ps(1.0f),
+                                           interpolants[INTERPOLANT_W_INVERSE]);
+            const __m256 color_scale = _mm256_mul_ps(w, _mm256_set1_ps(255.0f));
+            const __m256i r = _mm256_cvttps_epi32(
+                _mm256_mul_ps(interpolants[INTERPOLANT_R], color_scale));
+            const __m256i g = _mm256_cvttps_epi32(
+                _mm256_mul_ps(interpolants[INTERPOLANT_G], color_scale));
+            const __m256i b = _mm256_cvttps_epi32(
+                _mm256_mul_ps(interpolants[INTERPOLANT_B], color_scale));
+            const __m256i a = _mm256_cvttps_epi32(
+                _mm256_mul_ps(interpolants[INTERPOLANT_A], color_scale));
+            const __m256i primary_color = _mm256_or_si256(
+                _mm256_or_si256(_mm256_slli_epi32(a, 24),
+                                _mm256_slli_epi32(_mm256_and_si256(r, byte_mask), 16)),
+                _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(g, byte_mask), 8),
+                                _mm256_and_si256(b, byte_mask)));
 
-                    case Source::Constant:
-                        return tev_stage.const_a;
+            __m256i texture_color = _mm256_setzero_si256();
+            if (texturing_enable) {
+                const __m256 u = _mm256_mul_ps(interpolants[INTERPOLANT_U], w);
+                const __m256 v = _mm256_mul_ps(interpolants[INTERPOLANT_V], w);
+                const __m256i s = _mm256_min_epi32(_mm256_max_epi32(
+                    _mm256_cvttps_epi32(_mm256_mul_ps(u, texture_width)),
+                    _mm256_setzero_si256()), max_s);
+                const __m256i t = _mm256_min_epi32(_mm256_max_epi32(
+                    _mm256_cvttps_epi32(_mm256_mul_ps(v, texture_height)),
+                    _mm256_setzero_si256()), max_t);
+                const __m256i indices = _mm256_add_epi32(s, _mm256_mullo_epi32(t, texture_stride));
+                texture_color = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+                                                            (const int*)state.texture_data,
+                                                            indices, mask, 4);
+            }
 
-                    case Source::Previous:
-                        return combiner_output.a();
+            const __m256i color = CombineTev(tev_program, tev_constants, primary_color,
+                                             texture_color);
 
-                    default:
-                        ERROR_LOG(GPU, "Unknown alpha combiner source %d\n", (int)source);
-                        return 0;
+            // Packing works within 128-bit lanes: the low 64 bits of each lane are the depths of
+            // one row
+            const __m256i z = _mm256_cvttps_epi32(_mm256_mul_ps(interpolants[INTERPOLANT_Z],
+                                                                _mm256_set1_ps(65535.0f)));
+            const __m256i depth = _mm256_packus_epi32(
+                _mm256_and_si256(z, _mm256_set1_epi32(0xFFFF)), z);
+
+            u32* color_buffer = (u32*)state.color_buffer + x + y * state.framebuffer_width;
+            u16* depth_buffer = (u16*)state.depth_buffer + x + y * state.framebuffer_width;
+            const __m128i color_rows[2] = {
+                _mm256_castsi256_si128(color), _mm256_extracti128_si256(color, 1)
+            };
+            const __m128i depth_rows[2] = {
+                _mm256_castsi256_si128(depth), _mm256_extracti128_si256(depth, 1)
+            };
+            const __m128i row_masks[2] = {
+                _mm256_castsi256_si128(mask), _mm256_extracti128_si256(mask, 1)
+            };
+            for (int row = 0; row < 2; ++row) {
+                const int row_coverage = (coverage >> (4 * row)) & 0xF;
+                u32* color_row = color_buffer + row * state.framebuffer_width;
+                u16* depth_row = depth_buffer + row * state.framebuffer_width;
+                if (row_coverage == 0xF) {
+                    _mm_storeu_si128((__m128i*)color_row, color_rows[row]);
+                    _mm_storel_epi64((__m128i*)depth_row, depth_rows[row]);
+                } else if (row_coverage != 0) {
+                    _mm_maskstore_epi32((int*)color_row, row_masks[row], color_rows[row]);
+                    u16 depths[8];
+                    _mm_storeu_si128((__m128i*)depths, depth_rows[row]);
+                    for (int i = 0; i < 4; ++i) {
+                        if (row_coverage & (1 << i)) {
+                            depth_row[i] = depths[i];
+                        }
                     }
-                };
+                }
+            }
+        }
+    }
+}
 
-                auto GetColorModifier = [](ColorModifier factor, const Math::Vec3<u8>& values) -> Math::Vec3<u8> {
-                    switch (factor)
-                    {
-                    case ColorModifier::SourceColor:
-                        return values;
-                    default:
-                        ERROR_LOG(GPU, "Unknown color factor %d\n", (int)factor);
-                        return {};
+#endif // defined(_M_X64) || defined(_M_IX86)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Rasterizes the part of a triangle within a rectangle of pixels
+ * @param triangle Triangle to rasterize
+ * @param state Render state of the triangle
+ * @param rect_x0 First pixel of the rectangle in x, block aligned
+ * @param rect_y0 First pixel of the rectangle in y, block aligned
+ * @param rect_x1 Pixel past the end of the rectangle in x
+ * @param rect_y1 Pixel past the end of the rectangle in y
+ */
+static void RasterizeTriangle(const Triangle& triangle, const RenderState& state,
+                              int rect_x0, int rect_y0, int rect_x1, int rect_y1) {
+    const EdgeFunction* edges = triangle.edges;
+    const Plane* planes = triangle.planes;
+    const int origin_x = triangle.origin_x;
+    const int origin_y = triangle.origin_y;
+
+    const bool vectorize = (g_shade_block != nullptr && state.tev_program.supported);
+
+    // Pixels of the bounding box within the rectangle
+    const int begin_x = std::max(triangle.begin_x, rect_x0);
+    const int begin_y = std::max(triangle.begin_y, rect_y0);
+    const int end_x = std::min(triangle.end_x, rect_x1);
+    const int end_y = std::min(triangle.end_y, rect_y1);
+
+    // Blocks entirely outside of an edge are skipped, blocks entirely inside all edges are filled
+    // without testing each pixel, and only the remaining ones along the edges are tested per pixel
+    for (int block_y = begin_y & ~(kBlockSize - 1); block_y < end_y; block_y += kBlockSize) {
+        for (int block_x = begin_x & ~(kBlockSize - 1); block_x < end_x; block_x += kBlockSize) {
+            bool outside = false;
+            bool inside = true;
+            for (int i = 0; i < 3; ++i) {
+                const int w = edges[i].Evaluate(block_x - origin_x, block_y - origin_y);
+                outside |= (w + edges[i].block_max < 0);
+                inside &= (w + edges[i].block_min >= 0);
+            }
+            if (outside)
+                continue;
+
+            // Part of the block within the bounding box
+            const int x0 = std::max(block_x, begin_x);
+            const int y0 = std::max(block_y, begin_y);
+            const int x1 = std::min(block_x + kBlockSize, end_x);
+            const int y1 = std::min(block_y + kBlockSize, end_y);
+
+            if (vectorize) {
+                g_shade_block(triangle, state, x0, y0, x1, y1);
+                continue;
+            }
+
+            for (int y = y0; y < y1; ++y) {
+                int w0 = edges[0].Evaluate(x0 - origin_x, y - origin_y);
+                int w1 = edges[1].Evaluate(x0 - origin_x, y - origin_y);
+                int w2 = edges[2].Evaluate(x0 - origin_x, y - origin_y);
+
+                float interpolants[NUM_INTERPOLANTS];
+                for (int i = 0; i < NUM_INTERPOLANTS; ++i) {
+                    interpolants[i] = planes[i].Evaluate(x0 - origin_x, y - origin_y);
+                }
+
+                for (int x = x0; x < x1; ++x) {
+                    // If current pixel is covered by the current primitive
+                    if (inside || (w0 | w1 | w2) >= 0) {
+                        ShadePixel(state, x, y, interpolants);
                     }
-                };
 
-                auto GetAlphaModifier = [](AlphaModifier factor, u8 value) -> u8 {
-                    switch (factor) {
-                    case AlphaModifier::SourceAlpha:
-                        return value;
-                    default:
-                        ERROR_LOG(GPU, "Unknown color factor %d\n", (int)factor);
-                        return 0;
+                    w0 += edges[0].dx;
+                    w1 += edges[1].dx;
+                    w2 += edges[2].dx;
+                    for (int i = 0; i < NUM_INTERPOLANTS; ++i) {
+                        interpolants[i] += planes[i].dx;
                     }
-                };
+                }
+            }
+        }
+    }
+}
 
-                auto ColorCombine = [](Operation op, const Math::Vec3<u8> input[3]) -> Math::Vec3<u8> {
-                    switch (op) {
-                    case Operation::Replace:
-                        return input[0];
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Tile binning
 
-                    case Operation::Modulate:
-                        return ((input[0] * input[1]) / 255).Cast<u8>();
+static const int kTileSize = 32;                ///< Size of the screen tiles, in pixels
+static const int kMaxTilesX = 2048 / kTileSize; ///< Tiles in a row of the largest framebuffer
+static const int kMaxTilesY = 1024 / kTileSize; ///< Tiles in a column of the largest framebuffer
 
-                    default:
-                        ERROR_LOG(GPU, "Unknown color combiner operation %d\n", (int)op);
-                        return {};
-                    }
-                };
+static const size_t kMaxBatchTriangles = 4096;  ///< Triangles binned before a batch is dispatched
 
-                auto AlphaCombine = [](Operation op, const std::array<u8,3>& input) -> u8 {
-                    switch (op) {
-                    case Operation::Replace:
-                        return input[0];
+static_assert(kTileSize % kBlockSize == 0, "Tiles must be made of whole blocks");
 
-                    case Operation::Modulate:
-                        return input[0] * input[1] / 255;
+/// Triangles submitted since the last dispatch, binned into the screen tiles they overlap
+struct Batch {
+    std::vector<RenderState> states;
+    std::vector<Triangle> triangles;
+    std::vector<u32> bins[kMaxTilesX * kMaxTilesY]; ///< Triangles overlapping each tile, in order
+    std::vector<int> used_tiles;                    ///< Tiles with a non-empty bin
 
-                    default:
-                        ERROR_LOG(GPU, "Unknown alpha combiner operation %d\n", (int)op);
-                        return 0;
-                    }
-                };
+    void Clear() {
+        for (int tile : used_tiles) {
+            bins[tile].clear();
+        }
+        used_tiles.clear();
+        triangles.clear();
+        states.clear();
+    }
+};
 
-                // color combiner
-                // NOTE: Not sure if the alpha combiner might use the color output of the previous
-                //       stage as input. Hence, we currently don't directly write the result to
-                //       combiner_output.rgb(), but instead store it in a temporary variable until
-                //       alpha combining has been done.
-                Math::Vec3<u8> color_result[3] = {
-                    GetColorModifier(tev_stage.color_modifier1, GetColorSource(tev_stage.color_source1)),
-                    GetColorModifier(tev_stage.color_modifier2, GetColorSource(tev_stage.color_source2)),
-                    GetColorModifier(tev_stage.color_modifier3, GetColorSource(tev_stage.color_source3))
-                };
-                auto color_output = ColorCombine(tev_stage.color_op, color_result);
+static std::unique_ptr<Common::ThreadPool> g_pool;  ///< Rasterizes tiles, if enabled
+static std::unique_ptr<Batch> g_batches[2];         ///< Binned batch, and batch being rasterized
+static int g_current_batch;                         ///< Index of the batch triangles are binned in
 
-                // alpha combiner
-                std::array<u8,3> alpha_result = {
-                    GetAlphaModifier(tev_stage.alpha_modifier1, GetAlphaSource(tev_stage.alpha_source1)),
-                    GetAlphaModifier(tev_stage.alpha_modifier2, GetAlphaSource(tev_stage.alpha_source2)),
-                    GetAlphaModifier(tev_stage.alpha_modifier3, GetAlphaSource(tev_stage.alpha_source3))
-                };
-                auto alpha_output = AlphaCombine(tev_stage.alpha_op, alpha_result);
+/**
+ * Checks if a rectangle of pixels is entirely outside of an edge of a triangle
+ * @param triangle Triangle to check
+ * @param x0 First pixel of the rectangle in x
+ * @param y0 First pixel of the rectangle in y
+ * @param x1 Pixel past the end of the rectangle in x
+ * @param y1 Pixel past the end of the rectangle in y
+ * @return True if no pixel of the rectangle is covered by the triangle
+ */
+static bool IsOutside(const Triangle& triangle, int x0, int y0, int x1, int y1) {
+    for (const auto& edge : triangle.edges) {
+        const int w = edge.Evaluate(x0 - triangle.origin_x, y0 - triangle.origin_y) +
+                      std::max(0, edge.dx * (x1 - 1 - x0)) + std::max(0, edge.dy * (y1 - 1 - y0));
+        if (w < 0)
+            return true;
+    }
+    return false;
+}
+
+/// Rasterizes the batch triangles were binned in on the worker threads
+static void Dispatch() {
+    // The previous batch must be done before its tiles are reused
+    g_pool->WaitForIdle();
 
-                combiner_output = Math::MakeVec(color_output, alpha_output);
+    Batch* batch = g_batches[g_current_batch].get();
+    g_current_batch ^= 1;
+    g_batches[g_current_batch]->Clear();
+
+    // One task per tile, which rasterizes its triangles in the order they were submitted
+    for (int tile : batch->used_tiles) {
+        g_pool->Push([batch, tile] {
+            const int x0 = (tile % kMaxTilesX) * kTileSize;
+            const int y0 = (tile / kMaxTilesX) * kTileSize;
+            for (u32 index : batch->bins[tile]) {
+                const Triangle& triangle = batch->triangles[index];
+                const RenderState& state = batch->states[triangle.state];
+                RasterizeTriangle(triangle, state, x0, y0,
+                                  std::min(x0 + kTileSize, state.framebuffer_width),
+                                  std::min(y0 + kTileSize, state.framebuffer_height));
             }
+        });
+    }
+}
 
-            // TODO: Not sure if the multiplication by 65535 has already been taken care
-            // of when transforming to screen coordinates or not.
-            u16 z = (u16)(((float)v0.screenpos[2].ToFloat32() * w0 +
-                           (float)v1.screenpos[2].ToFloat32() * w1 +
-                           (float)v2.screenpos[2].ToFloat32() * w2) * 65535.f / wsum);
-            SetDepth(x >> 4, y >> 4, z);
+/**
+ * Adds a triangle to the bins of the tiles it overlaps
+ * @param triangle Triangle to add
+ */
+static void BinTriangle(Triangle& triangle) {
+    // Captured first, since capturing may dispatch the current batch
+    RenderState state = RenderState();
+    CaptureRenderState(state);
 
-            DrawPixel(x >> 4, y >> 4, combiner_output);
+    // Consecutive triangles usually share their render state
+    Batch* batch = g_batches[g_current_batch].get();
+    if (batch->states.empty() || memcmp(&batch->states.back(), &state, sizeof(state)) != 0) {
+        batch->states.push_back(state);
+    }
+    triangle.state = batch->states.size() - 1;
+
+    const int tile_x0 = triangle.begin_x / kTileSize;
+    const int tile_y0 = triangle.begin_y / kTileSize;
+    const int tile_x1 = std::min((std::min(triangle.end_x, state.framebuffer_width) + kTileSize - 1) /
+                                 kTileSize, kMaxTilesX);
+    const int tile_y1 = std::min((std::min(triangle.end_y, state.framebuffer_height) + kTileSize - 1) /
+                                 kTileSize, kMaxTilesY);
+
+    const u32 index = (u32)batch->triangles.size();
+    batch->triangles.push_back(triangle);
+    for (int tile_y = tile_y0; tile_y < tile_y1; ++tile_y) {
+        for (int tile_x = tile_x0; tile_x < tile_x1; ++tile_x) {
+            const int x0 = tile_x * kTileSize;
+            const int y0 = tile_y * kTileSize;
+            if (IsOutside(triangle, x0, y0, x0 + kTileSize, y0 + kTileSize))
+                continue;
+
+            const int tile = tile_x + tile_y * kMaxTilesX;
+            if (batch->bins[tile].empty()) {
+                batch->used_tiles.push_back(tile);
+            }
+            batch->bins[tile].push_back(index);
         }
     }
+
+    if (batch->triangles.size() >= kMaxBatchTriangles) {
+        Dispatch();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ProcessTriangle(const VertexShader::OutputVertex& v0,
+                     const VertexShader::OutputVertex& v1,
+                     const VertexShader::OutputVertex& v2)
+{
+    Triangle triangle;
+    if (!SetupTriangle(v0, v1, v2, triangle))
+        return;
+
+    if (g_pool) {
+        BinTriangle(triangle);
+        return;
+    }
+
+    // TODO: Proper scissor rect test! Pixels outside of the framebuffer are dropped for now.
+    RenderState state = RenderState();
+    CaptureRenderState(state);
+    RasterizeTriangle(triangle, state, 0, 0, state.framebuffer_width, state.framebuffer_height);
+}
+
+/// Waits until every triangle submitted so far is written to the color and depth buffers
+void Flush() {
+    if (g_pool) {
+        Dispatch();
+        g_pool->WaitForIdle();
+    }
+}
+
+/// Initializes the rasterizer, starting its worker threads if enabled
+void Init() {
+#if defined(_M_X64) || defined(_M_IX86)
+    if (cpu_info.bAVX2) {
+        g_shade_block = ShadeBlockAVX2;
+    } else if (cpu_info.bSSE4_1) {
+        g_shade_block = ShadeBlockSSE41;
+    }
+#endif
+
+    g_current_batch = 0;
+    if (Settings::values.num_rasterizer_threads > 0) {
+        g_pool.reset(new Common::ThreadPool(Settings::values.num_rasterizer_threads));
+        g_batches[0].reset(new Batch);
+        g_batches[1].reset(new Batch);
+    }
+}
+
+/// Flushes pending triangles and stops the worker threads
+void Shutdown() {
+    Flush();
+    g_pool.reset();
+    g_batches[0].reset();
+    g_batches[1].reset();
 }
 
 } // namespace Rasterizer
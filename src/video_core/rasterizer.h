@@ -12,10 +12,26 @@ namespace VertexShader {
 
 namespace Rasterizer {
 
+/**
+ * Rasterizes a triangle into the current color and depth buffers. With worker threads enabled,
+ * the triangle is only binned into screen tiles and written to the buffers later on: see Flush.
+ */
 void ProcessTriangle(const VertexShader::OutputVertex& v0,
                      const VertexShader::OutputVertex& v1,
                      const VertexShader::OutputVertex& v2);
 
+/**
+ * Waits until every triangle submitted so far is written to the color and depth buffers. Must be
+ * called before they are read (display transfers, memory fills, or by the application).
+ */
+void Flush();
+
+/// Initializes the rasterizer, starting its worker threads if enabled
+void Init();
+
+/// Flushes pending triangles and stops the worker threads
+void Shutdown();
+
 } // namespace Rasterizer
 
 } // namespace Pica
@@ -0,0 +1,92 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <vector>
+
+#include "common/file_util.h"
+
+#include "core/mem_map.h"
+#include "core/hw/gpu.h"
+
+#include "video_core/video_core.h"
+#include "video_core/renderer_null/renderer_null.h"
+
+/// RendererNull constructor
+RendererNull::RendererNull() {
+}
+
+/// RendererNull destructor
+RendererNull::~RendererNull() {
+}
+
+/// Swap buffers (render frame)
+void RendererNull::SwapBuffers() {
+    m_current_frame++;
+}
+
+/**
+ * Set the emulator window to use for renderer
+ * @param window EmuWindow handle to emulator window to use for rendering, may be nullptr
+ */
+void RendererNull::SetWindow(EmuWindow* window) {
+}
+
+/// Initialize the renderer
+void RendererNull::Init() {
+    NOTICE_LOG(RENDER, "initialized OK");
+}
+
+/// Shutdown the renderer
+void RendererNull::ShutDown() {
+}
+
+/**
+ * Writes the framebuffer currently displayed on the top screen to an uncompressed TGA file
+ * @param filename Path of the file to write
+ * @return True on success
+ */
+bool RendererNull::DumpTopScreen(const std::string& filename) const {
+    const auto& framebuffer_top = GPU::g_regs.framebuffer_config[0];
+    const u32 active_fb_top = (framebuffer_top.active_fb == 1)
+                            ? Memory::PhysicalToVirtualAddress(framebuffer_top.address_left2)
+                            : Memory::PhysicalToVirtualAddress(framebuffer_top.address_left1);
+    const u8* raw_data = Memory::GetPointer(active_fb_top);
+    if (raw_data == nullptr) {
+        ERROR_LOG(RENDER, "DumpTopScreen: framebuffer 0x%08x is not mapped", active_fb_top);
+        return false;
+    }
+
+    const int width = VideoCore::kScreenTopWidth;
+    const int height = VideoCore::kScreenTopHeight;
+
+    // Same layout as RendererOpenGL::FlipFramebuffer: the framebuffer is stored rotated, one
+    // column of BGR pixels after the other, starting from the bottom of the screen. TGA images are
+    // stored bottom-up with BGR pixels, so the columns are copied as they are.
+    std::vector<u8> image(18 + width * height * 3, 0);
+    u8* header = image.data();
+    header[2] = 2; // Uncompressed true-color
+    header[12] = width & 0xFF;
+    header[13] = width >> 8;
+    header[14] = height & 0xFF;
+    header[15] = height >> 8;
+    header[16] = 24; // Bits per pixel
+
+    u8* pixels = image.data() + 18;
+    for (int x = 0; x < width; x++) {
+        const u8* column = raw_data + x * framebuffer_top.stride;
+        for (int y = 0; y < height; y++) {
+            u8* out = pixels + (x + y * width) * 3;
+            out[0] = column[y * 3];
+            out[1] = column[y * 3 + 1];
+            out[2] = column[y * 3 + 2];
+        }
+    }
+
+    File::IOFile file(filename, "wb");
+    if (!file.IsOpen() || !file.WriteBytes(image.data(), image.size())) {
+        ERROR_LOG(RENDER, "DumpTopScreen: failed to write %s", filename.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common.h"
+#include "common/emu_window.h"
+
+#include "video_core/renderer_base.h"
+
+/**
+ * Renderer that doesn't draw anything, used to run the emulator without a window or an OpenGL
+ * context (e.g. for benchmarking). It only counts frames, and can save the last displayed top
+ * screen framebuffer to a file.
+ */
+class RendererNull : virtual public RendererBase {
+public:
+
+    RendererNull();
+    ~RendererNull();
+
+    /// Swap buffers (render frame)
+    void SwapBuffers();
+
+    /**
+     * Set the emulator window to use for renderer
+     * @param window EmuWindow handle to emulator window to use for rendering, may be nullptr
+     */
+    void SetWindow(EmuWindow* window);
+
+    /// Initialize the renderer
+    void Init();
+
+    /// Shutdown the renderer
+    void ShutDown();
+
+    /**
+     * Writes the framebuffer currently displayed on the top screen to an uncompressed TGA file
+     * @param filename Path of the file to write
+     * @return True on success
+     */
+    bool DumpTopScreen(const std::string& filename) const;
+
+};
@@ -247,6 +247,10 @@ void RendererOpenGL::SetWindow(EmuWindow* window) {
 void RendererOpenGL::Init() {
     render_window->MakeCurrent();
 
+    // Required in order for GLFW to work on Linux, 
+    // or for GL contexts above 2.x on OS X
+    glewExperimental = GL_TRUE;
+
     GLenum err = glewInit();
     if (GLEW_OK != err) {
         ERROR_LOG(RENDER, "Failed to initialize GLEW! Error message: \"%s\". Exiting...",
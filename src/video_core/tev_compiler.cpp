@@ -0,0 +1,335 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <cstring>
+#include <unordered_map>
+
+#include "common/hash.h"
+
+#include "pica.h"
+#include "tev_compiler.h"
+
+namespace Pica {
+
+namespace TevCompiler {
+
+static const u32 kColorMask = 0x00FFFFFF;   ///< Color channels of a BGRA8 value
+static const u32 kAlphaMask = 0xFF000000;   ///< Alpha channel of a BGRA8 value
+
+/**
+ * Translates the source of a configured stage input
+ * @param source Source of the input
+ * @param input Receives the input of the compiled stage
+ * @return False if the source isn't supported
+ */
+static bool TranslateSource(Regs::TevStageConfig::Source source, Input& input) {
+    using Source = Regs::TevStageConfig::Source;
+
+    switch (source) {
+    case Source::PrimaryColor:
+        input = Input::PrimaryColor;
+        return true;
+
+    case Source::Texture0:
+        input = Input::Texture0;
+        return true;
+
+    case Source::Constant:
+        input = Input::Constant;
+        return true;
+
+    case Source::Previous:
+        input = Input::Previous;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static bool ModulatesColor(Operation op) {
+    return op == Operation::Modulate || op == Operation::ModulateColor;
+}
+
+static bool ModulatesAlpha(Operation op) {
+    return op == Operation::Modulate || op == Operation::ModulateAlpha;
+}
+
+/// Multiplies the channels of two BGRA8 values, dividing the products by 255
+static u32 Modulate(u32 a, u32 b) {
+    u32 result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        result |= (((a >> shift) & 0xFF) * ((b >> shift) & 0xFF) / 255) << shift;
+    }
+    return result;
+}
+
+/**
+ * Evaluates a compiled stage
+ * @param stage Stage to evaluate
+ * @param primary_color Primary color, as BGRA8
+ * @param texture_color Texture color, as BGRA8
+ * @param previous Output of the previous stage, as BGRA8
+ * @return Output of the stage, as BGRA8
+ */
+static u32 EvaluateStage(const Stage& stage, u32 primary_color, u32 texture_color, u32 previous) {
+    u32 inputs[2];
+    for (int i = 0; i < 2; ++i) {
+        const u32 sources[] = { primary_color, texture_color, stage.constants[i], previous };
+        inputs[i] = (sources[(int)stage.color_inputs[i]] & kColorMask) |
+                    (sources[(int)stage.alpha_inputs[i]] & kAlphaMask);
+    }
+
+    switch (stage.op) {
+    case Operation::Replace:
+        return inputs[0];
+
+    case Operation::Modulate:
+        return Modulate(inputs[0], inputs[1]);
+
+    case Operation::ModulateColor:
+        return (Modulate(inputs[0], inputs[1]) & kColorMask) | (inputs[0] & kAlphaMask);
+
+    case Operation::ModulateAlpha:
+        return (inputs[0] & kColorMask) | (Modulate(inputs[0], inputs[1]) & kAlphaMask);
+    }
+    return 0;
+}
+
+/**
+ * Simplifies the product of the color or alpha channels of the inputs of a stage, if one of them
+ * is a constant 0 or 1
+ * @param inputs Sources of the channels of the inputs
+ * @param constants Constant values of the inputs
+ * @param mask Mask of the channels in the BGRA8 values
+ * @return False if the product was replaced by the first input
+ */
+static bool SimplifyModulate(Input inputs[2], u32 constants[2], u32 mask) {
+    auto IsConstant = [&](int i, u32 value) {
+        return inputs[i] == Input::Constant && (constants[i] & mask) == (value & mask);
+    };
+
+    if (IsConstant(1, 0xFFFFFFFF))
+        return false;
+
+    if (IsConstant(0, 0xFFFFFFFF)) {
+        inputs[0] = inputs[1];
+        constants[0] = (constants[0] & ~mask) | (constants[1] & mask);
+        return false;
+    }
+
+    if (IsConstant(0, 0) || IsConstant(1, 0)) {
+        inputs[0] = Input::Constant;
+        constants[0] &= ~mask;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Compiles a texture environment configuration
+ * @param tev_stages Configuration of the six stages
+ * @param program Receives the compiled program
+ */
+void Compile(const std::array<Regs::TevStageConfig, 6>& tev_stages, Program& program) {
+    using ColorModifier = Regs::TevStageConfig::ColorModifier;
+    using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
+    using TevOperation = Regs::TevStageConfig::Operation;
+
+    memset(&program, 0, sizeof(program));
+
+    // Output of the stages so far, if it is known at compile time. The interpreted combiner leaves
+    // the input of the first stage undefined, zero is as good as anything.
+    bool previous_known = true;
+    u32 previous = 0;
+
+    for (const auto& tev_stage : tev_stages) {
+        // The third inputs aren't used by Replace and Modulate, but configurations with unknown
+        // sources are left to the interpreted combiner, which reports them
+        Stage stage;
+        Input unused_input;
+        if (!TranslateSource(tev_stage.color_source1, stage.color_inputs[0]) ||
+            !TranslateSource(tev_stage.color_source2, stage.color_inputs[1]) ||
+            !TranslateSource(tev_stage.color_source3, unused_input) ||
+            !TranslateSource(tev_stage.alpha_source1, stage.alpha_inputs[0]) ||
+            !TranslateSource(tev_stage.alpha_source2, stage.alpha_inputs[1]) ||
+            !TranslateSource(tev_stage.alpha_source3, unused_input))
+            return;
+
+        if (tev_stage.color_modifier1 != ColorModifier::SourceColor ||
+            tev_stage.color_modifier2 != ColorModifier::SourceColor ||
+            tev_stage.color_modifier3 != ColorModifier::SourceColor ||
+            tev_stage.alpha_modifier1 != AlphaModifier::SourceAlpha ||
+            tev_stage.alpha_modifier2 != AlphaModifier::SourceAlpha ||
+            tev_stage.alpha_modifier3 != AlphaModifier::SourceAlpha)
+            return;
+
+        auto IsSupported = [](TevOperation op) {
+            return op == TevOperation::Replace || op == TevOperation::Modulate;
+        };
+        if (!IsSupported(tev_stage.color_op) || !IsSupported(tev_stage.alpha_op))
+            return;
+
+        const u32 constant = (tev_stage.const_a << 24) | (tev_stage.const_r << 16) |
+                             (tev_stage.const_g << 8) | tev_stage.const_b;
+        for (int i = 0; i < 2; ++i) {
+            if (previous_known && stage.color_inputs[i] == Input::Previous) {
+                stage.color_inputs[i] = Input::Constant;
+                stage.constants[i] = previous & kColorMask;
+            } else {
+                stage.constants[i] = constant & kColorMask;
+            }
+            if (previous_known && stage.alpha_inputs[i] == Input::Previous) {
+                stage.alpha_inputs[i] = Input::Constant;
+                stage.constants[i] |= previous & kAlphaMask;
+            } else {
+                stage.constants[i] |= constant & kAlphaMask;
+            }
+        }
+
+        bool color_modulate = (tev_stage.color_op == TevOperation::Modulate);
+        bool alpha_modulate = (tev_stage.alpha_op == TevOperation::Modulate);
+        if (color_modulate) {
+            color_modulate = SimplifyModulate(stage.color_inputs, stage.constants, kColorMask);
+        }
+        if (alpha_modulate) {
+            alpha_modulate = SimplifyModulate(stage.alpha_inputs, stage.constants, kAlphaMask);
+        }
+        if (color_modulate) {
+            stage.op = alpha_modulate ? Operation::Modulate : Operation::ModulateColor;
+        } else {
+            stage.op = alpha_modulate ? Operation::ModulateAlpha : Operation::Replace;
+        }
+
+        // Stages passing the previous output through are removed
+        if (stage.op == Operation::Replace && stage.color_inputs[0] == Input::Previous &&
+            stage.alpha_inputs[0] == Input::Previous)
+            continue;
+
+        // Stages of which every used input is constant are evaluated now
+        if (stage.color_inputs[0] == Input::Constant && stage.alpha_inputs[0] == Input::Constant &&
+            (!color_modulate || stage.color_inputs[1] == Input::Constant) &&
+            (!alpha_modulate || stage.alpha_inputs[1] == Input::Constant)) {
+            previous = EvaluateStage(stage, 0, 0, 0);
+            previous_known = true;
+            continue;
+        }
+
+        program.stages[program.num_stages++] = stage;
+        previous_known = false;
+    }
+
+    program.supported = true;
+    if (previous_known) {
+        // The output doesn't depend on any of the remaining stages
+        program.num_stages = 0;
+        program.constant_output = previous;
+        return;
+    }
+
+    // Stages whose output isn't read by the following ones are removed, going backwards from the
+    // last one, whose whole output is used
+    bool color_used = true;
+    bool alpha_used = true;
+    bool used[6];
+    for (int i = program.num_stages - 1; i >= 0; --i) {
+        const Stage& stage = program.stages[i];
+        used[i] = color_used || alpha_used;
+
+        color_used = color_used && (stage.color_inputs[0] == Input::Previous ||
+            (ModulatesColor(stage.op) && stage.color_inputs[1] == Input::Previous));
+        alpha_used = alpha_used && (stage.alpha_inputs[0] == Input::Previous ||
+            (ModulatesAlpha(stage.op) && stage.alpha_inputs[1] == Input::Previous));
+    }
+
+    int num_stages = 0;
+    for (int i = 0; i < program.num_stages; ++i) {
+        if (!used[i])
+            continue;
+
+        const Stage& stage = program.stages[i];
+        program.stages[num_stages++] = stage;
+        program.uses_texture0 |=
+            stage.color_inputs[0] == Input::Texture0 || stage.alpha_inputs[0] == Input::Texture0 ||
+            (ModulatesColor(stage.op) && stage.color_inputs[1] == Input::Texture0) ||
+            (ModulatesAlpha(stage.op) && stage.alpha_inputs[1] == Input::Texture0);
+    }
+    program.num_stages = num_stages;
+}
+
+/**
+ * Evaluates a program for a pixel
+ * @param program Program to evaluate
+ * @param primary_color Primary color of the pixel, as BGRA8
+ * @param texture_color Texture color of the pixel, as BGRA8
+ * @return Output color, as BGRA8
+ */
+u32 Evaluate(const Program& program, u32 primary_color, u32 texture_color) {
+    u32 previous = program.constant_output;
+    for (int i = 0; i < program.num_stages; ++i) {
+        previous = EvaluateStage(program.stages[i], primary_color, texture_color, previous);
+    }
+    return previous;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Program cache
+
+/// Programs are dropped once there are this many, e.g. when a constant is animated
+static const size_t kMaxCachedPrograms = 256;
+
+struct CacheEntry {
+    u32 config[sizeof(std::array<Regs::TevStageConfig, 6>) / sizeof(u32)];  ///< Configuration
+    Program program;
+};
+
+static std::unordered_map<u64, CacheEntry> g_cache;    ///< Compiled programs, by config hash
+static Program g_program;                               ///< Program of the current configuration
+static bool g_program_valid = false;                    ///< Whether g_program is up to date
+
+/// Returns the program of the current TEV configuration, compiling it if it isn't cached yet
+const Program& GetProgram() {
+    if (g_program_valid)
+        return g_program;
+
+    const auto tev_stages = registers.GetTevStages();
+    const u64 hash = GetMurmurHash3((const u8*)&tev_stages, sizeof(tev_stages), 0);
+
+    auto it = g_cache.find(hash);
+    if (it == g_cache.end() || memcmp(it->second.config, &tev_stages, sizeof(tev_stages)) != 0) {
+        if (g_cache.size() >= kMaxCachedPrograms) {
+            g_cache.clear();
+        }
+        CacheEntry& entry = g_cache[hash];
+        memcpy(entry.config, &tev_stages, sizeof(tev_stages));
+        Compile(tev_stages, entry.program);
+        it = g_cache.find(hash);
+    }
+
+    g_program = it->second.program;
+    g_program_valid = true;
+    return g_program;
+}
+
+/**
+ * Marks the current program outdated if a TEV register changed
+ * @param id Index of the register which was written with a new value
+ */
+void OnRegisterChanged(u32 id) {
+    static const u32 stage_ids[] = {
+        PICA_REG_INDEX(tev_stage0), PICA_REG_INDEX(tev_stage1), PICA_REG_INDEX(tev_stage2),
+        PICA_REG_INDEX(tev_stage3), PICA_REG_INDEX(tev_stage4), PICA_REG_INDEX(tev_stage5)
+    };
+    for (u32 stage_id : stage_ids) {
+        if (id >= stage_id && id < stage_id + sizeof(Regs::TevStageConfig) / sizeof(u32)) {
+            g_program_valid = false;
+            return;
+        }
+    }
+}
+
+} // namespace TevCompiler
+
+} // namespace Pica
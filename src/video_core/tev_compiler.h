@@ -0,0 +1,84 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+
+#include "common/common_types.h"
+
+#include "pica.h"
+
+namespace Pica {
+
+/**
+ * Compiles texture environment configurations into short programs evaluated by the rasterizer
+ * instead of the six configured stages: pass-through and unused stages are removed, and stages
+ * whose inputs are known at compile time are folded into constants. Programs are cached by a hash
+ * of the configuration, which is only looked up again once a TEV register changes.
+ */
+namespace TevCompiler {
+
+/// Input of a compiled stage
+enum class Input : u8 {
+    PrimaryColor,
+    Texture0,
+    Constant,   ///< Constant of the stage, or output of earlier stages known at compile time
+    Previous,   ///< Output of the previous compiled stage
+};
+
+/// Operation of a compiled stage
+enum class Operation : u8 {
+    Replace,        ///< Outputs the first input
+    Modulate,       ///< Outputs the product of the inputs
+    ModulateColor,  ///< Outputs the product of the color channels and the alpha of the first input
+    ModulateAlpha,  ///< Outputs the color of the first input and the product of the alpha channels
+};
+
+/// Stage of a compiled program. Each input takes its color and alpha channels from two sources.
+struct Stage {
+    Operation op;
+    Input color_inputs[2];  ///< Sources of the color channels of the inputs
+    Input alpha_inputs[2];  ///< Sources of the alpha channel of the inputs
+    u32 constants[2];       ///< Values of the inputs where their source is Constant, as BGRA8
+};
+
+/// Texture environment configuration compiled to a program
+struct Program {
+    bool supported;         ///< False if the configuration uses features only the rasterizer's
+                            ///< interpreted combiner implements
+    bool uses_texture0;     ///< Whether the output depends on the texture color
+    int num_stages;         ///< Number of stages left in the program
+    Stage stages[6];
+    u32 constant_output;    ///< Output of the program, as BGRA8, if no stage is left
+};
+
+/**
+ * Compiles a texture environment configuration
+ * @param tev_stages Configuration of the six stages
+ * @param program Receives the compiled program
+ */
+void Compile(const std::array<Regs::TevStageConfig, 6>& tev_stages, Program& program);
+
+/**
+ * Evaluates a program for a pixel
+ * @param program Program to evaluate
+ * @param primary_color Primary color of the pixel, as BGRA8
+ * @param texture_color Texture color of the pixel, as BGRA8
+ * @return Output color, as BGRA8
+ */
+u32 Evaluate(const Program& program, u32 primary_color, u32 texture_color);
+
+/// Returns the program of the current TEV configuration, compiling it if it isn't cached yet
+const Program& GetProgram();
+
+/**
+ * Marks the current program outdated if a TEV register changed
+ * @param id Index of the register which was written with a new value
+ */
+void OnRegisterChanged(u32 id);
+
+} // namespace TevCompiler
+
+} // namespace Pica
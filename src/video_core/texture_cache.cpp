@@ -0,0 +1,445 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common.h"
+#include "common/hash.h"
+#include "common/math_util.h"
+
+#include "core/mem_map.h"
+
+#include "pica.h"
+#include "texture_cache.h"
+
+#include "debug_utils/debug_utils.h"
+
+namespace Pica {
+
+namespace TextureCache {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Decoding
+
+/**
+ * Images are split into 8x8 tiles. Each tile is composed of four 4x4 subtiles each of which is
+ * composed of four 2x2 subtiles each of which is composed of four texels. Each structure is
+ * embedded into the next-bigger one in a diagonal pattern, e.g. texels are laid out in a 2x2
+ * subtile like this:
+ * 2 3
+ * 0 1
+ *
+ * The full 8x8 tile has the texels arranged like this:
+ *
+ * 42 43 46 47 58 59 62 63
+ * 40 41 44 45 56 57 60 61
+ * 34 35 38 39 50 51 54 55
+ * 32 33 36 37 48 49 52 53
+ * 10 11 14 15 26 27 30 31
+ * 08 09 12 13 24 25 28 29
+ * 02 03 06 07 18 19 22 23
+ * 00 01 04 05 16 17 20 21
+ *
+ * i.e. the bits of the x coordinate are interleaved with those of the y coordinate.
+ */
+static int GetTexelIndexWithinTile(int x, int y) {
+    return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2) | ((x & 4) << 2) |
+           ((y & 4) << 3);
+}
+
+static u32 MakeTexel(u32 r, u32 g, u32 b, u32 a) {
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static u32 Convert4To8(u32 value) {
+    return value * 0x11;
+}
+
+static u32 Convert5To8(u32 value) {
+    return (value << 3) | (value >> 2);
+}
+
+static u32 Convert6To8(u32 value) {
+    return (value << 2) | (value >> 4);
+}
+
+/// Returns the size of a texel of a format in bits, 0 for unknown formats
+static u32 GetBitsPerTexel(Regs::TextureFormat format) {
+    using Format = Regs::TextureFormat;
+
+    switch (format) {
+    case Format::RGBA8:
+        return 32;
+
+    case Format::RGB8:
+        return 24;
+
+    case Format::RGBA5551:
+    case Format::RGB565:
+    case Format::RGBA4:
+    case Format::IA8:
+    case Format::HILO8:
+        return 16;
+
+    case Format::I8:
+    case Format::A8:
+    case Format::IA4:
+    case Format::ETC1A4:
+        return 8;
+
+    case Format::I4:
+    case Format::A4:
+    case Format::ETC1:
+        return 4;
+
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Decodes a 4x4 block of an ETC1 compressed texture
+ * @param block Color data of the block
+ * @param alpha 4-bit alpha values of the texels, in the order of the color data
+ * @param texels Receives the texels of the block, as BGRA8, indexed by x + y * 4
+ */
+static void DecodeETC1Block(u64 block, u64 alpha, u32 texels[16]) {
+    static const int modifier_table[8][2] = {
+        { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+    };
+
+    const bool flip = (block >> 32) & 1;
+    const bool differential_mode = (block >> 33) & 1;
+    const u32 table_indices[2] = { (u32)(block >> 37) & 7, (u32)(block >> 34) & 7 };
+
+    // Base colors of the two halves of the block, split vertically, or horizontally if flipped
+    int base_colors[2][3];
+    for (int channel = 0; channel < 3; ++channel) {
+        const int shift = 59 - channel * 8;     // red, green, blue
+        if (differential_mode) {
+            const int base = (block >> shift) & 0x1F;
+            const int delta = ((int)((block >> (shift - 3)) & 7) ^ 4) - 4;
+            base_colors[0][channel] = Convert5To8(base);
+            base_colors[1][channel] = Convert5To8((base + delta) & 0x1F);
+        } else {
+            base_colors[0][channel] = Convert4To8((block >> (shift + 1)) & 0xF);
+            base_colors[1][channel] = Convert4To8((block >> (shift - 3)) & 0xF);
+        }
+    }
+
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            // Texels are stored column by column
+            const int texel = x * 4 + y;
+            const int half = (flip ? y : x) >= 2;
+
+            int modifier = modifier_table[table_indices[half]][(block >> texel) & 1];
+            if ((block >> (16 + texel)) & 1) {
+                modifier = -modifier;
+            }
+
+            const int* base_color = base_colors[half];
+            texels[x + y * 4] = MakeTexel(MathUtil::Clamp(base_color[0] + modifier, 0, 255),
+                                          MathUtil::Clamp(base_color[1] + modifier, 0, 255),
+                                          MathUtil::Clamp(base_color[2] + modifier, 0, 255),
+                                          Convert4To8((alpha >> (texel * 4)) & 0xF));
+        }
+    }
+}
+
+/**
+ * Decodes an 8x8 tile of an ETC1 or ETC1A4 texture, which is made of four 4x4 blocks
+ * @param source Data of the tile
+ * @param has_alpha Whether each block is preceded by its alpha values (ETC1A4)
+ * @param texels Receives the texels of the tile, as BGRA8, indexed like GetTexelIndexWithinTile
+ */
+static void DecodeETC1Tile(const u8* source, bool has_alpha, u32 texels[64]) {
+    for (int block_index = 0; block_index < 4; ++block_index) {
+        u64 alpha = ~0ULL;
+        if (has_alpha) {
+            memcpy(&alpha, source, sizeof(alpha));
+            source += sizeof(alpha);
+        }
+        u64 block;
+        memcpy(&block, source, sizeof(block));
+        source += sizeof(block);
+
+        u32 block_texels[16];
+        DecodeETC1Block(block, alpha, block_texels);
+
+        const int block_x = (block_index & 1) * 4;
+        const int block_y = (block_index >> 1) * 4;
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                texels[GetTexelIndexWithinTile(block_x + x, block_y + y)] =
+                    block_texels[x + y * 4];
+            }
+        }
+    }
+}
+
+/**
+ * Decodes an 8x8 tile of a texture
+ * @param source Data of the tile
+ * @param format Format of the texture
+ * @param texels Receives the texels of the tile, as BGRA8, indexed like GetTexelIndexWithinTile
+ */
+static void DecodeTile(const u8* source, Regs::TextureFormat format, u32 texels[64]) {
+    using Format = Regs::TextureFormat;
+
+    // Formats are decoded in separate loops, so that the compiler can unroll them
+    switch (format) {
+    case Format::RGBA8:
+        for (int i = 0; i < 64; ++i, source += 4) {
+            texels[i] = MakeTexel(source[3], source[2], source[1], source[0]);
+        }
+        break;
+
+    case Format::RGB8:
+        for (int i = 0; i < 64; ++i, source += 3) {
+            texels[i] = MakeTexel(source[2], source[1], source[0], 0xFF);
+        }
+        break;
+
+    case Format::RGBA5551:
+        for (int i = 0; i < 64; ++i, source += 2) {
+            const u32 value = source[0] | (source[1] << 8);
+            texels[i] = MakeTexel(Convert5To8(value >> 11), Convert5To8((value >> 6) & 0x1F),
+                                  Convert5To8((value >> 1) & 0x1F), (value & 1) ? 0xFF : 0);
+        }
+        break;
+
+    case Format::RGB565:
+        for (int i = 0; i < 64; ++i, source += 2) {
+            const u32 value = source[0] | (source[1] << 8);
+            texels[i] = MakeTexel(Convert5To8(value >> 11), Convert6To8((value >> 5) & 0x3F),
+                                  Convert5To8(value & 0x1F), 0xFF);
+        }
+        break;
+
+    case Format::RGBA4:
+        for (int i = 0; i < 64; ++i, source += 2) {
+            const u32 value = source[0] | (source[1] << 8);
+            texels[i] = MakeTexel(Convert4To8(value >> 12), Convert4To8((value >> 8) & 0xF),
+                                  Convert4To8((value >> 4) & 0xF), Convert4To8(value & 0xF));
+        }
+        break;
+
+    case Format::IA8:
+        for (int i = 0; i < 64; ++i, source += 2) {
+            texels[i] = MakeTexel(source[1], source[1], source[1], source[0]);
+        }
+        break;
+
+    case Format::HILO8:
+        for (int i = 0; i < 64; ++i, source += 2) {
+            texels[i] = MakeTexel(source[1], source[0], 0, 0xFF);
+        }
+        break;
+
+    case Format::I8:
+        for (int i = 0; i < 64; ++i) {
+            texels[i] = MakeTexel(source[i], source[i], source[i], 0xFF);
+        }
+        break;
+
+    case Format::A8:
+        for (int i = 0; i < 64; ++i) {
+            texels[i] = MakeTexel(0, 0, 0, source[i]);
+        }
+        break;
+
+    case Format::IA4:
+        for (int i = 0; i < 64; ++i) {
+            const u32 intensity = Convert4To8(source[i] >> 4);
+            texels[i] = MakeTexel(intensity, intensity, intensity, Convert4To8(source[i] & 0xF));
+        }
+        break;
+
+    // 4-bit formats store the even texels in the low nibbles
+    case Format::I4:
+        for (int i = 0; i < 64; ++i) {
+            const u32 intensity = Convert4To8((source[i / 2] >> ((i & 1) * 4)) & 0xF);
+            texels[i] = MakeTexel(intensity, intensity, intensity, 0xFF);
+        }
+        break;
+
+    case Format::A4:
+        for (int i = 0; i < 64; ++i) {
+            texels[i] = MakeTexel(0, 0, 0, Convert4To8((source[i / 2] >> ((i & 1) * 4)) & 0xF));
+        }
+        break;
+
+    case Format::ETC1:
+    case Format::ETC1A4:
+        DecodeETC1Tile(source, format == Format::ETC1A4, texels);
+        break;
+
+    default:
+        memset(texels, 0, 64 * sizeof(u32));
+        break;
+    }
+}
+
+/**
+ * Decodes a texture into a linear image
+ * @param source Data of the texture
+ * @param width Width of the texture in texels
+ * @param height Height of the texture in texels
+ * @param format Format of the texture
+ * @param texels Receives the texels row by row, as BGRA8
+ */
+static void DecodeTexture(const u8* source, int width, int height, Regs::TextureFormat format,
+                          u32* texels) {
+    const u32 tile_size = 64 * GetBitsPerTexel(format) / 8;
+
+    for (int tile_y = 0; tile_y < height; tile_y += 8) {
+        for (int tile_x = 0; tile_x < width; tile_x += 8, source += tile_size) {
+            u32 tile[64];
+            DecodeTile(source, format, tile);
+
+            // Sizes are multiples of 8 on hardware, partial tiles are clipped just in case
+            const int tile_width = std::min(8, width - tile_x);
+            const int tile_height = std::min(8, height - tile_y);
+            for (int y = 0; y < tile_height; ++y) {
+                u32* row = texels + tile_x + (tile_y + y) * width;
+                for (int x = 0; x < tile_width; ++x) {
+                    row[x] = tile[GetTexelIndexWithinTile(x, y)];
+                }
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Texture cache
+
+/// Textures are dropped once they take up this many bytes, e.g. when videos are streamed
+static const size_t kMaxCachedBytes = 64 * 1024 * 1024;
+
+struct CacheEntry {
+    u32 width;
+    u32 height;
+    u64 hash;           ///< Hash of the memory the texels were decoded from
+    u32 generation;     ///< Value of g_generation when the hash was last checked
+    std::vector<u32> texels;
+};
+
+static std::unordered_map<u64, CacheEntry> g_cache;     ///< Decoded textures, by address and format
+static size_t g_cached_bytes = 0;                       ///< Size of the decoded textures
+static u32 g_generation = 0;                            ///< Incremented by OnMemoryChanged
+
+/// Returns the key of the cache entry of a texture
+static u64 GetKey(const Regs::TextureConfig& config, Regs::TextureFormat format) {
+    return ((u64)format << 32) | config.GetPhysicalAddress();
+}
+
+/**
+ * Looks up a decoded texture without touching its memory
+ * @param config Configuration of the texture
+ * @param format Format of the texture
+ * @return Texels of the texture row by row, as BGRA8, or nullptr if the texture isn't cached or
+ *         has to be checked against its memory first: see Load
+ */
+const u32* Lookup(const Regs::TextureConfig& config, Regs::TextureFormat format) {
+    auto it = g_cache.find(GetKey(config, format));
+    if (it == g_cache.end())
+        return nullptr;
+
+    const CacheEntry& entry = it->second;
+    if (entry.generation != g_generation || entry.width != config.width ||
+        entry.height != config.height)
+        return nullptr;
+
+    return entry.texels.data();
+}
+
+/**
+ * Decodes a texture, unless it is cached and its memory didn't change since. Texels returned
+ * earlier by Lookup or Load may be freed or overwritten.
+ * @param config Configuration of the texture
+ * @param format Format of the texture
+ * @return Texels of the texture row by row, as BGRA8, or nullptr if it can't be decoded
+ */
+const u32* Load(const Regs::TextureConfig& config, Regs::TextureFormat format) {
+    const u32* texels = Lookup(config, format);
+    if (texels != nullptr)
+        return texels;
+
+    const u32 width = config.width;
+    const u32 height = config.height;
+    const u32 bits_per_texel = GetBitsPerTexel(format);
+    if (bits_per_texel == 0) {
+        ERROR_LOG(GPU, "Unknown texture format %d", (int)format);
+        return nullptr;
+    }
+
+    const u8* source = Memory::GetPointer(config.GetPhysicalAddress());
+    if (source == nullptr || width == 0 || height == 0) {
+        ERROR_LOG(GPU, "Invalid %ux%u texture at 0x%08X", width, height,
+                  config.GetPhysicalAddress());
+        return nullptr;
+    }
+
+    const u32 size = ((width + 7) & ~7) * ((height + 7) & ~7) * bits_per_texel / 8;
+    const u64 hash = GetHash64(source, size, 0);
+
+    const u64 key = GetKey(config, format);
+    auto it = g_cache.find(key);
+    if (it != g_cache.end()) {
+        CacheEntry& entry = it->second;
+        if (entry.width == width && entry.height == height && entry.hash == hash) {
+            entry.generation = g_generation;
+            return entry.texels.data();
+        }
+        g_cached_bytes -= entry.texels.size() * sizeof(u32);
+    } else if (g_cached_bytes + width * height * sizeof(u32) > kMaxCachedBytes) {
+        g_cache.clear();
+        g_cached_bytes = 0;
+    }
+
+    CacheEntry& entry = g_cache[key];
+    entry.width = width;
+    entry.height = height;
+    entry.hash = hash;
+    entry.generation = g_generation;
+    entry.texels.resize(width * height);
+    g_cached_bytes += entry.texels.size() * sizeof(u32);
+
+    DecodeTexture(source, width, height, format, entry.texels.data());
+    DebugUtils::DumpTexture(config, (u8*)source);
+
+    return entry.texels.data();
+}
+
+/// Makes cached textures be checked against their memory again before they are used next
+void OnMemoryChanged() {
+    ++g_generation;
+}
+
+/**
+ * Calls OnMemoryChanged if the framebuffer moved, since textures may have been rendered to
+ * @param id Index of the register which was written with a new value
+ */
+void OnRegisterChanged(u32 id) {
+    switch (id) {
+    case PICA_REG_INDEX(framebuffer.color_buffer_address):
+    case PICA_REG_INDEX(framebuffer.depth_buffer_address):
+        OnMemoryChanged();
+        break;
+    }
+}
+
+/// Frees all cached textures
+void Shutdown() {
+    g_cache.clear();
+    g_cached_bytes = 0;
+}
+
+} // namespace TextureCache
+
+} // namespace Pica
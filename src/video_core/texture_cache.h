@@ -0,0 +1,53 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "pica.h"
+
+namespace Pica {
+
+/**
+ * Caches textures decoded from their tiled PICA formats into linear images, so that the rasterizer
+ * fetches texels with a single load. Guest memory isn't write protected (the JIT and fastmem store
+ * to it directly), so entries are checked against a hash of their memory instead, once after each
+ * point where it may have changed: see OnMemoryChanged.
+ */
+namespace TextureCache {
+
+/**
+ * Looks up a decoded texture without touching its memory
+ * @param config Configuration of the texture
+ * @param format Format of the texture
+ * @return Texels of the texture row by row, as BGRA8, or nullptr if the texture isn't cached or
+ *         has to be checked against its memory first: see Load
+ */
+const u32* Lookup(const Regs::TextureConfig& config, Regs::TextureFormat format);
+
+/**
+ * Decodes a texture, unless it is cached and its memory didn't change since. Texels returned
+ * earlier by Lookup or Load may be freed or overwritten.
+ * @param config Configuration of the texture
+ * @param format Format of the texture
+ * @return Texels of the texture row by row, as BGRA8, or nullptr if it can't be decoded
+ */
+const u32* Load(const Regs::TextureConfig& config, Regs::TextureFormat format);
+
+/// Makes cached textures be checked against their memory again before they are used next
+void OnMemoryChanged();
+
+/**
+ * Calls OnMemoryChanged if the framebuffer moved, since textures may have been rendered to
+ * @param id Index of the register which was written with a new value
+ */
+void OnRegisterChanged(u32 id);
+
+/// Frees all cached textures
+void Shutdown();
+
+} // namespace TextureCache
+
+} // namespace Pica
@@ -9,8 +9,10 @@
 #include "core/core.h"
 
 #include "video_core/video_core.h"
+#include "video_core/rasterizer.h"
 #include "video_core/renderer_base.h"
-#include "video_core/renderer_opengl/renderer_opengl.h"
+#include "video_core/texture_cache.h"
+#include "video_core/renderer_null/renderer_null.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Video Core namespace
@@ -29,24 +31,28 @@ void Start() {
 }
 
 /// Initialize the video core
-void Init(EmuWindow* emu_window) {
-
-    // Required in order for GLFW to work on Linux, 
-    // or for GL contexts above 2.x on OS X
-    glewExperimental = GL_TRUE;
-
+void Init(EmuWindow* emu_window, RendererBase* renderer) {
     g_emu_window = emu_window;
-    g_renderer = new RendererOpenGL();
+    if (renderer != nullptr) {
+        g_renderer = renderer;
+    } else {
+        // Headless, nothing is drawn
+        g_renderer = new RendererNull();
+    }
     g_renderer->SetWindow(g_emu_window);
     g_renderer->Init();
 
     g_current_frame = 0;
 
+    Pica::Rasterizer::Init();
+
     NOTICE_LOG(VIDEO, "initialized OK");
 }
 
 /// Shutdown the video core
 void Shutdown() {
+    Pica::Rasterizer::Shutdown();
+    Pica::TextureCache::Shutdown();
     delete g_renderer;
     NOTICE_LOG(VIDEO, "shutdown OK");
 }
@@ -31,8 +31,13 @@ extern int             g_current_frame;         ///< Current frame
 /// Start the video core
 void Start();
 
-/// Initialize the video core
-void Init(EmuWindow* emu_window);
+/**
+ * Initialize the video core
+ * @param emu_window Window to render to, or nullptr to run headless
+ * @param renderer Renderer drawing to the window, owned by the video core from then on, or
+ * nullptr to use the null renderer
+ */
+void Init(EmuWindow* emu_window, RendererBase* renderer);
 
 /// Shutdown the video core
 void Shutdown();